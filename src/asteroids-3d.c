@@ -42,6 +42,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <float.h>
+#ifdef __SSE__
+  #include <xmmintrin.h>
+#endif
 
 #ifdef __GNUC__
   #pragma GCC diagnostic push
@@ -68,22 +72,21 @@
 #define SQRT_TOLERANCE 0.001f
 #define ARENA_SIZE     500.f /*from center to edge of arena*/
 #define MAX_SHOTS      8
-#define MAX_ASTEROIDS  64
+#define MAX_ASTEROIDS  128 /*whole asteroids, then fragments*/
+#define FIELD_ASTEROIDS 64
 #define INIT_ASTEROIDS 32
+#define CULL_NONE      0 /*asteroid occlusion culling modes*/
+#define CULL_QUERY     1
+#define CULL_CPU       2
 #define ASTER_LARGE    10
 #define ASTER_MED      5
 #define ASTER_SMALL    1
 #define true           '\x01'
 #define false          '\x00'
 
-/*for a square of 8 lines of 16 characters*/
-#define BITFONT_WIDTH      0.0625f
-#define BITFONT_HEIGHT     0.125f
-#define BITFONT_XOFFSET(x) ((float)(x%16)*BITFONT_WIDTH)
-#define BITFONT_YOFFSET(x) ((float)(7 - (x/16))*BITFONT_HEIGHT)
-
 const float radmod = M_PI/180.f;
 const float target_time = 50.f/3.f;
+double      sim_time    = 0.0; /*sum of frame time modifiers*/
 
 /*1-byte boolean*/
 typedef unsigned char bool;
@@ -99,6 +102,9 @@ typedef void (APIENTRY *glBufferDataARB_Func)(GLenum        target,
                                               GLsizeiptr    size,
                                               const GLvoid *data,
                                               GLenum        usage);
+typedef GLvoid* (APIENTRY *glMapBufferARB_Func)(GLenum      target,
+                                              GLenum        access);
+typedef GLboolean (APIENTRY *glUnmapBufferARB_Func)(GLenum  target);
 typedef void (APIENTRY *glGetQueryivARB_Func)(GLenum        target,
                                               GLenum        pname,
                                               GLint        *params);
@@ -113,16 +119,165 @@ typedef void (APIENTRY *glGetQueryObjectivARB_Func)(GLuint  id,
                                               GLenum        pname,
                                               GLint        *params);
 
+/*function pointers for EXT_framebuffer_object*/
+typedef void (APIENTRY *glGenFramebuffersEXT_Func)(GLsizei  n,
+                                              GLuint       *framebuffers);
+typedef void (APIENTRY *glDeleteFramebuffersEXT_Func)(GLsizei n,
+                                              const GLuint *framebuffers);
+typedef void (APIENTRY *glBindFramebufferEXT_Func)(GLenum   target,
+                                              GLuint        framebuffer);
+typedef void (APIENTRY *glFramebufferTexture2DEXT_Func)(GLenum target,
+                                              GLenum        attachment,
+                                              GLenum        textarget,
+                                              GLuint        texture,
+                                              GLint         level);
+typedef void (APIENTRY *glGenRenderbuffersEXT_Func)(GLsizei n,
+                                              GLuint       *renderbuffers);
+typedef void (APIENTRY *glDeleteRenderbuffersEXT_Func)(GLsizei n,
+                                              const GLuint *renderbuffers);
+typedef void (APIENTRY *glBindRenderbufferEXT_Func)(GLenum  target,
+                                              GLuint        renderbuffer);
+typedef void (APIENTRY *glRenderbufferStorageEXT_Func)(GLenum target,
+                                              GLenum        internalformat,
+                                              GLsizei       width,
+                                              GLsizei       height);
+typedef void (APIENTRY *glFramebufferRenderbufferEXT_Func)(GLenum target,
+                                              GLenum        attachment,
+                                              GLenum        renderbuffertarget,
+                                              GLuint        renderbuffer);
+typedef GLenum (APIENTRY *glCheckFramebufferStatusEXT_Func)(GLenum target);
+typedef void (APIENTRY *glGenerateMipmapEXT_Func)(GLenum   target);
+
+/*function pointers for ARB_vertex_array_object and
+ *ARB_draw_elements_base_vertex*/
+typedef void (APIENTRY *glGenVertexArrays_Func)(GLsizei     n,
+                                              GLuint       *arrays);
+typedef void (APIENTRY *glDeleteVertexArrays_Func)(GLsizei  n,
+                                              const GLuint *arrays);
+typedef void (APIENTRY *glBindVertexArray_Func)(GLuint      array);
+typedef void (APIENTRY *glDrawElementsBaseVertex_Func)(GLenum mode,
+                                              GLsizei       count,
+                                              GLenum        type,
+                                              const GLvoid *indices,
+                                              GLint         basevertex);
+
 glDeleteBuffersARB_Func    glDeleteBuffersARB_ptr    = 0;
 glGenBuffersARB_Func       glGenBuffersARB_ptr       = 0;
 glBindBufferARB_Func       glBindBufferARB_ptr       = 0;
 glBufferDataARB_Func       glBufferDataARB_ptr       = 0;
+glMapBufferARB_Func        glMapBufferARB_ptr        = 0;
+glUnmapBufferARB_Func      glUnmapBufferARB_ptr      = 0;
 glGetQueryivARB_Func       glGetQueryivARB_ptr       = 0;
 glGenQueriesARB_Func       glGenQueriesARB_ptr       = 0;
 glDeleteQueriesARB_Func    glDeleteQueriesARB_ptr    = 0;
 glBeginQueryARB_Func       glBeginQueryARB_ptr       = 0;
 glEndQueryARB_Func         glEndQueryARB_ptr         = 0;
 glGetQueryObjectivARB_Func glGetQueryObjectivARB_ptr = 0;
+glGenFramebuffersEXT_Func         glGenFramebuffersEXT_ptr         = 0;
+glDeleteFramebuffersEXT_Func      glDeleteFramebuffersEXT_ptr      = 0;
+glBindFramebufferEXT_Func         glBindFramebufferEXT_ptr         = 0;
+glFramebufferTexture2DEXT_Func    glFramebufferTexture2DEXT_ptr    = 0;
+glGenRenderbuffersEXT_Func        glGenRenderbuffersEXT_ptr        = 0;
+glDeleteRenderbuffersEXT_Func     glDeleteRenderbuffersEXT_ptr     = 0;
+glBindRenderbufferEXT_Func        glBindRenderbufferEXT_ptr        = 0;
+glRenderbufferStorageEXT_Func     glRenderbufferStorageEXT_ptr     = 0;
+glFramebufferRenderbufferEXT_Func glFramebufferRenderbufferEXT_ptr = 0;
+glCheckFramebufferStatusEXT_Func  glCheckFramebufferStatusEXT_ptr  = 0;
+glGenerateMipmapEXT_Func          glGenerateMipmapEXT_ptr          = 0;
+/*left as 0 when not supported*/
+glGenVertexArrays_Func        glGenVertexArrays_ptr        = 0;
+glDeleteVertexArrays_Func     glDeleteVertexArrays_ptr     = 0;
+glBindVertexArray_Func        glBindVertexArray_ptr        = 0;
+glDrawElementsBaseVertex_Func glDrawElementsBaseVertex_ptr = 0;
+
+/*function pointers for GLSL programs (OpenGL 2.0)*/
+typedef GLuint (APIENTRY *glCreateShader_Func)(GLenum       type);
+typedef void (APIENTRY *glShaderSource_Func)(GLuint         shader,
+                                              GLsizei       count,
+                                              const GLchar *const *string,
+                                              const GLint  *length);
+typedef void (APIENTRY *glCompileShader_Func)(GLuint        shader);
+typedef void (APIENTRY *glGetShaderiv_Func)(GLuint          shader,
+                                              GLenum        pname,
+                                              GLint        *params);
+typedef void (APIENTRY *glGetShaderInfoLog_Func)(GLuint     shader,
+                                              GLsizei       bufsize,
+                                              GLsizei      *length,
+                                              GLchar       *infolog);
+typedef void (APIENTRY *glDeleteShader_Func)(GLuint         shader);
+typedef GLuint (APIENTRY *glCreateProgram_Func)(void);
+typedef void (APIENTRY *glAttachShader_Func)(GLuint         program,
+                                              GLuint        shader);
+typedef void (APIENTRY *glBindAttribLocation_Func)(GLuint   program,
+                                              GLuint        index,
+                                              const GLchar *name);
+typedef void (APIENTRY *glLinkProgram_Func)(GLuint          program);
+typedef void (APIENTRY *glGetProgramiv_Func)(GLuint         program,
+                                              GLenum        pname,
+                                              GLint        *params);
+typedef void (APIENTRY *glGetProgramInfoLog_Func)(GLuint    program,
+                                              GLsizei       bufsize,
+                                              GLsizei      *length,
+                                              GLchar       *infolog);
+typedef void (APIENTRY *glDeleteProgram_Func)(GLuint        program);
+typedef void (APIENTRY *glUseProgram_Func)(GLuint           program);
+typedef GLint (APIENTRY *glGetUniformLocation_Func)(GLuint  program,
+                                              const GLchar *name);
+typedef void (APIENTRY *glUniform1i_Func)(GLint             location,
+                                              GLint         v0);
+typedef void (APIENTRY *glUniform4fv_Func)(GLint            location,
+                                              GLsizei       count,
+                                              const GLfloat *value);
+/*function pointers for ARB_texture_buffer_object*/
+typedef void (APIENTRY *glTexBufferARB_Func)(GLenum         target,
+                                              GLenum        internalformat,
+                                              GLuint        buffer);
+typedef void (APIENTRY *glActiveTexture_Func)(GLenum        texture);
+typedef void (APIENTRY *glVertexAttribPointer_Func)(GLuint  index,
+                                              GLint         size,
+                                              GLenum        type,
+                                              GLboolean     normalized,
+                                              GLsizei       stride,
+                                              const GLvoid *pointer);
+typedef void (APIENTRY *glEnableVertexAttribArray_Func)(GLuint index);
+typedef void (APIENTRY *glBufferSubDataARB_Func)(GLenum     target,
+                                              GLintptr      offset,
+                                              GLsizeiptr    size,
+                                              const GLvoid *data);
+/*function pointers for ARB_instanced_arrays and
+ *ARB_multi_draw_indirect*/
+typedef void (APIENTRY *glVertexAttribDivisorARB_Func)(GLuint index,
+                                              GLuint        divisor);
+typedef void (APIENTRY *glMultiDrawElementsIndirect_Func)(GLenum mode,
+                                              GLenum        type,
+                                              const GLvoid *indirect,
+                                              GLsizei       drawcount,
+                                              GLsizei       stride);
+
+glCreateShader_Func            glCreateShader_ptr            = 0;
+glShaderSource_Func            glShaderSource_ptr            = 0;
+glCompileShader_Func           glCompileShader_ptr           = 0;
+glGetShaderiv_Func             glGetShaderiv_ptr             = 0;
+glGetShaderInfoLog_Func        glGetShaderInfoLog_ptr        = 0;
+glDeleteShader_Func            glDeleteShader_ptr            = 0;
+glCreateProgram_Func           glCreateProgram_ptr           = 0;
+glAttachShader_Func            glAttachShader_ptr            = 0;
+glBindAttribLocation_Func      glBindAttribLocation_ptr      = 0;
+glLinkProgram_Func             glLinkProgram_ptr             = 0;
+glGetProgramiv_Func            glGetProgramiv_ptr            = 0;
+glGetProgramInfoLog_Func       glGetProgramInfoLog_ptr       = 0;
+glDeleteProgram_Func           glDeleteProgram_ptr           = 0;
+glUseProgram_Func              glUseProgram_ptr              = 0;
+glGetUniformLocation_Func      glGetUniformLocation_ptr      = 0;
+glUniform1i_Func               glUniform1i_ptr               = 0;
+glUniform4fv_Func              glUniform4fv_ptr              = 0;
+glTexBufferARB_Func            glTexBufferARB_ptr            = 0;
+glActiveTexture_Func           glActiveTexture_ptr           = 0;
+glVertexAttribPointer_Func     glVertexAttribPointer_ptr     = 0;
+glEnableVertexAttribArray_Func glEnableVertexAttribArray_ptr = 0;
+glBufferSubDataARB_Func        glBufferSubDataARB_ptr        = 0;
+glVertexAttribDivisorARB_Func    glVertexAttribDivisorARB_ptr    = 0;
+glMultiDrawElementsIndirect_Func glMultiDrawElementsIndirect_ptr = 0;
 
 /*** Model object ***
  *
@@ -140,10 +295,25 @@ typedef struct A3DModel {
     int       vertex_count;
     int       index_offset;
     int       vertex_offset;
+    int       base_vertex; /*vertex_offset in whole vertices*/
     int       mode;        /*drawing mode (GL_TRIANGLES, etc.)*/
     int       format;      /*storage format (GL_V3F, etc.)*/
 } A3DModel;
 
+/*** Vertex formats ***
+ *
+ * Interleaved formats used by models in the shared vertex
+ * buffer ('model_buffer', set by load_models()). When
+ * ARB_vertex_array_object is supported, there is
+ * one vertex array object per format in 'format_vao', in the
+ * same order as 'vertex_formats'.
+ **/
+#define VERTEX_FORMATS 3
+const GLenum vertex_formats[VERTEX_FORMATS] = {
+    GL_N3F_V3F, GL_V3F, GL_T2F_V3F};
+unsigned     format_vao[VERTEX_FORMATS]     = {0, 0, 0};
+unsigned     model_buffer[2]                = {0, 0}; /*vertex, index*/
+
 /*** Actor properties ***
  *
  * Struct containing physical properties of an object.
@@ -152,6 +322,10 @@ typedef struct A3DModel {
  * and orientation of the object. 'vel' and 'euler_rot' represent
  * incremental change in velocity and rotation. 'mass' is used
  * currently to indicate size.
+ *
+ * Asteroids move in closed form from 'spawn_pos' and
+ * 'spawn_orientation' at 'spawn_time' on the sim_time clock;
+ * their 'pos' and 'quat_orientation' are only the last result.
  **/
 typedef struct A3DActor {
     bool      is_spawned;
@@ -177,6 +351,18 @@ typedef struct A3DActor {
         float pitch;
         float roll;
     } euler_rot;
+    double    spawn_time;
+    struct {
+        float x;
+        float y;
+        float z;
+    } spawn_pos;
+    struct {
+        float x;
+        float y;
+        float z;
+        float w;
+    } spawn_orientation;
 } A3DActor;
 
 /*** Camera object ***
@@ -199,6 +385,7 @@ typedef struct A3DCamera {
     bool      ccw;
     bool      cw;
     bool      shoot;
+    bool      beam;          /*hit-scan fire*/
     bool      driftcam;      /*camera drift from mouse motion*/
     float     fovmod;
     float     rotmod;
@@ -248,6 +435,1277 @@ typedef struct A3DImage {
     int            offset;
 } A3DImage;
 
+/*** Texture atlas ***
+ *
+ * Single channel image holding every 2D asset: the bitmap
+ * font glyphs, reticule sprites and HUD icons, so that all
+ * 2D draws share one texture. 'rects' holds the texture
+ * coordinates of each asset, glyphs first, indexed by
+ * character code. Images are packed on shelves, left to
+ * right: 'shelf_x' and 'shelf_y' are the next free position
+ * and 'shelf_h' the height of the current shelf.
+ **/
+#define ATLAS_GLYPHS    128
+#define ATLAS_RETICULE  128 /*ring*/
+#define ATLAS_CROSSHAIR 129
+#define ATLAS_RECTS     144 /*room for HUD icons*/
+#define ATLAS_SPRITE    16  /*sprite size in pixels*/
+typedef struct A3DAtlasRect {
+    float          s0;
+    float          t0;
+    float          s1;
+    float          t1;
+} A3DAtlasRect;
+typedef struct A3DAtlas {
+    unsigned char *pixels;
+    int            width;
+    int            height;
+    int            shelf_x;
+    int            shelf_y;
+    int            shelf_h;
+    A3DAtlasRect   rects[ATLAS_RECTS];
+} A3DAtlas;
+A3DAtlas atlas;
+
+/*** Sprite batch ***
+ *
+ * Textured quads from the atlas collected in client memory
+ * and drawn with a single call from the 'buffer' vertex
+ * buffer. 'count' is the number of quads.
+ **/
+#define SPRITE_BATCH 1024
+typedef struct A3DSpriteVertex {
+    float          s, t;    /*GL_T2F_V3F*/
+    float          x, y, z;
+} A3DSpriteVertex;
+typedef struct A3DSpriteBatch {
+    A3DSpriteVertex quads[SPRITE_BATCH*4];
+    int             count;
+    unsigned        buffer;
+} A3DSpriteBatch;
+A3DSpriteBatch sprite_batch;
+
+/*** Projectile trails ***
+ *
+ * The last TRAIL_POINTS positions of each shot, in 'history'
+ * rings starting at 'head' with 'length' valid points.
+ * Ribbons for all shots are built in 'vertices' and appended
+ * to the 'buffer' ring of TRAIL_RING vertices at 'offset'; the
+ * buffer is only orphaned when the ring wraps.
+ **/
+#define TRAIL_POINTS 16
+#define TRAIL_WIDTH  0.6f
+#define TRAIL_FRAME  (MAX_SHOTS*(TRAIL_POINTS - 1)*4)
+#define TRAIL_RING   (TRAIL_FRAME*8)
+typedef struct A3DTrailVertex {
+    unsigned char  r, g, b, a;  /*GL_C4UB_V3F*/
+    float          x, y, z;
+} A3DTrailVertex;
+typedef struct A3DTrails {
+    float          history[MAX_SHOTS][TRAIL_POINTS][3];
+    int            head[MAX_SHOTS];
+    int            length[MAX_SHOTS];
+    A3DTrailVertex vertices[TRAIL_FRAME];
+    unsigned       buffer;
+    int            offset;
+} A3DTrails;
+
+/*** Streamed sectors ***
+ *
+ * Open world mode. Space is divided into cubes of SECTOR_SIZE
+ * and the 3x3x3 sectors around sector 'center' are live. All
+ * positions are relative to the middle of 'center', which moves
+ * with the player (floating origin), so they stay small however
+ * far the player flies. The arena does not wrap in this mode.
+ *
+ * Live slot s holds sector 'coords[s]' and owns asteroids
+ * [s*SECTOR_ASTEROIDS, (s + 1)*SECTOR_ASTEROIDS). A sector's slot
+ * only depends on its coordinates modulo 3, so moving one sector
+ * over replaces exactly the slots of the layer left behind.
+ * 'mass' keeps the generated sizes, 0 for empty places.
+ *
+ * The 27 live sectors share the FIELD_ASTEROIDS whole asteroid
+ * slots, which limits the density to 0 to SECTOR_ASTEROIDS
+ * asteroids per sector. These ranges are reserved: nothing else
+ * spawns below FIELD_ASTEROIDS in this mode, and pieces of hit
+ * asteroids come from the fragment slots above it, as an
+ * installed field overwrites its whole range.
+ *
+ * Fields are generated from 'seed' and the sector coordinates
+ * on the generator thread. The game thread fills job 'head' and
+ * posts 'filled'; the generator fills in job 'tail' and counts
+ * it in 'ready'; the game thread installs jobs from 'collect'
+ * and posts 'empty'. Results for slots that moved on meanwhile
+ * are dropped.
+ *
+ * Unloaded sectors only keep their coordinates and 2 bits per
+ * asteroid (SECTOR_KEPT, SECTOR_DESTROYED, SECTOR_MEDIUM or
+ * SECTOR_SMALL) in the 'deltas' table; when it is full, the
+ * least recently written entry is reused.
+ **/
+#define SECTOR_SIZE      500.f
+#define SECTOR_SLOTS     27 /*SECTOR_SLOTS*SECTOR_ASTEROIDS <= FIELD_ASTEROIDS*/
+#define SECTOR_ASTEROIDS 2
+#define SECTOR_JOBS      32
+#define SECTOR_DELTAS    256
+#define SECTOR_EMPTY     0 /*slot states*/
+#define SECTOR_QUEUED    1
+#define SECTOR_LOADED    2
+#define SECTOR_KEPT      0 /*asteroid deltas*/
+#define SECTOR_DESTROYED 1
+#define SECTOR_MEDIUM    2
+#define SECTOR_SMALL     3
+typedef struct A3DSectorJob {
+    int             slot;
+    int             coords[3];
+    A3DActor        aster[SECTOR_ASTEROIDS];
+} A3DSectorJob;
+typedef struct A3DSectorDelta {
+    int             coords[3];
+    unsigned        state;  /*2 bits per asteroid*/
+    unsigned        stamp;  /*0 if unused*/
+} A3DSectorDelta;
+typedef struct A3DSectors {
+    bool            enabled;
+    unsigned        seed;
+    int             center[3];
+    int             coords[SECTOR_SLOTS][3];
+    int             status[SECTOR_SLOTS];
+    float           mass[SECTOR_SLOTS][SECTOR_ASTEROIDS];
+    A3DSectorJob    jobs[SECTOR_JOBS];
+    int             head;
+    int             tail;
+    int             collect;
+    SDL_sem        *filled;
+    SDL_sem        *empty;
+    SDL_atomic_t    ready;
+    SDL_Thread     *thread;
+    bool            quit;
+    A3DSectorDelta  deltas[SECTOR_DELTAS];
+    unsigned        stamp;
+    int             loaded;     /*live slots with their field*/
+    unsigned        generated;  /*fields installed*/
+} A3DSectors;
+A3DSectors sectors;
+
+/*** Fragments ***
+ *
+ * Asteroids [FIELD_ASTEROIDS, MAX_ASTEROIDS) are a preallocated
+ * pool of fragments. 'free' is a stack of the 'free_count'
+ * unused pool slots, and 'piece' the mesh of each used one.
+ *
+ * A fracture into n pieces, FRACTURE_MIN to FRACTURE_MAX, uses
+ * the n meshes from piece (n - 2)*(n + 1)/2. They split the
+ * asteroid mesh into cones from its center to the patches of
+ * surface nearest n fixed directions. For each piece, 'offset'
+ * is its center in the asteroid model, 'scale' its bounding
+ * size relative to the asteroid, and 'share' its part of the
+ * volume. Piece meshes are centered and divided by 'scale', so
+ * a fragment's 'mass' bounds it as it does whole asteroids.
+ * Fragments do not break further.
+ *
+ * 'enabled' is false if the meshes could not be built; the pool
+ * then stays empty, and hit asteroids are only removed.
+ **/
+#define MAX_FRAGMENTS    (MAX_ASTEROIDS - FIELD_ASTEROIDS)
+#define FRACTURE_MIN     2
+#define FRACTURE_MAX     6
+#define FRACTURE_PIECES  20 /*pieces of all fractures, 2 + 3 + ... + 6*/
+#define FRACTURE_SPEED   0.3f
+typedef struct A3DFragments {
+    bool      enabled;
+    int       piece[MAX_FRAGMENTS];
+    int       free[MAX_FRAGMENTS];
+    int       free_count;
+    float     offset[FRACTURE_PIECES][3];
+    float     scale[FRACTURE_PIECES];
+    float     share[FRACTURE_PIECES];
+} A3DFragments;
+
+/*** Simulation tiers ***
+ *
+ * Asteroids far from the player are updated less often: those
+ * within SIM_NEAR every step, within SIM_MID every SIM_MID_RATE
+ * steps and the rest every SIM_FAR_RATE steps. The asteroid
+ * index offsets the step, so each step takes an even share of
+ * every tier.
+ *
+ * 'hot' is a loose grid of SIM_CELL cubes hashed into SIM_GRID
+ * flags, set around every shot and the player at the start of
+ * the step. Asteroids in a hot cell are updated whatever their
+ * tier, so nothing a shot approaches is skipped. 'counts' and
+ * 'updates' hold the tier sizes and updates of the last step.
+ *
+ * Tiers only spare the collision tests. The ray queries need
+ * every position, so refit_bvh() evaluates the closed form
+ * motion of all spawned asteroids each step.
+ **/
+#define SIM_TIERS     3
+#define SIM_NEAR      150.f
+#define SIM_MID       400.f
+#define SIM_MID_RATE  4
+#define SIM_FAR_RATE  16
+#define SIM_CELL      64.f /*> hit distance + SIM_FAR_RATE steps of drift*/
+#define SIM_GRID      256
+typedef struct A3DSimTiers {
+    unsigned        step;
+    float           player[3];
+    unsigned char   hot[SIM_GRID];
+    unsigned        counts[SIM_TIERS];
+    unsigned        updates;
+} A3DSimTiers;
+
+/*** Gravity ***
+ *
+ * Barnes-Hut octree for the mutual attraction of 'count' bodies
+ * of mass 'm' at 'x', 'y', 'z'. Accelerations go to 'ax', 'ay',
+ * 'az'.
+ *
+ * Bodies are sorted along a Morton curve of GRAVITY_BITS per
+ * axis, so every node holds a contiguous range of the sorted
+ * copies 'sx', 'sy', 'sz', 'sm', and 'order' maps them back.
+ * Nodes split until they hold GRAVITY_LEAF bodies or less. The
+ * levels above GRAVITY_SPLIT are built first, then the subtrees
+ * listed in 'tasks' are built in parallel, taking blocks of 8
+ * children from 'nodes' through 'used'. A subtree that finds the
+ * pool full stays a larger leaf, which is slower but still
+ * correct.
+ *
+ * A node of width 'size' at distance d from its center of mass
+ * is taken as a point mass when size < 'theta'*d. 'theta' 0
+ * visits every body.
+ **/
+#define GRAVITY_G         0.5f
+#define GRAVITY_SOFTENING 20.f
+#define GRAVITY_PLAYER    1.f /*mass of the player ship*/
+#define GRAVITY_THETA     0.5f
+#define GRAVITY_BITS      10
+#define GRAVITY_LEAF      8
+#define GRAVITY_SPLIT     2
+#define GRAVITY_TASKS     64 /*8^GRAVITY_SPLIT*/
+typedef struct A3DGravityNode {
+    float     com[3];
+    float     mass;
+    float     size;
+    int       child;  /*first of 8 children, 0 for a leaf*/
+    int       first;  /*range of sorted bodies*/
+    int       count;
+} A3DGravityNode;
+typedef struct A3DGravity {
+    bool             enabled;
+    float            theta;
+    int              capacity;
+    int              count;
+    float           *x, *y, *z, *m;
+    float           *ax, *ay, *az;
+    float           *sx, *sy, *sz, *sm;
+    unsigned        *code;
+    unsigned        *code_tmp;  /*radix sort scratch*/
+    int             *order;
+    int             *order_tmp;
+    float            lo[3];     /*root cell corner*/
+    float            size;      /*root cell width*/
+    A3DGravityNode  *nodes;
+    int              node_capacity;
+    SDL_atomic_t     used;
+    int              tasks[GRAVITY_TASKS];
+    int              task_count;
+} A3DGravity;
+
+/*** Asteroid bounding volume hierarchy ***
+ *
+ * Binary tree of boxes over every asteroid slot, for ray
+ * queries. Node 0 is the root and the children of a node
+ * follow it, 'child' being the first of two, or 0 for a leaf
+ * holding asteroid 'slot'. Spawned slots are split at the median
+ * of the longest axis, and unspawned ones are kept in a subtree
+ * of their own, their boxes empty until they spawn.
+ *
+ * The tree is refit to the asteroids every step, and only
+ * rebuilt once the summed box 'area' has grown BVH_REBUILD
+ * times past 'built_area', as motion loosens it.
+ **/
+#define BVH_NODES   (2*MAX_ASTEROIDS - 1)
+#define BVH_REBUILD 2.f
+typedef struct A3DBvhNode {
+    float     lo[3];
+    float     hi[3];
+    int       child;
+    int       slot;
+} A3DBvhNode;
+typedef struct A3DBvh {
+    A3DBvhNode nodes[BVH_NODES];
+    int        count;
+    float      area;
+    float      built_area;
+    unsigned   builds;
+} A3DBvh;
+
+/*** Ray query ***
+ *
+ * Ray from 'origin' along the unit vector 'dir', up to 'range'.
+ * 'hit' is set to the nearest asteroid hit, or -1, at 'dist'.
+ * A3DRayTask holds the shared data of a batch cast on the
+ * workers.
+ **/
+typedef struct A3DRay {
+    float     origin[3];
+    float     dir[3];
+    float     range;
+    int       hit;
+    float     dist;
+} A3DRay;
+typedef struct A3DRayTask {
+    const A3DBvh   *bvh;
+    const A3DActor *aster;
+    A3DRay         *rays;
+    SDL_atomic_t    hits;
+} A3DRayTask;
+
+/*** Aim assist ***
+ *
+ * 'target' is the asteroid under the crosshair, held for 'hold'
+ * time modifiers. Held for LOCK_TIME, it becomes 'locked' until
+ * it leaves LOCK_CONE around the view or AIM_RANGE, or is
+ * destroyed. Shots fired with a lock are turned to intercept it
+ * when the lead is within AIM_CONE of the view.
+ **/
+#define AIM_RANGE   800.f
+#define LOCK_TIME   30.f
+#define LOCK_CONE   0.94f  /*cosine, about 20 degrees*/
+#define AIM_CONE    0.985f /*cosine, about 10 degrees*/
+typedef struct A3DAim {
+    int       target;
+    int       locked;
+    float     hold;
+    float     dist;
+} A3DAim;
+
+/*** Hit-scan beam ***
+ *
+ * Asteroid spheres in SoA layout for batched ray tests, four at
+ * a time. 'x', 'y', 'z' and 'r2' (squared radius) are padded to
+ * a multiple of 4 with empty spheres, and 'slot' maps them back
+ * to the asteroid array.
+ *
+ * 'hit' is the asteroid the beam hit this step, or -1. The beam
+ * is shown from 'start' to 'end' for 'show' time modifiers.
+ **/
+#define BEAM_RANGE  800.f
+#define BEAM_RATE   100    /*ms between beam hits*/
+#define BEAM_SHOW   6.f
+typedef struct A3DBeam {
+    float    *x;
+    float    *y;
+    float    *z;
+    float    *r2;
+    int      *slot;
+    int       count;
+    int       capacity;
+    int       hit;
+    float     start[3];
+    float     end[3];
+    float     show;
+} A3DBeam;
+
+/*** Audio ***
+ *
+ * Sound effects are generated at startup as mono float samples
+ * and played through a pool of voices, mixed in the SDL audio
+ * callback. The game thread never touches the voices: it pushes
+ * commands to 'ring', a single producer, single consumer queue
+ * where only the game thread moves 'head' and only the callback
+ * moves 'tail'. Commands are dropped, not waited on, when the
+ * ring is full.
+ *
+ * A voice with 'sound' -1 is free. 'gain' holds the left and
+ * right gains of the voice. 'dropped' counts commands lost to a
+ * full ring and 'stolen' voices cut off for a new sound; both
+ * show in the debug HUD.
+ **/
+#define AUDIO_RATE    44100
+#define AUDIO_FRAMES  512   /*per callback*/
+#define AUDIO_VOICES  32
+#define AUDIO_RING    256   /*power of 2*/
+#define SOUND_SHOT    0
+#define SOUND_HIT     1
+#define SOUND_SPLIT   2
+#define SOUND_DEATH   3
+#define SOUNDS        4
+typedef struct A3DSound {
+    float    *data;
+    int       length;
+} A3DSound;
+typedef struct A3DVoice {
+    int       sound;
+    int       pos;
+    float     gain[2];
+} A3DVoice;
+typedef struct A3DSoundCommand {
+    int       sound;
+    float     gain;
+    float     pan;
+} A3DSoundCommand;
+typedef struct A3DAudio {
+    SDL_AudioDeviceID device;
+    A3DSound          sounds[SOUNDS];
+    A3DVoice          voices[AUDIO_VOICES];
+    A3DSoundCommand   ring[AUDIO_RING];
+    SDL_atomic_t      head;
+    SDL_atomic_t      tail;
+    unsigned          dropped;  /*commands, game thread*/
+    unsigned          stolen;   /*voices, callback*/
+} A3DAudio;
+
+/*** Gameplay events ***
+ *
+ * Typed events the simulation emits, for consumers to take in a
+ * batch after the step. 'slot' is the asteroid concerned, or -1,
+ * and 'mass' and 'pos' are copied from it as it was. 'shot' is
+ * the slot of the projectile of a hit, or -1 for the beam, and
+ * 'pieces' the fragments of a split. A hit that breaks its
+ * asteroid is marked 'split', its sound is left to the split
+ * event that follows.
+ *
+ * A3DEventRing is a fixed single producer, single consumer ring
+ * like the audio commands. Emitted events stay unseen until
+ * publish_events() moves 'head' past them, so a step is seen
+ * whole. 'pending' and the telemetry counts belong to the
+ * producer. A full ring hands out 'overflow' and counts it as
+ * 'dropped', so emitting never fails.
+ **/
+#define EVENT_SHOT_HIT         0
+#define EVENT_ASTEROID_SPLIT   1
+#define EVENT_PLAYER_DIED      2
+#define EVENT_ASTEROID_SPAWNED 3
+#define EVENT_TYPES            4
+#define EVENT_RING             1024 /*power of 2*/
+#define EVENT_BATCH            256
+typedef struct A3DEvent {
+    int       type;
+    int       slot;
+    int       shot;
+    int       pieces;
+    bool      split;
+    float     mass;
+    float     pos[3];
+} A3DEvent;
+typedef struct A3DEventRing {
+    A3DEvent      ring[EVENT_RING];
+    A3DEvent      overflow;
+    SDL_atomic_t  head;
+    SDL_atomic_t  tail;
+    int           pending;
+    unsigned      emitted[EVENT_TYPES];
+    unsigned      dropped;
+} A3DEventRing;
+
+/*** Timer wheel ***
+ *
+ * Hierarchical timing wheel of TIMER_LEVELS levels of TIMER_SLOTS
+ * slots, counting ticks of TIMER_TICK ms. Level 0 holds timers
+ * due within TIMER_SLOTS ticks, one slot per tick; each level up
+ * covers TIMER_SLOTS times the span, and its slots are cascaded
+ * down as the wheel below wraps. Inserting and cancelling are
+ * O(1), and a timer costs nothing until its slot comes up.
+ *
+ * Timers live in a pool, linked into slot lists by 'prev' and
+ * 'next' indices; free ones are chained by 'next' from
+ * 'free_list'. 'slot' is the list a timer is in, or -1 when free.
+ * A handle is the pool index plus 'generation' times the
+ * capacity, so stale handles cancel nothing. 'period' repeats a
+ * timer, 0 fires it once.
+ **/
+#define TIMER_TICK    16   /*ms*/
+#define TIMER_BITS    6
+#define TIMER_SLOTS   (1 << TIMER_BITS)
+#define TIMER_LEVELS  4
+typedef void (*A3DTimer_Func)(void *data, int arg);
+typedef struct A3DTimer {
+    A3DTimer_Func func;
+    void         *data;
+    int           arg;
+    unsigned      due;      /*tick*/
+    unsigned      period;   /*ticks*/
+    unsigned      generation;
+    int           prev;
+    int           next;
+    int           slot;
+} A3DTimer;
+typedef struct A3DTimerWheel {
+    A3DTimer *timers;
+    int       capacity;
+    int       free_list;
+    int       heads[TIMER_LEVELS*TIMER_SLOTS];
+    unsigned  origin;       /*ms at tick 0*/
+    unsigned  tick;
+    unsigned  active;
+    unsigned  fired;
+} A3DTimerWheel;
+
+/*** Entity component system ***
+ *
+ * Entities are grouped by archetype, the set of components they
+ * have, given as a 'mask' of component ids. An archetype stores
+ * each component in a contiguous column of 'count' rows, and the
+ * entity of each row in 'entities', so iterating one component
+ * walks one array. Removing a row moves the last row into it.
+ * The columns share one 'block', each starting a cache line past
+ * the end of the one before, so that rows of different columns
+ * don't fall on the same 4K page offset and stall each other.
+ * Growing moves the block, so pointers into a column only hold
+ * until the next entity of its archetype is made, unless the
+ * archetype is 'fixed': it then takes no entities and loses
+ * none, and its rows stay where they are.
+ *
+ * A query lists the archetypes holding all components of its
+ * mask. Queries are cached: a new archetype is added to every
+ * matching query as it is created, so running one never searches.
+ * Systems run a function over each archetype of their query, in
+ * the order they were added; entities they destroy are removed
+ * after all systems ran.
+ *
+ * The entity table maps a handle to its archetype and row. A
+ * handle is the table index plus 'generation' times the
+ * capacity, and free entries are chained through 'row'.
+ **/
+#define ECS_COMPONENTS 16
+#define ECS_ARCHETYPES 32
+#define ECS_QUERIES    16
+#define ECS_SYSTEMS    16
+typedef struct A3DArchetype {
+    unsigned  mask;
+    int       count;
+    int       capacity;
+    unsigned *entities;
+    void     *block;
+    void     *columns[ECS_COMPONENTS];
+    bool      fixed;
+} A3DArchetype;
+typedef struct A3DQuery {
+    unsigned  mask;
+    int       count;
+    int       archetypes[ECS_ARCHETYPES];
+} A3DQuery;
+typedef struct A3DEntity {
+    int       archetype;
+    int       row;
+    unsigned  generation;
+} A3DEntity;
+typedef struct A3DWorld A3DWorld;
+typedef void (*A3DSystem_Func)(A3DWorld *w, A3DArchetype *a, void *data,
+                               const float dt);
+typedef struct A3DSystem {
+    A3DSystem_Func func;
+    int            query;
+    void          *data;
+} A3DSystem;
+struct A3DWorld {
+    int           sizes[ECS_COMPONENTS];
+    int           component_count;
+    A3DArchetype  archetypes[ECS_ARCHETYPES];
+    int           archetype_count;
+    A3DQuery      queries[ECS_QUERIES];
+    int           query_count;
+    A3DSystem     systems[ECS_SYSTEMS];
+    int           system_count;
+    A3DEntity    *entities;
+    int           capacity;
+    int           free_list;
+    int           live;
+    unsigned     *doomed;
+    int           doomed_count;
+};
+
+/*** Scene entities ***
+ *
+ * Components of the objects placed in the scene. Popup score
+ * texts have COMP_POS, COMP_ORI and COMP_POPUP, whose 'age' runs
+ * from 0 to 1 before they go. Reticules have COMP_POS, COMP_ORI
+ * and COMP_SIGHT, 'offset' in front of the player.
+ *
+ * The player, the asteroids, the shots and the blast have
+ * COMP_ACTOR. Shots add COMP_SLOT, the index from 0 to MAX_SHOTS
+ * their trail and hit events keep while they live, and the tag
+ * COMP_SHOT, and the blast COMP_BLAST, its growth 'rate'.
+ *
+ * The player and the MAX_ASTEROIDS asteroids are made once, in
+ * fixed archetypes. Asteroids add COMP_SLOT, made in slot order,
+ * so their COMP_ACTOR column is the slot array the BVH, gravity,
+ * sectors and fragments index; spawning only sets 'is_spawned'.
+ **/
+#define COMP_POS       0   /*float[3]*/
+#define COMP_ORI       1   /*float[4]*/
+#define COMP_POPUP     2
+#define COMP_SIGHT     3
+#define COMP_ACTOR     4   /*A3DActor*/
+#define COMP_SLOT      5   /*int*/
+#define COMP_BLAST     6
+#define COMP_SHOT      7   /*tag, no data*/
+#define SCENE_ENTITIES 512
+typedef struct A3DPopup {
+    float     age;
+    char      text[8];
+} A3DPopup;
+typedef struct A3DSight {
+    float     offset;
+    int       sprite;
+} A3DSight;
+typedef struct A3DBlast {
+    float     rate;
+} A3DBlast;
+
+/*** Settings ***
+ *
+ * Quality and scale settings, given on the command line as
+ * '--key value', as 'key value' lines in a --config file, or as
+ * 'key value...' lines in a --sweep file, each line listing the
+ * values to try. 'vsync' is -1 to follow the mode, off when
+ * benchmarking and on otherwise.
+ *
+ * A sweep runs the program once per combination of values with
+ * --bench and the combination, and tabulates the results.
+ **/
+#define CONFIG_KEYS    7
+#define SWEEP_VALUES   16
+#define SWEEP_FRAMES   300
+typedef struct A3DConfig {
+    int       width;
+    int       height;
+    int       vsync;
+    int       asteroids;
+    int       segments;
+    float     skybox_radius;
+    int       cull_mode;
+} A3DConfig;
+typedef struct A3DSweep {
+    int       keys[CONFIG_KEYS];
+    int       key_count;
+    char      values[CONFIG_KEYS][SWEEP_VALUES][16];
+    int       value_count[CONFIG_KEYS];
+    unsigned  runs;
+} A3DSweep;
+
+const char *config_keys[CONFIG_KEYS] = {"width", "height", "vsync",
+                                        "asteroids", "segments", "skybox",
+                                        "cull"};
+const char *cull_names[3] = {"none", "query", "cpu"};
+
+/*** Overdraw measurement ***
+ *
+ * Debug level 3 counts the fragments written to each pixel in
+ * the stencil buffer. The counts are read back into one of two
+ * pixel pack buffers and mapped a frame later; 'average' and
+ * 'max' are the overdraw of the last frame read back, per
+ * window pixel.
+ *
+ * With occlusion queries, each pass is wrapped in a samples
+ * passed query. Passes may be split into several 'segments'
+ * per frame; query results are read a frame late, and summed
+ * per pass in 'pass_layers', in layers per pixel. Fragments
+ * outside of any pass, such as occlusion query boxes, only
+ * show in the total.
+ *
+ * 'heatmap' replaces the scene with the counts, layered with
+ * additive blending: 1 to 4 layers shade to blue, up to 8 to
+ * cyan and up to 12 to white.
+ **/
+#define OVERDRAW_MODELS    0 /*player, shots, asteroids*/
+#define OVERDRAW_SKYBOX    1
+#define OVERDRAW_BOUNDBOX  2
+#define OVERDRAW_IMPOSTORS 3
+#define OVERDRAW_TEXT      4
+#define OVERDRAW_TRAILS    5
+#define OVERDRAW_BLAST     6
+#define OVERDRAW_PASSES    7
+#define OVERDRAW_SEGMENTS  12
+#define OVERDRAW_LEVELS    12
+const char *overdraw_names[OVERDRAW_PASSES] = {
+    "models", "sky", "bbox", "imp", "text", "trail", "blast"};
+typedef struct A3DOverdraw {
+    bool      enabled;
+    bool      heatmap;
+    unsigned  frames;
+    unsigned  pbo[2];
+    int       size[2][2];   /*width, height of each read*/
+    bool      pending[2];
+    float     average;
+    int       max;
+    bool      use_queries;
+    unsigned  queries[2][OVERDRAW_SEGMENTS];
+    int       segment_pass[2][OVERDRAW_SEGMENTS];
+    int       segments[2];
+    int       pass;         /*pass of the open segment, or -1*/
+    float     pass_layers[OVERDRAW_PASSES];
+} A3DOverdraw;
+
+/*** Scaled render target ***
+ *
+ * Offscreen framebuffer that the 3D scene is rendered into.
+ *
+ * The color texture and depth renderbuffer are allocated at
+ * the native drawable size ('width' x 'height'). Only the
+ * lower-left 'view_width' x 'view_height' region is rendered
+ * to, which is 'scale' times the native size. 'frame_ms' is
+ * a smoothed measure of the frame cost used to pick 'scale'.
+ **/
+typedef struct A3DRenderTarget {
+    bool      enabled;
+    unsigned  fbo;
+    unsigned  color_tex;
+    unsigned  depth_rb;
+    int       width;
+    int       height;
+    int       view_width;
+    int       view_height;
+    float     scale;
+    float     frame_ms;
+} A3DRenderTarget;
+
+/*** Asteroid impostors ***
+ *
+ * Camera facing quads drawn in place of distant asteroids.
+ *
+ * 'texture' is an atlas of IMPOSTOR_VIEWS*IMPOSTOR_VIEWS views of
+ * the asteroid model, IMPOSTOR_CELL pixels each, rendered once
+ * at startup. Views are spread over the sphere with an
+ * octahedral mapping of the view direction in object space.
+ * 'basis' holds the object space right and up vectors each view
+ * was rendered with, so quads keep the asteroid's roll.
+ *
+ * Asteroids fade in as impostors between IMPOSTOR_NEAR and
+ * IMPOSTOR_FAR distance per unit of mass, drawn over the mesh,
+ * and replace the mesh beyond that. 'quads' holds 4 vertices
+ * per impostor, streamed to 'buffer' and drawn in one call.
+ * 'texture' is 0 if impostors are not supported.
+ **/
+#define IMPOSTOR_VIEWS   8
+#define IMPOSTOR_CELL    64
+#define IMPOSTOR_RADIUS  1.6f /*bounds of the asteroid model*/
+#define IMPOSTOR_NEAR    50.f
+#define IMPOSTOR_FAR     60.f
+typedef struct A3DImpostorVertex { /*GL_T2F_C4UB_V3F*/
+    float          s, t;
+    unsigned char  color[4];
+    float          x, y, z;
+} A3DImpostorVertex;
+
+typedef struct A3DImpostors {
+    unsigned           texture;
+    unsigned           buffer;
+    float              basis[IMPOSTOR_VIEWS*IMPOSTOR_VIEWS][6];
+    A3DImpostorVertex *quads;
+    int                count;
+} A3DImpostors;
+
+/*** Frame recorder ***
+ *
+ * Writes presented frames to a YUV4MPEG2 (.y4m) file.
+ *
+ * Each frame is read back into the next of RECORD_PBOS pixel
+ * pack buffers, and mapped RECORD_PBOS frames later, by when
+ * the transfer is done. 'pending' flags buffers holding a frame
+ * that was not mapped yet. Mapped frames are copied into one of
+ * RECORD_SLOTS system memory slots; the writer thread converts
+ * them to 4:2:0 YUV and writes them to 'file'.
+ *
+ * 'filled' and 'empty' count filled and free slots. The render
+ * thread fills slot 'head', the writer empties slot 'tail'. If
+ * no slot is free, the frame is counted in 'dropped' rather than
+ * waiting for the writer. 'width' and 'height' are fixed when
+ * recording starts.
+ **/
+#define RECORD_PBOS  3
+#define RECORD_SLOTS 4
+typedef struct A3DRecorder {
+    FILE           *file;
+    int             width;
+    int             height;
+    unsigned        pbo[RECORD_PBOS];
+    bool            pending[RECORD_PBOS];
+    unsigned        frames;
+    unsigned        written;
+    unsigned        dropped;
+    unsigned char  *slots[RECORD_SLOTS];
+    unsigned char  *yuv;
+    int             head;
+    int             tail;
+    SDL_sem        *filled;
+    SDL_sem        *empty;
+    SDL_Thread     *thread;
+    bool            quit;
+} A3DRecorder;
+
+/*** GL state cache ***
+ *
+ * Shadow copy of the GL state that changes while drawing.
+ *
+ * The state_*() functions compare against this copy and only
+ * call into GL when the value actually changes. 'issued' and
+ * 'skipped' count the calls that went through and the calls
+ * that were dropped since they were last reset. The initial
+ * values match the GL defaults, so every change to cached state
+ * has to go through state_*() for the copy to stay valid.
+ *
+ * 'enable' is indexed in the order of cached_caps[].
+ **/
+#define CACHED_CAPS 8
+const GLenum cached_caps[CACHED_CAPS] = {
+    GL_DEPTH_TEST, GL_CULL_FACE,    GL_LIGHTING, GL_LIGHT0,
+    GL_FOG,        GL_RESCALE_NORMAL, GL_BLEND,  GL_TEXTURE_2D};
+
+typedef struct A3DStateCache {
+    bool      enable[CACHED_CAPS];
+    unsigned  texture;
+    unsigned  array_buffer;
+    unsigned  element_buffer;
+    unsigned  unpack_buffer;
+    float     ambient[4];
+    float     diffuse[4];
+    float     specular[4];
+    float     emission[4];
+    float     color[4];
+    float     fog_range[2];
+    GLenum    blend_src;
+    GLenum    blend_dst;
+    bool      depth_mask;
+    bool      color_mask;
+    unsigned  vertex_array;
+    unsigned  program;
+    int       array_format;  /*last glInterleavedArrays() call, reset
+                               when the array buffer or VAO changes*/
+    int       array_offset;
+    unsigned  issued;
+    unsigned  skipped;
+} A3DStateCache;
+
+A3DStateCache gl_state = {
+    {false, false, false, false, false, false, false, false},
+    0, 0, 0, 0,
+    {0.2f, 0.2f, 0.2f, 1.f},
+    {0.8f, 0.8f, 0.8f, 1.f},
+    {0.f,  0.f,  0.f,  1.f},
+    {0.f,  0.f,  0.f,  1.f},
+    {1.f,  1.f,  1.f,  1.f},
+    {0.f,  1.f},
+    GL_ONE, GL_ZERO,
+    true, true,
+    0, 0, 0, -1,
+    0, 0};
+
+/*** Frame statistics ***
+ *
+ * Counters for the work submitted to GL in one frame.
+ *
+ * 'indices' counts indices for glDrawElements() draws and
+ * vertices for immediate mode draws. 'queries_hidden' is the
+ * number of occlusion query results that culled an asteroid.
+ * State changes are counted by the state cache (gl_state).
+ * All counters are reset at the start of each frame.
+ **/
+typedef struct A3DFrameStats {
+    unsigned  draw_calls;
+    unsigned  indices;
+    unsigned  matrix_pushes;
+    unsigned  texture_binds;
+    unsigned  queries;
+    unsigned  queries_hidden;
+    unsigned  occluders;
+    unsigned  culled;
+    unsigned  impostors;
+    unsigned  lights;
+    unsigned  sim_tiers[3];  /*asteroids per simulation tier*/
+    unsigned  sim_updates;
+    unsigned  rays;
+    unsigned  ray_hits;
+    unsigned  events;        /*gameplay events consumed*/
+} A3DFrameStats;
+
+A3DFrameStats frame_stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0, 0, 0}, 0,
+                             0, 0, 0};
+
+/*** Worker threads ***
+ *
+ * A small pool of threads for splitting work across cores.
+ *
+ * run_workers() hands out the range [0, total) in chunks of
+ * 'chunk' items. 'next' is the start of the next unclaimed
+ * chunk. Workers wait on 'start' and post 'done' when they run
+ * out of chunks. The calling thread also takes chunks, so a
+ * pool with no threads runs everything in the caller.
+ **/
+typedef void (*A3DTask_Func)(void *data, int begin, int end);
+
+typedef struct A3DWorkers {
+    int           count;
+    SDL_Thread  **threads;
+    SDL_sem      *start;
+    SDL_sem      *done;
+    A3DTask_Func  func;
+    void         *data;
+    int           total;
+    int           chunk;
+    SDL_atomic_t  next;
+    bool          quit;
+} A3DWorkers;
+
+/*** Model instance ***
+ *
+ * Per-instance attributes for the indirect drawing program.
+ *
+ * 'model' is the column-major modelview matrix of the instance,
+ * view included, so one pass can mix objects drawn relative to
+ * the camera and to the world. The material colors replace the
+ * glMaterial() calls of the fixed function path.
+ **/
+typedef struct A3DInstance {
+    float     model[16];
+    float     ambient[4];
+    float     diffuse[4];
+    float     specular[4];
+    float     emission[4];
+} A3DInstance;
+
+/*** Indirect draw command ***
+ *
+ * Layout of one command in GL_DRAW_INDIRECT_BUFFER, as read by
+ * glMultiDrawElementsIndirect().
+ **/
+typedef struct A3DDrawCommand {
+    GLuint    count;
+    GLuint    instance_count;
+    GLuint    first_index;
+    GLint     base_vertex;
+    GLuint    base_instance;
+} A3DDrawCommand;
+
+/*** Indirect draw pass ***
+ *
+ * Objects for drawing all opaque models in a single
+ * glMultiDrawElementsIndirect() call.
+ *
+ * 'program' is 0 if the pass is not supported. 'vao' reads
+ * vertices from the shared model buffer and instances from
+ * 'instance_buffer'. 'instances' has room for 'capacity'
+ * instances and 'commands' for INDIRECT_MODELS commands, one
+ * per model. 'enabled' can be toggled at runtime.
+ **/
+#define INDIRECT_MODELS 4
+typedef struct A3DIndirect {
+    bool            enabled;
+    unsigned        program;
+    unsigned        vao;
+    unsigned        instance_buffer;
+    unsigned        command_buffer;
+    int             capacity;
+    A3DInstance    *instances;
+    A3DDrawCommand  commands[INDIRECT_MODELS];
+} A3DIndirect;
+
+/*** Indirect pass shaders ***
+ *
+ * GLSL 1.20 version of the fixed function state used for opaque
+ * models: GL_LIGHT0 with the light model ambient, GL_FRONT
+ * shininess and linear fog, all read from built-in uniforms.
+ * FLAT is defined by the header, as 'flat' when flat varyings
+ * are available to match glShadeModel(GL_FLAT).
+ *
+ * Sources are split into lines to stay within C89 string
+ * limits, and are terminated by NULL.
+ **/
+const char *indirect_header      = "#version 120\n#define FLAT\n";
+const char *indirect_header_flat = "#version 120\n"
+                                   "#extension GL_EXT_gpu_shader4 : require\n"
+                                   "#define FLAT flat\n";
+const char *cluster_header       = "#version 120\n"
+                                   "#extension GL_EXT_gpu_shader4 : require\n"
+                                   "#define FLAT flat\n"
+                                   "#define CLUSTERED\n";
+const char *indirect_vs[] = {
+    "attribute vec4 i_model0, i_model1, i_model2, i_model3;\n",
+    "attribute vec4 i_ambient, i_diffuse, i_specular, i_emission;\n",
+    "FLAT varying vec4 v_color;\n",
+    "varying float v_fog;\n",
+    "void main()\n",
+    "{\n",
+    "    mat4  mv  = mat4(i_model0, i_model1, i_model2, i_model3);\n",
+    "    vec4  eye = mv * gl_Vertex;\n",
+    "    vec4  lp  = gl_LightSource[0].position;\n",
+    "    vec3  n   = normalize(mat3(mv) * gl_Normal);\n",
+    "    vec3  l   = normalize(lp.xyz - lp.w * eye.xyz);\n",
+    "    vec3  h   = normalize(l + vec3(0.0, 0.0, 1.0));\n",
+    "    float nl  = max(dot(n, l), 0.0);\n",
+    "    float nh  = 0.0;\n",
+    "    if(nl > 0.0)\n",
+    "        nh = pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess);\n",
+    "    v_color = i_emission +\n",
+    "        i_ambient  * (gl_LightModel.ambient +\n",
+    "                      gl_LightSource[0].ambient) +\n",
+    "        i_diffuse  * gl_LightSource[0].diffuse  * nl +\n",
+    "        i_specular * gl_LightSource[0].specular * nh;\n",
+    "#ifdef CLUSTERED\n",
+    "    v_color.rgb += i_diffuse.rgb * cluster_light(eye.xyz, n);\n",
+    "#endif\n",
+    "    v_color.a = i_diffuse.a;\n",
+    "    v_fog = clamp((gl_Fog.end - abs(eye.z)) * gl_Fog.scale, 0.0, 1.0);\n",
+    "    gl_Position = gl_ProjectionMatrix * eye;\n",
+    "}\n",
+    NULL};
+const char *indirect_fs[] = {
+    "FLAT varying vec4 v_color;\n",
+    "varying float v_fog;\n",
+    "void main()\n",
+    "{\n",
+    "    gl_FragColor = vec4(mix(gl_Fog.color.rgb, v_color.rgb, v_fog),\n",
+    "                        v_color.a);\n",
+    "}\n",
+    NULL};
+const char *indirect_attribs[8] = {
+    "i_model0",  "i_model1",  "i_model2",   "i_model3",
+    "i_ambient", "i_diffuse", "i_specular", "i_emission"};
+
+/*** Scene shading program ***
+ *
+ * GLSL 1.20 replacement for the fixed function lighting, fog
+ * and texturing of single draws, with the same light model as
+ * the indirect pass. Material colors are the 'u_material'
+ * uniforms (ambient, diffuse, specular, emission), and the
+ * GL_LIGHTING, GL_FOG and GL_TEXTURE_2D enables are mirrored by
+ * 'u_lit', 'u_fog' and 'u_tex'. Unlit draws use the current
+ * color, and textures modulate it like GL_MODULATE.
+ *
+ * The state cache writes these instead of the fixed function
+ * state while the program is in use, and brings the other side
+ * up to date when switching programs. 'program' is 0 if GLSL is
+ * not supported. 'enabled' can be toggled at runtime.
+ **/
+typedef struct A3DShading {
+    bool      enabled;
+    unsigned  program;
+    int       u_material[4];
+    int       u_lit;
+    int       u_fog;
+    int       u_tex;
+} A3DShading;
+A3DShading shading = {false, 0, {-1, -1, -1, -1}, -1, -1, -1};
+
+const char *shading_vs[] = {
+    "uniform vec4 u_ambient, u_diffuse, u_specular, u_emission;\n",
+    "uniform bool u_lit;\n",
+    "FLAT varying vec4 v_color;\n",
+    "varying vec2  v_uv;\n",
+    "varying float v_fog;\n",
+    "void main()\n",
+    "{\n",
+    "    vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n",
+    "    if(u_lit)\n",
+    "    {\n",
+    "        vec4  lp = gl_LightSource[0].position;\n",
+    "        vec3  n  = normalize(gl_NormalMatrix * gl_Normal);\n",
+    "        vec3  l  = normalize(lp.xyz - lp.w * eye.xyz);\n",
+    "        vec3  h  = normalize(l + vec3(0.0, 0.0, 1.0));\n",
+    "        float nl = max(dot(n, l), 0.0);\n",
+    "        float nh = 0.0;\n",
+    "        if(nl > 0.0)\n",
+    "            nh = pow(max(dot(n, h), 0.0),\n",
+    "                     gl_FrontMaterial.shininess);\n",
+    "        v_color = u_emission +\n",
+    "            u_ambient  * (gl_LightModel.ambient +\n",
+    "                          gl_LightSource[0].ambient) +\n",
+    "            u_diffuse  * gl_LightSource[0].diffuse  * nl +\n",
+    "            u_specular * gl_LightSource[0].specular * nh;\n",
+    "#ifdef CLUSTERED\n",
+    "        v_color.rgb += u_diffuse.rgb * cluster_light(eye.xyz, n);\n",
+    "#endif\n",
+    "        v_color.a = u_diffuse.a;\n",
+    "    }\n",
+    "    else\n",
+    "        v_color = gl_Color;\n",
+    "    v_uv  = gl_MultiTexCoord0.xy;\n",
+    "    v_fog = clamp((gl_Fog.end - abs(eye.z)) * gl_Fog.scale, 0.0, 1.0);\n",
+    "    gl_Position = gl_ProjectionMatrix * eye;\n",
+    "}\n",
+    NULL};
+const char *shading_fs[] = {
+    "uniform bool u_fog, u_tex;\n",
+    "uniform sampler2D u_sampler;\n",
+    "FLAT varying vec4 v_color;\n",
+    "varying vec2  v_uv;\n",
+    "varying float v_fog;\n",
+    "void main()\n",
+    "{\n",
+    "    vec4 c = v_color;\n",
+    "    if(u_tex)\n",
+    "        c *= texture2D(u_sampler, v_uv);\n",
+    "    if(u_fog)\n",
+    "        c.rgb = mix(gl_Fog.color.rgb, c.rgb, v_fog);\n",
+    "    gl_FragColor = c;\n",
+    "}\n",
+    NULL};
+
+/*** Clustered point lights ***
+ *
+ * Shots and the blast light the scene as point lights, which
+ * are sorted into a grid of view space clusters: CLUSTER_X by
+ * CLUSTER_Y screen tiles and CLUSTER_Z depth slices, spaced
+ * exponentially between the near and far planes. Each vertex
+ * only walks the lights of its own cluster, so lighting cost
+ * depends on local light density rather than the light count.
+ *
+ * Everything is uploaded each frame into 'buffer', read through
+ * the RGBA32F buffer texture 'texture' on texture unit 1:
+ *
+ *     texel 0            - tile scale x, y, slice scale, bias
+ *     1 + cluster        - first reference texel, light count
+ *     CLUSTER_LIGHTS + 2i - view position and radius of light i
+ *     CLUSTER_LIGHTS + 2i + 1 - color of light i
+ *     CLUSTER_REFS + r   - texel of a light, per cluster
+ *
+ * 'lights' holds 'count' lights in view space. Lights that
+ * would overflow MAX_LIGHT_REFS references are left out of the
+ * remaining clusters. 'program' is the scene shading program
+ * (and 'enabled' is false) when the buffer texture or flat
+ * varyings are not supported.
+ **/
+#define CLUSTER_X      16 /*must match cluster_vs[]*/
+#define CLUSTER_Y      8
+#define CLUSTER_Z      24
+#define CLUSTERS       (CLUSTER_X*CLUSTER_Y*CLUSTER_Z)
+#define MAX_LIGHTS     512
+#define MAX_LIGHT_REFS 8192
+#define CLUSTER_LIGHTS (1 + CLUSTERS)
+#define CLUSTER_REFS   (CLUSTER_LIGHTS + 2*MAX_LIGHTS)
+#define CLUSTER_TEXELS (CLUSTER_REFS + MAX_LIGHT_REFS)
+typedef struct A3DLight {
+    float     pos[4];   /*view space, radius in w*/
+    float     color[4];
+} A3DLight;
+typedef struct A3DLights {
+    bool      enabled;
+    unsigned  buffer;
+    unsigned  texture;
+    int       count;
+    int       refs;
+    A3DLight  lights[MAX_LIGHTS];
+    int       first[CLUSTERS];
+    int       bounds[MAX_LIGHTS][6]; /*cluster range, x0 < 0 if culled*/
+    float    *texels;  /*CLUSTER_TEXELS RGBA texels*/
+} A3DLights;
+
+/*** Cluster lighting shader ***
+ *
+ * Placed before the vertex shaders of both programs, and only
+ * compiled with CLUSTERED defined. cluster_light() returns the
+ * diffuse light at eye space position 'eye' with normal 'n'.
+ **/
+const char *cluster_vs[] = {
+    "#ifdef CLUSTERED\n",
+    "uniform samplerBuffer u_lights;\n",
+    "vec3 cluster_light(vec3 eye, vec3 n)\n",
+    "{\n",
+    "    vec4  p  = texelFetchBuffer(u_lights, 0);\n",
+    "    float d  = max(-eye.z, 0.001);\n",
+    "    int   tx = int(clamp((eye.x*p.x/d*0.5 + 0.5)*16.0, 0.0, 15.0));\n",
+    "    int   ty = int(clamp((eye.y*p.y/d*0.5 + 0.5)*8.0,  0.0, 7.0));\n",
+    "    int   tz = int(clamp(log(d)*p.z + p.w, 0.0, 23.0));\n",
+    "    vec4  c  = texelFetchBuffer(u_lights, 1 + (tz*8 + ty)*16 + tx);\n",
+    "    vec3  sum = vec3(0.0);\n",
+    "    for(int i = 0; i < int(c.y); i++)\n",
+    "    {\n",
+    "        int   li = int(texelFetchBuffer(u_lights, int(c.x) + i).x);\n",
+    "        vec4  lp = texelFetchBuffer(u_lights, li);\n",
+    "        vec3  l  = lp.xyz - eye;\n",
+    "        float r  = max(length(l), 0.001);\n",
+    "        float a  = max(1.0 - r/lp.w, 0.0);\n",
+    "        sum += texelFetchBuffer(u_lights, li + 1).rgb *\n",
+    "               (a*a*max(dot(n, l), 0.0)/r);\n",
+    "    }\n",
+    "    return sum;\n",
+    "}\n",
+    "#endif\n",
+    NULL};
+
+/*** Asteroid instance task ***
+ *
+ * Shared data for fill_asteroid_instances().
+ *
+ * 'visible' flags which asteroids passed the occlusion test.
+ * Visible asteroids are posed at sim_time and appended to
+ * 'out', with 'count' as the shared append position. 'view' is the
+ * camera's modelview matrix.
+ **/
+typedef struct A3DAsteroidTask {
+    A3DActor     *aster;
+    const bool   *visible;
+    const float  *view;
+    A3DInstance  *out;
+    SDL_atomic_t  count;
+} A3DAsteroidTask;
+
+/*** Occluder mesh ***
+ *
+ * Positions and indices of a model kept in system memory for
+ * the software occlusion rasterizer. 'vertex_count' is the
+ * number of xyz positions in 'vertices'.
+ **/
+typedef struct A3DOccluderMesh {
+    int       vertex_count;
+    int       index_count;
+    float    *vertices;
+    unsigned *indices;
+} A3DOccluderMesh;
+
+/*** Occluder triangle ***
+ *
+ * A screen-space triangle set up for rasterization.
+ *
+ * 'edge' holds a, b and c of the edge functions a*x + b*y + c,
+ * which are positive inside the triangle. Coverage is sampled
+ * at pixel centers. 'depth' is the distance of the farthest
+ * vertex, so the occluder is never in front of the real
+ * surface. The pixel bounds are [x0, x1) and [y0, y1).
+ **/
+typedef struct A3DOccTriangle {
+    float     edge[3][3];
+    float     depth;
+    int       x0, y0, x1, y1;
+} A3DOccTriangle;
+
+/*** Software occlusion ***
+ *
+ * A low resolution depth buffer filled by the CPU with a few
+ * large occluders, against which asteroid bounds are tested
+ * before they are drawn.
+ *
+ * 'depth' holds OCC_WIDTH*OCC_HEIGHT view distances, bottom row
+ * first, FLT_MAX where nothing was drawn. Rasterization is split
+ * into bands of OCC_BAND rows, so workers never share pixels.
+ * 'screen' is scratch space for projected occluder vertices.
+ * 'scale_x' and 'scale_y' map view space to normalized device
+ * coordinates at unit distance, 'near' is the near clip plane.
+ *
+ * The remaining members are set per frame for the test task.
+ * Asteroids are tested where they are drawn, at sim_time.
+ **/
+#define OCC_WIDTH         128
+#define OCC_HEIGHT        64
+#define OCC_BAND          8
+#define MAX_OCCLUDERS     8
+#define OCC_ASTER_RADIUS  1.6f /*bounds of the asteroid model*/
+typedef struct A3DOcclusion {
+    float          *depth;
+    float          *screen;
+    A3DOccTriangle *tris;
+    int             tri_count;
+    int             tri_capacity;
+    float           scale_x;
+    float           scale_y;
+    float           near;
+    const float    *view;
+    A3DActor       *aster;
+    bool           *visible;
+} A3DOcclusion;
+
 /*** Reset game objects ***
  *
  * Resets the player and asteroids.
@@ -294,6 +1752,34 @@ void transform_static_actor(A3DActor *obj, float dt);
 void rotate_static_actor   (A3DActor *obj, float *m, float dt);
 void translate_static_actor(A3DActor *obj, float *m, float dt);
 
+/*** Closed form motion ***
+ *
+ * For actors in constant motion that are rarely looked at.
+ * Rather than stepping every frame, the pose is evaluated from
+ * the spawn pose and the time since, so actors nobody looks at
+ * cost nothing.
+ *
+ * spawn_static_actor() makes the current 'pos' and orientation
+ * the start of the motion at the current sim_time. Call it after
+ * placing the actor, or after changing 'vel' or 'euler_rot' once
+ * the current pose was evaluated.
+ *
+ * locate_static_actor() only updates 'pos', for collision and
+ * visibility tests. pose_static_actor() also updates the
+ * orientation, and writes the transform to 'm' unless it is
+ * NULL. place_static_actor() multiplies the current matrix by
+ * the pose, as transform_static_actor() does.
+ *
+ * Positions wrap around the arena unless the world is open.
+ * Spin is the rotation stepping would make with dt = 1, taken
+ * as a constant angular velocity, so the orientation stays a
+ * unit quaternion however long the actor lives.
+ **/
+void spawn_static_actor (A3DActor *obj);
+void locate_static_actor(A3DActor *obj);
+void pose_static_actor  (A3DActor *obj, float *m);
+void place_static_actor (A3DActor *obj);
+
 /*** Set text orientation ***
  *
  * Apply rotation and translation to text object.
@@ -396,9 +1882,24 @@ bool load_model_from_file(const char *file_prefix, A3DModel *model);
  * call and reinitializes them with new models in model.
  * Memory allocation/deallocation is handled internally, so
  * no memory management of vertex/index data is necessary.
+ *
+ * Vertex offsets are padded to a multiple of each model's
+ * vertex stride, so a model can also be drawn by its
+ * 'base_vertex' from a pointer set at the start of the buffer.
+ * If ARB_vertex_array_object is supported, one vertex array
+ * object is set up for each entry in vertex_formats.
  **/
 bool load_models(A3DModel **model, const int count);
 
+/*** Get vertex stride ***
+ *
+ * Returns the number of floats per vertex for an interleaved
+ * format, or 0 if the format is not in vertex_formats.
+ *
+ *     format - Interleaved format (GL_N3F_V3F, etc.)
+ **/
+int vertex_stride(const int format);
+
 /*** Generate bounding box ***
  *
  * Generates a line grid box based on the number of segments.
@@ -429,9 +1930,13 @@ void generate_skybox(A3DModel *box, const float radius);
  *
  *     model - Model to draw
  *
- * Changes the vertex buffer offset to the specified model
- * and draws the model using glDrawElements() with the
- * associated index offset.
+ * With ARB_draw_elements_base_vertex, the vertex array object
+ * (or array pointers) for the model's format are bound only when
+ * the format changes, and the model is drawn with
+ * glDrawElementsBaseVertex() from its base vertex. Otherwise
+ * the vertex buffer offset is changed to the specified model
+ * and the model is drawn using glDrawElements(). In both cases
+ * the associated index offset is used.
  *
  * This assumes the drawing mode is GL_TRIANGLES and the
  * index packing is GL_UNSIGNED_INT.
@@ -468,89 +1973,1131 @@ void draw_skybox(const A3DModel box, const float x,
  **/
 void draw_text(const char *text, const float width, const bool charwidth);
 
-int main(void)
-{
-    /*vars*/
-    bool          loop_exit      = false,
-                  skip_dt        = false,
-                  fullscreen     = false,
-                  red_tc         = true,
-                  gen_mips       = true,
-                  occ_query      = true,
-                  occ_query2     = true,
-                  started_query  = false;
-    char          win_title[256] = {'\0'},
-                  t_fps[16]      = {'\0'},
-                  t_mspf[16]     = {'\0'},
-                  t_relvel[32]   = {'\0'},
-                  t_score[32]    = {'\0'},
-                  t_topscore[32] = {'\0'},
-                 *basepath;
-    float         aspect_ratio   = 1.f,
-                  fov            = 80.f,
-                  top_clip       = 0.f,
-                  bottom_clip    = 0.f,
-                  left_clip      = 0.f,
-                  right_clip     = 0.f,
-                  near_clip      = 1.f,
-                  far_clip       = 800.f,
-                  shot_speed     = 5.f,
-                  frametime      = -1.f,
-                  mintime        = 0.f,
-                  timemod        = 1.f,
-                  blastmod       = 32.f;
-    float         tmp_diffuse_color[] = {0.f, 0.8f, 0.f, 1.f};
-    float         unit_box_vert[] = {
-                   1.f,  1.f,  1.f,
-                   1.f,  1.f, -1.f,
-                  -1.f,  1.f, -1.f,
-                  -1.f,  1.f,  1.f,
-                   1.f, -1.f,  1.f,
-                   1.f, -1.f, -1.f,
-                  -1.f, -1.f, -1.f,
-                  -1.f, -1.f,  1.f};
-    unsigned      unit_box_in[] = {
-                  0, 1, 2, 3,
-                  0, 3, 7, 4,
-                  1, 0, 4, 5,
-                  2, 1, 5, 6,
-                  3, 2, 6, 7,
-                  7, 6, 5, 4};
-    int           i,j,k,
-                  width_real,
-                  height_real,
-                  debug_level      = 1;
-    unsigned      shot_loop_count  = 0,
-                  spawn_loop_count = 0,
-                  title_loop_count = 0,
-                  currtime         = 0,
-                  prevtime         = 0,
-                  difftime         = 0,
-                  score            = 0,
-                  topscore         = 0,
-                  texbuf[2],
-                  aster_queries[MAX_ASTEROIDS];
-    SDL_Event     ev_main;
-    SDL_Window   *win_main;
+/*** Texture atlas ***
+ *
+ * init_atlas() allocates a blank 'width' by 'height' atlas.
+ *
+ * atlas_add() packs an image into the atlas and splits it
+ * into a grid of 'cols' by 'rows' cells. Cells are numbered
+ * from 'first', left to right, starting at the last row of
+ * 'pixels'. Returns false if the atlas is full.
+ *
+ * atlas_sprites() draws the reticule sprites into the atlas.
+ **/
+bool init_atlas   (A3DAtlas *a, const int width, const int height);
+bool atlas_add    (A3DAtlas *a, const unsigned char *pixels,
+                   const int width, const int height,
+                   const int cols, const int rows, const int first);
+bool atlas_sprites(A3DAtlas *a);
+
+/*** Sprite batching ***
+ *
+ * batch_text() adds a string with its first character
+ * centered at 'x', 'y', with 'width' as in draw_text().
+ *
+ * batch_sprite() adds atlas rect 'id' as a 'size' wide square
+ * centered at 'x', 'y'.
+ *
+ * flush_batch() draws the batch with the current matrix and
+ * color, and empties it. A full batch is flushed early, so
+ * all quads of a batch should share the same matrix.
+ **/
+void batch_text  (A3DSpriteBatch *b, const char *text, const float x,
+                  const float y, const float width, const bool charwidth);
+void batch_sprite(A3DSpriteBatch *b, const int id, const float x,
+                  const float y, const float size);
+void batch_quad  (A3DSpriteBatch *b, const A3DAtlasRect r,
+                  const float x, const float y, const float w,
+                  const float h);
+void flush_batch (A3DSpriteBatch *b);
+
+/*** Projectile trails ***
+ *
+ * init_trails() creates the ring buffer and clears the history.
+ *
+ * update_trails() records the position of each of the 'count'
+ * 'shots' in the trail of its entry in 'slots', and forgets the
+ * trails of the slots no shot holds.
+ *
+ * draw_trails() draws camera facing ribbons seen from world
+ * position 'eye' with one call, and returns the vertex count.
+ **/
+void init_trails  (A3DTrails *t);
+void update_trails(A3DTrails *t, const A3DActor *shots, const int *slots,
+                   const int count);
+int  draw_trails  (A3DTrails *t, const float *eye);
+
+/*** Streamed sectors ***
+ *
+ * init_sectors() starts the generator thread and queues the
+ * sectors around the origin. Returns true if successful, false
+ * if otherwise.
+ *
+ * recenter_sectors() moves 'center' to the sector of 'player'
+ * once it is well past the border, and sets 'shift' to the
+ * offset to subtract from all positions. Returns false if the
+ * center did not move.
+ *
+ * stream_sectors() unloads sectors that left the live window
+ * into the delta table, queues the sectors that entered it, and
+ * installs generated fields into 'aster'.
+ *
+ * reset_sectors() forgets all deltas and reloads the sectors
+ * around the origin, for a new game.
+ *
+ * shift_actors() subtracts 'shift' from the positions of
+ * 'count' actors.
+ **/
+bool init_sectors    (A3DSectors *s, const unsigned seed);
+bool recenter_sectors(A3DSectors *s, const A3DActor *player, float *shift);
+void stream_sectors  (A3DSectors *s, A3DActor *aster);
+void reset_sectors   (A3DSectors *s, A3DActor *aster);
+void free_sectors    (A3DSectors *s);
+void shift_actors    (A3DActor *a, const int count, const float *shift);
+
+/*** Fragments ***
+ *
+ * Breaks asteroids into pieces from the fragment pool.
+ *
+ *     f      - Fragment pool.
+ *     pieces - FRACTURE_PIECES models to fill, GL_N3F_V3F.
+ *     mesh   - Asteroid mesh to cut.
+ *     aster  - Asteroid array, MAX_ASTEROIDS long.
+ *     index  - Asteroid to break or remove.
+ *     count  - Number of pieces, FRACTURE_MIN to FRACTURE_MAX.
+ *
+ * generate_fragments() builds the piece meshes and tables at
+ * load time. Returns true if successful, false if otherwise.
+ *
+ * fracture_asteroid() replaces asteroid 'index', posed at the
+ * current time, with up to 'count' fragments flying apart from
+ * its center. Velocities are weighted by volume so momentum is
+ * conserved, over the pieces made when the pool is short of
+ * 'count'. Returns the number of fragments, 0 if the pool is
+ * too low and the asteroid is only removed.
+ *
+ * remove_asteroid() despawns asteroid 'index', and returns it
+ * to the pool if it is a fragment. reset_fragments() frees the
+ * whole pool.
+ *
+ * build_fragment() writes piece 'piece' of the triangles for
+ * which 'owner' matches, capped by cones to 'apex'.
+ **/
+bool generate_fragments(A3DFragments *f, A3DModel *pieces,
+                        const A3DOccluderMesh *mesh);
+int  fracture_asteroid (A3DFragments *f, A3DActor *aster, const int index,
+                        const int count);
+void remove_asteroid   (A3DFragments *f, A3DActor *aster, const int index);
+void reset_fragments   (A3DFragments *f, A3DActor *aster);
+bool build_fragment    (A3DFragments *f, A3DModel *model, const int piece,
+                        const A3DOccluderMesh *mesh, const int *owner,
+                        const float *apex, const float radius);
+
+/*** Simulation tiers ***
+ *
+ * begin_sim_step() starts a step: it marks the loose grid cells
+ * around the 'count' 'shots' and the 'player', and clears the
+ * counts.
+ *
+ * sim_due() returns true if asteroid 'index' should be updated
+ * this step, from its tier and the grid, and counts it. An
+ * asteroid that may have wrapped across the arena since it was
+ * last located is located first, as its old position could be
+ * on the far side.
+ *
+ * sim_cell() hashes the grid cell holding 'x', 'y', 'z', offset
+ * by 'dx', 'dy', 'dz' cells.
+ **/
+void begin_sim_step(A3DSimTiers *s, const A3DActor *shots, const int count,
+                    const A3DActor *player);
+bool sim_due       (A3DSimTiers *s, const int index, A3DActor *a);
+int  sim_cell      (const float x, const float y, const float z,
+                    const int dx, const int dy, const int dz);
+
+/*** Gravity ***
+ *
+ * Barnes-Hut approximation of the attraction between bodies.
+ *
+ *     g        - Gravity object.
+ *     capacity - Maximum number of bodies.
+ *     w        - Worker pool to build and solve with.
+ *     aster    - Asteroid array, attracted by their mass.
+ *     count    - Number of asteroids.
+ *     player   - Player, attracted as GRAVITY_PLAYER.
+ *     dt       - Time modifier of the step.
+ *
+ * init_gravity() returns true if successful, false if otherwise.
+ *
+ * build_gravity() sorts the 'count' bodies in 'g' and rebuilds
+ * the tree. solve_gravity() then writes the acceleration of
+ * every body. gravity_reference() sums the acceleration of body
+ * 'i' directly from every other body into 'a', for accuracy
+ * tests against the tree.
+ *
+ * step_gravity() loads the spawned asteroids and the player,
+ * solves, and changes their velocities. Asteroids are posed
+ * and respawned around the change, as when they are hit.
+ *
+ * run_gravity_bench() times the tree against direct sums over
+ * random fields of 1k, 10k and 100k bodies, and prints the
+ * results with the error as JSON to stdout. Direct sums are
+ * timed over a sample of bodies at larger counts.
+ **/
+bool init_gravity     (A3DGravity *g, const int capacity);
+void build_gravity    (A3DGravity *g, A3DWorkers *w);
+void solve_gravity    (A3DGravity *g, A3DWorkers *w);
+void gravity_reference(const A3DGravity *g, const int i, float *a);
+void step_gravity     (A3DGravity *g, A3DWorkers *w, A3DActor *aster,
+                       const int count, A3DActor *player, const float dt);
+void free_gravity     (A3DGravity *g);
+int  run_gravity_bench(const float theta);
+void gravity_codes    (void *data, int begin, int end); /*worker tasks*/
+void gravity_gather   (void *data, int begin, int end);
+void gravity_subtrees (void *data, int begin, int end);
+void gravity_forces   (void *data, int begin, int end);
+void build_gravity_node(A3DGravity *g, const int node, const int depth,
+                        const int split);
+void sum_gravity_node (A3DGravity *g, const int node);
+void sum_gravity_top  (A3DGravity *g, const int node, const int depth);
+
+/*** Ray queries ***
+ *
+ * Nearest asteroid hit along rays, through the BVH.
+ *
+ *     b     - BVH object.
+ *     aster - Asteroid array, MAX_ASTEROIDS long.
+ *     ray   - Ray to cast, 'hit' and 'dist' are set.
+ *
+ * refit_bvh() locates every spawned asteroid, far tiers
+ * included, and refits the boxes to them, rebuilding the tree
+ * when there is none or it has grown too loose. Later code in
+ * the step can rely on 'pos' being current. build_bvh() rebuilds the tree, and
+ * fit_bvh() fits the boxes bottom up, returning their area.
+ *
+ * cast_ray() returns the asteroid hit, or -1. cast_rays() is a
+ * worker task over the rays of an A3DRayTask, counting hits.
+ *
+ * build_bvh_node() builds node 'node' over the 'count' slots in
+ * 'slots', whose centers are in 'center', taking pairs of child
+ * nodes from b->count. ray_box() returns the distance where a
+ * ray enters a box within 'range', or -1 if it misses.
+ **/
+void  refit_bvh     (A3DBvh *b, A3DActor *aster);
+void  build_bvh     (A3DBvh *b, const A3DActor *aster);
+float fit_bvh       (A3DBvh *b, const A3DActor *aster);
+int   cast_ray      (const A3DBvh *b, const A3DActor *aster, A3DRay *ray);
+void  cast_rays     (void *data, int begin, int end);
+void  build_bvh_node(A3DBvh *b, const int node, int *slots, const int count,
+                     const float *center);
+float ray_box       (const A3DBvhNode *n, const float *origin,
+                     const float *inv, const float range);
+
+/*** Aim assist ***
+ *
+ *     a      - Aim object.
+ *     b      - BVH of the asteroids, refit this step.
+ *     aster  - Asteroid array.
+ *     player - Player, looking down the shot direction.
+ *     shot   - Spawned projectile, with its velocity set.
+ *     speed  - Projectile speed.
+ *     dt     - Time modifier of the step.
+ *
+ * update_aim() casts the crosshair ray and updates the target
+ * and lock. auto_aim() turns 'shot' to intercept the locked
+ * asteroid, and returns true if it did.
+ *
+ * aim_forward() writes the unit shot direction of 'player'.
+ **/
+void update_aim (A3DAim *a, const A3DBvh *b, const A3DActor *aster,
+                 const A3DActor *player, const float dt);
+bool auto_aim   (const A3DAim *a, A3DActor *aster, const A3DActor *player,
+                 A3DActor *shot, const float speed);
+void aim_forward(const A3DActor *player, float *dir);
+
+/*** Hit-scan beam ***
+ *
+ *     b        - Beam object.
+ *     capacity - Maximum number of asteroids.
+ *     aster    - Asteroid array, located this step.
+ *     count    - Number of asteroids.
+ *     origin   - Start of the beam.
+ *     dir      - Unit direction of the beam.
+ *     dist     - Range of the beam, set to the distance of the hit.
+ *
+ * init_beam() returns true if successful, false if otherwise.
+ * load_beam() copies the spawned asteroids into the SoA arrays.
+ *
+ * beam_nearest() tests every loaded sphere, four at a time with
+ * SSE, and returns the index of the nearest hit, or -1.
+ * beam_reference() does the same one sphere at a time, for tests.
+ *
+ * draw_beam() draws the last beam as a line fading with 'show',
+ * with the view matrix loaded.
+ *
+ * run_beam_bench() fires the beam 60 times a second for ten
+ * seconds into 100k asteroids without opening a window, and
+ * prints the timings against the reference as JSON to stdout.
+ **/
+bool init_beam     (A3DBeam *b, const int capacity);
+void load_beam     (A3DBeam *b, const A3DActor *aster, const int count);
+int  beam_nearest  (const A3DBeam *b, const float *origin, const float *dir,
+                    float *dist);
+int  beam_reference(const A3DBeam *b, const float *origin, const float *dir,
+                    float *dist);
+void draw_beam     (const A3DBeam *b);
+void free_beam     (A3DBeam *b);
+int  run_beam_bench(void);
+
+/*** Audio ***
+ *
+ *     a      - Audio object.
+ *     sound  - SOUND_* index.
+ *     gain   - Volume, 0 to 1.
+ *     pan    - Stereo position, -1 (left) to 1 (right).
+ *     out    - Interleaved stereo float samples.
+ *     frames - Number of stereo frames in 'out'.
+ *
+ * init_audio() generates the sounds and starts the device.
+ * Returns true if successful, false if otherwise. It runs under
+ * SDL_AUDIODRIVER=dummy with no sound card.
+ *
+ * play_sound() queues a sound from the game thread. Returns
+ * false if the ring was full and the command dropped.
+ *
+ * mix_audio() takes the queued commands, mixing into 'out' from
+ * zero. Voices are summed four samples at a time with SSE, and
+ * the oldest voice is stolen when none is free. audio_callback()
+ * is the SDL callback around it.
+ *
+ * generate_sounds() synthesizes every SOUND_* into one block.
+ *
+ * run_audio_bench() mixes 1, 8 and 32 voices with the device
+ * paused, and prints the cost per voice as JSON to stdout.
+ **/
+bool init_audio     (A3DAudio *a);
+bool play_sound     (A3DAudio *a, const int sound, const float gain,
+                     const float pan);
+void mix_audio      (A3DAudio *a, float *out, const int frames);
+void audio_callback (void *data, Uint8 *stream, int len);
+bool generate_sounds(A3DAudio *a);
+void free_audio     (A3DAudio *a);
+int  run_audio_bench(void);
+
+/*** Gameplay events ***
+ *
+ *     r     - Event ring.
+ *     type  - EVENT_* type.
+ *     slot  - Asteroid slot, or -1.
+ *     a     - Actor to copy 'mass' and 'pos' from, or NULL.
+ *     out   - Array of at least 'max' events.
+ *
+ * emit_event() returns the event to fill in, on the producer.
+ * publish_events() makes the emitted events visible. These two
+ * belong to the simulation thread.
+ *
+ * poll_events() copies up to 'max' published events to 'out' and
+ * returns how many, on the consumer.
+ **/
+void      init_events   (A3DEventRing *r);
+A3DEvent *emit_event    (A3DEventRing *r, const int type, const int slot,
+                         const A3DActor *a);
+void      publish_events(A3DEventRing *r);
+int       poll_events   (A3DEventRing *r, A3DEvent *out, const int max);
+
+/*** Timer wheel ***
+ *
+ *     w        - Timer wheel.
+ *     capacity - Maximum number of pending timers.
+ *     now      - Current time (ms), as from SDL_GetTicks().
+ *     delay    - Time until the timer fires (ms), at least a tick.
+ *     period   - Time between repeats (ms), or 0 to fire once.
+ *     func     - Callback, given 'data' and 'arg'.
+ *     handle   - Handle from add_timer().
+ *
+ * init_timers() returns true if successful, false if otherwise.
+ *
+ * add_timer() returns the handle of the new timer, or 0 if the
+ * pool is full. cancel_timer() returns false if the timer had
+ * already fired or been cancelled.
+ *
+ * advance_timers() runs the wheel up to 'now', firing due timers
+ * in order. Callbacks may add and cancel timers. Called once a
+ * simulation step.
+ *
+ * place_timer() links timer 'index' into the slot for its due
+ * tick, and unlink_timer() takes it out.
+ *
+ * timer_set_flag() is a callback setting the bool at 'data'.
+ **/
+bool     init_timers   (A3DTimerWheel *w, const int capacity,
+                        const unsigned now);
+unsigned add_timer     (A3DTimerWheel *w, const unsigned delay,
+                        const unsigned period, A3DTimer_Func func,
+                        void *data, const int arg);
+bool     cancel_timer  (A3DTimerWheel *w, const unsigned handle);
+void     advance_timers(A3DTimerWheel *w, const unsigned now);
+void     place_timer   (A3DTimerWheel *w, const int index);
+void     unlink_timer  (A3DTimerWheel *w, const int index);
+void     free_timers   (A3DTimerWheel *w);
+void     timer_set_flag(void *data, int arg);
+
+/*** Entity component system ***
+ *
+ *     w        - World object.
+ *     capacity - Maximum number of entities.
+ *     sizes    - Size of each component type, in id order.
+ *     count    - Number of component types.
+ *     mask     - Set of component ids, as 1 << id.
+ *     entity   - Entity handle.
+ *     comp     - Component id.
+ *
+ * init_world() returns true if successful, false if otherwise.
+ *
+ * add_query() returns a query id, and add_system() a system id
+ * running 'func' over the archetypes of 'query', or -1 when full.
+ *
+ * create_entity() returns a new entity with uninitialized
+ * components, or 0 on failure, as when its archetype is fixed.
+ * destroy_entity() removes it at once, and must not be used
+ * while its archetype is iterated; defer_destroy() removes it
+ * after the running systems. Entities of fixed archetypes stay.
+ * entity_component() returns the component of an entity, or NULL.
+ *
+ * run_systems() runs every system in order with time modifier
+ * 'dt', then removes deferred entities.
+ *
+ * find_archetype() returns the archetype of 'mask', creating it
+ * and adding it to the matching queries. Returns -1 when full.
+ * fix_archetype() also fixes it, so that pointers into its
+ * columns stay valid.
+ *
+ * run_ecs_bench() integrates positions of 100k entities through
+ * a system, against plain SoA arrays and the A3DActor array, and
+ * prints the time per entity as JSON to stdout.
+ **/
+bool     init_world      (A3DWorld *w, const int capacity, const int *sizes,
+                          const int count);
+int      add_query       (A3DWorld *w, const unsigned mask);
+int      add_system      (A3DWorld *w, const int query, A3DSystem_Func func,
+                          void *data);
+unsigned create_entity   (A3DWorld *w, const unsigned mask);
+void     destroy_entity  (A3DWorld *w, const unsigned entity);
+void     defer_destroy   (A3DWorld *w, const unsigned entity);
+void    *entity_component(A3DWorld *w, const unsigned entity, const int comp);
+void     run_systems     (A3DWorld *w, const float dt);
+int      find_archetype  (A3DWorld *w, const unsigned mask);
+int      fix_archetype   (A3DWorld *w, const unsigned mask);
+void     free_world      (A3DWorld *w);
+int      run_ecs_bench   (void);
+
+/*** Scene systems ***
+ *
+ * popup_system() ages popup texts and turns them to face the
+ * player, destroying them when done. sight_system() places the
+ * reticules in front of the player. shot_system() destroys shots
+ * 320 units away from the player. 'data' is the player actor.
+ *
+ * blast_system() grows the blast and pulls the camera, whose
+ * object is 'data', back from it, destroying it when done.
+ *
+ * move_system() is the benchmark system, adding COMP_VEL to
+ * COMP_POS (both float[3]).
+ **/
+void popup_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt);
+void sight_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt);
+void shot_system (A3DWorld *w, A3DArchetype *a, void *data, const float dt);
+void blast_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt);
+void move_system (A3DWorld *w, A3DArchetype *a, void *data, const float dt);
+
+/*** Settings ***
+ *
+ *     c     - Config object.
+ *     key   - Setting name, from config_keys.
+ *     value - Setting value as text.
+ *     file  - Path of a config or sweep file.
+ *     exe   - Path of this program, run for each combination.
+ *     frames - Frames per combination.
+ *     argc, argv - Command line, passed on to each combination.
+ *     command - Shell command being built.
+ *     arg   - Argument to append to it.
+ *
+ * default_config() returns the built in settings.
+ *
+ * set_config() returns 1 if the setting was applied, 0 if the
+ * value is invalid, or -1 if 'key' is not a setting.
+ *
+ * load_config() and run_sweep() return true if successful,
+ * false if otherwise. run_sweep() prints a results table with
+ * one row per combination to stdout. Each run gets the command
+ * line without --sweep and --bench, so the base settings hold,
+ * followed by the swept ones.
+ *
+ * append_arg() appends a space and 'arg' quoted for the shell,
+ * which takes up to 4 times its length plus 3 characters.
+ **/
+A3DConfig default_config(void);
+int       set_config    (A3DConfig *c, const char *key, const char *value);
+bool      load_config   (A3DConfig *c, const char *file);
+bool      load_sweep    (A3DSweep *s, const char *file);
+bool      run_sweep     (const char *file, const int frames,
+                         const int argc, char *argv[]);
+void      append_arg    (char *command, const char *arg);
+
+/*** Sector generator ***
+ *
+ * sector_main() is the generator thread. generate_sector() fills
+ * 'aster' with the field of the sector at 'coords', placed
+ * relative to the middle of the sector; the same 'seed' and
+ * 'coords' always give the same field.
+ **/
+int  sector_main    (void *data);
+void generate_sector(const unsigned seed, const int *coords,
+                     A3DActor *aster);
+
+/*** Xorshift random numbers ***
+ *
+ * Returns the next of Marsaglia's 32-bit xorshift sequence from
+ * the nonzero 'state', for threads that must not share rand().
+ **/
+unsigned xorshift32(unsigned *state);
+
+/*** Push matrix ***
+ *
+ * Calls glPushMatrix() and counts it in frame_stats.
+ **/
+void push_matrix(void);
+
+/*** Print benchmark results ***
+ *
+ * Prints averaged frame statistics as a JSON object to stdout.
+ *
+ *     frames - Number of frames measured.
+ *     ms     - Total frame time (ms).
+ *     cpu    - Total CPU time before buffer swaps (ms).
+ *     gpu    - Total GPU time from timer queries (ms).
+ *     total  - Frame statistics summed over all frames.
+ *     issued - Total state changes issued.
+ *     skip   - Total state changes skipped.
+ *     cull   - Name of the culling mode.
+ *     cull_ms - Total culling time (ms).
+ *     ray_ms - Total time of the --rays batches (ms).
+ **/
+void print_bench_json(const unsigned frames, const double ms,
+                      const double cpu, const double gpu,
+                      const A3DFrameStats total, const double issued,
+                      const double skip, const char *cull,
+                      const double cull_ms, const double ray_ms);
+
+/*** Worker thread pool ***
+ *
+ * Starts, runs and stops the worker threads.
+ *
+ *     w     - Worker pool object.
+ *     count - Number of threads to start.
+ *     func  - Task to run on [begin, end) item ranges.
+ *     data  - Pointer passed to each task call.
+ *     total - Number of items.
+ *     chunk - Items claimed at a time.
+ *
+ * init_workers() returns true if successful, false if otherwise.
+ * On failure the pool runs everything on the calling thread.
+ * run_workers() blocks until all items are done. Small jobs of
+ * one chunk or less run on the calling thread directly.
+ **/
+bool init_workers(A3DWorkers *w, const int count);
+void run_workers (A3DWorkers *w, A3DTask_Func func, void *data,
+                  const int total, const int chunk);
+void free_workers(A3DWorkers *w);
+int  worker_main (void *data);           /*SDL thread entry*/
+void worker_chunks(A3DWorkers *w);      /*take chunks until done*/
+
+/*** Build GLSL program ***
+ *
+ * Compiles and links a vertex/fragment shader pair.
+ *
+ *     header  - Source placed before both shaders (#version).
+ *     lib     - Lines placed before the vertex shader,
+ *               terminated by NULL, or NULL for none.
+ *     vs      - Vertex shader lines, terminated by NULL.
+ *     fs      - Fragment shader lines, terminated by NULL.
+ *     attribs - Attribute names, bound to locations FIRST_ATTRIB,
+ *               FIRST_ATTRIB + 1, ...
+ *     count   - Number of attribute names.
+ *
+ * Returns the program object, or 0 if it failed to build.
+ * Compile and link logs are written to stderr. Locations below
+ * FIRST_ATTRIB are left alone, as some drivers alias them to the
+ * built in attributes (gl_Normal is 2, gl_Color 3 and
+ * gl_MultiTexCoord0 8 on NVIDIA).
+ **/
+#define MAX_SHADER_LINES 96
+#define FIRST_ATTRIB     9
+unsigned build_program(const char *header, const char **lib,
+                       const char **vs, const char **fs,
+                       const char **attribs, const int count);
+
+/*** Initialize indirect draw pass ***
+ *
+ * Sets up the program, vertex array and buffers for drawing
+ * opaque models with glMultiDrawElementsIndirect().
+ *
+ *     mdi      - Indirect pass object.
+ *     capacity - Maximum number of instances per frame.
+ *     header   - Shader header: indirect_header, or
+ *                indirect_header_flat when EXT_gpu_shader4 flat
+ *                varyings can match GL_FLAT shading, or
+ *                cluster_header to add clustered lights.
+ *
+ * Returns true if successful, false if otherwise, also when
+ * there are too few vertex attributes for the instances. Must
+ * be called after load_models().
+ **/
+bool init_indirect(A3DIndirect *mdi, const int capacity,
+                   const char *header);
+
+/*** Initialize scene shading ***
+ *
+ * Builds the scene shading program and looks up its uniforms.
+ * 'header' is as for init_indirect(). Returns true if
+ * successful, false if otherwise.
+ **/
+bool init_shading(A3DShading *sh, const char *header);
+
+/*** Clustered lights ***
+ *
+ * init_lights() creates the light buffer texture and points
+ * the 'u_lights' sampler of 'count' programs at it.
+ *
+ * add_light() transforms world position 'x', 'y', 'z' by the
+ * camera matrix 'view' and adds a light of 'radius' and
+ * 'color'. Returns false if there is no room.
+ *
+ * upload_lights() sorts the lights into clusters for the
+ * frustum given by 'near', 'far' and the 'scale_x', 'scale_y'
+ * projection scales, uploads them and clears the list. If the
+ * references would overflow, the lights per cluster are capped.
+ * Returns the number of light references.
+ **/
+bool init_lights  (A3DLights *l, const unsigned *programs, const int count);
+bool add_light    (A3DLights *l, const float *view, const float x,
+                   const float y, const float z, const float radius,
+                   const float *color);
+int  upload_lights(A3DLights *l, const float near, const float far,
+                   const float scale_x, const float scale_y);
+
+/*** Scene program ***
+ *
+ * Returns the program single draws should use: the scene
+ * shading program when enabled, otherwise 0.
+ **/
+unsigned scene_program(void);
+
+/*** Shading state ***
+ *
+ * shading_uniform() returns the uniform mirroring an enable
+ * cap, or -1 if the cap has none. sync_shading() copies the
+ * cached material and enables to the shading program if
+ * 'to_glsl' is true, and to the fixed function state if false.
+ **/
+int  shading_uniform(const GLenum cap);
+void sync_shading   (const bool to_glsl);
+
+/*** Submit indirect draw pass ***
+ *
+ * Draws all instances with one glMultiDrawElementsIndirect().
+ *
+ *     mdi    - Indirect pass object.
+ *     model  - Array of INDIRECT_MODELS models.
+ *     counts - Instances per model. Instances for model[i]
+ *              directly follow those of model[i-1].
+ *
+ * Builds a command per model from its index offset and base
+ * vertex, uploads the instances and commands, and draws them
+ * with the instancing program.
+ **/
+void submit_indirect(A3DIndirect *mdi, A3DModel **model,
+                     const int *counts);
+
+/*** Actor instance ***
+ *
+ * Advances an actor and writes its instance transform.
+ *
+ *     obj   - Actor object.
+ *     view  - Camera modelview matrix.
+ *     inst  - Instance to fill.
+ *     scale - Uniform scale for the model.
+ *     dt    - Frame time modifier.
+ *
+ * Same as transform_static_actor() followed by glScalef() with
+ * 'view' loaded, but the matrix is written to 'inst' instead
+ * of GL.
+ **/
+void actor_instance(A3DActor *obj, const float *view, A3DInstance *inst,
+                    const float scale, const float dt);
+
+/*** Multiply matrices ***
+ *
+ * out = a * b, for column-major 4x4 matrices. 'out' must not
+ * alias 'a' or 'b'.
+ **/
+void mult_matrix(const float *a, const float *b, float *out);
+
+/*** Fill asteroid instances ***
+ *
+ * Worker task for asteroids [begin, end). 'data' is an
+ * A3DAsteroidTask. Visible asteroids are advanced and written
+ * to the instance array with their material colors. Space for
+ * each chunk is claimed with a single atomic add.
+ **/
+void fill_asteroid_instances(void *data, int begin, int end);
+
+/*** Asteroid color ***
+ *
+ * Sets the diffuse color of an asteroid by size.
+ *
+ *     mass  - Asteroid mass.
+ *     color - RGB(A) color, alpha is left as is.
+ **/
+void asteroid_color(const float mass, float *color);
+
+/*** Load occluder mesh ***
+ *
+ * Loads the positions of a GL_N3F_V3F model from file, for
+ * use as a software occluder.
+ *
+ *     mesh        - Occluder mesh to fill.
+ *     file_prefix - Model file path, as for load_model_from_file().
+ *
+ * Returns true if successful, false if otherwise.
+ **/
+bool load_occluder_mesh(A3DOccluderMesh *mesh, const char *file_prefix);
+
+/*** Initialize software occlusion ***
+ *
+ * Allocates the depth buffer and scratch space.
+ *
+ *     occ          - Occlusion object.
+ *     max_tris     - Maximum occluder triangles per frame.
+ *     max_vertices - Vertices of the largest occluder mesh.
+ **/
+void init_occlusion(A3DOcclusion *occ, const int max_tris,
+                    const int max_vertices);
+
+/*** Set up occluders ***
+ *
+ * Picks the large whole asteroids that cover the most of the
+ * screen and sets up their triangles, plus those of the player.
+ *
+ *     occ    - Occlusion object, with the per frame members set.
+ *     aster  - Asteroid occluder mesh.
+ *     player - Player occluder mesh, NULL if not spawned.
+ *     player_mv - Modelview matrix of the player model.
+ *
+ * Returns the number of occluders used.
+ **/
+int setup_occluders(A3DOcclusion *occ, const A3DOccluderMesh *aster,
+                    const A3DOccluderMesh *player, const float *player_mv);
+
+/*** Add occluder ***
+ *
+ * Projects a mesh with modelview matrix 'mv' and appends its
+ * front facing triangles. Triangles crossing the near plane
+ * are dropped, which only makes the occluder smaller.
+ **/
+void add_occluder(A3DOcclusion *occ, const A3DOccluderMesh *mesh,
+                  const float *mv);
+
+/*** Occlusion tasks ***
+ *
+ * Worker tasks, 'data' is an A3DOcclusion.
+ *
+ * rasterize_occluders() clears and fills bands [begin, end) of
+ * the depth buffer. test_occlusion() sets 'visible' for
+ * asteroids [begin, end). An asteroid is hidden if it is off
+ * screen, or if every pixel under its screen bounds holds an
+ * occluder closer than the nearest point of its bounds.
+ * Both use SSE when available.
+ **/
+void rasterize_occluders(void *data, int begin, int end);
+void test_occlusion     (void *data, int begin, int end);
+
+/*** Cached state changes ***
+ *
+ * Change GL state through the state cache.
+ *
+ *     cap    - Capability for glEnable()/glDisable().
+ *     tex    - GL_TEXTURE_2D texture object.
+ *     target - Buffer binding point.
+ *     buffer - Buffer object.
+ *     pname  - Front face material parameter. GL_AMBIENT,
+ *              GL_DIFFUSE, GL_SPECULAR or GL_EMISSION.
+ *     v      - RGBA material color.
+ *     vao    - Vertex array object.
+ *     program - GLSL program object, 0 for fixed function.
+ *     format - Interleaved format for glInterleavedArrays().
+ *     offset - Byte offset into the bound GL_ARRAY_BUFFER.
+ *
+ * Each function skips the GL call when the cached value already
+ * matches. Capabilities that aren't in cached_caps[] and
+ * untracked buffer targets are always passed through.
+ *
+ * These replace glPushAttrib()/glPopAttrib() pairs. Instead of
+ * restoring state after drawing, each pass sets the state it
+ * depends on and anything that is already set costs nothing.
+ *
+ * While the scene shading program is in use, materials and the
+ * lighting, fog and texturing enables go to its uniforms.
+ **/
+void state_enable      (const GLenum cap);
+void state_disable     (const GLenum cap);
+void state_bind_texture(const unsigned tex);
+void state_bind_buffer (const GLenum target, const unsigned buffer);
+void state_material    (const GLenum pname, const float *v);
+void state_color       (const float r, const float g, const float b);
+void state_fog_range   (const float start, const float end);
+void state_blend_func  (const GLenum src, const GLenum dst);
+void state_depth_mask  (const bool mask);
+void state_color_mask  (const bool mask);
+void state_bind_vertex_array(const unsigned vao);
+void state_use_program (const unsigned program);
+void state_interleaved_arrays(const int format, const int offset);
+int  state_cap_index   (const GLenum cap); /*index into cached_caps[]*/
+
+/*** Initialize render target ***
+ *
+ * (Re)allocates the offscreen framebuffer.
+ *
+ *     rt     - Render target object.
+ *     width  - Native drawable width.
+ *     height - Native drawable height.
+ *
+ * Returns true if successful, false if otherwise, in which case
+ * no objects are left and 'fbo' is 0.
+ *
+ * Any objects from a previous call are deleted first, so this
+ * is also used to resize the target when the window changes
+ * size. The current resolution scale is kept.
+ **/
+bool init_render_target(A3DRenderTarget *rt, const int width,
+                        const int height);
+
+/*** Update resolution scale ***
+ *
+ * Adjusts the render target's resolution scale.
+ *
+ *     rt       - Render target object.
+ *     frame_ms - Cost of the last frame in milliseconds.
+ *
+ * The frame cost is smoothed and compared against target_time.
+ * Above 90% of the budget the scale drops quickly, below 70%
+ * it creeps back up. Since fill cost grows with the square of
+ * the scale, the step is taken from the square root of the
+ * budget ratio. The scale is kept between 0.5 and 1.0.
+ **/
+void update_render_scale(A3DRenderTarget *rt, const float frame_ms);
+
+/*** Begin/end render target ***
+ *
+ * Redirects drawing to the scaled render target and back.
+ *
+ *     rt     - Render target object.
+ *     width  - Native drawable width.
+ *     height - Native drawable height.
+ *
+ * begin_render_target() binds the framebuffer and sets the
+ * viewport to the scaled region. end_render_target() rebinds
+ * the window framebuffer and upscales the scaled region to fill
+ * the window as a textured quad. The window's depth buffer is
+ * cleared afterwards so overlays are drawn on top.
+ **/
+void begin_render_target(const A3DRenderTarget *rt);
+void end_render_target(const A3DRenderTarget *rt, const int width,
+                       const int height);
+
+/*** Initialize impostors ***
+ *
+ * Renders the atlas of asteroid views through a temporary
+ * framebuffer object.
+ *
+ *     imp   - Impostor object.
+ *     model - Asteroid model.
+ *
+ * Returns true if successful, false if otherwise. Needs
+ * EXT_framebuffer_object, and the lighting setup of main().
+ **/
+bool init_impostors(A3DImpostors *imp, const A3DModel model);
+
+/*** Impostor views ***
+ *
+ * impostor_view() gets the object space direction towards the
+ * camera of an atlas cell, and the right and up vectors it is
+ * rendered with. impostor_cell() returns the cell closest to a
+ * unit direction.
+ **/
+void impostor_view(const int cell, float *dir, float *basis);
+int  impostor_cell(const float *dir);
+
+/*** Collect and draw impostors ***
+ *
+ * collect_impostors() builds quads for the visible whole
+ * asteroids past IMPOSTOR_NEAR. Those past IMPOSTOR_FAR are marked not
+ * visible, so the mesh is not drawn.
+ * Returns the number of impostors.
+ *
+ * draw_impostors() draws all quads in one call, with the view
+ * matrix loaded.
+ **/
+int  collect_impostors(A3DImpostors *imp, A3DActor *aster, bool *visible,
+                       const float *view);
+void draw_impostors(A3DImpostors *imp);
+
+/*** Overdraw measurement ***
+ *
+ * init_overdraw() creates the read back buffers, and pass
+ * queries if 'use_queries' is true. Returns false if there is
+ * no stencil buffer.
+ *
+ * overdraw_begin_frame() clears the stencil buffer and starts
+ * counting fragments. overdraw_pass() closes the open pass
+ * segment and opens one for 'pass', or none if 'pass' is -1.
+ * overdraw_end_frame() stops counting, reads back the counts
+ * and collects last frame's results. All three do nothing
+ * unless 'enabled' is set.
+ *
+ * draw_overdraw_heatmap() draws the stencil counts over the
+ * scene, and must follow overdraw_end_frame().
+ **/
+bool init_overdraw        (A3DOverdraw *od, const bool use_queries);
+void overdraw_begin_frame (A3DOverdraw *od);
+void overdraw_pass        (A3DOverdraw *od, const int pass);
+void overdraw_end_frame   (A3DOverdraw *od, const int width,
+                           const int height);
+void draw_overdraw_heatmap(void);
+
+/*** Frame recording ***
+ *
+ * start_recorder() opens 'filename', writes the stream header
+ * and starts the writer thread. Returns true if successful,
+ * false if otherwise.
+ *
+ * capture_frame() reads back the default framebuffer, and
+ * queues the frame read RECORD_PBOS calls ago. Frames are
+ * dropped while the window is smaller than the recording.
+ *
+ * stop_recorder() queues the frames still in flight, waits for
+ * the writer to finish, and prints a summary.
+ **/
+bool start_recorder(A3DRecorder *rec, const char *filename,
+                    const int width, const int height);
+void capture_frame (A3DRecorder *rec, const int width, const int height);
+void stop_recorder (A3DRecorder *rec);
+
+/*** Queue recorded frame ***
+ *
+ * Maps pixel pack buffer 'index' and copies it to a free slot.
+ * If 'wait' is false and no slot is free, the frame is dropped.
+ **/
+void queue_frame(A3DRecorder *rec, const int index, const bool wait);
+
+/*** Recorder writer thread ***
+ *
+ * Converts and writes queued frames until 'quit' is set.
+ **/
+int recorder_main(void *data);
+
+/*** RGBA to YUV 4:2:0 ***
+ *
+ * Converts a bottom-up RGBA image to top-down planar YUV 4:2:0
+ * with full range BT.601 coefficients. Width and height must be
+ * even. 'yuv' holds width*height*3/2 bytes.
+ **/
+void rgba_to_i420(const unsigned char *rgba, unsigned char *yuv,
+                  const int width, const int height);
+
+int main(int argc, char *argv[])
+{
+    /*vars*/
+    bool          loop_exit      = false,
+                  skip_dt        = false,
+                  fullscreen     = false,
+                  red_tc         = true,
+                  gen_mips       = true,
+                  occ_query      = true,
+                  occ_query2     = true,
+                  started_query  = false,
+                  timer_query    = true,
+                  started_timer  = false;
+    char          win_title[256] = {'\0'},
+                  t_fps[16]      = {'\0'},
+                  t_mspf[16]     = {'\0'},
+                  t_res[32]      = {'\0'},
+                  t_state[48]    = {'\0'},
+                  t_draws[64]    = {'\0'},
+                  t_cull[64]     = {'\0'},
+                  t_rec[48]      = {'\0'},
+                  t_overdraw[160] = {'\0'},
+                  t_sector[64]   = {'\0'},
+                  t_sim[64]      = {'\0'},
+                  t_ray[64]      = {'\0'},
+                  t_events[80]   = {'\0'},
+                  t_audio[64]    = {'\0'},
+                  t_relvel[32]   = {'\0'},
+                  t_score[32]    = {'\0'},
+                  t_topscore[32] = {'\0'},
+                 *basepath;
+    float         aspect_ratio   = 1.f,
+                  fov            = 80.f,
+                  top_clip       = 0.f,
+                  bottom_clip    = 0.f,
+                  left_clip      = 0.f,
+                  right_clip     = 0.f,
+                  near_clip      = 1.f,
+                  far_clip       = 800.f,
+                  shot_speed     = 5.f,
+                  frametime      = -1.f,
+                  mintime        = 0.f,
+                  timemod        = 1.f,
+                  cpu_ms         = 0.f,
+                  gpu_ms         = 0.f;
+    double        bench_ms       = 0.0,
+                  bench_cpu      = 0.0,
+                  bench_gpu      = 0.0,
+                  bench_issued   = 0.0,
+                  bench_skipped  = 0.0,
+                  bench_cull     = 0.0,
+                  bench_rays     = 0.0;
+    float         tmp_diffuse_color[] = {0.f, 0.8f, 0.f, 1.f};
+    const float   mat_ambient[]  = {0.2f, 0.2f, 0.2f, 1.f},
+                  mat_specular[] = {0.5f, 0.5f, 0.5f, 1.f},
+                  mat_none[]     = {0.f,  0.f,  0.f,  1.f},
+                  shot_light[]   = {0.f,  1.f,  1.f,  1.f},
+                  blast_light[]  = {1.f,  0.6f, 0.2f, 1.f};
+    float         unit_box_vert[] = {
+                   1.f,  1.f,  1.f,
+                   1.f,  1.f, -1.f,
+                  -1.f,  1.f, -1.f,
+                  -1.f,  1.f,  1.f,
+                   1.f, -1.f,  1.f,
+                   1.f, -1.f, -1.f,
+                  -1.f, -1.f, -1.f,
+                  -1.f, -1.f,  1.f};
+    unsigned      unit_box_in[] = {
+                  0, 1, 2, 3,
+                  0, 3, 7, 4,
+                  1, 0, 4, 5,
+                  2, 1, 5, 6,
+                  3, 2, 6, 7,
+                  7, 6, 5, 4};
+    int           i,j,k,
+                  width_real,
+                  height_real,
+                  debug_level      = 1,
+                  bench_frames     = 0;
+    unsigned      shot_timer       = 0,
+                  beam_timer       = 0,
+                  currtime         = 0,
+                  prevtime         = 0,
+                  difftime         = 0,
+                  frame_count      = 0,
+                  score            = 0,
+                  topscore         = 0,
+                  texbuf[2],
+                  time_queries[2],
+                  aster_queries[MAX_ASTEROIDS];
+    Uint64        perf_start       = 0,
+                  perf_freq        = 1;
+    SDL_Event     ev_main;
+    SDL_Window   *win_main;
     SDL_GLContext win_main_gl;
-    A3DActor      a_player = {
+    const A3DActor player_start = {
                     true, 1.f,
                     {0.f,0.f,0.f},
                     {0.f,0.f,0.f},
                     {0.f,0.f,0.f,1.f},
-                    {0.f,0.f,0.f}};
-    A3DActor      a_blast = {
-                    false, 1.f,
+                    {0.f,0.f,0.f},
+                    0.f,
+                    {0.f,0.f,0.f},
+                    {0.f,0.f,0.f,1.f}};
+    const A3DActor blast_start = {
+                    true, 0.001f,
                     {0.f,0.f,0.f},
                     {0.f,0.f,0.f},
                     {0.f,0.f,0.f,1.f},
-                    {0.f,0.f,0.f}};
-    A3DActor     *a_shot;
-    A3DActor     *a_aster;
+                    {0.f,0.f,0.f},
+                    0.f,
+                    {0.f,0.f,0.f},
+                    {0.f,0.f,0.f,1.f}};
+    A3DFrameStats bench_total = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {0, 0, 0}, 0,
+                                 0, 0, 0};
+    A3DRenderTarget rt = {
+                    true, 0, 0, 0, 0, 0, 0, 0, 1.f, 0.f};
+    A3DIndirect   mdi = {
+                    true, 0, 0, 0, 0, 0, NULL, {{0, 0, 0, 0, 0}}};
+    A3DWorkers    workers;
+    A3DAsteroidTask aster_task;
+    A3DModel     *mdi_models[INDIRECT_MODELS];
+    int           mdi_counts[INDIRECT_MODELS];
+    bool          aster_visible[MAX_ASTEROIDS];
+    bool          flat_varyings = true;
+    const char   *shader_header;
+    A3DLights     lights;
+    A3DTrails     trails;
+    A3DSimTiers   sim_tiers;
+    A3DGravity    gravity;
+    bool          use_gravity    = false,
+                  gravity_bench  = false;
+    float         gravity_theta  = GRAVITY_THETA;
+    A3DBvh        bvh;
+    A3DAim        aim = {-1, false, 0.f, 0.f};
+    A3DRayTask    ray_task;
+    A3DRay       *ray_load      = NULL;
+    int           extra_rays    = 0;
+    unsigned      ray_hits      = 0;
+    A3DBeam       beam;
+    bool          beam_ok       = false,
+                  beam_bench    = false,
+                  audio_bench   = false;
+    A3DAudio      audio;
+    A3DEventRing  events;
+    A3DTimerWheel timers;
+    bool          shot_ready    = true,
+                  beam_ready    = true,
+                  spawn_due     = false,
+                  title_due     = true;
+    A3DEvent      event_batch[EVENT_BATCH];
+    unsigned      event_counts[EVENT_TYPES] = {0, 0, 0, 0},
+                  step_events   = 0;
+    A3DScoreText  target_mark   =
+            {true,  {'\0'}, 0.f, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f, 1.f}};
+    unsigned      light_programs[2];
+    int           extra_lights  = 0;
+    float        *light_pos     = NULL;
+    float         view_matrix[16],
+                  player_matrix[16];
+    A3DOcclusion  occ;
+    A3DImpostors  impostors      = {0, 0, {{0.f}}, NULL, 0};
+    A3DRecorder   recorder;
+    A3DOverdraw   overdraw;
+    bool          overdraw_ok    = false;
+    const char   *record_file    = NULL;
+    bool          open_world     = false;
+    A3DOccluderMesh occ_asteroid,
+                  occ_player;
+    int           cull_mode,
+                  init_asteroids;
+    Uint64        cull_start;
+    A3DConfig     config;
+    const char   *sweep_file     = NULL;
+    A3DActor     *a_player,
+                 *a_blast       = NULL,
+                 *a_aster;
+    A3DArchetype *shots;
+    unsigned      player,
+                  blast         = 0;
     A3DCamera     camera = {
                     NULL, false, false, false, false,
                     false, false, false, false, false,
-                    true, 1.f, 0.005f, 7.f, 0.008f,
+                    false, true, 1.f, 0.005f, 7.f, 0.008f,
                     0.8f, {0.f, -2.f, -5.f}, 0.f};
     A3DModel      m_player,
                   m_projectile,
@@ -559,1893 +3106,8074 @@ int main(void)
                   m_boundbox,
                   m_skybox,
                   m_unitbox,
-                 *m_ptr_all[7];
+                  m_fragment[FRACTURE_PIECES],
+                 *m_ptr_all[7 + FRACTURE_PIECES];
+    A3DFragments  fragments;
     A3DImage      i_font,
                   i_skybox;
-    A3DScoreText  scoretext[3] =
-            {{false, {'\0'}, 0.f, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
-    A3DScoreText  reticule[3]  =
-            {{true,  {'\0'}, 0.f, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f, 1.f}}};
+    A3DScoreText  scoretext =
+            {true,  {'\0'}, 0.f, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f, 1.f}};
+    A3DWorld      world;
+    int           popup_query,
+                  sight_query;
+    bool          ecs_bench     = false;
+    const int     scene_sizes[8] = {sizeof(float)*3, sizeof(float)*4,
+                                    sizeof(A3DPopup), sizeof(A3DSight),
+                                    sizeof(A3DActor), sizeof(int),
+                                    sizeof(A3DBlast), 0};
+    const unsigned popup_mask   = (1u << COMP_POS) | (1u << COMP_ORI) |
+                                  (1u << COMP_POPUP),
+                  sight_mask    = (1u << COMP_POS) | (1u << COMP_ORI) |
+                                  (1u << COMP_SIGHT),
+                  player_mask   = (1u << COMP_ACTOR),
+                  aster_mask    = (1u << COMP_ACTOR) | (1u << COMP_SLOT),
+                  shot_mask     = (1u << COMP_ACTOR) | (1u << COMP_SLOT) |
+                                  (1u << COMP_SHOT),
+                  blast_mask    = (1u << COMP_ACTOR) | (1u << COMP_BLAST);
+    const float   sight_offset[3] = {100.f, 30.f, 10.f};
+    const int     sight_sprite[3] =
+            {ATLAS_RETICULE, ATLAS_CROSSHAIR, ATLAS_CROSSHAIR};
+
+    /*command line*/
+    config = default_config();
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--bench") && i + 1 < argc)
+        {
+            bench_frames = atoi(argv[++i]);
+            if(bench_frames < 1)
+            {
+                fprintf(stderr, "Invalid frame count for --bench\n");
+                return 1;
+            }
+        }
+        else if(!strncmp(argv[i], "--", 2) && i + 1 < argc &&
+                (k = set_config(&config, argv[i] + 2, argv[i + 1])) >= 0)
+        {
+            if(!k)
+                return 1;
+            i++;
+        }
+        else if(!strcmp(argv[i], "--config") && i + 1 < argc)
+        {
+            if(!load_config(&config, argv[++i]))
+                return 1;
+        }
+        else if(!strcmp(argv[i], "--sweep") && i + 1 < argc)
+            sweep_file = argv[++i];
+        else if(!strcmp(argv[i], "--record") && i + 1 < argc)
+            record_file = argv[++i];
+        else if(!strcmp(argv[i], "--open"))
+            open_world = true;
+        else if(!strcmp(argv[i], "--lights") && i + 1 < argc)
+        {
+            extra_lights = atoi(argv[++i]);
+            if(extra_lights < 0)          extra_lights = 0;
+            if(extra_lights > MAX_LIGHTS) extra_lights = MAX_LIGHTS;
+        }
+        else if(!strcmp(argv[i], "--gravity"))
+            use_gravity = true;
+        else if(!strcmp(argv[i], "--rays") && i + 1 < argc)
+        {
+            extra_rays = atoi(argv[++i]);
+            if(extra_rays < 0) extra_rays = 0;
+        }
+        else if(!strcmp(argv[i], "--gravity-bench"))
+            gravity_bench = true;
+        else if(!strcmp(argv[i], "--beam-bench"))
+            beam_bench = true;
+        else if(!strcmp(argv[i], "--audio-bench"))
+            audio_bench = true;
+        else if(!strcmp(argv[i], "--ecs-bench"))
+            ecs_bench = true;
+        else if(!strcmp(argv[i], "--theta") && i + 1 < argc)
+        {
+            gravity_theta = (float)atof(argv[++i]);
+            if(gravity_theta < 0.f || gravity_theta > 2.f)
+            {
+                fprintf(stderr, "Opening angle must be 0 to 2\n");
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--bench frames] "
+                    "[--cull none|query|cpu] [--asteroids count] "
+                    "[--record file.y4m] [--lights count] [--open] "
+                    "[--gravity] [--gravity-bench] [--theta angle] "
+                    "[--rays count] [--beam-bench] [--audio-bench] "
+                    "[--ecs-bench] [--width pixels] [--height pixels] "
+                    "[--vsync on|off] [--segments count] "
+                    "[--skybox radius] [--config file] [--sweep file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    /*one child run per combination, --bench sets the frames*/
+    if(sweep_file)
+        return run_sweep(sweep_file, bench_frames ? bench_frames :
+                         SWEEP_FRAMES, argc, argv) ? 0 : 1;
+    cull_mode      = config.cull_mode;
+    init_asteroids = config.asteroids;
+    /*no window for the benchmarks*/
+    if(gravity_bench)
+        return run_gravity_bench(gravity_theta);
+    if(beam_bench)
+        return run_beam_bench();
+    if(ecs_bench)
+        return run_ecs_bench();
+    if(audio_bench)
+    {
+        i = run_audio_bench();
+        SDL_Quit();
+        return i;
+    }
+
+    /*the player and the scene objects are entities, projectiles
+     *come and go in the shot archetype*/
+    if(!init_world(&world, SCENE_ENTITIES, scene_sizes, 8))
+        return 1;
+    popup_query = add_query(&world, popup_mask);
+    sight_query = add_query(&world, sight_mask);
+    player      = create_entity(&world, player_mask);
+    a_player    = entity_component(&world, player, COMP_ACTOR);
+    if(!a_player)
+    {
+        fprintf(stderr, "Failed to create player\n");
+        free_world(&world);
+        return 1;
+    }
+    /*the one player, its pointer holds*/
+    *a_player   = player_start;
+    fix_archetype(&world, player_mask);
+    shots       = &world.archetypes[find_archetype(&world, shot_mask)];
+    add_system(&world, popup_query, popup_system, a_player);
+    add_system(&world, sight_query, sight_system, a_player);
+    add_system(&world, add_query(&world, shot_mask), shot_system, a_player);
+    add_system(&world, add_query(&world, blast_mask), blast_system, &camera);
+    for(i = 0; i < 3; i++)
+    {
+        const unsigned e = create_entity(&world, sight_mask);
+        A3DSight *sight  = entity_component(&world, e, COMP_SIGHT);
+        sight->offset = sight_offset[i];
+        sight->sprite = sight_sprite[i];
+    }
+
+    /*initialize asteroids, a fixed pool in slot order*/
+    for(i = 0; i < MAX_ASTEROIDS; i++)
+    {
+        const unsigned e = create_entity(&world, aster_mask);
+        A3DActor *a      = entity_component(&world, e, COMP_ACTOR);
+        if(!a)
+        {
+            fprintf(stderr, "Failed to create asteroids\n");
+            free_world(&world);
+            return 1;
+        }
+        *(int *)entity_component(&world, e, COMP_SLOT) = i;
+        memset(a, 0, sizeof(A3DActor));
+        a->quat_orientation.w = 1.f;
+    }
+    a_aster = world.archetypes[fix_archetype(&world, aster_mask)].
+              columns[COMP_ACTOR];
+
+    /*tie camera to player actor*/
+    camera.player = a_player;
+
+    /*get base path name*/
+    if(!(basepath = SDL_GetBasePath()))
+    {
+        fprintf(stderr, "Could not get executable base path.\n");
+        return 1;
+    }
+
+    /*set model path and pointers for load_models*/
+    /*buit-in data*/
+    generate_boundbox(&m_boundbox, config.segments);
+    generate_skybox(&m_skybox, config.skybox_radius);
+    m_unitbox.vertex_data  = unit_box_vert;
+    m_unitbox.vertex_count = sizeof(unit_box_vert)/sizeof(*unit_box_vert);
+    m_unitbox.index_data   = unit_box_in;
+    m_unitbox.index_count  = sizeof(unit_box_in)/sizeof(*unit_box_in);
+    /*file paths*/
+    m_unitbox.file_root    = "none";
+    m_boundbox.file_root   = "none";
+    m_skybox.file_root     = "none";
+    m_player.file_root     = malloc(strlen(basepath) + 32);
+    m_projectile.file_root = malloc(strlen(basepath) + 32);
+    m_asteroid.file_root   = malloc(strlen(basepath) + 32);
+    m_blast.file_root      = malloc(strlen(basepath) + 32);
+    strcpy(m_player.file_root,     basepath);
+    strcpy(m_projectile.file_root, basepath);
+    strcpy(m_asteroid.file_root,   basepath);
+    strcpy(m_blast.file_root,      basepath);
+    strcat(m_player.file_root,     "data/model/player1");
+    strcat(m_projectile.file_root, "data/model/projectile1");
+    strcat(m_asteroid.file_root,   "data/model/asteroid1");
+    strcat(m_blast.file_root,      "data/model/blast2");
+    /*if data is static*/
+    m_player.const_data     = false;
+    m_projectile.const_data = false;
+    m_asteroid.const_data   = false;
+    m_blast.const_data      = false;
+    m_boundbox.const_data   = false;
+    m_skybox.const_data     = false;
+    m_unitbox.const_data    = true;
+    /*drawing mode*/
+    m_player.mode       = GL_TRIANGLES;
+    m_projectile.mode   = GL_TRIANGLES;
+    m_asteroid.mode     = GL_TRIANGLES;
+    m_blast.mode        = GL_TRIANGLES;
+    m_boundbox.mode     = GL_LINES;
+    m_skybox.mode       = GL_QUADS;
+    m_unitbox.mode      = GL_QUADS;
+    /*interleaved format*/
+    m_player.format     = GL_N3F_V3F;
+    m_projectile.format = GL_N3F_V3F;
+    m_asteroid.format   = GL_N3F_V3F;
+    m_blast.format      = GL_N3F_V3F;
+    m_boundbox.format   = GL_V3F;
+    m_skybox.format     = GL_T2F_V3F;
+    m_unitbox.format    = GL_V3F;
+    /*pointers to models*/
+    m_ptr_all[0] = &m_player;
+    m_ptr_all[1] = &m_projectile;
+    m_ptr_all[2] = &m_asteroid;
+    m_ptr_all[3] = &m_blast;
+    m_ptr_all[4] = &m_boundbox;
+    m_ptr_all[5] = &m_skybox;
+    m_ptr_all[6] = &m_unitbox;
+
+    /*set image path*/
+    i_font.filename = malloc(strlen(basepath) + 32);
+    strcpy(i_font.filename, basepath);
+    strcat(i_font.filename, "data/image/8x16s_bitfont.png");
+    i_skybox.filename = malloc(strlen(basepath) + 32);
+    strcpy(i_skybox.filename, basepath);
+    strcat(i_skybox.filename, "data/image/skybox0d.png");
+
+    #ifdef _WIN32
+    /*write output to file on Windows*/
+    char *winfilepath = malloc(strlen(basepath) + 32);
+    strcpy(winfilepath, basepath);
+    strcat(winfilepath, "stdout.txt");
+    freopen(winfilepath, "w", stdout);
+    strcpy(winfilepath, basepath);
+    strcat(winfilepath, "stderr.txt");
+    freopen(winfilepath, "w", stderr);
+    free(winfilepath);
+    #endif
+
+    /*init*/
+    SDL_Init(SDL_INIT_VIDEO);
+    /*stencil for overdraw measurement*/
+    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+    win_main = SDL_CreateWindow("Asteroids 3D", SDL_WINDOWPOS_UNDEFINED,
+            SDL_WINDOWPOS_UNDEFINED, config.width, config.height,
+            SDL_WINDOW_OPENGL);
+    if(!win_main)
+    {
+        fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
+        return 1;
+    }
+    win_main_gl = SDL_GL_CreateContext(win_main);
+    if(!win_main_gl)
+    {
+        fprintf(stderr, "SDL_GL_CreatContext failed: %s\n", SDL_GetError());
+        return 1;
+    }
+    if(config.vsync < 0)
+        config.vsync = bench_frames ? 0 : 1;
+    if(SDL_GL_SetSwapInterval(config.vsync))
+    {
+        fprintf(stderr, "SDL_GL_SetSwapInterval failed: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_GL_GetDrawableSize(win_main, &width_real, &height_real);
+    aspect_ratio = width_real/(float)height_real;
+    if(SDL_SetRelativeMouseMode(SDL_TRUE))
+        fprintf(stderr,
+                "SDL_SetRelativeMouseMode failed. Mouse capture disabled.\n");
+    /*check GL extension availability*/
+    if(!SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object"))
+    {
+        fprintf(stderr, "ARB_vertex_buffer_object not supported\n");
+        return 1;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object"))
+    {
+        fprintf(stderr, "ARB_pixel_buffer_object not supported\n");
+        return 1;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_EXT_texture_compression_rgtc"))
+    {
+        fprintf(stderr, "EXT_texture_compression_rgtc not supported\n");
+        red_tc = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_texture_swizzle") &&
+       !SDL_GL_ExtensionSupported("GL_EXT_texture_swizzle"))
+    {
+        fprintf(stderr, "(ARB/EXT)_texture_swizzle not supported\n");
+        red_tc = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_SGIS_generate_mipmap"))
+    {
+        fprintf(stderr, "GL_SGIS_generate_mipmap not supported\n");
+        gen_mips = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_occlusion_query"))
+    {
+        fprintf(stderr, "GL_ARB_occlusion_query not supported\n");
+        occ_query = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_occlusion_query2"))
+    {
+        fprintf(stderr, "GL_ARB_occlusion_query2 not supported\n");
+        occ_query2 = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_draw_elements_base_vertex"))
+        fprintf(stderr, "GL_ARB_draw_elements_base_vertex not supported\n");
+    else
+    {
+        *(void **)(&glDrawElementsBaseVertex_ptr) =
+            SDL_GL_GetProcAddress("glDrawElementsBaseVertex");
+        if(!SDL_GL_ExtensionSupported("GL_ARB_vertex_array_object"))
+            fprintf(stderr, "GL_ARB_vertex_array_object not supported\n");
+        else
+        {
+            *(void **)(&glGenVertexArrays_ptr) =
+                SDL_GL_GetProcAddress("glGenVertexArrays");
+            *(void **)(&glDeleteVertexArrays_ptr) =
+                SDL_GL_GetProcAddress("glDeleteVertexArrays");
+            *(void **)(&glBindVertexArray_ptr) =
+                SDL_GL_GetProcAddress("glBindVertexArray");
+        }
+    }
+    if(!SDL_GL_ExtensionSupported("GL_EXT_framebuffer_object"))
+    {
+        fprintf(stderr, "GL_EXT_framebuffer_object not supported\n");
+        rt.enabled = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_timer_query") &&
+       !SDL_GL_ExtensionSupported("GL_EXT_timer_query"))
+    {
+        fprintf(stderr, "(ARB/EXT)_timer_query not supported\n");
+        timer_query = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_multi_draw_indirect"))
+    {
+        fprintf(stderr, "GL_ARB_multi_draw_indirect not supported\n");
+        mdi.enabled = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_base_instance"))
+    {
+        fprintf(stderr, "GL_ARB_base_instance not supported\n");
+        mdi.enabled = false;
+    }
+    if(!SDL_GL_ExtensionSupported("GL_ARB_instanced_arrays"))
+    {
+        fprintf(stderr, "GL_ARB_instanced_arrays not supported\n");
+        mdi.enabled = false;
+    }
+    if(!glBindVertexArray_ptr) /*reported above*/
+        mdi.enabled = false;
+    if(!SDL_GL_ExtensionSupported("GL_EXT_gpu_shader4"))
+    {
+        fprintf(stderr, "GL_EXT_gpu_shader4 not supported\n");
+        flat_varyings = false;
+    }
+    lights.enabled = flat_varyings;
+    if(!SDL_GL_ExtensionSupported("GL_ARB_texture_buffer_object"))
+    {
+        fprintf(stderr, "GL_ARB_texture_buffer_object not supported\n");
+        lights.enabled = false;
+    }
+    /*fetch buffer object functions*/
+    *(void **)(&glDeleteBuffersARB_ptr) =
+        SDL_GL_GetProcAddress("glDeleteBuffersARB");
+    *(void **)(&glGenBuffersARB_ptr) =
+        SDL_GL_GetProcAddress("glGenBuffersARB");
+    *(void **)(&glBindBufferARB_ptr) =
+        SDL_GL_GetProcAddress("glBindBufferARB");
+    *(void **)(&glBufferDataARB_ptr) =
+        SDL_GL_GetProcAddress("glBufferDataARB");
+    *(void **)(&glMapBufferARB_ptr) =
+        SDL_GL_GetProcAddress("glMapBufferARB");
+    *(void **)(&glUnmapBufferARB_ptr) =
+        SDL_GL_GetProcAddress("glUnmapBufferARB");
+    if(occ_query || timer_query)
+    {
+        *(void **)(&glGetQueryivARB_ptr) =
+            SDL_GL_GetProcAddress("glGetQueryivARB");
+        *(void **)(&glGenQueriesARB_ptr) =
+            SDL_GL_GetProcAddress("glGenQueriesARB");
+        *(void **)(&glDeleteQueriesARB_ptr) =
+            SDL_GL_GetProcAddress("glDeleteQueriesARB");
+        *(void **)(&glBeginQueryARB_ptr) =
+            SDL_GL_GetProcAddress("glBeginQueryARB");
+        *(void **)(&glEndQueryARB_ptr) =
+            SDL_GL_GetProcAddress("glEndQueryARB");
+        *(void **)(&glGetQueryObjectivARB_ptr) =
+            SDL_GL_GetProcAddress("glGetQueryObjectivARB");
+    }
+    if(occ_query)
+    {
+        int qb = 0;
+        glGetQueryivARB_ptr(GL_SAMPLES_PASSED, GL_QUERY_COUNTER_BITS, &qb);
+        if(!qb)
+        {
+            fprintf(stderr, "No occlusion query bits\n");
+            occ_query = false;
+        }
+    }
+    if(!occ_query && cull_mode == CULL_QUERY)
+        cull_mode = CULL_CPU;
+    if(timer_query)
+        glGenQueriesARB_ptr(2, time_queries);
+    /*fetch framebuffer object functions*/
+    if(rt.enabled)
+    {
+        *(void **)(&glGenFramebuffersEXT_ptr) =
+            SDL_GL_GetProcAddress("glGenFramebuffersEXT");
+        *(void **)(&glDeleteFramebuffersEXT_ptr) =
+            SDL_GL_GetProcAddress("glDeleteFramebuffersEXT");
+        *(void **)(&glBindFramebufferEXT_ptr) =
+            SDL_GL_GetProcAddress("glBindFramebufferEXT");
+        *(void **)(&glFramebufferTexture2DEXT_ptr) =
+            SDL_GL_GetProcAddress("glFramebufferTexture2DEXT");
+        *(void **)(&glGenRenderbuffersEXT_ptr) =
+            SDL_GL_GetProcAddress("glGenRenderbuffersEXT");
+        *(void **)(&glDeleteRenderbuffersEXT_ptr) =
+            SDL_GL_GetProcAddress("glDeleteRenderbuffersEXT");
+        *(void **)(&glBindRenderbufferEXT_ptr) =
+            SDL_GL_GetProcAddress("glBindRenderbufferEXT");
+        *(void **)(&glRenderbufferStorageEXT_ptr) =
+            SDL_GL_GetProcAddress("glRenderbufferStorageEXT");
+        *(void **)(&glFramebufferRenderbufferEXT_ptr) =
+            SDL_GL_GetProcAddress("glFramebufferRenderbufferEXT");
+        *(void **)(&glCheckFramebufferStatusEXT_ptr) =
+            SDL_GL_GetProcAddress("glCheckFramebufferStatusEXT");
+        *(void **)(&glGenerateMipmapEXT_ptr) =
+            SDL_GL_GetProcAddress("glGenerateMipmapEXT");
+        if(!init_render_target(&rt, width_real, height_real))
+        {
+            fprintf(stderr, "Dynamic resolution disabled.\n");
+            rt.enabled = false;
+        }
+    }
+    /*system memory copies for software occlusion*/
+    if(!load_occluder_mesh(&occ_asteroid, m_asteroid.file_root) ||
+       !load_occluder_mesh(&occ_player,   m_player.file_root))
+        return 1;
+    /*fragments are cut from the occluder copy*/
+    if(!generate_fragments(&fragments, m_fragment, &occ_asteroid))
+        fprintf(stderr, "Asteroid fracture disabled.\n");
+    for(i = 0; i < FRACTURE_PIECES; i++)
+        m_ptr_all[7 + i] = &m_fragment[i];
+    reset_fragments(&fragments, a_aster);
+    /*load models*/
+    if(!load_models(m_ptr_all, fragments.enabled ? 7 + FRACTURE_PIECES : 7))
+        return 1;
+    init_occlusion(&occ, (occ_asteroid.index_count*MAX_OCCLUDERS +
+                          occ_player.index_count)/3,
+                   occ_asteroid.vertex_count > occ_player.vertex_count ?
+                   occ_asteroid.vertex_count : occ_player.vertex_count);
+    free(m_player.file_root);
+    free(m_projectile.file_root);
+    free(m_asteroid.file_root);
+    free(m_blast.file_root);
+    /*fetch program functions*/
+    *(void **)(&glCreateShader_ptr) =
+        SDL_GL_GetProcAddress("glCreateShader");
+    *(void **)(&glShaderSource_ptr) =
+        SDL_GL_GetProcAddress("glShaderSource");
+    *(void **)(&glCompileShader_ptr) =
+        SDL_GL_GetProcAddress("glCompileShader");
+    *(void **)(&glGetShaderiv_ptr) =
+        SDL_GL_GetProcAddress("glGetShaderiv");
+    *(void **)(&glGetShaderInfoLog_ptr) =
+        SDL_GL_GetProcAddress("glGetShaderInfoLog");
+    *(void **)(&glDeleteShader_ptr) =
+        SDL_GL_GetProcAddress("glDeleteShader");
+    *(void **)(&glCreateProgram_ptr) =
+        SDL_GL_GetProcAddress("glCreateProgram");
+    *(void **)(&glAttachShader_ptr) =
+        SDL_GL_GetProcAddress("glAttachShader");
+    *(void **)(&glBindAttribLocation_ptr) =
+        SDL_GL_GetProcAddress("glBindAttribLocation");
+    *(void **)(&glLinkProgram_ptr) =
+        SDL_GL_GetProcAddress("glLinkProgram");
+    *(void **)(&glGetProgramiv_ptr) =
+        SDL_GL_GetProcAddress("glGetProgramiv");
+    *(void **)(&glGetProgramInfoLog_ptr) =
+        SDL_GL_GetProcAddress("glGetProgramInfoLog");
+    *(void **)(&glDeleteProgram_ptr) =
+        SDL_GL_GetProcAddress("glDeleteProgram");
+    *(void **)(&glUseProgram_ptr) =
+        SDL_GL_GetProcAddress("glUseProgram");
+    *(void **)(&glGetUniformLocation_ptr) =
+        SDL_GL_GetProcAddress("glGetUniformLocation");
+    *(void **)(&glUniform1i_ptr) =
+        SDL_GL_GetProcAddress("glUniform1i");
+    *(void **)(&glUniform4fv_ptr) =
+        SDL_GL_GetProcAddress("glUniform4fv");
+    *(void **)(&glTexBufferARB_ptr) =
+        SDL_GL_GetProcAddress("glTexBufferARB");
+    *(void **)(&glActiveTexture_ptr) =
+        SDL_GL_GetProcAddress("glActiveTexture");
+    if(!glTexBufferARB_ptr || !glActiveTexture_ptr)
+        lights.enabled = false;
+    if(lights.enabled)      shader_header = cluster_header;
+    else if(flat_varyings)  shader_header = indirect_header_flat;
+    else                    shader_header = indirect_header;
+    /*every program function used is required*/
+    if(!glCreateShader_ptr      || !glShaderSource_ptr       ||
+       !glCompileShader_ptr     || !glGetShaderiv_ptr        ||
+       !glGetShaderInfoLog_ptr  || !glDeleteShader_ptr       ||
+       !glCreateProgram_ptr     || !glAttachShader_ptr       ||
+       !glBindAttribLocation_ptr || !glLinkProgram_ptr       ||
+       !glGetProgramiv_ptr      || !glGetProgramInfoLog_ptr  ||
+       !glDeleteProgram_ptr     || !glUseProgram_ptr         ||
+       !glGetUniformLocation_ptr || !glUniform1i_ptr         ||
+       !glUniform4fv_ptr)
+    {
+        fprintf(stderr, "GLSL programs not supported\n");
+        mdi.enabled    = false;
+        lights.enabled = false;
+    }
+    else if(!init_shading(&shading, shader_header))
+        fprintf(stderr, "GLSL shading disabled.\n");
+    /*fetch instancing functions*/
+    if(mdi.enabled)
+    {
+        *(void **)(&glVertexAttribPointer_ptr) =
+            SDL_GL_GetProcAddress("glVertexAttribPointer");
+        *(void **)(&glEnableVertexAttribArray_ptr) =
+            SDL_GL_GetProcAddress("glEnableVertexAttribArray");
+        *(void **)(&glBufferSubDataARB_ptr) =
+            SDL_GL_GetProcAddress("glBufferSubDataARB");
+        *(void **)(&glVertexAttribDivisorARB_ptr) =
+            SDL_GL_GetProcAddress("glVertexAttribDivisorARB");
+        *(void **)(&glMultiDrawElementsIndirect_ptr) =
+            SDL_GL_GetProcAddress("glMultiDrawElementsIndirect");
+        if(!init_indirect(&mdi, 2 + MAX_SHOTS + MAX_ASTEROIDS,
+                          shader_header))
+        {
+            fprintf(stderr, "Indirect drawing disabled.\n");
+            mdi.enabled = false;
+        }
+    }
+    /*point lights for both programs*/
+    light_programs[0] = shading.program;
+    light_programs[1] = mdi.program;
+    if(lights.enabled && (!shading.program ||
+                          !init_lights(&lights, light_programs, 2)))
+    {
+        fprintf(stderr, "Clustered lights disabled.\n");
+        lights.enabled = false;
+    }
+    mdi_models[0] = &m_player;
+    mdi_models[1] = &m_blast;
+    mdi_models[2] = &m_projectile;
+    mdi_models[3] = &m_asteroid;
+    /*start worker threads, leaving a core to the render thread*/
+    i = SDL_GetCPUCount() - 1;
+    if(i > 7) i = 7;
+    if(!init_workers(&workers, i))
+        fprintf(stderr, "Worker threads disabled.\n");
+    gravity.enabled = false;
+    if(use_gravity)
+    {
+        if(init_gravity(&gravity, MAX_ASTEROIDS + 1))
+        {
+            gravity.enabled = true;
+            gravity.theta   = gravity_theta;
+        }
+        else
+            fprintf(stderr, "Gravity disabled.\n");
+    }
+    bvh.count      = 0;
+    bvh.area       = 0.f;
+    bvh.built_area = 0.f;
+    bvh.builds     = 0;
+    init_events(&events);
+    /*one place for the timed behavior*/
+    if(!init_timers(&timers, 256, SDL_GetTicks()))
+        return 1;
+    add_timer(&timers, 30000, 30000, timer_set_flag, &spawn_due, 0);
+    add_timer(&timers, 500, 500, timer_set_flag, &title_due, 0);
+    if(!init_audio(&audio))
+        fprintf(stderr, "Audio disabled.\n");
+    beam_ok = init_beam(&beam, MAX_ASTEROIDS);
+    if(!beam_ok)
+        fprintf(stderr, "Beam disabled.\n");
+    if(extra_rays)
+    {
+        ray_load = malloc(sizeof(A3DRay)*extra_rays);
+        if(!ray_load)
+        {
+            fprintf(stderr, "Ray load disabled.\n");
+            extra_rays = 0;
+        }
+    }
+    /*load images*/
+    i_font.data = stbi_load(i_font.filename, &i_font.width, &i_font.height,
+                           &i_font.depth, 1);
+    i_skybox.data = stbi_load(i_skybox.filename, &i_skybox.width,
+                                &i_skybox.height, &i_skybox.depth, 1);
+    if(i_font.data && i_font.depth == 1)
+    {
+        unsigned char *packed;
+        unsigned pixbuffer;
+        int tbytes;
+        int bytes;
+        /*pack bitmap font and sprites into the atlas*/
+        if(!init_atlas(&atlas, 2*i_font.width, i_font.height) ||
+           !atlas_add(&atlas, i_font.data, i_font.width, i_font.height,
+                      16, 8, 0) || !atlas_sprites(&atlas))
+        {
+            fprintf(stderr, "Could not build texture atlas\n");
+            return 1;
+        }
+        printf("Loaded image %s - %dx%dx%d texture\n",
+                i_font.filename, i_font.width, i_font.height, i_font.depth);
+        free(i_font.data);
+        bytes = atlas.width * atlas.height;
+        packed = atlas.pixels;
+        atlas.pixels = NULL;
+        i_font.offset = 0;
+        /*pack skybox textures*/
+        tbytes = i_skybox.width * i_skybox.height;
+        if(!i_skybox.data || i_skybox.depth != 1)
+        {
+            fprintf(stderr, "Could not process image file %s\n",
+                    i_skybox.filename);
+            perror("fopen error");
+            return 1;
+        }
+        packed = realloc(packed, bytes + tbytes);
+        memcpy(packed + bytes, i_skybox.data, tbytes);
+        i_skybox.offset = bytes;
+        bytes += tbytes;
+        free(i_skybox.data);
+        printf("Loaded image %s - %dx%dx%d texture\n",
+                i_skybox.filename, i_skybox.width,
+                i_skybox.height, i_skybox.depth);
+        /*send packed data to device memory*/
+        glGenBuffersARB_ptr(1, &pixbuffer);
+        state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, pixbuffer);
+        glBufferDataARB_ptr(GL_PIXEL_UNPACK_BUFFER, bytes, packed,
+                            GL_STATIC_DRAW);
+        free(packed);
+        /*texture object*/
+        glGenTextures(2, texbuf);
+        state_bind_texture(texbuf[0]);
+        if(gen_mips)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                            GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP_SGIS, GL_TRUE);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state_bind_texture(texbuf[1]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if(red_tc) /*red channel compression*/
+        {
+            int txc;
+            state_bind_texture(texbuf[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1_EXT,
+                    atlas.width, atlas.height, 0, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_font.offset);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
+                    GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &txc);
+            printf("Texture atlas - RGTC Red channel compression: %d bytes\n",
+                    txc);
+            state_bind_texture(texbuf[1]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1_EXT,
+                    i_skybox.width, i_skybox.height, 0, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_skybox.offset);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
+                    GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &txc);
+            printf("%s - RGTC Red channel compression: %d bytes\n",
+                    i_skybox.filename, txc);
+        }
+        else /*no compression*/
+        {
+            state_bind_texture(texbuf[0]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY,
+                    atlas.width, atlas.height, 0, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_font.offset);
+            state_bind_texture(texbuf[1]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+                    i_skybox.width, i_skybox.height, 0, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_skybox.offset);
+        }
+        printf("Image uncompressed data total: %d bytes\n\n", bytes);
+        sprite_batch.count = 0;
+        glGenBuffersARB_ptr(1, &sprite_batch.buffer);
+        init_trails(&trails);
+    }
+    else
+    {
+        fprintf(stderr, "Could not process image file %s\n", i_font.filename);
+        perror("fopen error");
+        return 1;
+    }
+    free(i_font.filename);
+    free(i_skybox.filename);
+    /*setup*/
+    state_enable(GL_DEPTH_TEST);
+    state_enable(GL_CULL_FACE);
+    state_enable(GL_LIGHTING);
+    state_enable(GL_LIGHT0);
+    state_material(GL_SPECULAR, mat_specular);
+    glMateriali(GL_FRONT, GL_SHININESS, 127);
+    state_enable(GL_RESCALE_NORMAL);
+    state_enable(GL_FOG);
+    glFogi(GL_FOG_MODE, GL_LINEAR);
+    state_fog_range(500.f, 800.f);
+    state_blend_func(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
+    glShadeModel(GL_FLAT);
+    recorder.file = NULL;
+    if(record_file && !start_recorder(&recorder, record_file,
+                                      width_real, height_real))
+        return 1;
+    /*overdraw debug level*/
+    overdraw_ok = init_overdraw(&overdraw, occ_query);
+    if(!overdraw_ok)
+        fprintf(stderr, "Overdraw measurement disabled.\n");
+    /*asteroid impostor atlas*/
+    if(glGenerateMipmapEXT_ptr && !init_impostors(&impostors, m_asteroid))
+        fprintf(stderr, "Asteroid impostors disabled.\n");
+
+    prevtime  = SDL_GetTicks();
+    perf_freq = SDL_GetPerformanceFrequency();
+
+    /*spawn initial asteroids*/
+    if(bench_frames) srand(1); /*same field every run*/
+    else             srand((unsigned)time(NULL));
+    /*open world fields come from the generator*/
+    if(open_world && !init_sectors(&sectors, (unsigned)rand() + 1u))
+        fprintf(stderr, "Open world disabled.\n");
+    for(i = 0; i < init_asteroids && !sectors.enabled; i++)
+    {
+        a_aster[i].is_spawned      = true;
+        if(rand() & 0x01)      /*50%*/
+            a_aster[i].mass        = ASTER_MED;
+        else if(rand() & 0x01) /*25%*/
+            a_aster[i].mass        = ASTER_LARGE;
+        else                   /*25%*/
+            a_aster[i].mass        = ASTER_SMALL;
+        a_aster[i].pos.x           = (float)((rand()%500) - 250);
+        a_aster[i].pos.y           = (float)((rand()%500) - 250);
+        a_aster[i].pos.z           = ARENA_SIZE;
+        a_aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
+        a_aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
+        a_aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
+        a_aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
+        a_aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
+        a_aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+        spawn_static_actor(&a_aster[i]);
+    }
+    /*fixed lights for measuring lighting cost*/
+    if(extra_lights)
+        light_pos = malloc(sizeof(float)*3*extra_lights);
+    for(i = 0; i < extra_lights; i++)
+    {
+        light_pos[3*i]     = (float)((rand()%500) - 250);
+        light_pos[3*i + 1] = (float)((rand()%500) - 250);
+        light_pos[3*i + 2] = (float)((rand()%500) - 250);
+    }
+
+    /*main loop*/
+    while(!loop_exit)
+    {
+        do {
+            /*get previous frame time*/
+            currtime = SDL_GetTicks();
+            if(frametime < 0.0001f)
+            {
+                frametime = (float)(currtime - prevtime);
+                if(frametime > 250) frametime = 250;
+            }
+            /*min(frametime, target_time)*/
+            if(frametime > target_time)
+            {
+                mintime = target_time;
+                skip_dt = true;
+            }
+            else if(skip_dt)
+            {
+                skip_dt = false;
+                if(frametime > target_time*0.2f)
+                     mintime = frametime;
+                else mintime = target_time;
+            }
+            else mintime = frametime;
+        } while(frametime < 0.0001f);
+        perf_start = SDL_GetPerformanceCounter();
+        /*get time modifier*/
+        timemod = mintime/target_time;
+        sim_time += timemod;
+        difftime = currtime - prevtime;
+        prevtime = currtime;
+
+        /*events*/
+        while(SDL_PollEvent(&ev_main))
+        {
+            if(ev_main.type == SDL_QUIT)
+                loop_exit = true;
+            else if(ev_main.type == SDL_KEYDOWN)
+            {
+                if(ev_main.key.keysym.scancode == SDL_SCANCODE_ESCAPE)
+                    loop_exit     = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_BACKSPACE)
+                {
+                    if(camera.driftcam) camera.driftcam = false;
+                    else                camera.driftcam = true;
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_GRAVE)
+                {
+                    if(debug_level == 3 || (debug_level == 2 && !overdraw_ok))
+                         debug_level = 0;
+                    else debug_level++;
+                    overdraw.enabled = debug_level == 3;
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F1)
+                {
+                    int display;
+                    SDL_DisplayMode d_mode;
+                    if(fullscreen)
+                    {
+                        fullscreen = false;
+                        SDL_SetWindowFullscreen(win_main, 0);
+                        SDL_SetWindowSize(win_main, config.width,
+                                          config.height);
+                        SDL_GL_GetDrawableSize(win_main, &width_real,
+                                              &height_real);
+                    }
+                    else
+                    {
+                        fullscreen = true;
+                        display = SDL_GetWindowDisplayIndex(win_main);
+                        SDL_GetDesktopDisplayMode(display, &d_mode);
+                        SDL_SetWindowDisplayMode(win_main, &d_mode);
+                        SDL_SetWindowFullscreen(win_main,
+                                                SDL_WINDOW_FULLSCREEN);
+                        SDL_GL_GetDrawableSize(win_main, &width_real,
+                                              &height_real);
+                    }
+                    /*resize even while disabled, F2 may enable it*/
+                    if(rt.fbo && !init_render_target(&rt, width_real,
+                                                     height_real))
+                        rt.enabled = false;
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F2)
+                {
+                    /*toggle dynamic resolution*/
+                    if(rt.fbo)
+                    {
+                        if(rt.enabled) rt.enabled = false;
+                        else           rt.enabled = true;
+                    }
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F6)
+                {
+                    /*toggle GLSL shading*/
+                    if(shading.program)
+                    {
+                        if(shading.enabled) shading.enabled = false;
+                        else                shading.enabled = true;
+                    }
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F5)
+                {
+                    /*toggle overdraw heatmap*/
+                    if(overdraw.heatmap) overdraw.heatmap = false;
+                    else                 overdraw.heatmap = true;
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F4)
+                {
+                    /*cycle asteroid culling mode*/
+                    cull_mode = (cull_mode + 1) % 3;
+                    if(cull_mode == CULL_QUERY && !occ_query)
+                        cull_mode = CULL_CPU;
+                    started_query = false;
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F3)
+                {
+                    /*toggle indirect drawing*/
+                    if(mdi.program)
+                    {
+                        if(mdi.enabled) mdi.enabled = false;
+                        else            mdi.enabled = true;
+                    }
+                }
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_W)
+                    camera.forward  = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_S)
+                    camera.backward = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_A)
+                    camera.left     = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_D)
+                    camera.right    = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LSHIFT)
+                    camera.up       = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LCTRL)
+                    camera.down     = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_Q)
+                    camera.ccw      = true;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_E)
+                    camera.cw       = true;
+            }
+            else if(ev_main.type == SDL_KEYUP)
+            {
+                if(ev_main.key.keysym.scancode == SDL_SCANCODE_W)
+                    camera.forward  = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_S)
+                    camera.backward = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_A)
+                    camera.left     = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_D)
+                    camera.right    = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LSHIFT)
+                    camera.up       = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LCTRL)
+                    camera.down     = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_Q)
+                    camera.ccw      = false;
+                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_E)
+                    camera.cw       = false;
+            }
+            else if(ev_main.type == SDL_MOUSEMOTION)
+            {
+                a_player->euler_rot.yaw   = -camera.rotmod * camera.sens *
+                                            (float)ev_main.motion.xrel;
+                a_player->euler_rot.pitch = -camera.rotmod * camera.sens *
+                                            (float)ev_main.motion.yrel;
+            }
+            else if(ev_main.type == SDL_MOUSEBUTTONDOWN)
+            {
+                if(ev_main.button.button == SDL_BUTTON_LEFT)
+                    camera.shoot = true;
+                else if(ev_main.button.button == SDL_BUTTON_RIGHT)
+                    camera.beam  = true;
+            }
+            else if(ev_main.type == SDL_MOUSEBUTTONUP)
+            {
+                if(ev_main.button.button == SDL_BUTTON_LEFT)
+                    camera.shoot = false;
+                else if(ev_main.button.button == SDL_BUTTON_RIGHT)
+                    camera.beam  = false;
+            }
+        }
+
+        /*get view frustum values*/
+        top_clip = (float)tan(fov * camera.fovmod * radmod * 0.5f) * near_clip;
+        bottom_clip = -top_clip;
+        left_clip = aspect_ratio * bottom_clip;
+        right_clip = -left_clip;
+
+        /*follow the player through the open world*/
+        if(sectors.enabled)
+        {
+            float shift[3];
+            if(recenter_sectors(&sectors, a_player, shift))
+            {
+                a_player->pos.x += shift[0];
+                a_player->pos.y += shift[1];
+                a_player->pos.z += shift[2];
+                shift_actors(a_aster, MAX_ASTEROIDS, shift);
+                shift_actors(shots->columns[COMP_ACTOR], shots->count, shift);
+                if(a_blast)
+                    shift_actors(a_blast, 1, shift);
+                for(i = 0; i < world.queries[popup_query].count; i++)
+                {
+                    A3DArchetype *a = &world.archetypes[
+                                      world.queries[popup_query].archetypes[i]];
+                    float (*pos)[3] = a->columns[COMP_POS];
+                    for(j = 0; j < a->count; j++)
+                    {
+                        pos[j][0] -= shift[0];
+                        pos[j][1] -= shift[1];
+                        pos[j][2] -= shift[2];
+                    }
+                }
+                for(i = 0; i < MAX_SHOTS; i++)
+                    for(j = 0; j < TRAIL_POINTS; j++)
+                        for(k = 0; k < 3; k++)
+                            trails.history[i][j][k] -= shift[k];
+                for(i = 0; i < 3*extra_lights; i++)
+                    light_pos[i] -= shift[i % 3];
+                /*fragments left behind with their sectors*/
+                for(i = FIELD_ASTEROIDS; i < MAX_ASTEROIDS; i++)
+                {
+                    float p[3];
+                    if(!a_aster[i].is_spawned)
+                        continue;
+                    locate_static_actor(&a_aster[i]);
+                    p[0] = a_aster[i].pos.x;
+                    p[1] = a_aster[i].pos.y;
+                    p[2] = a_aster[i].pos.z;
+                    for(j = 0; j < 3; j++)
+                        if(p[j] > 1.5f*SECTOR_SIZE || p[j] < -1.5f*SECTOR_SIZE)
+                            break;
+                    if(j < 3)
+                        remove_asteroid(&fragments, a_aster, i);
+                }
+            }
+            stream_sectors(&sectors, a_aster);
+        }
+
+        /*update state*/
+        advance_timers(&timers, currtime);
+        if(camera.ccw)
+           a_player->euler_rot.roll =  camera.rollmod*camera.rotmod*timemod;
+        if(camera.cw)
+           a_player->euler_rot.roll = -camera.rollmod*camera.rotmod*timemod;
+        if(camera.shoot && a_player->is_spawned)
+        {
+            /*when button is pressed, or every 250 ms*/
+            if(shot_ready)
+            {
+                const int *slot = shots->columns[COMP_SLOT];
+                unsigned   used = 0, e = 0;
+                shot_ready = false;
+                shot_timer = add_timer(&timers, 250, 0, timer_set_flag,
+                                       &shot_ready, 0);
+                /*find free projectile slot*/
+                for(i = 0; i < shots->count; i++)
+                    used |= 1u << slot[i];
+                for(i = 0; i < MAX_SHOTS; i++)
+                    if(!(used & (1u << i)))
+                        break;
+                if(i < MAX_SHOTS)
+                    e = create_entity(&world, shot_mask);
+                if(e)
+                {
+                    A3DActor *shot = entity_component(&world, e, COMP_ACTOR);
+                    *(int *)entity_component(&world, e, COMP_SLOT) = i;
+                    memset(shot, 0, sizeof(A3DActor));
+                    shot->is_spawned = true;
+                    shot->pos.x = -a_player->pos.x;
+                    shot->pos.y = -a_player->pos.y;
+                    shot->pos.z = -a_player->pos.z;
+                    shot->vel.z = shot_speed;
+                    /*180 degree yaw applied to conj(player)*/
+                    shot->quat_orientation.x =-a_player->quat_orientation.z;
+                    shot->quat_orientation.y = a_player->quat_orientation.w;
+                    shot->quat_orientation.z = a_player->quat_orientation.x;
+                    shot->quat_orientation.w = a_player->quat_orientation.y;
+                    /*apply shot_speed to real vel vector*/
+                    get_shot_vel(shot);
+                    /*add player's velocity*/
+                    shot->vel.x -= a_player->vel.x;
+                    shot->vel.y -= a_player->vel.y;
+                    shot->vel.z -= a_player->vel.z;
+                    /*lead a locked target*/
+                    auto_aim(&aim, a_aster, a_player, shot, shot_speed);
+                    play_sound(&audio, SOUND_SHOT, 0.5f, 0.f);
+                }
+            }
+        }
+        else if(!shot_ready)
+        {
+            cancel_timer(&timers, shot_timer);
+            shot_ready = true;
+        }
+        /*mutual attraction, before anything reads positions*/
+        if(gravity.enabled)
+            step_gravity(&gravity, &workers, a_aster, MAX_ASTEROIDS,
+                         a_player, timemod);
+        /*ray queries see this step's positions*/
+        refit_bvh(&bvh, a_aster);
+        update_aim(&aim, &bvh, a_aster, a_player, timemod);
+        if(extra_rays && a_player->is_spawned)
+        {
+            const Uint64 ray_start = SDL_GetPerformanceCounter();
+            float        f[3];
+            aim_forward(a_player, f);
+            /*random rays ahead of the player, as bots would cast*/
+            for(i = 0; i < extra_rays; i++)
+            {
+                float *d = ray_load[i].dir, len;
+                d[0] = (float)(rand()%2001 - 1000);
+                d[1] = (float)(rand()%2001 - 1000);
+                d[2] = (float)(rand()%2001 - 1000);
+                len  = (float)sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+                if(len < 1.f)
+                    len = d[2] = 1.f;
+                if(d[0]*f[0] + d[1]*f[1] + d[2]*f[2] < 0.f)
+                    len = -len;
+                d[0] /= len;
+                d[1] /= len;
+                d[2] /= len;
+                ray_load[i].origin[0] = -a_player->pos.x;
+                ray_load[i].origin[1] = -a_player->pos.y;
+                ray_load[i].origin[2] = -a_player->pos.z;
+                ray_load[i].range     = AIM_RANGE;
+            }
+            ray_task.bvh   = &bvh;
+            ray_task.aster = a_aster;
+            ray_task.rays  = ray_load;
+            SDL_AtomicSet(&ray_task.hits, 0);
+            run_workers(&workers, cast_rays, &ray_task, extra_rays, 256);
+            ray_hits = (unsigned)SDL_AtomicGet(&ray_task.hits);
+            if(bench_frames)
+                bench_rays += (double)(SDL_GetPerformanceCounter() -
+                                       ray_start)*1000.0/(double)perf_freq;
+        }
+        /*hit-scan beam, resolved in this step's collisions*/
+        beam.hit = -1;
+        if(beam.show > 0.f)
+            beam.show -= timemod;
+        if(camera.beam && a_player->is_spawned && beam_ok)
+        {
+            if(beam_ready)
+            {
+                float dist = BEAM_RANGE, dir[3];
+                beam_ready = false;
+                beam_timer = add_timer(&timers, BEAM_RATE, 0, timer_set_flag,
+                                       &beam_ready, 0);
+                beam.start[0] = -a_player->pos.x;
+                beam.start[1] = -a_player->pos.y;
+                beam.start[2] = -a_player->pos.z;
+                aim_forward(a_player, dir);
+                load_beam(&beam, a_aster, MAX_ASTEROIDS);
+                j = beam_nearest(&beam, beam.start, dir, &dist);
+                if(j >= 0)
+                    beam.hit = beam.slot[j];
+                for(j = 0; j < 3; j++)
+                    beam.end[j] = beam.start[j] + dir[j]*dist;
+                beam.show = BEAM_SHOW;
+                play_sound(&audio, SOUND_SHOT, 0.3f, 0.f);
+            }
+        }
+        else if(!beam_ready)
+        {
+            cancel_timer(&timers, beam_timer);
+            beam_ready = true;
+        }
+        /*check asteroids, far ones less often*/
+        begin_sim_step(&sim_tiers, shots->columns[COMP_ACTOR], shots->count,
+                       a_player);
+        for(i = 0; i < MAX_ASTEROIDS; i++)
+        {
+            A3DEvent *ev;
+            A3DActor *shot = shots->columns[COMP_ACTOR];
+            float     dx, dy, dz;
+            bool      split;
+            int       hit  = -1;
+            if(!a_aster[i].is_spawned || !a_player->is_spawned)
+                continue;
+            /*located by refit_bvh() this step*/
+            if(!sim_due(&sim_tiers, i, &a_aster[i]) && i != beam.hit)
+                continue;
+            /*player collision*/
+            dx = a_aster[i].pos.x + a_player->pos.x;
+            dy = a_aster[i].pos.y + a_player->pos.y;
+            dz = a_aster[i].pos.z + a_player->pos.z;
+            /*check collision*/
+            if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) > 0.8f/(a_aster[i].mass))
+            {
+                ev = emit_event(&events, EVENT_PLAYER_DIED, i, NULL);
+                a_player->is_spawned = false;
+                ev->pos[0] = -a_player->pos.x;
+                ev->pos[1] = -a_player->pos.y;
+                ev->pos[2] = -a_player->pos.z;
+            }
+            /*projectile collision*/
+            for(j = 0; j < shots->count; j++)
+            {
+                /*get distance between shot and asteroid*/
+                dx = shot[j].pos.x - a_aster[i].pos.x;
+                dy = shot[j].pos.y - a_aster[i].pos.y;
+                dz = shot[j].pos.z - a_aster[i].pos.z;
+                /*check hit*/
+                if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) < 0.8f/a_aster[i].mass)
+                    continue;
+                hit = ((int *)shots->columns[COMP_SLOT])[j];
+                destroy_entity(&world, shots->entities[j]);
+                /*one hit per asteroid and step*/
+                break;
+            }
+            if(hit < 0 && i != beam.hit)
+                continue;
+            /*score and effects are left to the consumers,
+             *whole asteroids break into pieces from here,
+             *small ones and fragments are gone*/
+            split = i < FIELD_ASTEROIDS &&
+                    a_aster[i].mass > (ASTER_SMALL + ASTER_MED)*0.5f;
+            ev = emit_event(&events, EVENT_SHOT_HIT, i, &a_aster[i]);
+            ev->shot  = hit;
+            ev->split = split;
+            pose_static_actor(&a_aster[i], NULL);
+            if(split)
+            {
+                ev = emit_event(&events, EVENT_ASTEROID_SPLIT, i, &a_aster[i]);
+                ev->pieces = fracture_asteroid(&fragments, a_aster, i,
+                                               FRACTURE_MIN + rand()%
+                                               (FRACTURE_MAX - FRACTURE_MIN +
+                                                1));
+            }
+            else
+                remove_asteroid(&fragments, a_aster, i);
+        }
+        /*spawn new asteroid, sectors fill the open world*/
+        if(spawn_due && !sectors.enabled)
+        {
+            for(i = 0; i < FIELD_ASTEROIDS; i++)
+            {
+                if(a_aster[i].is_spawned)
+                    continue;
+                a_aster[i].is_spawned      = true;
+                if(rand() & 0x01) /*50%*/
+                    a_aster[i].mass        = ASTER_MED;
+                else              /*50%*/
+                    a_aster[i].mass        = ASTER_LARGE;
+                a_aster[i].pos.x           = (float)((rand()%500) - 250);
+                a_aster[i].pos.y           = (float)((rand()%500) - 250);
+                a_aster[i].pos.z           = ARENA_SIZE;
+                a_aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
+                a_aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
+                a_aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
+                a_aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
+                a_aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
+                a_aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+                spawn_static_actor(&a_aster[i]);
+                emit_event(&events, EVENT_ASTEROID_SPAWNED, i, &a_aster[i]);
+                break;
+            }
+        }
+        spawn_due = false;
+        /*consume the step's events*/
+        publish_events(&events);
+        j = poll_events(&events, event_batch, EVENT_BATCH);
+        for(i = 0; i < j; i++)
+        {
+            const A3DEvent *ev = &event_batch[i];
+            float dx = ev->pos[0] + a_player->pos.x,
+                  dy = ev->pos[1] + a_player->pos.y,
+                  dz = ev->pos[2] + a_player->pos.z,
+                  gain;
+            /*quieter with distance*/
+            gain = 200.f/(200.f + (float)sqrt(dx*dx + dy*dy + dz*dz));
+            event_counts[ev->type]++;
+            if(ev->type == EVENT_SHOT_HIT)
+            {
+                const char *text;
+                const unsigned e = create_entity(&world, popup_mask);
+                A3DPopup *popup  = entity_component(&world, e, COMP_POPUP);
+                float    *pos    = entity_component(&world, e, COMP_POS);
+                if(ev->slot >= FIELD_ASTEROIDS ||
+                   ev->mass < (ASTER_SMALL + ASTER_MED)*0.5f)
+                {
+                    score += 50;
+                    text   = "+50";
+                }
+                else if(ev->mass > (ASTER_LARGE + ASTER_MED)*0.5f)
+                {
+                    score += 10;
+                    text   = "+10";
+                }
+                else
+                {
+                    score += 20;
+                    text   = "+20";
+                }
+                /*spawn scoretext object*/
+                if(e)
+                {
+                    popup->age = 0.f;
+                    strcpy(popup->text, text);
+                    pos[0] = ev->pos[0];
+                    pos[1] = ev->pos[1];
+                    pos[2] = ev->pos[2];
+                }
+                if(!ev->split)
+                    play_sound(&audio, SOUND_HIT, gain, 0.f);
+            }
+            else if(ev->type == EVENT_ASTEROID_SPLIT)
+                play_sound(&audio, SOUND_SPLIT, gain, 0.f);
+            else if(ev->type == EVENT_PLAYER_DIED)
+            {
+                play_sound(&audio, SOUND_DEATH, 1.f, 0.f);
+                blast = create_entity(&world, blast_mask);
+                if(blast)
+                {
+                    A3DActor *b = entity_component(&world, blast, COMP_ACTOR);
+                    ((A3DBlast *)entity_component(&world, blast,
+                                                  COMP_BLAST))->rate = 20.f;
+                    *b                 = blast_start;
+                    b->pos.x           = ev->pos[0];
+                    b->pos.y           = ev->pos[1];
+                    b->pos.z           = ev->pos[2];
+                    b->euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
+                    b->euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
+                    b->euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+                }
+            }
+        }
+        step_events += (unsigned)j;
+        /*age score texts, follow with reticules, retire shots and
+         *grow the blast effect*/
+        run_systems(&world, timemod);
+        a_blast = entity_component(&world, blast, COMP_ACTOR);
+        if(!a_player->is_spawned && !a_blast) /*reset game*/
+        {
+            camera.fovmod = 1.f;
+            camera.pos_offset[2] = -5.f;
+            /*reset score*/
+            if(score > topscore) topscore = score;
+            score = 0;
+            reset_game(a_player, a_aster);
+            reset_fragments(&fragments, a_aster);
+            if(sectors.enabled)
+                reset_sectors(&sectors, a_aster);
+        }
+
+        /*** drawing ***/
+        if(timer_query)
+        {
+            /*result of the query issued last frame*/
+            int qavail = 0, qns = 0;
+            if(started_timer)
+            {
+                glGetQueryObjectivARB_ptr(time_queries[1],
+                        GL_QUERY_RESULT_AVAILABLE, &qavail);
+                if(qavail)
+                {
+                    glGetQueryObjectivARB_ptr(time_queries[1],
+                            GL_QUERY_RESULT, &qns);
+                    gpu_ms = (float)qns * 0.000001f;
+                }
+            }
+            glBeginQueryARB_ptr(GL_TIME_ELAPSED, time_queries[0]);
+        }
+        gl_state.issued  = 0;
+        gl_state.skipped = 0;
+        memset(&frame_stats, 0, sizeof(frame_stats));
+        memcpy(frame_stats.sim_tiers, sim_tiers.counts,
+               sizeof(sim_tiers.counts));
+        frame_stats.sim_updates = sim_tiers.updates;
+        frame_stats.rays        = a_player->is_spawned ? extra_rays : 0;
+        frame_stats.ray_hits    = ray_hits;
+        frame_stats.events      = step_events;
+        step_events             = 0;
+        /*overdraw is counted in the window's stencil buffer*/
+        if(rt.enabled && !overdraw.enabled)
+            begin_render_target(&rt);
+        else
+            glViewport(0, 0, width_real, height_real);
+        /*glClear() is affected by the write masks*/
+        state_color_mask(true);
+        state_depth_mask(true);
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        overdraw_begin_frame(&overdraw);
+        overdraw_pass(&overdraw, OVERDRAW_MODELS);
+        state_use_program(scene_program());
+        /*projection*/
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glFrustum(left_clip, right_clip, bottom_clip,
+                  top_clip,  near_clip,  far_clip);
+        /*modelview*/
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        /*lit solid objects*/
+        state_enable(GL_DEPTH_TEST);
+        state_enable(GL_CULL_FACE);
+        state_enable(GL_LIGHTING);
+        state_enable(GL_FOG);
+        state_disable(GL_BLEND);
+        state_disable(GL_TEXTURE_2D);
+        state_depth_mask(true);
+        state_fog_range(500.f, 800.f);
+        state_material(GL_AMBIENT,  mat_ambient);
+        state_material(GL_SPECULAR, mat_specular);
+        state_material(GL_EMISSION, mat_none);
+        /*player model*/
+        glTranslatef(camera.pos_offset[0], camera.pos_offset[1],
+                     camera.pos_offset[2]);
+        glRotatef(camera.roll, 0.f, 0.f, 1.f);
+        tmp_diffuse_color[0] = 1.f;
+        tmp_diffuse_color[1] = 1.f;
+        tmp_diffuse_color[2] = 1.f;
+        memset(mdi_counts, 0, sizeof(mdi_counts));
+        glGetFloatv(GL_MODELVIEW_MATRIX, player_matrix);
+        if(mdi.enabled)
+        {
+            /*player is drawn relative to the camera*/
+            if(a_player->is_spawned)
+            {
+                A3DInstance *inst = &mdi.instances[0];
+                memcpy(inst->model, player_matrix, sizeof(float)*16);
+                memcpy(inst->ambient,  mat_ambient,       sizeof(float)*4);
+                memcpy(inst->diffuse,  tmp_diffuse_color, sizeof(float)*4);
+                memcpy(inst->specular, mat_specular,      sizeof(float)*4);
+                memcpy(inst->emission, mat_none,          sizeof(float)*4);
+                mdi_counts[0] = 1;
+            }
+        }
+        else
+        {
+            state_material(GL_DIFFUSE, tmp_diffuse_color);
+            if(a_player->is_spawned) draw_model(m_player);
+        }
+        move_camera(&camera, timemod);
+        overdraw_pass(&overdraw, OVERDRAW_SKYBOX);
+        state_bind_texture(texbuf[1]);
+        draw_skybox(m_skybox, -a_player->pos.x, -a_player->pos.y,
+                    -a_player->pos.z);
+        glGetFloatv(GL_MODELVIEW_MATRIX, view_matrix);
+        overdraw_pass(&overdraw, OVERDRAW_MODELS);
+        /*shots and the blast light the scene, through the programs
+         *only; the fixed function path has no use for the list*/
+        if(lights.enabled && (shading.enabled || mdi.enabled))
+        {
+            const A3DActor *shot = shots->columns[COMP_ACTOR];
+            for(i = 0; i < shots->count; i++)
+                add_light(&lights, view_matrix, shot[i].pos.x,
+                          shot[i].pos.y, shot[i].pos.z, 30.f, shot_light);
+            if(a_blast)
+                add_light(&lights, view_matrix, a_blast->pos.x,
+                          a_blast->pos.y, a_blast->pos.z,
+                          a_blast->mass*4.f, blast_light);
+            for(i = 0; i < extra_lights; i++)
+                add_light(&lights, view_matrix, light_pos[3*i],
+                          light_pos[3*i + 1], light_pos[3*i + 2], 30.f,
+                          shot_light);
+            frame_stats.lights = lights.count;
+            upload_lights(&lights, near_clip, far_clip,
+                          near_clip/right_clip, near_clip/top_clip);
+        }
+        /*blast, on its own when measuring its overdraw*/
+        if(a_blast && mdi.enabled && !overdraw.enabled)
+        {
+            A3DInstance *inst = &mdi.instances[mdi_counts[0]];
+            actor_instance(a_blast, view_matrix, inst, a_blast->mass,
+                           timemod);
+            inst->ambient[0]  = inst->diffuse[0]  = 0.8f;
+            inst->ambient[1]  = inst->diffuse[1]  = 0.4f;
+            inst->ambient[2]  = inst->diffuse[2]  = 0.2f;
+            inst->ambient[3]  = inst->diffuse[3]  = 1.f;
+            inst->specular[0] = inst->specular[1] = 1.f;
+            inst->specular[2] = 0.f;
+            inst->specular[3] = 1.f;
+            memcpy(inst->emission, mat_none, sizeof(float)*4);
+            mdi_counts[1] = 1;
+        }
+        else if(a_blast)
+        {
+            state_enable(GL_LIGHTING);
+            state_enable(GL_FOG);
+            state_disable(GL_TEXTURE_2D);
+            state_depth_mask(true);
+            push_matrix();
+                tmp_diffuse_color[0] = 1.f;
+                tmp_diffuse_color[1] = 1.f;
+                tmp_diffuse_color[2] = 0.f;
+                state_material(GL_SPECULAR, tmp_diffuse_color);
+                tmp_diffuse_color[0] = 0.8f;
+                tmp_diffuse_color[1] = 0.4f;
+                tmp_diffuse_color[2] = 0.2f;
+                state_material(GL_AMBIENT,  tmp_diffuse_color);
+                state_material(GL_DIFFUSE,  tmp_diffuse_color);
+                transform_static_actor(a_blast, timemod);
+                glScalef(a_blast->mass, a_blast->mass, a_blast->mass);
+                overdraw_pass(&overdraw, OVERDRAW_BLAST);
+                draw_model(m_blast);
+                overdraw_pass(&overdraw, OVERDRAW_MODELS);
+            glPopMatrix();
+        }
+        /*** begin scene ***/
+        /*bounding box*/
+        state_disable(GL_LIGHTING);
+        state_enable(GL_FOG);
+        state_disable(GL_TEXTURE_2D);
+        state_depth_mask(true);
+        state_fog_range(200.f, 300.f);
+        state_color(0.8f, 0.f, 0.f);
+        overdraw_pass(&overdraw, OVERDRAW_BOUNDBOX);
+        if(!sectors.enabled)
+            draw_model(m_boundbox);
+        overdraw_pass(&overdraw, OVERDRAW_MODELS);
+        /*projectiles*/
+        state_enable(GL_LIGHTING);
+        state_fog_range(500.f, 800.f);
+        state_material(GL_AMBIENT,  mat_ambient);
+        state_material(GL_SPECULAR, mat_specular);
+        tmp_diffuse_color[0] = 1.f;
+        tmp_diffuse_color[1] = 1.f;
+        tmp_diffuse_color[2] = 1.f;
+        state_material(GL_DIFFUSE,  tmp_diffuse_color);
+        tmp_diffuse_color[0] = 0.f;
+        tmp_diffuse_color[1] = 1.f;
+        tmp_diffuse_color[2] = 1.f;
+        for(i = 0; i < shots->count; i++)
+        {
+            A3DActor *shot = (A3DActor *)shots->columns[COMP_ACTOR] + i;
+            if(mdi.enabled)
+            {
+                A3DInstance *inst = &mdi.instances[mdi_counts[0] +
+                                                   mdi_counts[1] +
+                                                   mdi_counts[2]];
+                actor_instance(shot, view_matrix, inst, 1.f, timemod);
+                memcpy(inst->ambient,  mat_ambient,  sizeof(float)*4);
+                memcpy(inst->specular, mat_specular, sizeof(float)*4);
+                inst->diffuse[0] = inst->diffuse[1] = 1.f;
+                inst->diffuse[2] = inst->diffuse[3] = 1.f;
+                memcpy(inst->emission, tmp_diffuse_color, sizeof(float)*4);
+                mdi_counts[2]++;
+                continue;
+            }
+            state_material(GL_EMISSION, tmp_diffuse_color);
+            push_matrix();
+                transform_static_actor(shot, timemod);
+                draw_model(m_projectile);
+            glPopMatrix();
+        }
+        update_trails(&trails, shots->columns[COMP_ACTOR],
+                      shots->columns[COMP_SLOT], shots->count);
+        /*asteroid visibility*/
+        if(cull_mode == CULL_CPU)
+        {
+            cull_start    = SDL_GetPerformanceCounter();
+            occ.scale_x   = near_clip/right_clip;
+            occ.scale_y   = near_clip/top_clip;
+            occ.near      = near_clip;
+            occ.view      = view_matrix;
+            occ.aster     = a_aster;
+            occ.visible   = aster_visible;
+            frame_stats.occluders = setup_occluders(&occ, &occ_asteroid,
+                    a_player->is_spawned ? &occ_player : NULL, player_matrix);
+            run_workers(&workers, rasterize_occluders, &occ,
+                        OCC_HEIGHT/OCC_BAND, 1);
+            run_workers(&workers, test_occlusion, &occ, MAX_ASTEROIDS, 8);
+            for(i = 0; i < MAX_ASTEROIDS; i++)
+                if(a_aster[i].is_spawned && !aster_visible[i])
+                    frame_stats.culled++;
+            bench_cull += (double)(SDL_GetPerformanceCounter() - cull_start)*
+                          1000.0/(double)perf_freq;
+        }
+        /*query results are read on the render thread*/
+        for(i = 0; i < MAX_ASTEROIDS && cull_mode != CULL_CPU; i++)
+        {
+            int qresult = 1;
+            aster_visible[i] = false;
+            if(!a_aster[i].is_spawned)
+                continue;
+            if(cull_mode == CULL_QUERY && started_query)
+            {
+                glGetQueryObjectivARB_ptr(aster_queries[i],
+                        GL_QUERY_RESULT, &qresult);
+                if(!qresult)
+                    frame_stats.queries_hidden++;
+            }
+            if(qresult)
+                aster_visible[i] = true;
+        }
+        /*distant asteroids*/
+        if(impostors.texture)
+            frame_stats.impostors = collect_impostors(&impostors, a_aster,
+                    aster_visible, view_matrix);
+        if(mdi.enabled)
+        {
+            /*fill asteroid instances on the workers, then draw all
+             *opaque models at once*/
+            aster_task.aster   = a_aster;
+            aster_task.visible = aster_visible;
+            aster_task.view    = view_matrix;
+            aster_task.out     = &mdi.instances[mdi_counts[0] +
+                                                mdi_counts[1] +
+                                                mdi_counts[2]];
+            SDL_AtomicSet(&aster_task.count, 0);
+            run_workers(&workers, fill_asteroid_instances, &aster_task,
+                        FIELD_ASTEROIDS, 16);
+            mdi_counts[3] = SDL_AtomicGet(&aster_task.count);
+            submit_indirect(&mdi, mdi_models, mdi_counts);
+        }
+        state_material(GL_EMISSION, mat_none);
+        for(i = 0; i < MAX_ASTEROIDS; i++)
+        {
+            /*the indirect pass has drawn the whole ones*/
+            if(!aster_visible[i] || (mdi.enabled && i < FIELD_ASTEROIDS))
+                continue;
+            asteroid_color(a_aster[i].mass, tmp_diffuse_color);
+            state_material(GL_DIFFUSE, tmp_diffuse_color);
+            push_matrix();
+                place_static_actor(&a_aster[i]);
+                glScalef(a_aster[i].mass, a_aster[i].mass, a_aster[i].mass);
+                if(i < FIELD_ASTEROIDS)
+                    draw_model(m_asteroid);
+                else
+                    draw_model(m_fragment[fragments.piece[i -
+                                                          FIELD_ASTEROIDS]]);
+            glPopMatrix();
+        }
+        /*asteroid occlusion queries*/
+        overdraw_pass(&overdraw, -1);
+        if(cull_mode == CULL_QUERY)
+        {
+            int sf;
+            glDeleteQueriesARB_ptr(MAX_ASTEROIDS, aster_queries);
+            glGenQueriesARB_ptr(MAX_ASTEROIDS, aster_queries);
+            if(occ_query2) sf = GL_ANY_SAMPLES_PASSED;
+            else           sf = GL_SAMPLES_PASSED_ARB;
+            state_disable(GL_LIGHTING);
+            state_depth_mask(false);
+            state_color_mask(false);
+            for(i = 0; i < MAX_ASTEROIDS; i++)
+            {
+                push_matrix();
+                    glBeginQueryARB_ptr(sf, aster_queries[i]);
+                    frame_stats.queries++;
+                    if(a_aster[i].is_spawned)
+                    {
+                        /*same pose as drawn, no second step*/
+                        place_static_actor(&a_aster[i]);
+                        glScalef(a_aster[i].mass*1.2f, a_aster[i].mass*1.2f,
+                                a_aster[i].mass*1.2f);
+                        draw_model(m_unitbox);
+                    }
+                    glEndQueryARB_ptr(sf);
+                glPopMatrix();
+            }
+            started_query = true;
+        }
+        /*impostors blend over the opaque scene*/
+        overdraw_pass(&overdraw, OVERDRAW_IMPOSTORS);
+        if(impostors.texture)
+            draw_impostors(&impostors);
+        overdraw_pass(&overdraw, OVERDRAW_TRAILS);
+        {
+            float eye[3];
+            eye[0] = -a_player->pos.x;
+            eye[1] = -a_player->pos.y;
+            eye[2] = -a_player->pos.z;
+            draw_trails(&trails, eye);
+        }
+        draw_beam(&beam);
+        overdraw_pass(&overdraw, OVERDRAW_TEXT);
+        /*2D assets all come from the atlas*/
+        state_bind_texture(texbuf[0]);
+        /*scoretext objects*/
+        for(i = 0; i < world.queries[popup_query].count; i++)
+        {
+            A3DArchetype *a = &world.archetypes[
+                              world.queries[popup_query].archetypes[i]];
+            const A3DPopup *popup = a->columns[COMP_POPUP];
+            const float (*pos)[3] = a->columns[COMP_POS],
+                        (*ori)[4] = a->columns[COMP_ORI];
+            for(j = 0; j < a->count; j++)
+            {
+                scoretext.pos.x = pos[j][0];
+                scoretext.pos.y = pos[j][1];
+                scoretext.pos.z = pos[j][2];
+                scoretext.ori.x = ori[j][0];
+                scoretext.ori.y = ori[j][1];
+                scoretext.ori.z = ori[j][2];
+                scoretext.ori.w = ori[j][3];
+                state_enable(GL_DEPTH_TEST);
+                state_color(0.5f - 0.5f*popup[j].age,
+                            1.f - popup[j].age, 0.f);
+                push_matrix();
+                    orient_text(scoretext);
+                    draw_text(popup[j].text, 10.f, false);
+                glPopMatrix();
+            }
+        }
+        /*mark the aimed at asteroid, red when locked*/
+        if(a_player->is_spawned && aim.target >= 0)
+        {
+            target_mark.pos.x = a_aster[aim.target].pos.x;
+            target_mark.pos.y = a_aster[aim.target].pos.y;
+            target_mark.pos.z = a_aster[aim.target].pos.z;
+            target_mark.ori.x = -a_player->quat_orientation.x;
+            target_mark.ori.y = -a_player->quat_orientation.y;
+            target_mark.ori.z = -a_player->quat_orientation.z;
+            target_mark.ori.w =  a_player->quat_orientation.w;
+            state_disable(GL_DEPTH_TEST);
+            if(aim.locked)
+                state_color(1.f, 0.2f, 0.2f);
+            else
+                state_color(1.f, 1.f, 0.2f);
+            push_matrix();
+                orient_text(target_mark);
+                batch_sprite(&sprite_batch, ATLAS_RETICULE, 0.f, 0.f,
+                             1.5f*a_aster[aim.target].mass);
+                flush_batch(&sprite_batch);
+            glPopMatrix();
+        }
+        /*targeting reticules*/
+        for(i = 0; a_player->is_spawned &&
+                   i < world.queries[sight_query].count; i++)
+        {
+            A3DArchetype *a = &world.archetypes[
+                              world.queries[sight_query].archetypes[i]];
+            const A3DSight *sight = a->columns[COMP_SIGHT];
+            const float (*pos)[3] = a->columns[COMP_POS],
+                        (*ori)[4] = a->columns[COMP_ORI];
+            for(j = 0; j < a->count; j++)
+            {
+                scoretext.pos.x = pos[j][0];
+                scoretext.pos.y = pos[j][1];
+                scoretext.pos.z = pos[j][2];
+                scoretext.ori.x = ori[j][0];
+                scoretext.ori.y = ori[j][1];
+                scoretext.ori.z = ori[j][2];
+                scoretext.ori.w = ori[j][3];
+                state_disable(GL_DEPTH_TEST);
+                state_color(1.f, 1.f, 1.f);
+                push_matrix();
+                    orient_text(scoretext);
+                    batch_sprite(&sprite_batch, sight[j].sprite, 0.f, 0.f,
+                                 0.03f*sight[j].offset);
+                    flush_batch(&sprite_batch);
+                glPopMatrix();
+            }
+        }
+        overdraw_end_frame(&overdraw, width_real, height_real);
+        if(overdraw.enabled && overdraw.heatmap)
+            draw_overdraw_heatmap();
+        /*upscale scene to window*/
+        if(rt.enabled && !overdraw.enabled)
+            end_render_target(&rt, width_real, height_real);
+        if(timer_query)
+        {
+            unsigned tq     = time_queries[0];
+            glEndQueryARB_ptr(GL_TIME_ELAPSED);
+            time_queries[0] = time_queries[1];
+            time_queries[1] = tq;
+            started_timer   = true;
+        }
+        /*bitmap text*/
+        if(debug_level)
+        {
+            glMatrixMode(GL_PROJECTION);
+            glLoadIdentity();
+            glOrtho(-aspect_ratio, aspect_ratio, -1.f, 1.f, -1.f, 1.f);
+            glMatrixMode(GL_MODELVIEW);
+            glLoadIdentity();
+            state_disable(GL_DEPTH_TEST);
+            state_color(1.f, 1.f, 1.f);
+            state_bind_texture(texbuf[0]);
+            /*one batch for the whole overlay*/
+            batch_text(&sprite_batch, t_relvel, -aspect_ratio*0.5f, -0.94f,
+                       aspect_ratio, false);
+            batch_text(&sprite_batch, t_score, -aspect_ratio + 0.01f, 0.98f,
+                       0.02f, true);
+            batch_text(&sprite_batch, t_topscore, -aspect_ratio + 0.01f,
+                       0.94f, 0.02f, true);
+            if(debug_level > 1)
+            {
+                batch_text(&sprite_batch, t_fps, aspect_ratio*0.8f, 0.98f,
+                           0.02f, true);
+                batch_text(&sprite_batch, t_mspf, aspect_ratio*0.8f, 0.94f,
+                           0.02f, true);
+                batch_text(&sprite_batch, t_res, aspect_ratio*0.8f - 0.16f,
+                           0.90f, 0.02f, true);
+                batch_text(&sprite_batch, t_state, -aspect_ratio + 0.01f,
+                           0.86f, 0.02f, true);
+                batch_text(&sprite_batch, t_draws, -aspect_ratio + 0.01f,
+                           0.82f, 0.02f, true);
+                batch_text(&sprite_batch, t_cull, -aspect_ratio + 0.01f,
+                           0.78f, 0.02f, true);
+                if(recorder.file)
+                    batch_text(&sprite_batch, t_rec, -aspect_ratio + 0.01f,
+                               0.74f, 0.02f, true);
+                if(sectors.enabled)
+                    batch_text(&sprite_batch, t_sector,
+                               -aspect_ratio + 0.01f, 0.66f, 0.02f, true);
+                batch_text(&sprite_batch, t_sim, -aspect_ratio + 0.01f,
+                           0.62f, 0.02f, true);
+                batch_text(&sprite_batch, t_ray, -aspect_ratio + 0.01f,
+                           0.58f, 0.02f, true);
+                batch_text(&sprite_batch, t_events, -aspect_ratio + 0.01f,
+                           0.54f, 0.02f, true);
+                if(audio.device)
+                    batch_text(&sprite_batch, t_audio,
+                               -aspect_ratio + 0.01f, 0.50f, 0.02f, true);
+            }
+            if(debug_level > 2)
+                batch_text(&sprite_batch, t_overdraw, -aspect_ratio + 0.01f,
+                           0.70f, 0.02f, true);
+            flush_batch(&sprite_batch);
+        }
+        /*presented frame, with overlays*/
+        if(recorder.file)
+            capture_frame(&recorder, width_real, height_real);
+        /*** end scene ***/
+        cpu_ms = (float)((double)(SDL_GetPerformanceCounter() - perf_start)*
+                         1000.0/(double)perf_freq);
+        if(rt.enabled)
+        {
+            /*frame cost, ignoring time spent waiting on vsync*/
+            float cost = cpu_ms > gpu_ms ? cpu_ms : gpu_ms;
+            if((float)difftime > target_time*1.2f && (float)difftime > cost)
+                cost = (float)difftime;
+            update_render_scale(&rt, cost);
+        }
+        SDL_GL_SwapWindow(win_main);
+        frametime -= mintime;
+        /*benchmark totals*/
+        if(bench_frames)
+        {
+            bench_ms      += (double)difftime;
+            bench_cpu     += (double)cpu_ms;
+            bench_gpu     += (double)gpu_ms;
+            bench_issued  += (double)gl_state.issued;
+            bench_skipped += (double)gl_state.skipped;
+            bench_total.draw_calls     += frame_stats.draw_calls;
+            bench_total.indices        += frame_stats.indices;
+            bench_total.matrix_pushes  += frame_stats.matrix_pushes;
+            bench_total.texture_binds  += frame_stats.texture_binds;
+            bench_total.queries        += frame_stats.queries;
+            bench_total.queries_hidden += frame_stats.queries_hidden;
+            bench_total.occluders      += frame_stats.occluders;
+            bench_total.culled         += frame_stats.culled;
+            bench_total.impostors      += frame_stats.impostors;
+            bench_total.lights         += frame_stats.lights;
+            bench_total.sim_updates    += frame_stats.sim_updates;
+            bench_total.rays           += frame_stats.rays;
+            bench_total.ray_hits       += frame_stats.ray_hits;
+            bench_total.events         += frame_stats.events;
+            for(i = 0; i < SIM_TIERS; i++)
+                bench_total.sim_tiers[i] += frame_stats.sim_tiers[i];
+            if(++frame_count >= (unsigned)bench_frames)
+                loop_exit = true;
+        }
+        /*update text/window title*/
+        if(title_due)
+        {
+            const A3DActor *p = a_player;
+            float relvel = 16.f/(inv_sqrt_dwh(p->vel.x*p->vel.x +
+                                              p->vel.y*p->vel.y +
+                                              p->vel.z*p->vel.z));
+            title_due = false;
+            sprintf(t_mspf,     "%u ms/F", difftime);
+            sprintf(t_fps,      "%.2f FPS", 1000.f/(float)difftime);
+            if(rt.enabled)
+                 sprintf(t_res, "Res: %3d%% %dx%d", (int)(rt.scale*100.f),
+                         rt.view_width, rt.view_height);
+            else sprintf(t_res, "Res: native");
+            sprintf(t_state, "GL state: %u set %u skipped",
+                    gl_state.issued, gl_state.skipped);
+            sprintf(t_draws,
+                    "Draws: %u Idx: %u Push: %u Tex: %u Query: %u/%u",
+                    frame_stats.draw_calls, frame_stats.indices,
+                    frame_stats.matrix_pushes, frame_stats.texture_binds,
+                    frame_stats.queries_hidden, frame_stats.queries);
+            sprintf(t_cull, "Cull: %s Occluders: %u Culled: %u Imp: %u "
+                    "Lights: %u", cull_names[cull_mode],
+                    frame_stats.occluders,
+                    frame_stats.culled + frame_stats.queries_hidden,
+                    frame_stats.impostors, frame_stats.lights);
+            sprintf(t_sim, "Sim: %u/%u/%u Updates: %u",
+                    frame_stats.sim_tiers[0], frame_stats.sim_tiers[1],
+                    frame_stats.sim_tiers[2], frame_stats.sim_updates);
+            sprintf(t_ray, "Rays: %u Hits: %u BVH builds: %u%s",
+                    frame_stats.rays, frame_stats.ray_hits, bvh.builds,
+                    aim.locked ? " Locked" : "");
+            sprintf(t_events, "Events: %u Hit: %u Split: %u Died: %u "
+                    "Spawned: %u Dropped: %u", frame_stats.events,
+                    event_counts[EVENT_SHOT_HIT],
+                    event_counts[EVENT_ASTEROID_SPLIT],
+                    event_counts[EVENT_PLAYER_DIED],
+                    event_counts[EVENT_ASTEROID_SPAWNED], events.dropped);
+            sprintf(t_audio, "Audio: %u dropped %u stolen",
+                    audio.dropped, audio.stolen);
+            if(recorder.file)
+                sprintf(t_rec, "Rec: %u frames %u dropped",
+                        recorder.frames, recorder.dropped);
+            if(sectors.enabled)
+                sprintf(t_sector, "Sector: %d %d %d Live: %d/%d Fields: %u",
+                        sectors.center[0], sectors.center[1],
+                        sectors.center[2], sectors.loaded, SECTOR_SLOTS,
+                        sectors.generated);
+            if(overdraw.enabled)
+            {
+                int n = sprintf(t_overdraw, "Overdraw: %.2f avg %d max",
+                                overdraw.average, overdraw.max);
+                for(i = 0; i < OVERDRAW_PASSES && overdraw.use_queries; i++)
+                    n += sprintf(t_overdraw + n, " %s %.2f",
+                                 overdraw_names[i], overdraw.pass_layers[i]);
+            }
+            sprintf(t_relvel,   "Relative velocity: %.2f m/s", relvel);
+            sprintf(t_score,    "Score:     %u", score);
+            sprintf(t_topscore, "Top Score: %u", topscore);
+            sprintf(win_title, "Asteroids 3D - %s - %s --- %s --- %s",
+                    t_score, t_topscore, t_relvel, t_fps);
+            SDL_SetWindowTitle(win_main, win_title);
+        }
+    }
+
+    if(bench_frames)
+        print_bench_json(frame_count, bench_ms, bench_cpu, bench_gpu,
+                         bench_total, bench_issued, bench_skipped,
+                         cull_names[cull_mode], bench_cull, bench_rays);
+
+    /*cleanup*/
+    if(recorder.file)
+        stop_recorder(&recorder);
+    free_workers(&workers);
+    glDeleteBuffersARB_ptr(1, &sprite_batch.buffer);
+    glDeleteBuffersARB_ptr(1, &trails.buffer);
+    if(lights.enabled)
+    {
+        glDeleteTextures(1, &lights.texture);
+        glDeleteBuffersARB_ptr(1, &lights.buffer);
+        free(lights.texels);
+    }
+    free(light_pos);
+    if(sectors.enabled)
+        free_sectors(&sectors);
+    if(gravity.enabled)
+        free_gravity(&gravity);
+    free(ray_load);
+    if(beam_ok)
+        free_beam(&beam);
+    free_audio(&audio);
+    free_timers(&timers);
+    free_world(&world);
+    if(overdraw_ok)
+    {
+        glDeleteBuffersARB_ptr(2, overdraw.pbo);
+        if(overdraw.use_queries)
+            glDeleteQueriesARB_ptr(2*OVERDRAW_SEGMENTS, overdraw.queries[0]);
+    }
+    if(impostors.texture)
+    {
+        glDeleteTextures(1, &impostors.texture);
+        glDeleteBuffersARB_ptr(1, &impostors.buffer);
+        free(impostors.quads);
+    }
+    free(occ.depth);
+    free(occ.screen);
+    free(occ.tris);
+    free(occ_asteroid.vertices);
+    free(occ_asteroid.indices);
+    free(occ_player.vertices);
+    free(occ_player.indices);
+    state_use_program(0);
+    if(shading.program)
+        glDeleteProgram_ptr(shading.program);
+    if(mdi.program)
+    {
+        state_bind_vertex_array(0);
+        glDeleteProgram_ptr(mdi.program);
+        glDeleteVertexArrays_ptr(1, &mdi.vao);
+        glDeleteBuffersARB_ptr(1, &mdi.instance_buffer);
+        glDeleteBuffersARB_ptr(1, &mdi.command_buffer);
+        free(mdi.instances);
+    }
+    if(rt.fbo)
+    {
+        glDeleteFramebuffersEXT_ptr(1, &rt.fbo);
+        glDeleteRenderbuffersEXT_ptr(1, &rt.depth_rb);
+        glDeleteTextures(1, &rt.color_tex);
+    }
+    if(glGetError() != GL_NO_ERROR)
+        fprintf(stderr, "GL encountered an error durring execution\n");
+    SDL_GL_DeleteContext(win_main_gl);
+    SDL_DestroyWindow(win_main);
+    SDL_Quit();
+    return 0;
+}
+
+void reset_game(A3DActor *player, A3DActor *aster)
+{
+    int i;
+    /*reset player*/
+    player->is_spawned         = true;
+    player->pos.x              = 0.f;
+    player->pos.y              = 0.f;
+    player->pos.z              = 0.f;
+    player->vel.x              = 0.f;
+    player->vel.y              = 0.f;
+    player->vel.z              = 0.f;
+    player->quat_orientation.x = 0.f;
+    player->quat_orientation.y = 0.f;
+    player->quat_orientation.z = 0.f;
+    player->quat_orientation.w = 1.f;
+    player->euler_rot.yaw      = 0.f;
+    player->euler_rot.pitch    = 0.f;
+    player->euler_rot.roll     = 0.f;
+    /*reset asteroids*/
+    for(i = 0; i < MAX_ASTEROIDS; i++)
+    {
+        aster[i].is_spawned      = false;
+        if(i >= INIT_ASTEROIDS) continue;
+        aster[i].is_spawned      = true;
+        if(rand() & 0x01)      /*50%*/
+            aster[i].mass        = ASTER_MED;
+        else if(rand() & 0x01) /*25%*/
+            aster[i].mass        = ASTER_LARGE;
+        else                   /*25%*/
+            aster[i].mass        = ASTER_SMALL;
+        aster[i].pos.x           = (float)((rand()%500) - 250);
+        aster[i].pos.y           = (float)((rand()%500) - 250);
+        aster[i].pos.z           = ARENA_SIZE;
+        aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
+        aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
+        aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
+        aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
+        aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
+        aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+        spawn_static_actor(&aster[i]);
+    }
+}
+
+void get_shot_vel(A3DActor *obj)
+{
+    float *x = &(obj->quat_orientation.x),
+          *y = &(obj->quat_orientation.y),
+          *z = &(obj->quat_orientation.z),
+          *w = &(obj->quat_orientation.w);
+
+    obj->vel.x = obj->vel.z * (2.f*(*x)*(*z) - 2.f*(*y)*(*w));
+    obj->vel.y = obj->vel.z * (2.f*(*y)*(*z) + 2.f*(*x)*(*w));
+    obj->vel.z = obj->vel.z * (1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y));
+}
+
+void orient_text(const A3DScoreText t)
+{
+    float m[16];
+
+    /*quat -> transposed rotation matrix
+     *
+     * | x(x) y(x) z(x) tx |
+     * | x(y) y(y) z(y) ty |
+     * | x(z) y(z) z(z) tz |
+     * |  0    0    0    1 |
+     *
+     * where x() is the x axis direction,
+     * y() is the y axis direction, and
+     * z() is the z axis direction. Each
+     * axis has a (x,y,z) component.
+     */
+    m[0] = 1.f - 2.f*(t.ori.y)*(t.ori.y) - 2.f*(t.ori.z)*(t.ori.z);
+    m[1] = 2.f*(t.ori.x)*(t.ori.y) - 2.f*(t.ori.z)*(t.ori.w);
+    m[2] = 2.f*(t.ori.x)*(t.ori.z) + 2.f*(t.ori.y)*(t.ori.w);
+    m[3] = 0.f;
+
+    m[4] = 2.f*(t.ori.x)*(t.ori.y) + 2.f*(t.ori.z)*(t.ori.w);
+    m[5] = 1.f - 2.f*(t.ori.x)*(t.ori.x) - 2.f*(t.ori.z)*(t.ori.z);
+    m[6] = 2.f*(t.ori.y)*(t.ori.z) - 2.f*(t.ori.x)*(t.ori.w);
+    m[7] = 0.f;
+
+    m[8] = 2.f*(t.ori.x)*(t.ori.z) - 2.f*(t.ori.y)*(t.ori.w);
+    m[9] = 2.f*(t.ori.y)*(t.ori.z) + 2.f*(t.ori.x)*(t.ori.w);
+    m[10] = 1.f - 2.f*(t.ori.x)*(t.ori.x) - 2.f*(t.ori.y)*(t.ori.y);
+    m[11] = 0.f;
+
+    m[12] = t.pos.x;
+    m[13] = t.pos.y;
+    m[14] = t.pos.z;
+    m[15] = 1.f;
+
+    glMultMatrixf(m);
+}
+
+void rotate_static_actor(A3DActor *obj, float *m, float dt)
+{
+    float tmp, x2, y2, z2, w2,
+          s1, s2, s3, c1, c2, c3;
+    float *x = &(obj->quat_orientation.x),
+          *y = &(obj->quat_orientation.y),
+          *z = &(obj->quat_orientation.z),
+          *w = &(obj->quat_orientation.w);
+
+    /*euler -> quat*/
+    s1 = (float)sin(obj->euler_rot.yaw   * 0.5f * dt);
+    s2 = (float)sin(obj->euler_rot.roll  * 0.5f * dt);
+    s3 = (float)sin(obj->euler_rot.pitch * 0.5f * dt);
+    c1 = (float)cos(obj->euler_rot.yaw   * 0.5f * dt);
+    c2 = (float)cos(obj->euler_rot.roll  * 0.5f * dt);
+    c3 = (float)cos(obj->euler_rot.pitch * 0.5f * dt);
+    w2 = c1*c2*c3 - s1*s2*s3;
+    x2 = s1*s2*c3 + c1*c2*s3;
+    y2 = s1*c2*c3 + c1*s2*s3;
+    z2 = c1*s2*c3 - s1*c2*s3;
+    /*normalize*/
+    tmp = x2*x2 + y2*y2 + z2*z2 + w2*w2;
+    if((float)fabs(tmp - 1.f) > SQRT_TOLERANCE)
+    {
+        if(tmp > SQRT_TOLERANCE)
+        {
+            tmp = inv_sqrt_dwh(tmp);
+            x2 *= tmp;
+            y2 *= tmp;
+            z2 *= tmp;
+            w2 *= tmp;
+        }
+        else /*identity*/
+        {
+            w2 = 1.f;
+            x2 = 0.f;
+            y2 = 0.f;
+            z2 = 0.f;
+        }
+    }
+
+    /*multiply quats*/
+    s1 = *w*x2 + *x*w2 + *y*z2 - *z*y2;
+    s2 = *w*y2 + *y*w2 + *z*x2 - *x*z2;
+    s3 = *w*z2 + *z*w2 + *x*y2 - *y*x2;
+    *w = *w*w2 - *x*x2 - *y*y2 - *z*z2;
+    *x = s1;
+    *y = s2;
+    *z = s3;
+
+    /*quat -> transposed rotation matrix
+     *
+     * | x(x) y(x) z(x) tx |
+     * | x(y) y(y) z(y) ty |
+     * | x(z) y(z) z(z) tz |
+     * |  0    0    0    1 |
+     *
+     * where x() is the x axis direction,
+     * y() is the y axis direction, and
+     * z() is the z axis direction. Each
+     * axis has a (x,y,z) component.
+     */
+    m[0] = 1.f - 2.f*(*y)*(*y) - 2.f*(*z)*(*z);
+    m[1] = 2.f*(*x)*(*y) - 2.f*(*z)*(*w);
+    m[2] = 2.f*(*x)*(*z) + 2.f*(*y)*(*w);
+    m[3] = 0.f;
+
+    m[4] = 2.f*(*x)*(*y) + 2.f*(*z)*(*w);
+    m[5] = 1.f - 2.f*(*x)*(*x) - 2.f*(*z)*(*z);
+    m[6] = 2.f*(*y)*(*z) - 2.f*(*x)*(*w);
+    m[7] = 0.f;
+
+    m[8] = 2.f*(*x)*(*z) - 2.f*(*y)*(*w);
+    m[9] = 2.f*(*y)*(*z) + 2.f*(*x)*(*w);
+    m[10] = 1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y);
+    m[11] = 0.f;
+}
+
+void translate_static_actor(A3DActor *obj, float *m, float dt)
+{
+    float *x = &(obj->pos.x),
+          *y = &(obj->pos.y),
+          *z = &(obj->pos.z);
+
+    /*move along vel vector*/
+    *x += obj->vel.x * dt;
+    *y += obj->vel.y * dt;
+    *z += obj->vel.z * dt;
+    /*wrap position, unless the world is open*/
+    if(!sectors.enabled)
+    {
+        if(*x >  ARENA_SIZE)
+           *x = -ARENA_SIZE + 0.001f;
+        if(*x < -ARENA_SIZE)
+           *x =  ARENA_SIZE - 0.001f;
+        if(*y >  ARENA_SIZE)
+           *y = -ARENA_SIZE + 0.001f;
+        if(*y < -ARENA_SIZE)
+           *y =  ARENA_SIZE - 0.001f;
+        if(*z >  ARENA_SIZE)
+           *z = -ARENA_SIZE + 0.001f;
+        if(*z < -ARENA_SIZE)
+           *z =  ARENA_SIZE - 0.001f;
+    }
+
+    /*update translation component of matrix*/
+    m[12] = *x;
+    m[13] = *y;
+    m[14] = *z;
+    m[15] = 1.f;
+}
+
+void transform_static_actor(A3DActor *obj, float dt)
+{
+    float m[16];
+    rotate_static_actor(obj, m, dt);
+    translate_static_actor(obj, m, dt);
+    glMultMatrixf(m);
+}
+
+void move_camera(A3DCamera *cam, float dt)
+{
+    static float zz = 0.02f, yacc, pacc;
+    float s1, s2, s3, m[16];
+    float *x = &(cam->player->pos.x),
+          *y = &(cam->player->pos.y),
+          *z = &(cam->player->pos.z);
+
+    /*camera movement panning/zooming*/
+    if((float)fabs(cam->player->euler_rot.yaw) < 0.000001f)
+    {
+        if(yacc < 1000.f) yacc += dt;
+    }
+    else yacc = 0.f;
+    if((float)fabs(cam->player->euler_rot.pitch) < 0.000001f)
+    {
+        if(pacc < 1000.f) pacc += dt;
+    }
+    else pacc = 0.f;
+    if(cam->driftcam)
+    {
+        cam->roll += cam->player->euler_rot.yaw * 0.5f * dt/radmod;
+        cam->pos_offset[1] -= cam->player->euler_rot.pitch * 0.02f * dt/radmod;
+    }
+    if(yacc > 10.f || !cam->driftcam)
+    {
+        if(cam->roll < -1.f)     cam->roll += 0.5f*dt;
+        else if(cam->roll > 1.f) cam->roll -= 0.5f*dt;
+        else                     cam->roll = 0.f;
+    }
+    if(pacc > 10.f || !cam->driftcam)
+    {
+        if(cam->pos_offset[1] < -2.05f)      cam->pos_offset[1] += 0.02f*dt;
+        else if(cam->pos_offset[1] > -1.95f) cam->pos_offset[1] -= 0.02f*dt;
+        else                                 cam->pos_offset[1] = -2.f;
+    }
+    cam->pos_offset[0] = 0.1f * cam->roll;
+    if(cam->roll > 15.f)
+       cam->roll = 15.f;
+    if(cam->roll < -15.f)
+       cam->roll = -15.f;
+    if(cam->pos_offset[1] < -3.f)
+       cam->pos_offset[1] = -3.f;
+    if(cam->pos_offset[1] > -1.f)
+       cam->pos_offset[1] = -1.f;
+
+    /*update rotation*/
+    rotate_static_actor(cam->player, m, dt);
+    /*stop applying rotation*/
+    cam->player->euler_rot.yaw   = 0.f;
+    cam->player->euler_rot.roll  = 0.f;
+    cam->player->euler_rot.pitch = 0.f;
+
+    if(cam->player->is_spawned)
+    {
+        /*increment velocity*/
+        if(cam->forward ^ cam->backward) /*along z axis*/
+        {
+            if(zz > 0.005f) zz -= 0.001f*dt;
+            s1 = m[2]  * cam->velmod * dt;
+            s2 = m[6]  * cam->velmod * dt;
+            s3 = m[10] * cam->velmod * dt;
+            if(cam->forward) /*forward*/
+            {
+                cam->player->vel.x += s1;
+                cam->player->vel.y += s2;
+                cam->player->vel.z += s3;
+                if(cam->fovmod < 1.2f && cam->driftcam)
+                    cam->fovmod += dt*zz;
+            }
+            else               /*backward*/
+            {
+                cam->player->vel.x -= s1;
+                cam->player->vel.y -= s2;
+                cam->player->vel.z -= s3;
+                if(cam->fovmod > 0.8f && cam->driftcam)
+                    cam->fovmod -= dt*zz;
+            }
+        }
+        else
+        {
+            zz = 0.02f;
+            if(cam->fovmod > 1.02f)
+                 cam->fovmod -= 1.5f*dt*zz;
+            else if(cam->fovmod < 0.98f)
+                 cam->fovmod += 1.5f*dt*zz;
+            else cam->fovmod = 1.f;
+        }
+        if(cam->left ^ cam->right) /*along x axis*/
+        {
+            s1 = m[0] * cam->velmod * dt;
+            s2 = m[4] * cam->velmod * dt;
+            s3 = m[8] * cam->velmod * dt;
+            if(cam->left) /*left*/
+            {
+                cam->player->vel.x += s1;
+                cam->player->vel.y += s2;
+                cam->player->vel.z += s3;
+            }
+            else            /*right*/
+            {
+                cam->player->vel.x -= s1;
+                cam->player->vel.y -= s2;
+                cam->player->vel.z -= s3;
+            }
+        }
+        if(cam->up ^ cam->down) /*along y axis*/
+        {
+            s1 = m[1] * cam->velmod * dt;
+            s2 = m[5] * cam->velmod * dt;
+            s3 = m[9] * cam->velmod * dt;
+            if(cam->up) /*up*/
+            {
+                cam->player->vel.x -= s1;
+                cam->player->vel.y -= s2;
+                cam->player->vel.z -= s3;
+            }
+            else          /*down*/
+            {
+                cam->player->vel.x += s1;
+                cam->player->vel.y += s2;
+                cam->player->vel.z += s3;
+            }
+        }
+        *x += cam->player->vel.x * dt;
+        *y += cam->player->vel.y * dt;
+        *z += cam->player->vel.z * dt;
+        /*wrap position, unless the world is open*/
+        if(!sectors.enabled)
+        {
+            if(*x >  ARENA_SIZE)
+               *x = -ARENA_SIZE + 0.001f;
+            if(*x < -ARENA_SIZE)
+               *x =  ARENA_SIZE - 0.001f;
+            if(*y >  ARENA_SIZE)
+               *y = -ARENA_SIZE + 0.001f;
+            if(*y < -ARENA_SIZE)
+               *y =  ARENA_SIZE - 0.001f;
+            if(*z >  ARENA_SIZE)
+               *z = -ARENA_SIZE + 0.001f;
+            if(*z < -ARENA_SIZE)
+               *z =  ARENA_SIZE - 0.001f;
+        }
+    }
+
+    /*update translation component of matrix*/
+    m[12] = m[0]*(*x) + m[4]*(*y) + m[8]*(*z);
+    m[13] = m[1]*(*x) + m[5]*(*y) + m[9]*(*z);
+    m[14] = m[2]*(*x) + m[6]*(*y) + m[10]*(*z);
+    m[15] = 1.f;
+
+    glMultMatrixf(m);
+}
+
+float inv_sqrt_dwh(float x)
+{
+    float const mx = 0.5f*1.000876311302185f*x;
+    int xi         = *(int*)&x;
+    xi             = 0x5f375a87 - (xi >> 1);
+    x              = *(float*)&xi;
+    return x*(1.5f*1.000876311302185f - mx*x*x);
+}
+
+bool load_model_from_file(const char *file_prefix, A3DModel *model)
+{
+    FILE *file_data;
+    char metadata_line[256] = {'\0'};
+    char *nl;
+    char *token_buffer;
+    char *file_path;
+    char ixsum[16]  = {'\0'}; /*read from *.met*/
+    char nvsum[16]  = {'\0'};
+    char ixsum_[16] = {'\0'}; /*computed from index/vertex data*/
+    char nvsum_[16] = {'\0'};
+    unsigned ix_checksum = 0;
+    unsigned nv_checksum = 0;
+    unsigned tmp_uint    = 0;
+    int i = 0;
+
+    /*allocate apropriate space for path*/
+    file_path = malloc(strlen(file_prefix) + 5);
+    /*get metadata*/
+    strcpy(file_path, file_prefix);
+    strcat(file_path, ".met");
+    if((file_data = fopen(file_path, "r")) == NULL)
+    {
+        fprintf(stderr, "Could not open: %s\n", file_path);
+        perror("fopen error");
+        free(file_path);
+        return false;
+    }
+    while(!feof(file_data))
+    {
+        if(!fgets(metadata_line, sizeof(metadata_line), file_data))
+            break;
+        nl = strchr(metadata_line, '\n');
+        if(nl)
+            *nl = '\0';
+        token_buffer = strtok(metadata_line, " ");
+        if(!token_buffer)
+            continue;
+        /*get index count*/
+        if(!strcmp(token_buffer, "indexcount:"))
+        {
+            if((token_buffer = strtok(NULL, " ")))
+            {
+                model->index_count = atoi(token_buffer);
+                if(!model->index_count)
+                {
+                    fprintf(stderr,
+                      "atoi error: Could not load index count from file %s\n",
+                      file_path);
+                    fclose(file_data);
+                    free(file_path);
+                    return false;
+                }
+            }
+        }
+        /*get vertex count*/
+        else if(!strcmp(token_buffer, "vertexcount:"))
+        {
+            if((token_buffer = strtok(NULL, " ")))
+            {
+                model->vertex_count = atoi(token_buffer);
+                if(!model->vertex_count)
+                {
+                    fprintf(stderr,
+                      "atoi error: Could not load vertex count from file %s\n",
+                      file_path);
+                    fclose(file_data);
+                    free(file_path);
+                    return false;
+                }
+            }
+        }
+        /*get index/vertex checksum*/
+        else if(!strcmp(token_buffer, "indexsum:"))
+        {
+            size_t ixsum_len = strlen(token_buffer);
+            if(ixsum_len > 15)
+                ixsum_len = 15;
+            if((token_buffer = strtok(NULL, " ")))
+                memcpy(ixsum, token_buffer, ixsum_len);
+        }
+        else if(!strcmp(token_buffer, "vertexsum:"))
+        {
+            size_t nvsum_len = strlen(token_buffer);
+            if(nvsum_len > 15)
+                nvsum_len = 15;
+            if((token_buffer = strtok(NULL, " ")))
+                memcpy(nvsum, token_buffer, nvsum_len);
+        }
+    }
+    fclose(file_data);
+
+    /*get index data*/
+    model->index_data = malloc(model->index_count*sizeof(unsigned));
+    strcpy(file_path, file_prefix);
+    strcat(file_path, ".ix");
+    if((file_data = fopen(file_path, "rb")) == NULL)
+    {
+        perror("fopen error");
+        free(file_path);
+        return false;
+    }
+    if(fread(model->index_data, sizeof(unsigned), model->index_count,
+                file_data) != (unsigned)model->index_count)
+    {
+        fprintf(stderr,
+                "fread error: Could not read %lu bytes of data from file %s\n",
+                model->index_count*sizeof(unsigned), file_path);
+        fclose(file_data);
+        free(file_path);
+        return false;
+    }
+    fclose(file_data);
+
+    /*get vertex data*/
+    model->vertex_data = malloc(model->vertex_count*sizeof(float));
+    strcpy(file_path, file_prefix);
+    strcat(file_path, ".nv");
+    if((file_data = fopen(file_path, "rb")) == NULL)
+    {
+        perror("fopen error");
+        free(file_path);
+        return false;
+    }
+    if(fread(model->vertex_data, sizeof(float), model->vertex_count,
+                file_data) != (unsigned)model->vertex_count)
+    {
+        fprintf(stderr,
+                "fread error: Could not read %lu bytes of data from file %s\n",
+                model->vertex_count*sizeof(float), file_path);
+        fclose(file_data);
+        free(file_path);
+        return false;
+    }
+    fclose(file_data);
+
+    /*check checksums*/
+    for(i = 0; i < (model->index_count - 1); i += 64)
+    {
+        ix_checksum = ix_checksum ^ model->index_data[i];
+        ix_checksum = ix_checksum ^ (model->index_data[i+1] >> 16);
+        ix_checksum = ix_checksum ^ (model->index_data[i+1] << 16);
+    }
+    for(i = 0; i < model->vertex_count; i += 64)
+    {
+        memcpy(&tmp_uint, &model->vertex_data[i], sizeof(float));
+        nv_checksum = nv_checksum ^ tmp_uint;
+    }
+    sprintf(ixsum_, "%x", ix_checksum);
+    sprintf(nvsum_, "%x", nv_checksum);
+    if(strcmp(ixsum_,ixsum))
+    {
+        fprintf(stderr, "Index checksum mismatch. Got %s instead of %s.\n",
+                ixsum_, ixsum);
+        free(file_path);
+        return false;
+    }
+    if(strcmp(nvsum_,nvsum))
+    {
+        fprintf(stderr, "Vertex checksum mismatch. Got %s instead of %s.\n",
+                nvsum_, nvsum);
+        free(file_path);
+        return false;
+    }
+
+    printf("Loaded model %s - %d indices - %d vertices\n", file_prefix,
+            model->index_count, model->vertex_count);
+    free(file_path);
+    return true;
+}
+
+bool load_models(A3DModel **model, const int count)
+{
+    int i, j, stride;
+    unsigned  all_icount = 0;
+    unsigned  all_vcount = 0;
+    unsigned *all_idata;
+    float    *all_vdata;
+
+    /*clear buffers of any previous call to load_models*/
+    unsigned *buffer = model_buffer;
+    if(buffer[0] || buffer[1])
+    {
+        /*deleting bound buffers unbinds them*/
+        glDeleteBuffersARB_ptr(2, buffer);
+        gl_state.array_buffer   = 0;
+        gl_state.element_buffer = 0;
+    }
+    if(format_vao[0])
+    {
+        state_bind_vertex_array(0);
+        glDeleteVertexArrays_ptr(VERTEX_FORMATS, format_vao);
+        format_vao[0] = 0;
+    }
+
+    /*load models from file*/
+    for(i = 0; i < count; i++)
+    {
+        if(strcmp(model[i]->file_root, "none"))
+        {
+            if(!load_model_from_file(model[i]->file_root, model[i]))
+            {
+                fprintf(stderr, "Failed to load model from file\n");
+                return false;
+            }
+        }
+        else
+            printf("Embedded model #%d - %d indices - %d vertices\n", i,
+                    model[i]->index_count, model[i]->vertex_count);
+        /*get offsets, padded to a whole number of vertices*/
+        stride = vertex_stride(model[i]->format);
+        if(!stride)
+        {
+            fprintf(stderr, "Unknown vertex format 0x%x\n",
+                    model[i]->format);
+            /*free model data loaded so far*/
+            for(j = 0; j <= i; j++)
+            {
+                if(model[j]->const_data)
+                    continue;
+                free(model[j]->vertex_data);
+                free(model[j]->index_data);
+            }
+            return false;
+        }
+        if(all_vcount % stride)
+            all_vcount += stride - all_vcount % stride;
+        model[i]->vertex_offset = all_vcount*sizeof(float);
+        model[i]->base_vertex   = all_vcount/stride;
+        model[i]->index_offset  = all_icount*sizeof(unsigned);
+        /*get total number of elements*/
+        all_vcount += model[i]->vertex_count;
+        all_icount += model[i]->index_count;
+    }
+
+    /*build combined arrays*/
+    all_vdata = calloc(all_vcount, sizeof(float));
+    all_idata = malloc(sizeof(unsigned) * all_icount);
+    for(i = 0; i < count; i++)
+    {
+        memcpy(all_vdata + model[i]->vertex_offset/sizeof(float),
+                model[i]->vertex_data,
+                model[i]->vertex_count * sizeof(float));
+        memcpy(all_idata + model[i]->index_offset/sizeof(unsigned),
+                model[i]->index_data,
+                model[i]->index_count * sizeof(unsigned));
+        /*free model data*/
+        if(!model[i]->const_data)
+        {
+            free(model[i]->vertex_data);
+            free(model[i]->index_data);
+        }
+    }
+
+    /*copy index/vertex data to device memory*/
+    glGenBuffersARB_ptr(2, buffer);
+    state_bind_buffer(GL_ARRAY_BUFFER, buffer[0]);
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER,
+                        sizeof(float) * all_vcount,
+                        all_vdata, GL_STATIC_DRAW);
+    state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer[1]);
+    glBufferDataARB_ptr(GL_ELEMENT_ARRAY_BUFFER,
+                        sizeof(unsigned) * all_icount,
+                        all_idata, GL_STATIC_DRAW);
+    /*one vertex array object per format*/
+    if(glGenVertexArrays_ptr)
+    {
+        glGenVertexArrays_ptr(VERTEX_FORMATS, format_vao);
+        for(i = 0; i < VERTEX_FORMATS; i++)
+        {
+            state_bind_vertex_array(format_vao[i]);
+            /*element array binding is stored in the VAO,
+             *so it bypasses the state cache*/
+            glBindBufferARB_ptr(GL_ELEMENT_ARRAY_BUFFER, buffer[1]);
+            glInterleavedArrays(vertex_formats[i], 0, (void*)(intptr_t)(0));
+        }
+        state_bind_vertex_array(0);
+    }
+
+    /*free index/vertex data*/
+    free(all_idata);
+    free(all_vdata);
+
+    printf("Model data total: %lu bytes\n\n", sizeof(float) * all_vcount +
+                                              sizeof(unsigned) * all_icount);
+    return true;
+}
+
+void generate_boundbox(A3DModel *box, const int segments)
+{
+    /*distance between segments*/
+    const float d = 2.f * ARENA_SIZE / (float)segments;
+    const int vcount = 24 * segments;
+    int i, count = 0;
+
+    box->vertex_count = 3 * vcount;
+    box->index_count  = vcount;
+    box->vertex_data  = malloc(box->vertex_count * sizeof(float));
+    box->index_data   = malloc(box->index_count  * sizeof(unsigned));
+
+    /*forward side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+    }
+    /*right side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    /*back side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    /*left side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    /*top side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+    }
+    /*bottom side*/
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE;
+    }
+    for(i = 0; i < segments*6; i += 6)
+    {
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        box->vertex_data[count++] = ARENA_SIZE;
+        box->vertex_data[count++] = -ARENA_SIZE;
+        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+    }
+    /*indices*/
+    for(i = 0; i < box->index_count; i++)
+        box->index_data[i] = i;
+    printf("Bounding box:\n");
+    printf("      Index count: %d\n", box->index_count);
+    printf("      Vertex count: %d\n", box->vertex_count);
+    printf("      Segments: %d\n", segments);
+    printf("      Segment distance: %.2f\n\n", d);
+}
+
+void generate_skybox(A3DModel *box, const float radius)
+{
+    int i,j;
+    box->vertex_count = 120; /*6 sides = 24 vertices = 120 floats*/
+    box->index_count  = 24;
+    box->vertex_data  = malloc(box->vertex_count * sizeof(float));
+    box->index_data   = malloc(box->index_count  * sizeof(unsigned));
+
+    /*texture coords*/
+    for(i = 0; i < box->vertex_count; i += 20)
+    {
+        box->vertex_data[i]    = 2.f;
+        box->vertex_data[i+1]  = 2.f;
+        box->vertex_data[i+5]  = 0.f;
+        box->vertex_data[i+6]  = 2.f;
+        box->vertex_data[i+10] = 0.f;
+        box->vertex_data[i+11] = 0.f;
+        box->vertex_data[i+15] = 2.f;
+        box->vertex_data[i+16] = 0.f;
+    }
+    /*verts*/
+    /*front and back*/
+    for(i = 0, j = 1; i < 40; i += 20, j *= -1)
+    {
+        box->vertex_data[i+2]  = radius*j;
+        box->vertex_data[i+3]  = radius;
+        box->vertex_data[i+4]  = -radius*j;
+        box->vertex_data[i+7]  = -radius*j;
+        box->vertex_data[i+8]  = radius;
+        box->vertex_data[i+9]  = -radius*j;
+        box->vertex_data[i+12] = -radius*j;
+        box->vertex_data[i+13] = -radius;
+        box->vertex_data[i+14] = -radius*j;
+        box->vertex_data[i+17]  = radius*j;
+        box->vertex_data[i+18]  = -radius;
+        box->vertex_data[i+19]  = -radius*j;
+    }
+    /*right and left*/
+    for(i = 40, j = 1; i < 80; i += 20, j *= -1)
+    {
+        box->vertex_data[i+2]  = radius*j;
+        box->vertex_data[i+3]  = radius;
+        box->vertex_data[i+4]  = radius*j;
+        box->vertex_data[i+7]  = radius*j;
+        box->vertex_data[i+8]  = radius;
+        box->vertex_data[i+9]  = -radius*j;
+        box->vertex_data[i+12] = radius*j;
+        box->vertex_data[i+13] = -radius;
+        box->vertex_data[i+14] = -radius*j;
+        box->vertex_data[i+17]  = radius*j;
+        box->vertex_data[i+18]  = -radius;
+        box->vertex_data[i+19]  = radius*j;
+    }
+    /*bottom and top*/
+    for(i = 80, j = 1; i < 120; i += 20, j *= -1)
+    {
+        box->vertex_data[i+2]  = -radius;
+        box->vertex_data[i+3]  = -radius*j;
+        box->vertex_data[i+4]  = radius*j;
+        box->vertex_data[i+7]  = radius;
+        box->vertex_data[i+8]  = -radius*j;
+        box->vertex_data[i+9]  = radius*j;
+        box->vertex_data[i+12] = radius;
+        box->vertex_data[i+13] = -radius*j;
+        box->vertex_data[i+14] = -radius*j;
+        box->vertex_data[i+17]  = -radius;
+        box->vertex_data[i+18]  = -radius*j;
+        box->vertex_data[i+19]  = -radius*j;
+    }
+    /*indices*/
+    for(i = 0; i < box->index_count; i++)
+        box->index_data[i] = i;
+    printf("Skybox:\n");
+    printf("      Index count: %d\n", box->index_count);
+    printf("      Vertex count: %d\n", box->vertex_count);
+    printf("      Radius: %.2f\n\n", radius);
+}
+
+void draw_model(const A3DModel model)
+{
+    int i;
+    frame_stats.draw_calls++;
+    frame_stats.indices += model.index_count;
+    if(glDrawElementsBaseVertex_ptr)
+    {
+        if(format_vao[0])
+        {
+            for(i = 0; i < VERTEX_FORMATS - 1; i++)
+                if(vertex_formats[i] == (GLenum)model.format)
+                    break;
+            state_bind_vertex_array(format_vao[i]);
+        }
+        else
+        {
+            state_bind_buffer(GL_ARRAY_BUFFER, model_buffer[0]);
+            state_interleaved_arrays(model.format, 0);
+        }
+        glDrawElementsBaseVertex_ptr(model.mode, model.index_count,
+                GL_UNSIGNED_INT, (void*)(intptr_t)model.index_offset,
+                model.base_vertex);
+        return;
+    }
+    state_bind_buffer(GL_ARRAY_BUFFER, model_buffer[0]);
+    state_interleaved_arrays(model.format, model.vertex_offset);
+    glDrawElements(model.mode, model.index_count, GL_UNSIGNED_INT,
+            (void*)(intptr_t)model.index_offset);
+}
+
+void draw_skybox(const A3DModel box, const float x,
+                 const float y, const float z)
+{
+    state_disable(GL_LIGHTING);
+    state_disable(GL_FOG);
+    state_disable(GL_BLEND);
+    state_enable(GL_TEXTURE_2D);
+    state_depth_mask(false);
+    push_matrix();
+        glTranslatef(x, y, z);
+        draw_model(box);
+    glPopMatrix();
+}
+
+void draw_text(const char *text, const float width, const bool charwidth)
+{
+    batch_text(&sprite_batch, text, 0.f, 0.f, width, charwidth);
+    flush_batch(&sprite_batch);
+}
+
+bool init_render_target(A3DRenderTarget *rt, const int width,
+                        const int height)
+{
+    GLenum status;
+
+    /*clear objects from any previous call*/
+    if(rt->fbo)
+    {
+        glDeleteFramebuffersEXT_ptr(1, &rt->fbo);
+        glDeleteRenderbuffersEXT_ptr(1, &rt->depth_rb);
+        glDeleteTextures(1, &rt->color_tex);
+        rt->fbo = 0;
+    }
+    rt->width  = width;
+    rt->height = height;
+    if(rt->scale < 0.5f || rt->scale > 1.f)
+        rt->scale = 1.f;
+    rt->view_width  = (int)((float)width  * rt->scale);
+    rt->view_height = (int)((float)height * rt->scale);
+
+    /*color texture*/
+    glGenTextures(1, &rt->color_tex);
+    state_bind_texture(rt->color_tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, NULL);
+    /*depth buffer*/
+    glGenRenderbuffersEXT_ptr(1, &rt->depth_rb);
+    glBindRenderbufferEXT_ptr(GL_RENDERBUFFER_EXT, rt->depth_rb);
+    glRenderbufferStorageEXT_ptr(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24,
+                                 width, height);
+    glBindRenderbufferEXT_ptr(GL_RENDERBUFFER_EXT, 0);
+    /*framebuffer*/
+    glGenFramebuffersEXT_ptr(1, &rt->fbo);
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, rt->fbo);
+    glFramebufferTexture2DEXT_ptr(GL_FRAMEBUFFER_EXT,
+            GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, rt->color_tex, 0);
+    glFramebufferRenderbufferEXT_ptr(GL_FRAMEBUFFER_EXT,
+            GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rt->depth_rb);
+    status = glCheckFramebufferStatusEXT_ptr(GL_FRAMEBUFFER_EXT);
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, 0);
+    if(status != GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+        fprintf(stderr, "Framebuffer incomplete: 0x%x\n", status);
+        /*a zero 'fbo' keeps F2 from enabling it*/
+        glDeleteFramebuffersEXT_ptr(1, &rt->fbo);
+        glDeleteRenderbuffersEXT_ptr(1, &rt->depth_rb);
+        glDeleteTextures(1, &rt->color_tex);
+        rt->fbo = 0;
+        return false;
+    }
+
+    printf("Render target: %dx%d\n\n", width, height);
+    return true;
+}
+
+void update_render_scale(A3DRenderTarget *rt, const float frame_ms)
+{
+    float step;
+
+    /*smooth out single frame spikes*/
+    if(rt->frame_ms < 0.0001f)
+         rt->frame_ms  = frame_ms;
+    else rt->frame_ms += (frame_ms - rt->frame_ms) * 0.1f;
+
+    if(rt->frame_ms > target_time*0.9f)      /*over budget*/
+    {
+        step = (float)sqrt(target_time*0.8f/rt->frame_ms);
+        if(step < 0.95f) step = 0.95f;
+        rt->scale *= step;
+    }
+    else if(rt->frame_ms < target_time*0.7f) /*under budget*/
+        rt->scale += 0.002f;
+    if(rt->scale < 0.5f) rt->scale = 0.5f;
+    if(rt->scale > 1.f)  rt->scale = 1.f;
+
+    rt->view_width  = (int)((float)rt->width  * rt->scale);
+    rt->view_height = (int)((float)rt->height * rt->scale);
+}
+
+void begin_render_target(const A3DRenderTarget *rt)
+{
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, rt->fbo);
+    glViewport(0, 0, rt->view_width, rt->view_height);
+}
+
+void end_render_target(const A3DRenderTarget *rt, const int width,
+                       const int height)
+{
+    float s = (float)rt->view_width /(float)rt->width,
+          t = (float)rt->view_height/(float)rt->height;
+
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, 0);
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    state_disable(GL_LIGHTING);
+    state_disable(GL_FOG);
+    state_disable(GL_BLEND);
+    state_disable(GL_DEPTH_TEST);
+    state_disable(GL_CULL_FACE);
+    state_enable(GL_TEXTURE_2D);
+    state_color_mask(true);
+    state_bind_texture(rt->color_tex);
+    state_color(1.f, 1.f, 1.f);
+    frame_stats.draw_calls++;
+    frame_stats.indices += 4;
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.f, 0.f); glVertex2f(-1.f, -1.f);
+        glTexCoord2f(s,   0.f); glVertex2f( 1.f, -1.f);
+        glTexCoord2f(s,   t);   glVertex2f( 1.f,  1.f);
+        glTexCoord2f(0.f, t);   glVertex2f(-1.f,  1.f);
+    glEnd();
+    state_depth_mask(true);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+int state_cap_index(const GLenum cap)
+{
+    int i;
+    for(i = 0; i < CACHED_CAPS; i++)
+        if(cached_caps[i] == cap)
+            return i;
+    return -1;
+}
+
+void state_enable(const GLenum cap)
+{
+    int i = state_cap_index(cap);
+    if(i >= 0)
+    {
+        if(gl_state.enable[i])
+        {
+            gl_state.skipped++;
+            return;
+        }
+        gl_state.enable[i] = true;
+    }
+    gl_state.issued++;
+    if(shading.program && gl_state.program == shading.program &&
+       shading_uniform(cap) >= 0)
+        glUniform1i_ptr(shading_uniform(cap), 1);
+    else
+        glEnable(cap);
+}
+
+void state_disable(const GLenum cap)
+{
+    int i = state_cap_index(cap);
+    if(i >= 0)
+    {
+        if(!gl_state.enable[i])
+        {
+            gl_state.skipped++;
+            return;
+        }
+        gl_state.enable[i] = false;
+    }
+    gl_state.issued++;
+    if(shading.program && gl_state.program == shading.program &&
+       shading_uniform(cap) >= 0)
+        glUniform1i_ptr(shading_uniform(cap), 0);
+    else
+        glDisable(cap);
+}
+
+void state_bind_texture(const unsigned tex)
+{
+    if(gl_state.texture == tex)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.texture = tex;
+    gl_state.issued++;
+    frame_stats.texture_binds++;
+    glBindTexture(GL_TEXTURE_2D, tex);
+}
+
+void state_bind_buffer(const GLenum target, const unsigned buffer)
+{
+    unsigned *cached = NULL;
+    if(target == GL_ARRAY_BUFFER)
+        cached = &gl_state.array_buffer;
+    else if(target == GL_ELEMENT_ARRAY_BUFFER)
+        cached = &gl_state.element_buffer;
+    else if(target == GL_PIXEL_UNPACK_BUFFER)
+        cached = &gl_state.unpack_buffer;
+    if(cached)
+    {
+        if(*cached == buffer)
+        {
+            gl_state.skipped++;
+            return;
+        }
+        *cached = buffer;
+        /*array pointers are relative to the bound buffer*/
+        if(target == GL_ARRAY_BUFFER)
+            gl_state.array_format = -1;
+    }
+    gl_state.issued++;
+    glBindBufferARB_ptr(target, buffer);
+}
+
+void state_material(const GLenum pname, const float *v)
+{
+    float *cached;
+    if(pname == GL_AMBIENT)       cached = gl_state.ambient;
+    else if(pname == GL_DIFFUSE)  cached = gl_state.diffuse;
+    else if(pname == GL_SPECULAR) cached = gl_state.specular;
+    else                          cached = gl_state.emission;
+    if(!memcmp(cached, v, sizeof(float)*4))
+    {
+        gl_state.skipped++;
+        return;
+    }
+    memcpy(cached, v, sizeof(float)*4);
+    gl_state.issued++;
+    if(shading.program && gl_state.program == shading.program)
+        glUniform4fv_ptr(shading.u_material[(cached - gl_state.ambient)/4],
+                         1, v);
+    else
+        glMaterialfv(GL_FRONT, pname, v);
+}
+
+void state_color(const float r, const float g, const float b)
+{
+    float c[4];
+    c[0] = r;
+    c[1] = g;
+    c[2] = b;
+    c[3] = 1.f;
+    if(!memcmp(gl_state.color, c, sizeof(c)))
+    {
+        gl_state.skipped++;
+        return;
+    }
+    memcpy(gl_state.color, c, sizeof(c));
+    gl_state.issued++;
+    glColor3f(r, g, b);
+}
+
+void state_fog_range(const float start, const float end)
+{
+    float f[2];
+    f[0] = start;
+    f[1] = end;
+    if(!memcmp(gl_state.fog_range, f, sizeof(f)))
+    {
+        gl_state.skipped++;
+        return;
+    }
+    memcpy(gl_state.fog_range, f, sizeof(f));
+    gl_state.issued += 2;
+    glFogf(GL_FOG_START, start);
+    glFogf(GL_FOG_END, end);
+}
+
+void state_blend_func(const GLenum src, const GLenum dst)
+{
+    if(gl_state.blend_src == src && gl_state.blend_dst == dst)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.blend_src = src;
+    gl_state.blend_dst = dst;
+    gl_state.issued++;
+    glBlendFunc(src, dst);
+}
+
+void state_depth_mask(const bool mask)
+{
+    if(gl_state.depth_mask == mask)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.depth_mask = mask;
+    gl_state.issued++;
+    glDepthMask(mask ? GL_TRUE : GL_FALSE);
+}
+
+void state_color_mask(const bool mask)
+{
+    GLboolean m = mask ? GL_TRUE : GL_FALSE;
+    if(gl_state.color_mask == mask)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.color_mask = mask;
+    gl_state.issued++;
+    glColorMask(m, m, m, m);
+}
+
+void push_matrix(void)
+{
+    frame_stats.matrix_pushes++;
+    glPushMatrix();
+}
+
+void print_bench_json(const unsigned frames, const double ms,
+                      const double cpu, const double gpu,
+                      const A3DFrameStats total, const double issued,
+                      const double skip, const char *cull,
+                      const double cull_ms, const double ray_ms)
+{
+    double n = frames ? (double)frames : 1.0;
+    printf("{\n");
+    printf("  \"frames\": %u,\n",            frames);
+    printf("  \"ms_per_frame\": %.3f,\n",    ms/n);
+    printf("  \"cpu_ms\": %.3f,\n",          cpu/n);
+    printf("  \"gpu_ms\": %.3f,\n",          gpu/n);
+    printf("  \"draw_calls\": %.2f,\n",      (double)total.draw_calls/n);
+    printf("  \"indices\": %.2f,\n",         (double)total.indices/n);
+    printf("  \"matrix_pushes\": %.2f,\n",   (double)total.matrix_pushes/n);
+    printf("  \"texture_binds\": %.2f,\n",   (double)total.texture_binds/n);
+    printf("  \"state_issued\": %.2f,\n",    issued/n);
+    printf("  \"state_skipped\": %.2f,\n",   skip/n);
+    printf("  \"queries\": %.2f,\n",         (double)total.queries/n);
+    printf("  \"queries_hidden\": %.2f,\n",  (double)total.queries_hidden/n);
+    printf("  \"cull\": \"%s\",\n",          cull);
+    printf("  \"cull_ms\": %.3f,\n",         cull_ms/n);
+    printf("  \"occluders\": %.2f,\n",       (double)total.occluders/n);
+    printf("  \"culled\": %.2f,\n",          (double)total.culled/n);
+    printf("  \"impostors\": %.2f,\n",       (double)total.impostors/n);
+    printf("  \"lights\": %.2f,\n",          (double)total.lights/n);
+    printf("  \"sim_near\": %.2f,\n",        (double)total.sim_tiers[0]/n);
+    printf("  \"sim_mid\": %.2f,\n",         (double)total.sim_tiers[1]/n);
+    printf("  \"sim_far\": %.2f,\n",         (double)total.sim_tiers[2]/n);
+    printf("  \"sim_updates\": %.2f,\n",     (double)total.sim_updates/n);
+    printf("  \"rays\": %.2f,\n",            (double)total.rays/n);
+    printf("  \"ray_hits\": %.2f,\n",        (double)total.ray_hits/n);
+    printf("  \"ray_ms\": %.3f,\n",          ray_ms/n);
+    printf("  \"events\": %.2f\n",           (double)total.events/n);
+    printf("}\n");
+}
+
+void state_bind_vertex_array(const unsigned vao)
+{
+    if(gl_state.vertex_array == vao)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.vertex_array = vao;
+    gl_state.array_format = -1;
+    gl_state.issued++;
+    glBindVertexArray_ptr(vao);
+}
+
+void state_interleaved_arrays(const int format, const int offset)
+{
+    if(gl_state.array_format == format && gl_state.array_offset == offset)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.array_format = format;
+    gl_state.array_offset = offset;
+    gl_state.issued++;
+    glInterleavedArrays(format, 0, (void*)(intptr_t)offset);
+}
+
+int vertex_stride(const int format)
+{
+    if(format == GL_N3F_V3F)  return 6;
+    if(format == GL_V3F)      return 3;
+    if(format == GL_T2F_V3F)  return 5;
+    return 0;
+}
+
+void state_use_program(const unsigned program)
+{
+    if(gl_state.program == program)
+    {
+        gl_state.skipped++;
+        return;
+    }
+    gl_state.issued++;
+    glUseProgram_ptr(program);
+    /*cached state was kept on the side in use*/
+    if(shading.program && gl_state.program == shading.program)
+        sync_shading(false);
+    gl_state.program = program;
+    if(shading.program && program == shading.program)
+        sync_shading(true);
+}
+
+bool init_workers(A3DWorkers *w, const int count)
+{
+    int i;
+    w->count   = 0;
+    w->threads = NULL;
+    w->func    = NULL;
+    w->data    = NULL;
+    w->total   = 0;
+    w->chunk   = 1;
+    w->quit    = false;
+    SDL_AtomicSet(&w->next, 0);
+    w->start   = SDL_CreateSemaphore(0);
+    w->done    = SDL_CreateSemaphore(0);
+    if(!w->start || !w->done)
+    {
+        fprintf(stderr, "SDL_CreateSemaphore failed: %s\n", SDL_GetError());
+        return false;
+    }
+    if(count < 1)
+        return true;
+    w->threads = malloc(sizeof(SDL_Thread*) * count);
+    for(i = 0; i < count; i++)
+    {
+        w->threads[i] = SDL_CreateThread(worker_main, "a3d_worker", w);
+        if(!w->threads[i])
+        {
+            fprintf(stderr, "SDL_CreateThread failed: %s\n", SDL_GetError());
+            return false;
+        }
+        w->count++;
+    }
+    return true;
+}
+
+void run_workers(A3DWorkers *w, A3DTask_Func func, void *data,
+                 const int total, const int chunk)
+{
+    int i, wake;
+    if(!w->count || total <= chunk)
+    {
+        func(data, 0, total);
+        return;
+    }
+    w->func  = func;
+    w->data  = data;
+    w->total = total;
+    w->chunk = chunk;
+    SDL_AtomicSet(&w->next, 0);
+    /*no more threads than remaining chunks*/
+    wake = (total + chunk - 1)/chunk - 1;
+    if(wake > w->count) wake = w->count;
+    for(i = 0; i < wake; i++)
+        SDL_SemPost(w->start);
+    worker_chunks(w);
+    for(i = 0; i < wake; i++)
+        SDL_SemWait(w->done);
+}
+
+void free_workers(A3DWorkers *w)
+{
+    int i;
+    w->quit = true;
+    for(i = 0; i < w->count; i++)
+        SDL_SemPost(w->start);
+    for(i = 0; i < w->count; i++)
+        SDL_WaitThread(w->threads[i], NULL);
+    free(w->threads);
+    if(w->start) SDL_DestroySemaphore(w->start);
+    if(w->done)  SDL_DestroySemaphore(w->done);
+    w->threads = NULL;
+    w->count   = 0;
+}
+
+int worker_main(void *data)
+{
+    A3DWorkers *w = data;
+    for(;;)
+    {
+        SDL_SemWait(w->start);
+        if(w->quit)
+            break;
+        worker_chunks(w);
+        SDL_SemPost(w->done);
+    }
+    return 0;
+}
+
+void worker_chunks(A3DWorkers *w)
+{
+    int begin, end;
+    for(;;)
+    {
+        begin = SDL_AtomicAdd(&w->next, w->chunk);
+        if(begin >= w->total)
+            break;
+        end = begin + w->chunk;
+        if(end > w->total) end = w->total;
+        w->func(w->data, begin, end);
+    }
+}
+
+unsigned build_program(const char *header, const char **lib,
+                       const char **vs, const char **fs,
+                       const char **attribs, const int count)
+{
+    const GLenum type[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char *src[MAX_SHADER_LINES];
+    const char **lines;
+    char log[1024];
+    unsigned shader, program;
+    int i, n, ok;
+
+    program = glCreateProgram_ptr();
+    for(i = 0; i < 2; i++)
+    {
+        src[0] = header;
+        n      = 1;
+        for(lines = lib; !i && lines && *lines && n < MAX_SHADER_LINES;)
+            src[n++] = *lines++;
+        for(lines = i ? fs : vs; *lines && n < MAX_SHADER_LINES;)
+            src[n++] = *lines++;
+        shader = glCreateShader_ptr(type[i]);
+        glShaderSource_ptr(shader, n, src, NULL);
+        glCompileShader_ptr(shader);
+        glGetShaderiv_ptr(shader, GL_COMPILE_STATUS, &ok);
+        if(!ok)
+        {
+            glGetShaderInfoLog_ptr(shader, sizeof(log), NULL, log);
+            fprintf(stderr, "Shader compile failed:\n%s\n", log);
+        }
+        /*deleted along with the program*/
+        glAttachShader_ptr(program, shader);
+        glDeleteShader_ptr(shader);
+    }
+    for(i = 0; i < count; i++)
+        glBindAttribLocation_ptr(program, FIRST_ATTRIB + i, attribs[i]);
+    glLinkProgram_ptr(program);
+    glGetProgramiv_ptr(program, GL_LINK_STATUS, &ok);
+    if(!ok)
+    {
+        glGetProgramInfoLog_ptr(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Program link failed:\n%s\n", log);
+        glDeleteProgram_ptr(program);
+        return 0;
+    }
+    return program;
+}
+
+bool init_indirect(A3DIndirect *mdi, const int capacity,
+                   const char *header)
+{
+    GLint attribs = 0;
+    int i;
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &attribs);
+    if(attribs < FIRST_ATTRIB + 8)
+    {
+        fprintf(stderr, "Only %d vertex attributes\n", (int)attribs);
+        return false;
+    }
+    mdi->program = build_program(header, cluster_vs, indirect_vs,
+                                 indirect_fs, indirect_attribs, 8);
+    if(!mdi->program)
+        return false;
+    mdi->capacity  = capacity;
+    mdi->instances = malloc(sizeof(A3DInstance) * capacity);
+    glGenBuffersARB_ptr(1, &mdi->instance_buffer);
+    glGenBuffersARB_ptr(1, &mdi->command_buffer);
+    glBindBufferARB_ptr(GL_DRAW_INDIRECT_BUFFER, mdi->command_buffer);
+    glBufferDataARB_ptr(GL_DRAW_INDIRECT_BUFFER, sizeof(mdi->commands),
+                        NULL, GL_STREAM_DRAW);
+    /*model vertices from the shared buffer, one instance per draw*/
+    glGenVertexArrays_ptr(1, &mdi->vao);
+    state_bind_vertex_array(mdi->vao);
+    /*array state set here is stored in the VAO,
+     *so it bypasses the state cache*/
+    glBindBufferARB_ptr(GL_ELEMENT_ARRAY_BUFFER, model_buffer[1]);
+    state_bind_buffer(GL_ARRAY_BUFFER, model_buffer[0]);
+    glInterleavedArrays(GL_N3F_V3F, 0, (void*)(intptr_t)(0));
+    state_bind_buffer(GL_ARRAY_BUFFER, mdi->instance_buffer);
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER, sizeof(A3DInstance) * capacity,
+                        NULL, GL_STREAM_DRAW);
+    for(i = 0; i < 8; i++)
+    {
+        glEnableVertexAttribArray_ptr(FIRST_ATTRIB + i);
+        glVertexAttribPointer_ptr(FIRST_ATTRIB + i, 4, GL_FLOAT, GL_FALSE,
+                sizeof(A3DInstance), (void*)(intptr_t)(i*4*sizeof(float)));
+        glVertexAttribDivisorARB_ptr(FIRST_ATTRIB + i, 1);
+    }
+    state_bind_vertex_array(0);
+    return true;
+}
+
+void submit_indirect(A3DIndirect *mdi, A3DModel **model,
+                     const int *counts)
+{
+    int i, n = 0;
+    for(i = 0; i < INDIRECT_MODELS; i++)
+    {
+        mdi->commands[i].count          = model[i]->index_count;
+        mdi->commands[i].instance_count = counts[i];
+        mdi->commands[i].first_index    = model[i]->index_offset /
+                                          sizeof(unsigned);
+        mdi->commands[i].base_vertex    = model[i]->base_vertex;
+        mdi->commands[i].base_instance  = n;
+        frame_stats.indices += model[i]->index_count * counts[i];
+        n += counts[i];
+    }
+    if(!n)
+        return;
+    frame_stats.draw_calls++;
+    /*orphan last frame's instances before writing new ones*/
+    state_bind_buffer(GL_ARRAY_BUFFER, mdi->instance_buffer);
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER, sizeof(A3DInstance) * mdi->capacity,
+                        NULL, GL_STREAM_DRAW);
+    glBufferSubDataARB_ptr(GL_ARRAY_BUFFER, 0, sizeof(A3DInstance) * n,
+                           mdi->instances);
+    glBindBufferARB_ptr(GL_DRAW_INDIRECT_BUFFER, mdi->command_buffer);
+    glBufferDataARB_ptr(GL_DRAW_INDIRECT_BUFFER, sizeof(mdi->commands),
+                        mdi->commands, GL_STREAM_DRAW);
+    state_use_program(mdi->program);
+    state_bind_vertex_array(mdi->vao);
+    glMultiDrawElementsIndirect_ptr(model[0]->mode, GL_UNSIGNED_INT,
+            (void*)(intptr_t)(0), INDIRECT_MODELS, 0);
+    state_bind_vertex_array(0);
+    state_use_program(scene_program());
+}
+
+void actor_instance(A3DActor *obj, const float *view, A3DInstance *inst,
+                    const float scale, const float dt)
+{
+    int i;
+    float m[16];
+    rotate_static_actor(obj, m, dt);
+    translate_static_actor(obj, m, dt);
+    for(i = 0; i < 12; i++)
+        m[i] *= scale;
+    mult_matrix(view, m, inst->model);
+}
+
+void mult_matrix(const float *a, const float *b, float *out)
+{
+    int i, j;
+    for(i = 0; i < 4; i++)
+        for(j = 0; j < 4; j++)
+            out[i*4 + j] = a[j]      * b[i*4]     + a[4 + j]  * b[i*4 + 1] +
+                           a[8 + j]  * b[i*4 + 2] + a[12 + j] * b[i*4 + 3];
+}
+
+void fill_asteroid_instances(void *data, int begin, int end)
+{
+    A3DAsteroidTask *t = data;
+    A3DInstance *inst;
+    float m[16];
+    int i, j, n = 0;
+    for(i = begin; i < end; i++)
+        if(t->visible[i]) n++;
+    if(!n)
+        return;
+    /*claim space for the whole chunk at once*/
+    inst = t->out + SDL_AtomicAdd(&t->count, n);
+    for(i = begin; i < end; i++)
+    {
+        if(!t->visible[i])
+            continue;
+        pose_static_actor(&t->aster[i], m);
+        for(j = 0; j < 12; j++)
+            m[j] *= t->aster[i].mass;
+        mult_matrix(t->view, m, inst->model);
+        inst->ambient[0]  = inst->ambient[1]  = inst->ambient[2]  = 0.2f;
+        inst->specular[0] = inst->specular[1] = inst->specular[2] = 0.5f;
+        inst->emission[0] = inst->emission[1] = inst->emission[2] = 0.f;
+        inst->ambient[3]  = inst->specular[3] = inst->emission[3] = 1.f;
+        inst->diffuse[3]  = 1.f;
+        asteroid_color(t->aster[i].mass, inst->diffuse);
+        inst++;
+    }
+}
+
+void asteroid_color(const float mass, float *color)
+{
+    color[0] = 0.8f;
+    if(mass > (ASTER_LARGE + ASTER_MED)*0.5f)
+    {   /*more red*/
+        color[1] = 0.4f;
+        color[2] = 0.4f;
+    }
+    else if(mass > (ASTER_SMALL + ASTER_MED)*0.5f)
+    {   /*less red*/
+        color[1] = 0.6f;
+        color[2] = 0.6f;
+    }
+    else
+    {   /*gray*/
+        color[1] = 0.8f;
+        color[2] = 0.8f;
+    }
+}
+
+bool load_occluder_mesh(A3DOccluderMesh *mesh, const char *file_prefix)
+{
+    int i;
+    A3DModel model;
+    if(!load_model_from_file(file_prefix, &model))
+        return false;
+    /*keep positions of the GL_N3F_V3F data*/
+    mesh->vertex_count = model.vertex_count/6;
+    mesh->index_count  = model.index_count;
+    mesh->indices      = model.index_data;
+    mesh->vertices     = malloc(sizeof(float)*3 * mesh->vertex_count);
+    for(i = 0; i < mesh->vertex_count; i++)
+        memcpy(mesh->vertices + i*3, model.vertex_data + i*6 + 3,
+               sizeof(float)*3);
+    free(model.vertex_data);
+    return true;
+}
+
+void init_occlusion(A3DOcclusion *occ, const int max_tris,
+                    const int max_vertices)
+{
+    occ->depth        = malloc(sizeof(float) * OCC_WIDTH * OCC_HEIGHT);
+    occ->screen       = malloc(sizeof(float)*3 * max_vertices);
+    occ->tris         = malloc(sizeof(A3DOccTriangle) * max_tris);
+    occ->tri_count    = 0;
+    occ->tri_capacity = max_tris;
+}
+
+int setup_occluders(A3DOcclusion *occ, const A3DOccluderMesh *aster,
+                    const A3DOccluderMesh *player, const float *player_mv)
+{
+    int i, j, count = 0, pick[MAX_OCCLUDERS];
+    float size[MAX_OCCLUDERS], m[16], mv[16];
+    const float *v = occ->view;
+
+    occ->tri_count = 0;
+    /*largest projected size first, fragments are not the mesh*/
+    for(i = 0; i < FIELD_ASTEROIDS; i++)
+    {
+        A3DActor *a = &occ->aster[i];
+        float d, s;
+        if(!a->is_spawned || a->mass < (ASTER_LARGE + ASTER_MED)*0.5f)
+            continue;
+        locate_static_actor(a);
+        d = -(v[2]*a->pos.x + v[6]*a->pos.y + v[10]*a->pos.z + v[14]);
+        if(d - OCC_ASTER_RADIUS*a->mass < occ->near)
+            continue;
+        s = a->mass/d;
+        for(j = count; j > 0 && size[j-1] < s; j--)
+        {
+            if(j == MAX_OCCLUDERS)
+                continue;
+            size[j] = size[j-1];
+            pick[j] = pick[j-1];
+        }
+        if(j == MAX_OCCLUDERS)
+            continue;
+        size[j] = s;
+        pick[j] = i;
+        if(count < MAX_OCCLUDERS) count++;
+    }
+    for(i = 0; i < count; i++)
+    {
+        pose_static_actor(&occ->aster[pick[i]], m);
+        for(j = 0; j < 12; j++)
+            m[j] *= occ->aster[pick[i]].mass;
+        mult_matrix(occ->view, m, mv);
+        add_occluder(occ, aster, mv);
+    }
+    if(player)
+    {
+        add_occluder(occ, player, player_mv);
+        count++;
+    }
+    return count;
+}
+
+void add_occluder(A3DOcclusion *occ, const A3DOccluderMesh *mesh,
+                  const float *mv)
+{
+    int i, j;
+    float *s = occ->screen;
+    const float *p;
+
+    /*to pixel coordinates and view distance*/
+    for(i = 0; i < mesh->vertex_count; i++)
+    {
+        float x, y, d;
+        p = mesh->vertices + i*3;
+        x =   mv[0]*p[0] + mv[4]*p[1] + mv[8]*p[2]  + mv[12];
+        y =   mv[1]*p[0] + mv[5]*p[1] + mv[9]*p[2]  + mv[13];
+        d = -(mv[2]*p[0] + mv[6]*p[1] + mv[10]*p[2] + mv[14]);
+        s[i*3 + 2] = d;
+        if(d < occ->near)
+            continue;
+        s[i*3]     = (x*occ->scale_x/d*0.5f + 0.5f) * (float)OCC_WIDTH;
+        s[i*3 + 1] = (y*occ->scale_y/d*0.5f + 0.5f) * (float)OCC_HEIGHT;
+    }
+    for(i = 0; i + 2 < mesh->index_count; i += 3)
+    {
+        A3DOccTriangle *tri;
+        const float *v[3];
+        float xmin, xmax, ymin, ymax;
+        if(occ->tri_count == occ->tri_capacity)
+            return;
+        for(j = 0; j < 3; j++)
+            v[j] = s + mesh->indices[i + j]*3;
+        if(v[0][2] < occ->near || v[1][2] < occ->near || v[2][2] < occ->near)
+            continue;
+        /*counter-clockwise is front facing*/
+        if((v[1][0] - v[0][0])*(v[2][1] - v[0][1]) -
+           (v[2][0] - v[0][0])*(v[1][1] - v[0][1]) <= 0.f)
+            continue;
+        xmin = xmax = v[0][0];
+        ymin = ymax = v[0][1];
+        tri = &occ->tris[occ->tri_count];
+        tri->depth = v[0][2];
+        for(j = 0; j < 3; j++)
+        {
+            const float *a = v[j], *b = v[(j + 1) % 3];
+            float *e = tri->edge[j];
+            e[0] = a[1] - b[1];
+            e[1] = b[0] - a[0];
+            e[2] = -e[0]*a[0] - e[1]*a[1];
+            if(a[0] < xmin) xmin = a[0];
+            if(a[0] > xmax) xmax = a[0];
+            if(a[1] < ymin) ymin = a[1];
+            if(a[1] > ymax) ymax = a[1];
+            if(a[2] > tri->depth) tri->depth = a[2];
+        }
+        if(xmax < 0.f || ymax < 0.f ||
+           xmin >= (float)OCC_WIDTH || ymin >= (float)OCC_HEIGHT)
+            continue;
+        tri->x0 = xmin > 0.f ? (int)xmin : 0;
+        tri->y0 = ymin > 0.f ? (int)ymin : 0;
+        tri->x1 = xmax < (float)(OCC_WIDTH - 1)  ? (int)xmax + 1 : OCC_WIDTH;
+        tri->y1 = ymax < (float)(OCC_HEIGHT - 1) ? (int)ymax + 1 : OCC_HEIGHT;
+        occ->tri_count++;
+    }
+}
+
+void rasterize_occluders(void *data, int begin, int end)
+{
+    A3DOcclusion *occ = data;
+    int band, t, x, y, y0, y1;
+    float *row, py;
+#ifdef __SSE__
+    const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+#else
+    int k;
+    float px;
+#endif
+
+    for(band = begin; band < end; band++)
+    {
+        y0 = band*OCC_BAND;
+        y1 = y0 + OCC_BAND;
+        for(x = y0*OCC_WIDTH; x < y1*OCC_WIDTH; x++)
+            occ->depth[x] = FLT_MAX;
+        for(t = 0; t < occ->tri_count; t++)
+        {
+            const A3DOccTriangle *tri = &occ->tris[t];
+            const float (*e)[3] = tri->edge;
+#ifdef __SSE__
+            const __m128 a0 = _mm_set1_ps(e[0][0]),
+                         a1 = _mm_set1_ps(e[1][0]),
+                         a2 = _mm_set1_ps(e[2][0]),
+                         dv = _mm_set1_ps(tri->depth);
+#endif
+            for(y = tri->y0 > y0 ? tri->y0 : y0;
+                y < tri->y1 && y < y1; y++)
+            {
+                row = occ->depth + y*OCC_WIDTH;
+                py  = (float)y + 0.5f;
+#ifdef __SSE__
+                {
+                    /*four pixels at a time, x0 rounded down*/
+                    __m128 r0 = _mm_set1_ps(e[0][1]*py + e[0][2]),
+                           r1 = _mm_set1_ps(e[1][1]*py + e[1][2]),
+                           r2 = _mm_set1_ps(e[2][1]*py + e[2][2]);
+                    for(x = tri->x0 & ~3; x < tri->x1; x += 4)
+                    {
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane),
+                               in, d;
+                        in = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0),
+                                          zero);
+                        in = _mm_and_ps(in, _mm_cmpge_ps(
+                                _mm_add_ps(_mm_mul_ps(a1, px), r1), zero));
+                        in = _mm_and_ps(in, _mm_cmpge_ps(
+                                _mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+                        d  = _mm_loadu_ps(row + x);
+                        d  = _mm_or_ps(_mm_and_ps(in, _mm_min_ps(d, dv)),
+                                       _mm_andnot_ps(in, d));
+                        _mm_storeu_ps(row + x, d);
+                    }
+                }
+#else
+                for(x = tri->x0; x < tri->x1; x++)
+                {
+                    px = (float)x + 0.5f;
+                    for(k = 0; k < 3; k++)
+                        if(e[k][0]*px + e[k][1]*py + e[k][2] < 0.f)
+                            break;
+                    if(k == 3 && tri->depth < row[x])
+                        row[x] = tri->depth;
+                }
+#endif
+            }
+        }
+    }
+}
+
+void test_occlusion(void *data, int begin, int end)
+{
+    A3DOcclusion *occ = data;
+    const float *v = occ->view;
+    float cx, cy, cz, r, dn, df, lo, hi, *row;
+    int i, x, y, x0, x1, y0, y1;
+    bool vis;
+#ifdef __SSE__
+    __m128 dnv;
+#endif
+
+    for(i = begin; i < end; i++)
+    {
+        A3DActor *a = &occ->aster[i];
+        occ->visible[i] = false;
+        if(!a->is_spawned)
+            continue;
+        /*bounding sphere*/
+        locate_static_actor(a);
+        cx = v[0]*a->pos.x + v[4]*a->pos.y + v[8]*a->pos.z  + v[12];
+        cy = v[1]*a->pos.x + v[5]*a->pos.y + v[9]*a->pos.z  + v[13];
+        cz = v[2]*a->pos.x + v[6]*a->pos.y + v[10]*a->pos.z + v[14];
+        r  = OCC_ASTER_RADIUS*a->mass;
+        dn = -cz - r;
+        df = -cz + r;
+        vis = false;
+        if(df < occ->near) /*behind the camera*/
+            vis = false;
+        else if(dn < occ->near)
+            vis = true;
+        else
+        {
+            /*screen bounds, using the distance that widens each side*/
+            lo = (cx - r)*occ->scale_x/((cx - r) < 0.f ? dn : df);
+            hi = (cx + r)*occ->scale_x/((cx + r) > 0.f ? dn : df);
+            lo = (lo*0.5f + 0.5f) * (float)OCC_WIDTH;
+            hi = (hi*0.5f + 0.5f) * (float)OCC_WIDTH;
+            x0 = lo > 0.f ? (int)lo : 0;
+            x1 = hi < (float)(OCC_WIDTH - 1) ? (int)hi + 1 : OCC_WIDTH;
+            if(hi < 0.f) x1 = 0;
+            lo = (cy - r)*occ->scale_y/((cy - r) < 0.f ? dn : df);
+            hi = (cy + r)*occ->scale_y/((cy + r) > 0.f ? dn : df);
+            lo = (lo*0.5f + 0.5f) * (float)OCC_HEIGHT;
+            hi = (hi*0.5f + 0.5f) * (float)OCC_HEIGHT;
+            y0 = lo > 0.f ? (int)lo : 0;
+            y1 = hi < (float)(OCC_HEIGHT - 1) ? (int)hi + 1 : OCC_HEIGHT;
+            if(hi < 0.f) y1 = 0;
+            /*visible if any pixel has no occluder in front of it*/
+#ifdef __SSE__
+            dnv = _mm_set1_ps(dn);
+#endif
+            for(y = y0; y < y1 && !vis; y++)
+            {
+                row = occ->depth + y*OCC_WIDTH;
+#ifdef __SSE__
+                for(x = x0 & ~3; x < x1 && !vis; x += 4)
+                    if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x),
+                                                    dnv)))
+                        vis = true;
+#else
+                for(x = x0; x < x1 && !vis; x++)
+                    if(row[x] >= dn)
+                        vis = true;
+#endif
+            }
+        }
+        occ->visible[i] = vis;
+    }
+}
+
+bool init_impostors(A3DImpostors *imp, const A3DModel model)
+{
+    const float white[4]   = {1.f, 1.f, 1.f, 1.f},
+                ambient[4] = {0.2f, 0.2f, 0.2f, 1.f},
+                spec[4]    = {0.5f, 0.5f, 0.5f, 1.f},
+                none[4]    = {0.f, 0.f, 0.f, 1.f};
+    const int size = IMPOSTOR_VIEWS*IMPOSTOR_CELL;
+    unsigned fbo, depth_rb;
+    float dir[3], m[16];
+    GLenum status;
+    int i;
+
+    imp->count = 0;
+    glGenTextures(1, &imp->texture);
+    state_bind_texture(imp->texture);
+    state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    /*stop while views are still 8x8, so they don't bleed together*/
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGenFramebuffersEXT_ptr(1, &fbo);
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, fbo);
+    glFramebufferTexture2DEXT_ptr(GL_FRAMEBUFFER_EXT,
+            GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, imp->texture, 0);
+    glGenRenderbuffersEXT_ptr(1, &depth_rb);
+    glBindRenderbufferEXT_ptr(GL_RENDERBUFFER_EXT, depth_rb);
+    glRenderbufferStorageEXT_ptr(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24,
+                                 size, size);
+    glFramebufferRenderbufferEXT_ptr(GL_FRAMEBUFFER_EXT,
+            GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depth_rb);
+    status = glCheckFramebufferStatusEXT_ptr(GL_FRAMEBUFFER_EXT);
+    if(status == GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+        /*cleared to transparent black*/
+        state_color_mask(true);
+        state_depth_mask(true);
+        glViewport(0, 0, size, size);
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(-IMPOSTOR_RADIUS, IMPOSTOR_RADIUS,
+                -IMPOSTOR_RADIUS, IMPOSTOR_RADIUS,
+                1.f, 1.f + 2.f*IMPOSTOR_RADIUS);
+        glMatrixMode(GL_MODELVIEW);
+        state_enable(GL_DEPTH_TEST);
+        state_enable(GL_CULL_FACE);
+        state_enable(GL_LIGHTING);
+        state_disable(GL_FOG);
+        state_disable(GL_BLEND);
+        state_disable(GL_TEXTURE_2D);
+        /*white, tinted per asteroid when drawn*/
+        state_material(GL_AMBIENT,  ambient);
+        state_material(GL_DIFFUSE,  white);
+        state_material(GL_SPECULAR, spec);
+        state_material(GL_EMISSION, none);
+        for(i = 0; i < IMPOSTOR_VIEWS*IMPOSTOR_VIEWS; i++)
+        {
+            float *b = imp->basis[i];
+            impostor_view(i, dir, b);
+            glViewport((i % IMPOSTOR_VIEWS)*IMPOSTOR_CELL,
+                       (i / IMPOSTOR_VIEWS)*IMPOSTOR_CELL,
+                       IMPOSTOR_CELL, IMPOSTOR_CELL);
+            /*look at the origin from 'dir'*/
+            m[0]  = b[0];   m[4]  = b[1];   m[8]  = b[2];   m[12] = 0.f;
+            m[1]  = b[3];   m[5]  = b[4];   m[9]  = b[5];   m[13] = 0.f;
+            m[2]  = dir[0]; m[6]  = dir[1]; m[10] = dir[2];
+            m[14] = -1.f - IMPOSTOR_RADIUS;
+            m[3]  = 0.f;    m[7]  = 0.f;    m[11] = 0.f;    m[15] = 1.f;
+            glLoadMatrixf(m);
+            draw_model(model);
+        }
+        glGenerateMipmapEXT_ptr(GL_TEXTURE_2D);
+    }
+    glBindFramebufferEXT_ptr(GL_FRAMEBUFFER_EXT, 0);
+    glDeleteRenderbuffersEXT_ptr(1, &depth_rb);
+    glDeleteFramebuffersEXT_ptr(1, &fbo);
+    if(status != GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+        fprintf(stderr, "Impostor framebuffer incomplete: 0x%x\n", status);
+        glDeleteTextures(1, &imp->texture);
+        imp->texture = 0;
+        return false;
+    }
+    glGenBuffersARB_ptr(1, &imp->buffer);
+    imp->quads = malloc(sizeof(A3DImpostorVertex)*4 * MAX_ASTEROIDS);
+    return true;
+}
+
+void impostor_view(const int cell, float *dir, float *basis)
+{
+    float u, v, t, len, up[3] = {0.f, 1.f, 0.f};
+    u = ((float)(cell % IMPOSTOR_VIEWS) + 0.5f)/IMPOSTOR_VIEWS*2.f - 1.f;
+    v = ((float)(cell / IMPOSTOR_VIEWS) + 0.5f)/IMPOSTOR_VIEWS*2.f - 1.f;
+    /*octahedral decode*/
+    dir[2] = 1.f - (float)fabs(u) - (float)fabs(v);
+    if(dir[2] < 0.f)
+    {
+        t = u;
+        u = (1.f - (float)fabs(v)) * (t < 0.f ? -1.f : 1.f);
+        v = (1.f - (float)fabs(t)) * (v < 0.f ? -1.f : 1.f);
+    }
+    len = inv_sqrt_dwh(u*u + v*v + dir[2]*dir[2]);
+    dir[0] = u*len;
+    dir[1] = v*len;
+    dir[2] *= len;
+    if((float)fabs(dir[1]) > 0.9f)
+    {
+        up[1] = 0.f;
+        up[2] = 1.f;
+    }
+    /*right = up x dir, up = dir x right*/
+    basis[0] = up[1]*dir[2] - up[2]*dir[1];
+    basis[1] = up[2]*dir[0] - up[0]*dir[2];
+    basis[2] = up[0]*dir[1] - up[1]*dir[0];
+    len = inv_sqrt_dwh(basis[0]*basis[0] + basis[1]*basis[1] +
+                       basis[2]*basis[2]);
+    basis[0] *= len;
+    basis[1] *= len;
+    basis[2] *= len;
+    basis[3] = dir[1]*basis[2] - dir[2]*basis[1];
+    basis[4] = dir[2]*basis[0] - dir[0]*basis[2];
+    basis[5] = dir[0]*basis[1] - dir[1]*basis[0];
+}
+
+int impostor_cell(const float *dir)
+{
+    float s = (float)fabs(dir[0]) + (float)fabs(dir[1]) + (float)fabs(dir[2]),
+          u = dir[0]/s,
+          v = dir[1]/s,
+          t;
+    int x, y;
+    /*octahedral encode*/
+    if(dir[2] < 0.f)
+    {
+        t = u;
+        u = (1.f - (float)fabs(v)) * (t < 0.f ? -1.f : 1.f);
+        v = (1.f - (float)fabs(t)) * (v < 0.f ? -1.f : 1.f);
+    }
+    x = (int)((u*0.5f + 0.5f) * IMPOSTOR_VIEWS);
+    y = (int)((v*0.5f + 0.5f) * IMPOSTOR_VIEWS);
+    if(x > IMPOSTOR_VIEWS - 1) x = IMPOSTOR_VIEWS - 1;
+    if(y > IMPOSTOR_VIEWS - 1) y = IMPOSTOR_VIEWS - 1;
+    if(x < 0) x = 0;
+    if(y < 0) y = 0;
+    return y*IMPOSTOR_VIEWS + x;
+}
+
+int collect_impostors(A3DImpostors *imp, A3DActor *aster, bool *visible,
+                      const float *view)
+{
+    const float *v = view;
+    const float cw = 1.f/IMPOSTOR_VIEWS;
+    float cam[3], w[3], d[3], right[3], up[3], c[3], color[4],
+          m[16], dist, fade, r, s0, t0;
+    A3DImpostorVertex *q;
+    int i, j, cell;
+
+    /*camera position from the rigid view matrix*/
+    for(j = 0; j < 3; j++)
+        cam[j] = -(v[j*4]*v[12] + v[j*4 + 1]*v[13] + v[j*4 + 2]*v[14]);
+    imp->count = 0;
+    for(i = 0; i < FIELD_ASTEROIDS; i++)
+    {
+        if(!visible[i])
+            continue;
+        locate_static_actor(&aster[i]);
+        w[0] = cam[0] - aster[i].pos.x;
+        w[1] = cam[1] - aster[i].pos.y;
+        w[2] = cam[2] - aster[i].pos.z;
+        dist = 1.f/inv_sqrt_dwh(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+        fade = (dist/aster[i].mass - IMPOSTOR_NEAR) /
+               (IMPOSTOR_FAR - IMPOSTOR_NEAR);
+        if(fade <= 0.f)
+            continue;
+        pose_static_actor(&aster[i], m);
+        if(fade >= 1.f)
+        {
+            visible[i] = false;
+            fade       = 1.f;
+        }
+        w[0] = cam[0] - m[12];
+        w[1] = cam[1] - m[13];
+        w[2] = cam[2] - m[14];
+        dist = inv_sqrt_dwh(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+        for(j = 0; j < 3; j++)
+            w[j] *= dist;
+        /*view direction in object space, picks the atlas cell*/
+        for(j = 0; j < 3; j++)
+            d[j] = m[j*4]*w[0] + m[j*4 + 1]*w[1] + m[j*4 + 2]*w[2];
+        cell = impostor_cell(d);
+        r = IMPOSTOR_RADIUS*aster[i].mass;
+        for(j = 0; j < 3; j++)
+        {
+            const float *b = imp->basis[cell];
+            right[j] = (m[j]*b[0] + m[4 + j]*b[1] + m[8 + j]*b[2]) * r;
+            up[j]    = (m[j]*b[3] + m[4 + j]*b[4] + m[8 + j]*b[5]) * r;
+            /*pulled towards the camera, to blend over the mesh*/
+            c[j]     = m[12 + j] + w[j]*r;
+        }
+        asteroid_color(aster[i].mass, color);
+        s0 = (float)(cell % IMPOSTOR_VIEWS) * cw;
+        t0 = (float)(cell / IMPOSTOR_VIEWS) * cw;
+        q  = imp->quads + imp->count*4;
+        for(j = 0; j < 4; j++)
+        {
+            float sx = (j == 1 || j == 2) ? 1.f : -1.f,
+                  sy = (j >= 2)           ? 1.f : -1.f;
+            q[j].s = s0 + (sx*0.5f + 0.5f)*cw;
+            q[j].t = t0 + (sy*0.5f + 0.5f)*cw;
+            q[j].color[0] = (unsigned char)(color[0]*255.f);
+            q[j].color[1] = (unsigned char)(color[1]*255.f);
+            q[j].color[2] = (unsigned char)(color[2]*255.f);
+            q[j].color[3] = (unsigned char)(fade*255.f);
+            q[j].x = c[0] + right[0]*sx + up[0]*sy;
+            q[j].y = c[1] + right[1]*sx + up[1]*sy;
+            q[j].z = c[2] + right[2]*sx + up[2]*sy;
+        }
+        imp->count++;
+    }
+    return imp->count;
+}
+
+void draw_impostors(A3DImpostors *imp)
+{
+    if(!imp->count)
+        return;
+    frame_stats.draw_calls++;
+    frame_stats.indices += 4*imp->count;
+    state_enable(GL_DEPTH_TEST);
+    state_enable(GL_CULL_FACE);
+    state_disable(GL_LIGHTING);
+    state_enable(GL_FOG);
+    state_enable(GL_BLEND);
+    state_enable(GL_TEXTURE_2D);
+    state_depth_mask(false);
+    state_fog_range(500.f, 800.f);
+    state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state_bind_texture(imp->texture);
+    state_bind_vertex_array(0);
+    state_bind_buffer(GL_ARRAY_BUFFER, imp->buffer);
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER,
+                        sizeof(A3DImpostorVertex)*4 * imp->count,
+                        imp->quads, GL_STREAM_DRAW);
+    state_interleaved_arrays(GL_T2F_C4UB_V3F, 0);
+    glDrawArrays(GL_QUADS, 0, 4*imp->count);
+    /*the color array leaves the current color undefined*/
+    gl_state.color[0] = -1.f;
+}
+
+bool start_recorder(A3DRecorder *rec, const char *filename,
+                    const int width, const int height)
+{
+    int i, bytes;
+    rec->width   = width  & ~1;
+    rec->height  = height & ~1;
+    rec->frames  = 0;
+    rec->written = 0;
+    rec->dropped = 0;
+    rec->head    = 0;
+    rec->tail    = 0;
+    rec->quit    = false;
+    if((rec->file = fopen(filename, "wb")) == NULL)
+    {
+        fprintf(stderr, "Could not open: %s\n", filename);
+        perror("fopen error");
+        return false;
+    }
+    /*frame rate of the fixed update rate*/
+    fprintf(rec->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+            rec->width, rec->height, (int)(1000.f/target_time + 0.5f));
+    bytes = rec->width * rec->height * 4;
+    for(i = 0; i < RECORD_SLOTS; i++)
+        rec->slots[i] = malloc(bytes);
+    rec->yuv = malloc(rec->width * rec->height * 3/2);
+    glGenBuffersARB_ptr(RECORD_PBOS, rec->pbo);
+    for(i = 0; i < RECORD_PBOS; i++)
+    {
+        glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, rec->pbo[i]);
+        glBufferDataARB_ptr(GL_PIXEL_PACK_BUFFER, bytes, NULL,
+                            GL_STREAM_READ);
+        rec->pending[i] = false;
+    }
+    glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, 0);
+    rec->filled = SDL_CreateSemaphore(0);
+    rec->empty  = SDL_CreateSemaphore(RECORD_SLOTS);
+    if(!rec->filled || !rec->empty)
+    {
+        fprintf(stderr, "SDL_CreateSemaphore failed: %s\n", SDL_GetError());
+        return false;
+    }
+    rec->thread = SDL_CreateThread(recorder_main, "a3d_recorder", rec);
+    if(!rec->thread)
+    {
+        fprintf(stderr, "SDL_CreateThread failed: %s\n", SDL_GetError());
+        return false;
+    }
+    printf("Recording %dx%d to %s\n", rec->width, rec->height, filename);
+    return true;
+}
 
-    /*initialize projectiles*/
-    a_shot = malloc(sizeof(A3DActor)*MAX_SHOTS);
-    for(i = 0; i < MAX_SHOTS; i++)
+void capture_frame(A3DRecorder *rec, const int width, const int height)
+{
+    int i = rec->frames % RECORD_PBOS;
+    if(width < rec->width || height < rec->height)
     {
-        a_shot[i].is_spawned         = false;
-        a_shot[i].mass               = 0.f;
-        a_shot[i].pos.x              = 0.f;
-        a_shot[i].pos.y              = 0.f;
-        a_shot[i].pos.z              = 0.f;
-        a_shot[i].vel.x              = 0.f;
-        a_shot[i].vel.y              = 0.f;
-        a_shot[i].vel.z              = 0.f;
-        a_shot[i].quat_orientation.x = 0.f;
-        a_shot[i].quat_orientation.y = 0.f;
-        a_shot[i].quat_orientation.z = 0.f;
-        a_shot[i].quat_orientation.w = 1.f;
-        a_shot[i].euler_rot.yaw      = 0.f;
-        a_shot[i].euler_rot.pitch    = 0.f;
-        a_shot[i].euler_rot.roll     = 0.f;
-    }
-
-    /*initialize asteroids*/
-    a_aster = malloc(sizeof(A3DActor)*MAX_ASTEROIDS);
-    for(i = 0; i < MAX_ASTEROIDS; i++)
+        rec->dropped++;
+        return;
+    }
+    /*the oldest read back is done by now*/
+    if(rec->pending[i])
+        queue_frame(rec, i, false);
+    glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, rec->pbo[i]);
+    glReadPixels(0, 0, rec->width, rec->height, GL_RGBA, GL_UNSIGNED_BYTE,
+                 (void*)(intptr_t)(0));
+    glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, 0);
+    rec->pending[i] = true;
+    rec->frames++;
+}
+
+void queue_frame(A3DRecorder *rec, const int index, const bool wait)
+{
+    const unsigned char *pixels;
+    rec->pending[index] = false;
+    if(wait)
+        SDL_SemWait(rec->empty);
+    else if(SDL_SemTryWait(rec->empty))
     {
-        a_aster[i].is_spawned         = false;
-        a_aster[i].mass               = 0.f;
-        a_aster[i].pos.x              = 0.f;
-        a_aster[i].pos.y              = 0.f;
-        a_aster[i].pos.z              = 0.f;
-        a_aster[i].vel.x              = 0.f;
-        a_aster[i].vel.y              = 0.f;
-        a_aster[i].vel.z              = 0.f;
-        a_aster[i].quat_orientation.x = 0.f;
-        a_aster[i].quat_orientation.y = 0.f;
-        a_aster[i].quat_orientation.z = 0.f;
-        a_aster[i].quat_orientation.w = 1.f;
-        a_aster[i].euler_rot.yaw      = 0.f;
-        a_aster[i].euler_rot.pitch    = 0.f;
-        a_aster[i].euler_rot.roll     = 0.f;
+        /*writer is behind*/
+        rec->dropped++;
+        return;
     }
+    glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, rec->pbo[index]);
+    pixels = glMapBufferARB_ptr(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if(pixels)
+        memcpy(rec->slots[rec->head], pixels, rec->width * rec->height * 4);
+    else
+        memset(rec->slots[rec->head], 0, rec->width * rec->height * 4);
+    glUnmapBufferARB_ptr(GL_PIXEL_PACK_BUFFER);
+    glBindBufferARB_ptr(GL_PIXEL_PACK_BUFFER, 0);
+    rec->head = (rec->head + 1) % RECORD_SLOTS;
+    SDL_SemPost(rec->filled);
+}
 
-    /*tie camera to player actor*/
-    camera.player = &a_player;
+void stop_recorder(A3DRecorder *rec)
+{
+    int i;
+    /*oldest first*/
+    for(i = 0; i < RECORD_PBOS; i++)
+        if(rec->pending[(rec->frames + i) % RECORD_PBOS])
+            queue_frame(rec, (rec->frames + i) % RECORD_PBOS, true);
+    /*all slots free means all frames are written*/
+    for(i = 0; i < RECORD_SLOTS; i++)
+        SDL_SemWait(rec->empty);
+    rec->quit = true;
+    SDL_SemPost(rec->filled);
+    SDL_WaitThread(rec->thread, NULL);
+    glDeleteBuffersARB_ptr(RECORD_PBOS, rec->pbo);
+    SDL_DestroySemaphore(rec->filled);
+    SDL_DestroySemaphore(rec->empty);
+    for(i = 0; i < RECORD_SLOTS; i++)
+        free(rec->slots[i]);
+    free(rec->yuv);
+    fclose(rec->file);
+    rec->file = NULL;
+    printf("Recorded %u frames, %u written, %u dropped\n",
+           rec->frames, rec->written, rec->dropped);
+}
+
+int recorder_main(void *data)
+{
+    A3DRecorder *rec = data;
+    size_t size = rec->width * rec->height * 3/2;
+    bool failed = false;
+    for(;;)
+    {
+        SDL_SemWait(rec->filled);
+        if(rec->quit)
+            break;
+        rgba_to_i420(rec->slots[rec->tail], rec->yuv,
+                     rec->width, rec->height);
+        rec->tail = (rec->tail + 1) % RECORD_SLOTS;
+        SDL_SemPost(rec->empty);
+        if(failed)
+            continue;
+        if(fputs("FRAME\n", rec->file) == EOF ||
+           fwrite(rec->yuv, 1, size, rec->file) != size)
+        {
+            perror("fwrite error");
+            failed = true;
+            continue;
+        }
+        rec->written++;
+    }
+    return 0;
+}
 
-    /*setup reticule*/
-    strcpy(reticule[0].text, "\x0f");
-    strcpy(reticule[1].text, "+");
-    strcpy(reticule[2].text, "+");
-    reticule[0].offset = 100.f;
-    reticule[1].offset = 30.f;
-    reticule[2].offset = 10.f;
+void rgba_to_i420(const unsigned char *rgba, unsigned char *yuv,
+                  const int width, const int height)
+{
+    unsigned char *y = yuv,
+                  *u = yuv + width*height,
+                  *v = u + width*height/4;
+    const unsigned char *p;
+    int i, j, r, g, b, cb, cr;
 
-    /*get base path name*/
-    if(!(basepath = SDL_GetBasePath()))
+    for(j = 0; j < height; j++)
     {
-        fprintf(stderr, "Could not get executable base path.\n");
-        return 1;
+        /*flip rows, GL reads bottom-up*/
+        p = rgba + (height - 1 - j)*width*4;
+        for(i = 0; i < width; i++, p += 4)
+            *y++ = (unsigned char)((77*p[0] + 150*p[1] + 29*p[2] + 128) >> 8);
+    }
+    for(j = 0; j < height; j += 2)
+    {
+        p = rgba + (height - 2 - j)*width*4;
+        for(i = 0; i < width; i += 2, p += 8)
+        {
+            /*average of 2x2 pixels*/
+            r = (p[0] + p[4] + p[width*4]     + p[width*4 + 4] + 2) >> 2;
+            g = (p[1] + p[5] + p[width*4 + 1] + p[width*4 + 5] + 2) >> 2;
+            b = (p[2] + p[6] + p[width*4 + 2] + p[width*4 + 6] + 2) >> 2;
+            /*offset keeps the shifted value positive*/
+            cb = (-43*r - 85*g + 128*b + 32896) >> 8;
+            cr = (128*r - 107*g - 21*b + 32896) >> 8;
+            *u++ = (unsigned char)(cb > 255 ? 255 : cb);
+            *v++ = (unsigned char)(cr > 255 ? 255 : cr);
+        }
     }
+}
 
-    /*set model path and pointers for load_models*/
-    /*buit-in data*/
-    generate_boundbox(&m_boundbox, 20);
-    generate_skybox(&m_skybox, 100.f);
-    m_unitbox.vertex_data  = unit_box_vert;
-    m_unitbox.vertex_count = sizeof(unit_box_vert)/sizeof(*unit_box_vert);
-    m_unitbox.index_data   = unit_box_in;
-    m_unitbox.index_count  = sizeof(unit_box_in)/sizeof(*unit_box_in);
-    /*file paths*/
-    m_unitbox.file_root    = "none";
-    m_boundbox.file_root   = "none";
-    m_skybox.file_root     = "none";
-    m_player.file_root     = malloc(strlen(basepath) + 32);
-    m_projectile.file_root = malloc(strlen(basepath) + 32);
-    m_asteroid.file_root   = malloc(strlen(basepath) + 32);
-    m_blast.file_root      = malloc(strlen(basepath) + 32);
-    strcpy(m_player.file_root,     basepath);
-    strcpy(m_projectile.file_root, basepath);
-    strcpy(m_asteroid.file_root,   basepath);
-    strcpy(m_blast.file_root,      basepath);
-    strcat(m_player.file_root,     "data/model/player1");
-    strcat(m_projectile.file_root, "data/model/projectile1");
-    strcat(m_asteroid.file_root,   "data/model/asteroid1");
-    strcat(m_blast.file_root,      "data/model/blast2");
-    /*if data is static*/
-    m_player.const_data     = false;
-    m_projectile.const_data = false;
-    m_asteroid.const_data   = false;
-    m_blast.const_data      = false;
-    m_boundbox.const_data   = false;
-    m_skybox.const_data     = false;
-    m_unitbox.const_data    = true;
-    /*drawing mode*/
-    m_player.mode       = GL_TRIANGLES;
-    m_projectile.mode   = GL_TRIANGLES;
-    m_asteroid.mode     = GL_TRIANGLES;
-    m_blast.mode        = GL_TRIANGLES;
-    m_boundbox.mode     = GL_LINES;
-    m_skybox.mode       = GL_QUADS;
-    m_unitbox.mode      = GL_QUADS;
-    /*interleaved format*/
-    m_player.format     = GL_N3F_V3F;
-    m_projectile.format = GL_N3F_V3F;
-    m_asteroid.format   = GL_N3F_V3F;
-    m_blast.format      = GL_N3F_V3F;
-    m_boundbox.format   = GL_V3F;
-    m_skybox.format     = GL_T2F_V3F;
-    m_unitbox.format    = GL_V3F;
-    /*pointers to models*/
-    m_ptr_all[0] = &m_player;
-    m_ptr_all[1] = &m_projectile;
-    m_ptr_all[2] = &m_asteroid;
-    m_ptr_all[3] = &m_blast;
-    m_ptr_all[4] = &m_boundbox;
-    m_ptr_all[5] = &m_skybox;
-    m_ptr_all[6] = &m_unitbox;
+bool init_atlas(A3DAtlas *a, const int width, const int height)
+{
+    int i;
+    a->width   = width;
+    a->height  = height;
+    a->shelf_x = 0;
+    a->shelf_y = 0;
+    a->shelf_h = 0;
+    for(i = 0; i < ATLAS_RECTS; i++)
+        a->rects[i].s0 = a->rects[i].t0 =
+        a->rects[i].s1 = a->rects[i].t1 = 0.f;
+    a->pixels = calloc(width * height, 1);
+    return a->pixels != NULL;
+}
 
-    /*set image path*/
-    i_font.filename = malloc(strlen(basepath) + 32);
-    strcpy(i_font.filename, basepath);
-    strcat(i_font.filename, "data/image/8x16s_bitfont.png");
-    i_skybox.filename = malloc(strlen(basepath) + 32);
-    strcpy(i_skybox.filename, basepath);
-    strcat(i_skybox.filename, "data/image/skybox0d.png");
+bool atlas_add(A3DAtlas *a, const unsigned char *pixels,
+               const int width, const int height,
+               const int cols, const int rows, const int first)
+{
+    int i, x, y, cw, ch;
+    if(first + cols*rows > ATLAS_RECTS)
+        return false;
+    /*start a new shelf*/
+    if(a->shelf_x + width > a->width)
+    {
+        a->shelf_x  = 0;
+        a->shelf_y += a->shelf_h;
+        a->shelf_h  = 0;
+    }
+    if(width > a->width || a->shelf_y + height > a->height)
+        return false;
+    x = a->shelf_x;
+    y = a->shelf_y;
+    for(i = 0; i < height; i++)
+        memcpy(a->pixels + (y + i)*a->width + x, pixels + i*width, width);
+    a->shelf_x += width;
+    if(height > a->shelf_h)
+        a->shelf_h = height;
+    /*cell rects, rows counted from the last row of the image*/
+    cw = width/cols;
+    ch = height/rows;
+    for(i = 0; i < cols*rows; i++)
+    {
+        A3DAtlasRect *r = &a->rects[first + i];
+        r->s0 = (float)(x + (i%cols)*cw)/(float)a->width;
+        r->t0 = (float)(y + (rows - 1 - i/cols)*ch)/(float)a->height;
+        r->s1 = r->s0 + (float)cw/(float)a->width;
+        r->t1 = r->t0 + (float)ch/(float)a->height;
+    }
+    return true;
+}
 
-    #ifdef _WIN32
-    /*write output to file on Windows*/
-    char *winfilepath = malloc(strlen(basepath) + 32);
-    strcpy(winfilepath, basepath);
-    strcat(winfilepath, "stdout.txt");
-    freopen(winfilepath, "w", stdout);
-    strcpy(winfilepath, basepath);
-    strcat(winfilepath, "stderr.txt");
-    freopen(winfilepath, "w", stderr);
-    free(winfilepath);
-    #endif
+bool atlas_sprites(A3DAtlas *a)
+{
+    unsigned char ring [ATLAS_SPRITE*ATLAS_SPRITE],
+                  cross[ATLAS_SPRITE*ATLAS_SPRITE];
+    const float c = (float)(ATLAS_SPRITE - 1)*0.5f;
+    float dx, dy, d;
+    int x, y;
+    for(y = 0; y < ATLAS_SPRITE; y++)
+    {
+        for(x = 0; x < ATLAS_SPRITE; x++)
+        {
+            dx = (float)x - c;
+            dy = (float)y - c;
+            d  = (float)sqrt(dx*dx + dy*dy);
+            /*ring with four inward ticks*/
+            ring[y*ATLAS_SPRITE + x] = (unsigned char)
+                ((d > c - 2.f && d < c - 0.5f) ||
+                 ((fabs(dx) < 1.f || fabs(dy) < 1.f) && d > c - 4.f &&
+                  d < c) ? 255 : 0);
+            /*cross with an open center*/
+            cross[y*ATLAS_SPRITE + x] = (unsigned char)
+                ((fabs(dx) < 1.f || fabs(dy) < 1.f) && d > 2.f &&
+                 d < c ? 255 : 0);
+        }
+    }
+    return atlas_add(a, ring,  ATLAS_SPRITE, ATLAS_SPRITE, 1, 1,
+                     ATLAS_RETICULE) &&
+           atlas_add(a, cross, ATLAS_SPRITE, ATLAS_SPRITE, 1, 1,
+                     ATLAS_CROSSHAIR);
+}
+
+void batch_text(A3DSpriteBatch *b, const char *text, const float x,
+                const float y, const float width, const bool charwidth)
+{
+    unsigned len, i;
+    float cw;
+    if(!text) return;
+    len = strlen(text);
+    if(!len) return;
+    if(charwidth) cw = width;
+    else          cw = width/(float)len;
+    for(i = 0; i < len; i++)
+        batch_quad(b, atlas.rects[(unsigned char)text[i] % ATLAS_GLYPHS],
+                   x + cw*(float)i, y, cw, 2.f*cw);
+}
+
+void batch_sprite(A3DSpriteBatch *b, const int id, const float x,
+                  const float y, const float size)
+{
+    batch_quad(b, atlas.rects[id], x, y, size, size);
+}
+
+void batch_quad(A3DSpriteBatch *b, const A3DAtlasRect r,
+                const float x, const float y, const float w, const float h)
+{
+    A3DSpriteVertex *v;
+    if(b->count == SPRITE_BATCH)
+        flush_batch(b);
+    v = &b->quads[4*b->count++];
+    v[0].s = r.s1; v[0].t = r.t1; v[0].x = x + w*0.5f; v[0].y = y + h*0.5f;
+    v[1].s = r.s0; v[1].t = r.t1; v[1].x = x - w*0.5f; v[1].y = y + h*0.5f;
+    v[2].s = r.s0; v[2].t = r.t0; v[2].x = x - w*0.5f; v[2].y = y - h*0.5f;
+    v[3].s = r.s1; v[3].t = r.t0; v[3].x = x + w*0.5f; v[3].y = y - h*0.5f;
+    v[0].z = v[1].z = v[2].z = v[3].z = 0.f;
+}
+
+void flush_batch(A3DSpriteBatch *b)
+{
+    if(!b->count)
+        return;
+    state_disable(GL_LIGHTING);
+    state_disable(GL_FOG);
+    state_enable(GL_BLEND);
+    state_enable(GL_TEXTURE_2D);
+    state_depth_mask(true);
+    state_color_mask(true);
+    state_blend_func(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
+    frame_stats.draw_calls++;
+    frame_stats.indices += 4*b->count;
+    state_bind_vertex_array(0);
+    state_bind_buffer(GL_ARRAY_BUFFER, b->buffer);
+    /*orphan the previous batch*/
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER, sizeof(A3DSpriteVertex)*4*b->count,
+                        b->quads, GL_STREAM_DRAW);
+    state_interleaved_arrays(GL_T2F_V3F, 0);
+    glDrawArrays(GL_QUADS, 0, 4*b->count);
+    b->count = 0;
+}
+
+bool init_overdraw(A3DOverdraw *od, const bool use_queries)
+{
+    int bits = 0;
+    od->enabled     = false;
+    od->heatmap     = true;
+    od->frames      = 0;
+    od->average     = 0.f;
+    od->max         = 0;
+    od->use_queries = use_queries;
+    od->segments[0] = od->segments[1] = 0;
+    od->pass        = -1;
+    od->pending[0]  = od->pending[1]  = false;
+    memset(od->pass_layers, 0, sizeof(od->pass_layers));
+    glGetIntegerv(GL_STENCIL_BITS, &bits);
+    if(bits < 8)
+    {
+        fprintf(stderr, "8 bit stencil buffer not available\n");
+        return false;
+    }
+    glGenBuffersARB_ptr(2, od->pbo);
+    if(use_queries)
+        glGenQueriesARB_ptr(2*OVERDRAW_SEGMENTS, od->queries[0]);
+    /*stencil rows are tightly packed*/
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    return true;
+}
+
+void overdraw_begin_frame(A3DOverdraw *od)
+{
+    if(!od->enabled)
+        return;
+    od->segments[od->frames % 2] = 0;
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    state_enable(GL_STENCIL_TEST);
+    /*count every fragment that passes the depth test*/
+    glStencilFunc(GL_ALWAYS, 0, 0xff);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+}
+
+void overdraw_pass(A3DOverdraw *od, const int pass)
+{
+    int f = od->frames % 2;
+    if(!od->enabled || !od->use_queries)
+        return;
+    if(od->pass >= 0)
+        glEndQueryARB_ptr(GL_SAMPLES_PASSED_ARB);
+    od->pass = -1;
+    if(pass < 0 || od->segments[f] == OVERDRAW_SEGMENTS)
+        return;
+    od->segment_pass[f][od->segments[f]] = pass;
+    glBeginQueryARB_ptr(GL_SAMPLES_PASSED_ARB,
+                        od->queries[f][od->segments[f]++]);
+    od->pass = pass;
+}
+
+void overdraw_end_frame(A3DOverdraw *od, const int width, const int height)
+{
+    int i, f = od->frames % 2, prev = (od->frames + 1) % 2;
+    const unsigned char *counts;
+    if(!od->enabled)
+        return;
+    overdraw_pass(od, -1);
+    state_disable(GL_STENCIL_TEST);
+    /*read this frame's counts*/
+    state_bind_buffer(GL_PIXEL_PACK_BUFFER, od->pbo[f]);
+    glBufferDataARB_ptr(GL_PIXEL_PACK_BUFFER, width*height, NULL,
+                        GL_STREAM_READ);
+    glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE,
+                 (void*)(intptr_t)(0));
+    od->size[f][0] = width;
+    od->size[f][1] = height;
+    od->pending[f] = true;
+    od->frames++;
+    /*map last frame's counts*/
+    if(od->pending[prev])
+    {
+        int n = od->size[prev][0]*od->size[prev][1];
+        od->pending[prev] = false;
+        state_bind_buffer(GL_PIXEL_PACK_BUFFER, od->pbo[prev]);
+        counts = glMapBufferARB_ptr(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if(counts && n)
+        {
+            unsigned long sum = 0;
+            int max = 0;
+            for(i = 0; i < n; i++)
+            {
+                sum += counts[i];
+                if(counts[i] > max)
+                    max = counts[i];
+            }
+            od->average = (float)sum/(float)n;
+            od->max     = max;
+        }
+        glUnmapBufferARB_ptr(GL_PIXEL_PACK_BUFFER);
+        /*pass fragments of the same frame*/
+        if(od->use_queries && n)
+        {
+            memset(od->pass_layers, 0, sizeof(od->pass_layers));
+            for(i = 0; i < od->segments[prev]; i++)
+            {
+                int samples = 0;
+                glGetQueryObjectivARB_ptr(od->queries[prev][i],
+                                           GL_QUERY_RESULT, &samples);
+                od->pass_layers[od->segment_pass[prev][i]] +=
+                    (float)samples/(float)n;
+            }
+        }
+    }
+    state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void draw_overdraw_heatmap(void)
+{
+    int k;
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    state_disable(GL_DEPTH_TEST);
+    state_disable(GL_LIGHTING);
+    state_disable(GL_FOG);
+    state_disable(GL_TEXTURE_2D);
+    state_disable(GL_BLEND);
+    state_color_mask(true);
+    state_color(0.f, 0.f, 0.f);
+    glRectf(-1.f, -1.f, 1.f, 1.f);
+    /*one additive layer per count*/
+    state_enable(GL_BLEND);
+    state_blend_func(GL_ONE, GL_ONE);
+    state_enable(GL_STENCIL_TEST);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    for(k = 0; k < OVERDRAW_LEVELS; k++)
+    {
+        if(k < 4)      state_color(0.f,   0.f,   0.25f);
+        else if(k < 8) state_color(0.f,   0.25f, 0.f);
+        else           state_color(0.25f, 0.f,   0.f);
+        /*count > k*/
+        glStencilFunc(GL_LESS, k, 0xff);
+        glRectf(-1.f, -1.f, 1.f, 1.f);
+    }
+    state_disable(GL_STENCIL_TEST);
+    frame_stats.draw_calls += OVERDRAW_LEVELS + 1;
+    frame_stats.indices    += 4*(OVERDRAW_LEVELS + 1);
+}
+
+bool init_shading(A3DShading *sh, const char *header)
+{
+    const char *names[4] = {"u_ambient", "u_diffuse", "u_specular",
+                            "u_emission"};
+    int i;
+    sh->program = build_program(header, cluster_vs, shading_vs,
+                                shading_fs, NULL, 0);
+    if(!sh->program)
+        return false;
+    for(i = 0; i < 4; i++)
+        sh->u_material[i] = glGetUniformLocation_ptr(sh->program, names[i]);
+    sh->u_lit   = glGetUniformLocation_ptr(sh->program, "u_lit");
+    sh->u_fog   = glGetUniformLocation_ptr(sh->program, "u_fog");
+    sh->u_tex   = glGetUniformLocation_ptr(sh->program, "u_tex");
+    sh->enabled = true;
+    return true;
+}
+
+unsigned scene_program(void)
+{
+    return shading.enabled ? shading.program : 0;
+}
+
+int shading_uniform(const GLenum cap)
+{
+    if(cap == GL_LIGHTING)   return shading.u_lit;
+    if(cap == GL_FOG)        return shading.u_fog;
+    if(cap == GL_TEXTURE_2D) return shading.u_tex;
+    return -1;
+}
+
+void sync_shading(const bool to_glsl)
+{
+    const GLenum caps[3]   = {GL_LIGHTING, GL_FOG, GL_TEXTURE_2D};
+    const GLenum params[4] = {GL_AMBIENT, GL_DIFFUSE, GL_SPECULAR,
+                              GL_EMISSION};
+    int i, c;
+    bool on;
+    for(i = 0; i < 4; i++)
+    {
+        const float *v = gl_state.ambient + 4*i;
+        if(to_glsl) glUniform4fv_ptr(shading.u_material[i], 1, v);
+        else        glMaterialfv(GL_FRONT, params[i], v);
+    }
+    for(i = 0; i < 3; i++)
+    {
+        c  = state_cap_index(caps[i]);
+        on = c >= 0 && gl_state.enable[c];
+        if(to_glsl)  glUniform1i_ptr(shading_uniform(caps[i]), on ? 1 : 0);
+        else if(on)  glEnable(caps[i]);
+        else         glDisable(caps[i]);
+    }
+}
+
+bool init_lights(A3DLights *l, const unsigned *programs, const int count)
+{
+    int i;
+    l->count  = 0;
+    l->refs   = 0;
+    l->texels = malloc(sizeof(float)*4*CLUSTER_TEXELS);
+    if(!l->texels)
+        return false;
+    glGenBuffersARB_ptr(1, &l->buffer);
+    state_bind_buffer(GL_TEXTURE_BUFFER_ARB, l->buffer);
+    glBufferDataARB_ptr(GL_TEXTURE_BUFFER_ARB,
+                        sizeof(float)*4*CLUSTER_TEXELS, NULL,
+                        GL_STREAM_DRAW);
+    state_bind_buffer(GL_TEXTURE_BUFFER_ARB, 0);
+    /*unit 1 is left to the light buffer*/
+    glGenTextures(1, &l->texture);
+    glActiveTexture_ptr(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER_ARB, l->texture);
+    glTexBufferARB_ptr(GL_TEXTURE_BUFFER_ARB, GL_RGBA32F_ARB, l->buffer);
+    glActiveTexture_ptr(GL_TEXTURE0);
+    for(i = 0; i < count; i++)
+    {
+        if(!programs[i])
+            continue;
+        glUseProgram_ptr(programs[i]);
+        glUniform1i_ptr(glGetUniformLocation_ptr(programs[i], "u_lights"), 1);
+    }
+    glUseProgram_ptr(gl_state.program);
+    return true;
+}
+
+bool add_light(A3DLights *l, const float *view, const float x,
+               const float y, const float z, const float radius,
+               const float *color)
+{
+    A3DLight *light;
+    int i;
+    if(l->count == MAX_LIGHTS)
+        return false;
+    light = &l->lights[l->count++];
+    for(i = 0; i < 3; i++)
+    {
+        light->pos[i]   = view[i]*x + view[4 + i]*y + view[8 + i]*z +
+                          view[12 + i];
+        light->color[i] = color[i];
+    }
+    light->pos[3]   = radius;
+    light->color[3] = 1.f;
+    return true;
+}
+
+int upload_lights(A3DLights *l, const float near, const float far,
+                  const float scale_x, const float scale_y)
+{
+    const float zs = (float)CLUSTER_Z/(float)log(far/near),
+                zb = -(float)log(near)*zs;
+    const float tiles[2] = {(float)CLUSTER_X, (float)CLUSTER_Y};
+    float *t = l->texels, scale[2], lo, hi, v, dmin, dmax, d, r;
+    int i, j, k, c, x, y, z, total = 0, limit, *b;
+
+    scale[0] = scale_x;
+    scale[1] = scale_y;
+    memset(l->first, 0, sizeof(l->first));
+    for(i = 0; i < l->count; i++)
+    {
+        b    = l->bounds[i];
+        b[0] = -1;
+        d    = -l->lights[i].pos[2];
+        r    = l->lights[i].pos[3];
+        dmin = d - r;
+        dmax = d + r;
+        if(dmax < near || dmin > far)
+            continue;
+        if(dmin < near) dmin = near;
+        if(dmax > far)  dmax = far;
+        /*screen tiles from the corners of the bounding box*/
+        for(j = 0; j < 2; j++)
+        {
+            float p = l->lights[i].pos[j];
+            lo = hi = (p - r)*scale[j]/dmin;
+            for(k = 1; k < 4; k++)
+            {
+                v = (p + ((k & 1) ? r : -r))*scale[j]/((k & 2) ? dmax : dmin);
+                if(v < lo) lo = v;
+                if(v > hi) hi = v;
+            }
+            if(hi < -1.f || lo > 1.f)
+                break;
+            lo = (lo*0.5f + 0.5f)*tiles[j];
+            hi = (hi*0.5f + 0.5f)*tiles[j];
+            b[2*j]     = (int)(lo < 0.f ? 0.f : lo > tiles[j] - 1.f ?
+                               tiles[j] - 1.f : lo);
+            b[2*j + 1] = (int)(hi < 0.f ? 0.f : hi > tiles[j] - 1.f ?
+                               tiles[j] - 1.f : hi);
+        }
+        if(j < 2)
+        {
+            b[0] = -1;
+            continue;
+        }
+        lo   = (float)log(dmin)*zs + zb;
+        hi   = (float)log(dmax)*zs + zb;
+        b[4] = (int)(lo < 0.f ? 0.f : lo > CLUSTER_Z - 1 ? CLUSTER_Z - 1 : lo);
+        b[5] = (int)(hi < 0.f ? 0.f : hi > CLUSTER_Z - 1 ? CLUSTER_Z - 1 : hi);
+        for(z = b[4]; z <= b[5]; z++)
+            for(y = b[2]; y <= b[3]; y++)
+                for(x = b[0]; x <= b[1]; x++)
+                    l->first[(z*CLUSTER_Y + y)*CLUSTER_X + x]++;
+    }
+    /*with too many references, cap the lights per cluster*/
+    for(c = 0; c < CLUSTERS; c++)
+        total += l->first[c];
+    limit = MAX_LIGHTS;
+    if(total > MAX_LIGHT_REFS)
+    {
+        int lo_limit = 0, hi_limit = MAX_LIGHTS;
+        while(lo_limit < hi_limit)
+        {
+            limit = (lo_limit + hi_limit + 1)/2;
+            for(c = 0, total = 0; c < CLUSTERS; c++)
+                total += l->first[c] < limit ? l->first[c] : limit;
+            if(total > MAX_LIGHT_REFS)
+                hi_limit = limit - 1;
+            else
+                lo_limit = limit;
+        }
+        limit = lo_limit;
+    }
+    /*reference ranges, then fill them*/
+    for(c = 0, total = 0; c < CLUSTERS; c++)
+    {
+        k                = l->first[c] < limit ? l->first[c] : limit;
+        l->first[c]      = total;
+        t[4*(1 + c)]     = (float)(CLUSTER_REFS + total);
+        t[4*(1 + c) + 1] = 0.f;
+        t[4*(1 + c) + 2] = (float)k;
+        total           += k;
+    }
+    for(i = 0; i < l->count; i++)
+    {
+        b = l->bounds[i];
+        for(z = b[4]; b[0] >= 0 && z <= b[5]; z++)
+            for(y = b[2]; y <= b[3]; y++)
+                for(x = b[0]; x <= b[1]; x++)
+                {
+                    float *cell = t + 4*(1 + (z*CLUSTER_Y + y)*CLUSTER_X + x);
+                    c = l->first[(z*CLUSTER_Y + y)*CLUSTER_X + x] +
+                        (int)cell[1];
+                    if(cell[1] >= cell[2])
+                        continue;
+                    t[4*(CLUSTER_REFS + c)] = (float)(CLUSTER_LIGHTS + 2*i);
+                    cell[1] += 1.f;
+                }
+        memcpy(t + 4*(CLUSTER_LIGHTS + 2*i),     l->lights[i].pos,
+               sizeof(float)*4);
+        memcpy(t + 4*(CLUSTER_LIGHTS + 2*i + 1), l->lights[i].color,
+               sizeof(float)*4);
+    }
+    t[0] = scale_x;
+    t[1] = scale_y;
+    t[2] = zs;
+    t[3] = zb;
+    l->refs = total;
+    /*orphan last frame's lights*/
+    state_bind_buffer(GL_TEXTURE_BUFFER_ARB, l->buffer);
+    glBufferDataARB_ptr(GL_TEXTURE_BUFFER_ARB,
+                        sizeof(float)*4*CLUSTER_TEXELS, NULL,
+                        GL_STREAM_DRAW);
+    glBufferSubDataARB_ptr(GL_TEXTURE_BUFFER_ARB, 0,
+                           sizeof(float)*4*CLUSTER_LIGHTS, t);
+    if(l->count)
+        glBufferSubDataARB_ptr(GL_TEXTURE_BUFFER_ARB,
+                               sizeof(float)*4*CLUSTER_LIGHTS,
+                               sizeof(float)*4*2*l->count,
+                               t + 4*CLUSTER_LIGHTS);
+    if(l->refs)
+        glBufferSubDataARB_ptr(GL_TEXTURE_BUFFER_ARB,
+                               sizeof(float)*4*CLUSTER_REFS,
+                               sizeof(float)*4*l->refs,
+                               t + 4*CLUSTER_REFS);
+    state_bind_buffer(GL_TEXTURE_BUFFER_ARB, 0);
+    l->count = 0;
+    return l->refs;
+}
+
+void init_trails(A3DTrails *t)
+{
+    memset(t->head,   0, sizeof(t->head));
+    memset(t->length, 0, sizeof(t->length));
+    t->offset = 0;
+    glGenBuffersARB_ptr(1, &t->buffer);
+    state_bind_buffer(GL_ARRAY_BUFFER, t->buffer);
+    glBufferDataARB_ptr(GL_ARRAY_BUFFER, sizeof(A3DTrailVertex)*TRAIL_RING,
+                        NULL, GL_STREAM_DRAW);
+}
+
+void update_trails(A3DTrails *t, const A3DActor *shots, const int *slots,
+                   const int count)
+{
+    unsigned live = 0;
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        const int s = slots[i];
+        float    *p;
+        live      |= 1u << s;
+        t->head[s] = (t->head[s] + 1) % TRAIL_POINTS;
+        p    = t->history[s][t->head[s]];
+        p[0] = shots[i].pos.x;
+        p[1] = shots[i].pos.y;
+        p[2] = shots[i].pos.z;
+        if(t->length[s] < TRAIL_POINTS)
+            t->length[s]++;
+    }
+    for(i = 0; i < MAX_SHOTS; i++)
+        if(!(live & (1u << i)))
+            t->length[i] = 0;
+}
+
+int draw_trails(A3DTrails *t, const float *eye)
+{
+    const float limit = ARENA_SIZE*ARENA_SIZE; /*wrapped around*/
+    float side[TRAIL_POINTS][3];
+    int i, j, k, n = 0;
+
+    for(i = 0; i < MAX_SHOTS; i++)
+    {
+        const int len = t->length[i];
+        float (*h)[3] = t->history[i];
+        /*ribbon half width across the view at each point*/
+        for(j = 0; j < len; j++)
+        {
+            const int a = (t->head[i] - j + TRAIL_POINTS) % TRAIL_POINTS,
+                      b = (t->head[i] - (j + 1 < len ? j + 1 : j) +
+                           TRAIL_POINTS) % TRAIL_POINTS,
+                      c = (t->head[i] - (j > 0 ? j - 1 : j) +
+                           TRAIL_POINTS) % TRAIL_POINTS;
+            float d[3], v[3], s[3], l, w;
+            for(k = 0; k < 3; k++)
+            {
+                d[k] = h[c][k] - h[b][k];
+                v[k] = h[a][k] - eye[k];
+            }
+            s[0] = d[1]*v[2] - d[2]*v[1];
+            s[1] = d[2]*v[0] - d[0]*v[2];
+            s[2] = d[0]*v[1] - d[1]*v[0];
+            l    = s[0]*s[0] + s[1]*s[1] + s[2]*s[2];
+            w    = TRAIL_WIDTH*(1.f - (float)j/TRAIL_POINTS);
+            w    = l > 0.f ? w*inv_sqrt_dwh(l) : 0.f;
+            for(k = 0; k < 3; k++)
+                side[j][k] = s[k]*w;
+        }
+        for(j = 0; j + 1 < len; j++)
+        {
+            const int a = (t->head[i] - j + TRAIL_POINTS) % TRAIL_POINTS,
+                      b = (t->head[i] - j - 1 + TRAIL_POINTS) % TRAIL_POINTS;
+            const unsigned char fa = (unsigned char)
+                                     (255*(TRAIL_POINTS - j)/TRAIL_POINTS),
+                                fb = (unsigned char)
+                                     (255*(TRAIL_POINTS - j - 1)/TRAIL_POINTS);
+            A3DTrailVertex *v = &t->vertices[n];
+            float dx = h[a][0] - h[b][0],
+                  dy = h[a][1] - h[b][1],
+                  dz = h[a][2] - h[b][2];
+            if(dx*dx + dy*dy + dz*dz > limit)
+                break;
+            v[0].x = h[a][0] - side[j][0];
+            v[0].y = h[a][1] - side[j][1];
+            v[0].z = h[a][2] - side[j][2];
+            v[1].x = h[a][0] + side[j][0];
+            v[1].y = h[a][1] + side[j][1];
+            v[1].z = h[a][2] + side[j][2];
+            v[2].x = h[b][0] + side[j + 1][0];
+            v[2].y = h[b][1] + side[j + 1][1];
+            v[2].z = h[b][2] + side[j + 1][2];
+            v[3].x = h[b][0] - side[j + 1][0];
+            v[3].y = h[b][1] - side[j + 1][1];
+            v[3].z = h[b][2] - side[j + 1][2];
+            for(k = 0; k < 4; k++)
+            {
+                v[k].r = 0;
+                v[k].g = v[k].b = 255;
+                v[k].a = k < 2 ? fa : fb;
+            }
+            n += 4;
+        }
+    }
+    if(!n)
+        return 0;
+    state_bind_vertex_array(0);
+    state_bind_buffer(GL_ARRAY_BUFFER, t->buffer);
+    /*append, and orphan only when the ring is full*/
+    if(t->offset + n > TRAIL_RING)
+    {
+        glBufferDataARB_ptr(GL_ARRAY_BUFFER,
+                            sizeof(A3DTrailVertex)*TRAIL_RING, NULL,
+                            GL_STREAM_DRAW);
+        t->offset = 0;
+    }
+    glBufferSubDataARB_ptr(GL_ARRAY_BUFFER,
+                           sizeof(A3DTrailVertex)*t->offset,
+                           sizeof(A3DTrailVertex)*n, t->vertices);
+    state_disable(GL_LIGHTING);
+    state_enable(GL_FOG);
+    state_disable(GL_TEXTURE_2D);
+    state_disable(GL_CULL_FACE);
+    state_enable(GL_BLEND);
+    state_depth_mask(false);
+    state_color_mask(true);
+    state_blend_func(GL_SRC_ALPHA, GL_ONE);
+    state_interleaved_arrays(GL_C4UB_V3F, 0);
+    frame_stats.draw_calls++;
+    frame_stats.indices += n;
+    glDrawArrays(GL_QUADS, t->offset, n);
+    /*the current color is undefined after a color array*/
+    gl_state.color[3] = -1.f;
+    state_enable(GL_CULL_FACE);
+    t->offset += n;
+    return n;
+}
 
-    /*init*/
-    SDL_Init(SDL_INIT_VIDEO);
-    win_main = SDL_CreateWindow("Asteroids 3D", SDL_WINDOWPOS_UNDEFINED,
-            SDL_WINDOWPOS_UNDEFINED, 800, 600, SDL_WINDOW_OPENGL);
-    if(!win_main)
+bool init_sectors(A3DSectors *s, const unsigned seed)
+{
+    memset(s, 0, sizeof(A3DSectors));
+    s->seed   = seed;
+    s->filled = SDL_CreateSemaphore(0);
+    s->empty  = SDL_CreateSemaphore(SECTOR_JOBS);
+    if(!s->filled || !s->empty)
     {
-        fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
-        return 1;
+        fprintf(stderr, "SDL_CreateSemaphore failed: %s\n", SDL_GetError());
+        return false;
     }
-    win_main_gl = SDL_GL_CreateContext(win_main);
-    if(!win_main_gl)
+    SDL_AtomicSet(&s->ready, 0);
+    s->thread = SDL_CreateThread(sector_main, "a3d_sectors", s);
+    if(!s->thread)
     {
-        fprintf(stderr, "SDL_GL_CreatContext failed: %s\n", SDL_GetError());
-        return 1;
+        fprintf(stderr, "SDL_CreateThread failed: %s\n", SDL_GetError());
+        SDL_DestroySemaphore(s->filled);
+        SDL_DestroySemaphore(s->empty);
+        return false;
     }
-    if(SDL_GL_SetSwapInterval(1))
+    s->enabled = true;
+    return true;
+}
+
+bool recenter_sectors(A3DSectors *s, const A3DActor *player, float *shift)
+{
+    bool moved = false;
+    float p[3];
+    int i;
+    p[0] = -player->pos.x;
+    p[1] = -player->pos.y;
+    p[2] = -player->pos.z;
+    for(i = 0; i < 3; i++)
     {
-        fprintf(stderr, "SDL_GL_SetSwapInterval failed: %s\n", SDL_GetError());
-        return 1;
+        shift[i] = 0.f;
+        /*a margin keeps the center from flipping at the border*/
+        if(p[i] > SECTOR_SIZE*0.6f)
+            shift[i] =  SECTOR_SIZE;
+        else if(p[i] < -SECTOR_SIZE*0.6f)
+            shift[i] = -SECTOR_SIZE;
+        else
+            continue;
+        s->center[i] += shift[i] > 0.f ? 1 : -1;
+        moved = true;
     }
-    SDL_GL_GetDrawableSize(win_main, &width_real, &height_real);
-    aspect_ratio = width_real/(float)height_real;
-    if(SDL_SetRelativeMouseMode(SDL_TRUE))
-        fprintf(stderr,
-                "SDL_SetRelativeMouseMode failed. Mouse capture disabled.\n");
-    /*check GL extension availability*/
-    if(!SDL_GL_ExtensionSupported("GL_ARB_vertex_buffer_object"))
+    return moved;
+}
+
+void stream_sectors(A3DSectors *s, A3DActor *aster)
+{
+    int i, j, k, want[3];
+    for(i = 0; i < SECTOR_SLOTS; i++)
     {
-        fprintf(stderr, "ARB_vertex_buffer_object not supported\n");
-        return 1;
+        A3DActor *a = &aster[i*SECTOR_ASTEROIDS];
+        /*the coordinate in [center - 1, center + 1] with the
+         *slot's digit modulo 3*/
+        for(j = 0; j < 3; j++)
+        {
+            const int digit = (j == 0 ? i/9 : j == 1 ? i/3 : i) % 3;
+            want[j] = s->center[j] - 1 +
+                      (digit - (s->center[j] % 3 + 3) % 3 + 4) % 3;
+        }
+        if(!memcmp(want, s->coords[i], sizeof(want)) &&
+           s->status[i] != SECTOR_EMPTY)
+            continue;
+        if(memcmp(want, s->coords[i], sizeof(want)) &&
+           s->status[i] == SECTOR_LOADED)
+        {
+            /*keep what happened to the field*/
+            A3DSectorDelta *d = NULL, *oldest = &s->deltas[0];
+            unsigned state = 0;
+            for(j = 0; j < SECTOR_ASTEROIDS; j++)
+            {
+                const float mass = s->mass[i][j];
+                if(mass > 0.5f && !a[j].is_spawned)
+                    state |= SECTOR_DESTROYED << 2*j;
+                else if(mass > 0.5f && a[j].mass < mass)
+                    state |= (a[j].mass > (ASTER_SMALL + ASTER_MED)*0.5f ?
+                              SECTOR_MEDIUM : SECTOR_SMALL) << 2*j;
+                a[j].is_spawned = false;
+            }
+            for(j = 0; j < SECTOR_DELTAS && !d; j++)
+            {
+                if(s->deltas[j].stamp &&
+                   !memcmp(s->deltas[j].coords, s->coords[i], sizeof(want)))
+                    d = &s->deltas[j];
+                else if(s->deltas[j].stamp < oldest->stamp)
+                    oldest = &s->deltas[j];
+            }
+            if(!d && state)
+                d = oldest;
+            if(d)
+            {
+                memcpy(d->coords, s->coords[i], sizeof(want));
+                d->state = state;
+                d->stamp = ++s->stamp;
+            }
+            s->loaded--;
+        }
+        memcpy(s->coords[i], want, sizeof(want));
+        s->status[i] = SECTOR_EMPTY;
+        /*queue it, or try again next frame*/
+        if(SDL_SemTryWait(s->empty))
+            continue;
+        s->jobs[s->head].slot = i;
+        memcpy(s->jobs[s->head].coords, want, sizeof(want));
+        s->head      = (s->head + 1) % SECTOR_JOBS;
+        s->status[i] = SECTOR_QUEUED;
+        SDL_SemPost(s->filled);
     }
-    if(!SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object"))
+    /*install finished fields*/
+    while(SDL_AtomicGet(&s->ready) > 0)
     {
-        fprintf(stderr, "ARB_pixel_buffer_object not supported\n");
-        return 1;
+        A3DSectorJob *job = &s->jobs[s->collect];
+        A3DActor *a = &aster[job->slot*SECTOR_ASTEROIDS];
+        unsigned state = 0;
+        s->collect = (s->collect + 1) % SECTOR_JOBS;
+        SDL_AtomicAdd(&s->ready, -1);
+        if(s->status[job->slot] != SECTOR_QUEUED ||
+           memcmp(job->coords, s->coords[job->slot], sizeof(want)))
+        {
+            SDL_SemPost(s->empty);
+            continue;
+        }
+        for(j = 0; j < SECTOR_DELTAS; j++)
+            if(s->deltas[j].stamp &&
+               !memcmp(s->deltas[j].coords, job->coords, sizeof(want)))
+                state = s->deltas[j].state;
+        for(j = 0; j < SECTOR_ASTEROIDS; j++)
+        {
+            a[j] = job->aster[j];
+            s->mass[job->slot][j] = a[j].is_spawned ? a[j].mass : 0.f;
+            k = (state >> 2*j) & 3;
+            if(k == SECTOR_DESTROYED)
+                a[j].is_spawned = false;
+            else if(k == SECTOR_MEDIUM)
+                a[j].mass = ASTER_MED;
+            else if(k == SECTOR_SMALL)
+                a[j].mass = ASTER_SMALL;
+            a[j].pos.x += (job->coords[0] - s->center[0])*SECTOR_SIZE;
+            a[j].pos.y += (job->coords[1] - s->center[1])*SECTOR_SIZE;
+            a[j].pos.z += (job->coords[2] - s->center[2])*SECTOR_SIZE;
+            spawn_static_actor(&a[j]);
+        }
+        s->status[job->slot] = SECTOR_LOADED;
+        s->loaded++;
+        s->generated++;
+        SDL_SemPost(s->empty);
     }
-    if(!SDL_GL_ExtensionSupported("GL_EXT_texture_compression_rgtc"))
+}
+
+void reset_sectors(A3DSectors *s, A3DActor *aster)
+{
+    int i;
+    for(i = 0; i < MAX_ASTEROIDS; i++)
+        aster[i].is_spawned = false;
+    for(i = 0; i < SECTOR_SLOTS; i++)
+        s->status[i] = SECTOR_EMPTY;
+    memset(s->deltas, 0, sizeof(s->deltas));
+    memset(s->center, 0, sizeof(s->center));
+    s->loaded = 0;
+}
+
+void free_sectors(A3DSectors *s)
+{
+    s->quit = true;
+    SDL_SemPost(s->filled);
+    SDL_WaitThread(s->thread, NULL);
+    SDL_DestroySemaphore(s->filled);
+    SDL_DestroySemaphore(s->empty);
+    s->enabled = false;
+}
+
+void shift_actors(A3DActor *a, const int count, const float *shift)
+{
+    int i;
+    for(i = 0; i < count; i++)
     {
-        fprintf(stderr, "EXT_texture_compression_rgtc not supported\n");
-        red_tc = false;
+        a[i].pos.x       -= shift[0];
+        a[i].pos.y       -= shift[1];
+        a[i].pos.z       -= shift[2];
+        a[i].spawn_pos.x -= shift[0];
+        a[i].spawn_pos.y -= shift[1];
+        a[i].spawn_pos.z -= shift[2];
     }
-    if(!SDL_GL_ExtensionSupported("GL_ARB_texture_swizzle") &&
-       !SDL_GL_ExtensionSupported("GL_EXT_texture_swizzle"))
+}
+
+int sector_main(void *data)
+{
+    A3DSectors *s = data;
+    for(;;)
     {
-        fprintf(stderr, "(ARB/EXT)_texture_swizzle not supported\n");
-        red_tc = false;
+        SDL_SemWait(s->filled);
+        if(s->quit)
+            break;
+        generate_sector(s->seed, s->jobs[s->tail].coords,
+                        s->jobs[s->tail].aster);
+        s->tail = (s->tail + 1) % SECTOR_JOBS;
+        SDL_AtomicAdd(&s->ready, 1);
     }
-    if(!SDL_GL_ExtensionSupported("GL_SGIS_generate_mipmap"))
+    return 0;
+}
+
+void generate_sector(const unsigned seed, const int *coords,
+                     A3DActor *aster)
+{
+    unsigned r = seed;
+    int i, count;
+    /*hash the coordinates into the seed*/
+    for(i = 0; i < 3; i++)
     {
-        fprintf(stderr, "GL_SGIS_generate_mipmap not supported\n");
-        gen_mips = false;
+        r ^= (unsigned)coords[i] + 0x9e3779b9u + (r << 6) + (r >> 2);
+        r *= 0x85ebca6bu;
+        r ^= r >> 13;
     }
-    if(!SDL_GL_ExtensionSupported("GL_ARB_occlusion_query"))
+    if(!r) r = 1;
+    count = xorshift32(&r) % (SECTOR_ASTEROIDS + 1);
+    for(i = 0; i < SECTOR_ASTEROIDS; i++)
     {
-        fprintf(stderr, "GL_ARB_occlusion_query not supported\n");
-        occ_query = false;
+        A3DActor *a = &aster[i];
+        memset(a, 0, sizeof(A3DActor));
+        a->quat_orientation.w = 1.f;
+        if(i >= count)
+            continue;
+        a->is_spawned      = true;
+        if(xorshift32(&r) & 0x01)      /*50%*/
+            a->mass        = ASTER_MED;
+        else if(xorshift32(&r) & 0x01) /*25%*/
+            a->mass        = ASTER_LARGE;
+        else                          /*25%*/
+            a->mass        = ASTER_SMALL;
+        a->pos.x           = (float)(xorshift32(&r)%500) - 250.f;
+        a->pos.y           = (float)(xorshift32(&r)%500) - 250.f;
+        a->pos.z           = (float)(xorshift32(&r)%500) - 250.f;
+        /*keep the player's start clear, as in the arena*/
+        if(!coords[0] && !coords[1] && !coords[2])
+            a->pos.z       = SECTOR_SIZE*0.5f;
+        a->vel.x           = ((int)(xorshift32(&r)%200) - 100) * 0.005f;
+        a->vel.y           = ((int)(xorshift32(&r)%200) - 100) * 0.005f;
+        a->vel.z           = ((int)(xorshift32(&r)%200) - 100) * 0.005f;
+        a->euler_rot.yaw   = ((int)(xorshift32(&r)%400) - 200) * 0.0001f;
+        a->euler_rot.pitch = ((int)(xorshift32(&r)%400) - 200) * 0.0001f;
+        a->euler_rot.roll  = ((int)(xorshift32(&r)%400) - 200) * 0.0001f;
     }
-    if(!SDL_GL_ExtensionSupported("GL_ARB_occlusion_query2"))
+}
+
+unsigned xorshift32(unsigned *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+void spawn_static_actor(A3DActor *obj)
+{
+    float *q = &obj->quat_orientation.x,
+           n = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+    int i;
+    /*start from a unit quaternion*/
+    if(n > SQRT_TOLERANCE)
     {
-        fprintf(stderr, "GL_ARB_occlusion_query2 not supported\n");
-        occ_query2 = false;
+        n = inv_sqrt_dwh(n);
+        for(i = 0; i < 4; i++)
+            q[i] *= n;
     }
-    /*fetch buffer object functions*/
-    *(void **)(&glDeleteBuffersARB_ptr) =
-        SDL_GL_GetProcAddress("glDeleteBuffersARB");
-    *(void **)(&glGenBuffersARB_ptr) =
-        SDL_GL_GetProcAddress("glGenBuffersARB");
-    *(void **)(&glBindBufferARB_ptr) =
-        SDL_GL_GetProcAddress("glBindBufferARB");
-    *(void **)(&glBufferDataARB_ptr) =
-        SDL_GL_GetProcAddress("glBufferDataARB");
-    if(occ_query)
+    else
     {
-        int qb = 0;
-        *(void **)(&glGetQueryivARB_ptr) =
-            SDL_GL_GetProcAddress("glGetQueryivARB");
-        *(void **)(&glGenQueriesARB_ptr) =
-            SDL_GL_GetProcAddress("glGenQueriesARB");
-        *(void **)(&glDeleteQueriesARB_ptr) =
-            SDL_GL_GetProcAddress("glDeleteQueriesARB");
-        *(void **)(&glBeginQueryARB_ptr) =
-            SDL_GL_GetProcAddress("glBeginQueryARB");
-        *(void **)(&glEndQueryARB_ptr) =
-            SDL_GL_GetProcAddress("glEndQueryARB");
-        *(void **)(&glGetQueryObjectivARB_ptr) =
-            SDL_GL_GetProcAddress("glGetQueryObjectivARB");
-        glGetQueryivARB_ptr(GL_SAMPLES_PASSED, GL_QUERY_COUNTER_BITS, &qb);
-        if(!qb)
-        {
-            fprintf(stderr, "No occlusion query bits\n");
-            occ_query = false;
-        }
+        q[0] = q[1] = q[2] = 0.f;
+        q[3] = 1.f;
     }
-    /*load models*/
-    if(!load_models(m_ptr_all, 7))
-        return 1;
-    free(m_player.file_root);
-    free(m_projectile.file_root);
-    free(m_asteroid.file_root);
-    free(m_blast.file_root);
-    /*load images*/
-    i_font.data = stbi_load(i_font.filename, &i_font.width, &i_font.height,
-                           &i_font.depth, 1);
-    i_skybox.data = stbi_load(i_skybox.filename, &i_skybox.width,
-                                &i_skybox.height, &i_skybox.depth, 1);
-    if(i_font.data && i_font.depth == 1)
+    obj->spawn_time          = sim_time;
+    obj->spawn_pos.x         = obj->pos.x;
+    obj->spawn_pos.y         = obj->pos.y;
+    obj->spawn_pos.z         = obj->pos.z;
+    obj->spawn_orientation.x = q[0];
+    obj->spawn_orientation.y = q[1];
+    obj->spawn_orientation.z = q[2];
+    obj->spawn_orientation.w = q[3];
+}
+
+void locate_static_actor(A3DActor *obj)
+{
+    /*double, so positions hold up over long sessions*/
+    const double t = sim_time - obj->spawn_time;
+    double p[3];
+    int i;
+    p[0] = obj->spawn_pos.x + obj->vel.x*t;
+    p[1] = obj->spawn_pos.y + obj->vel.y*t;
+    p[2] = obj->spawn_pos.z + obj->vel.z*t;
+    for(i = 0; i < 3; i++)
     {
-        unsigned char *packed;
-        unsigned pixbuffer;
-        int tbytes;
-        int bytes = (i_font.width * i_font.height);
-        packed = malloc(bytes);
-        /*pack bitmap font*/
-        memcpy(packed, i_font.data, bytes);
-        free(i_font.data);
-        i_font.offset = 0;
-        printf("Loaded image %s - %dx%dx%d texture\n",
-                i_font.filename, i_font.width, i_font.height, i_font.depth);
-        /*pack skybox textures*/
-        tbytes = i_skybox.width * i_skybox.height;
-        if(!i_skybox.data || i_skybox.depth != 1)
+        /*wrap into [-ARENA_SIZE, ARENA_SIZE)*/
+        if(!sectors.enabled && (p[i] >= ARENA_SIZE || p[i] < -ARENA_SIZE))
         {
-            fprintf(stderr, "Could not process image file %s\n",
-                    i_skybox.filename);
-            perror("fopen error");
-            return 1;
+            p[i] = fmod(p[i] + ARENA_SIZE, 2.0*ARENA_SIZE);
+            if(p[i] < 0.0)
+                p[i] += 2.0*ARENA_SIZE;
+            p[i] -= ARENA_SIZE;
         }
-        packed = realloc(packed, bytes + tbytes);
-        memcpy(packed + bytes, i_skybox.data, tbytes);
-        i_skybox.offset = bytes;
-        bytes += tbytes;
-        free(i_skybox.data);
-        printf("Loaded image %s - %dx%dx%d texture\n",
-                i_skybox.filename, i_skybox.width,
-                i_skybox.height, i_skybox.depth);
-        /*send packed data to device memory*/
-        glGenBuffersARB_ptr(1, &pixbuffer);
-        glBindBufferARB_ptr(GL_PIXEL_UNPACK_BUFFER, pixbuffer);
-        glBufferDataARB_ptr(GL_PIXEL_UNPACK_BUFFER, bytes, packed,
-                            GL_STATIC_DRAW);
-        free(packed);
-        /*texture object*/
-        glGenTextures(2, texbuf);
-        glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-        if(gen_mips)
+    }
+    obj->pos.x = (float)p[0];
+    obj->pos.y = (float)p[1];
+    obj->pos.z = (float)p[2];
+}
+
+void pose_static_actor(A3DActor *obj, float *m)
+{
+    const double t = sim_time - obj->spawn_time;
+    double a;
+    float s1, s2, s3, c1, c2, c3, r[4], q[4], len, s;
+    float *x = &(obj->quat_orientation.x),
+          *y = &(obj->quat_orientation.y),
+          *z = &(obj->quat_orientation.z),
+          *w = &(obj->quat_orientation.w);
+
+    locate_static_actor(obj);
+    /*the step rotate_static_actor() makes with dt = 1*/
+    s1 = (float)sin(obj->euler_rot.yaw   * 0.5f);
+    s2 = (float)sin(obj->euler_rot.roll  * 0.5f);
+    s3 = (float)sin(obj->euler_rot.pitch * 0.5f);
+    c1 = (float)cos(obj->euler_rot.yaw   * 0.5f);
+    c2 = (float)cos(obj->euler_rot.roll  * 0.5f);
+    c3 = (float)cos(obj->euler_rot.pitch * 0.5f);
+    r[3] = c1*c2*c3 - s1*s2*s3;
+    r[0] = s1*s2*c3 + c1*c2*s3;
+    r[1] = s1*c2*c3 + c1*s2*s3;
+    r[2] = c1*s2*c3 - s1*c2*s3;
+    /*raised to the power t as axis and angle*/
+    len = (float)sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+    if(len > 1e-7f)
+    {
+        a = atan2(len, r[3])*t;
+        s = (float)sin(a)/len;
+        r[0] *= s;
+        r[1] *= s;
+        r[2] *= s;
+        r[3]  = (float)cos(a);
+    }
+    else
+    {
+        r[0] = r[1] = r[2] = 0.f;
+        r[3] = 1.f;
+    }
+    /*spawn orientation times spin, as in rotate_static_actor()*/
+    q[0] = obj->spawn_orientation.x;
+    q[1] = obj->spawn_orientation.y;
+    q[2] = obj->spawn_orientation.z;
+    q[3] = obj->spawn_orientation.w;
+    *x = q[3]*r[0] + q[0]*r[3] + q[1]*r[2] - q[2]*r[1];
+    *y = q[3]*r[1] + q[1]*r[3] + q[2]*r[0] - q[0]*r[2];
+    *z = q[3]*r[2] + q[2]*r[3] + q[0]*r[1] - q[1]*r[0];
+    *w = q[3]*r[3] - q[0]*r[0] - q[1]*r[1] - q[2]*r[2];
+    if(!m)
+        return;
+    m[0]  = 1.f - 2.f*(*y)*(*y) - 2.f*(*z)*(*z);
+    m[1]  = 2.f*(*x)*(*y) - 2.f*(*z)*(*w);
+    m[2]  = 2.f*(*x)*(*z) + 2.f*(*y)*(*w);
+    m[3]  = 0.f;
+    m[4]  = 2.f*(*x)*(*y) + 2.f*(*z)*(*w);
+    m[5]  = 1.f - 2.f*(*x)*(*x) - 2.f*(*z)*(*z);
+    m[6]  = 2.f*(*y)*(*z) - 2.f*(*x)*(*w);
+    m[7]  = 0.f;
+    m[8]  = 2.f*(*x)*(*z) - 2.f*(*y)*(*w);
+    m[9]  = 2.f*(*y)*(*z) + 2.f*(*x)*(*w);
+    m[10] = 1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y);
+    m[11] = 0.f;
+    m[12] = obj->pos.x;
+    m[13] = obj->pos.y;
+    m[14] = obj->pos.z;
+    m[15] = 1.f;
+}
+
+void place_static_actor(A3DActor *obj)
+{
+    float m[16];
+    pose_static_actor(obj, m);
+    glMultMatrixf(m);
+}
+
+void begin_sim_step(A3DSimTiers *s, const A3DActor *shots, const int count,
+                    const A3DActor *player)
+{
+    int i, dx, dy, dz;
+    s->step++;
+    s->updates   = 0;
+    s->player[0] = -player->pos.x;
+    s->player[1] = -player->pos.y;
+    s->player[2] = -player->pos.z;
+    memset(s->counts, 0, sizeof(s->counts));
+    memset(s->hot, 0, sizeof(s->hot));
+    for(i = 0; i <= count; i++)
+    {
+        float p[3];
+        if(i < count && !shots[i].is_spawned)
+            continue;
+        if(i < count)
         {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                            GL_NEAREST_MIPMAP_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP_SGIS, GL_TRUE);
+            p[0] = shots[i].pos.x;
+            p[1] = shots[i].pos.y;
+            p[2] = shots[i].pos.z;
         }
         else
+            memcpy(p, s->player, sizeof(p));
+        for(dz = -1; dz <= 1; dz++)
+            for(dy = -1; dy <= 1; dy++)
+                for(dx = -1; dx <= 1; dx++)
+                    s->hot[sim_cell(p[0], p[1], p[2], dx, dy, dz)] = 1;
+    }
+}
+
+bool sim_due(A3DSimTiers *s, const int index, A3DActor *a)
+{
+    const float edge = ARENA_SIZE - SIM_CELL;
+    const unsigned turn = s->step + (unsigned)index;
+    float dx, dy, dz, d;
+    bool due;
+    /*within SIM_FAR_RATE steps of drift from an edge, it may have
+     *wrapped since it was last located*/
+    if(!sectors.enabled &&
+       (a->pos.x > edge || a->pos.x < -edge ||
+        a->pos.y > edge || a->pos.y < -edge ||
+        a->pos.z > edge || a->pos.z < -edge))
+        locate_static_actor(a);
+    dx = a->pos.x - s->player[0];
+    dy = a->pos.y - s->player[1];
+    dz = a->pos.z - s->player[2];
+    d  = dx*dx + dy*dy + dz*dz;
+    /*the last known position is close enough to pick a tier*/
+    if(d < SIM_NEAR*SIM_NEAR)
+    {
+        s->counts[0]++;
+        due = true;
+    }
+    else if(d < SIM_MID*SIM_MID)
+    {
+        s->counts[1]++;
+        due = turn % SIM_MID_RATE == 0;
+    }
+    else
+    {
+        s->counts[2]++;
+        due = turn % SIM_FAR_RATE == 0;
+    }
+    if(!due)
+        due = s->hot[sim_cell(a->pos.x, a->pos.y, a->pos.z, 0, 0, 0)];
+    if(due)
+        s->updates++;
+    return due;
+}
+
+int sim_cell(const float x, const float y, const float z,
+             const int dx, const int dy, const int dz)
+{
+    /*offset to keep the truncation a floor*/
+    const float fx = x/SIM_CELL + 4096.f,
+                fy = y/SIM_CELL + 4096.f,
+                fz = z/SIM_CELL + 4096.f;
+    const unsigned cx = (unsigned)((int)(fx > 0.f ? fx : 0.f) + dx),
+                   cy = (unsigned)((int)(fy > 0.f ? fy : 0.f) + dy),
+                   cz = (unsigned)((int)(fz > 0.f ? fz : 0.f) + dz);
+    return (int)((cx*73856093u ^ cy*19349663u ^ cz*83492791u) % SIM_GRID);
+}
+
+bool init_gravity(A3DGravity *g, const int capacity)
+{
+    g->enabled       = false;
+    g->theta         = GRAVITY_THETA;
+    g->capacity      = capacity;
+    g->count         = 0;
+    g->task_count    = 0;
+    g->size          = 1.f;
+    g->lo[0] = g->lo[1] = g->lo[2] = 0.f;
+    /*about two nodes a body for even fields*/
+    g->node_capacity = capacity*2 + GRAVITY_TASKS*8 + 1;
+    SDL_AtomicSet(&g->used, 1);
+    /*one block for the bodies, as the sort swaps its arrays*/
+    g->x         = malloc((sizeof(float)*14 + sizeof(unsigned)*2 +
+                           sizeof(int)*2)*capacity);
+    g->nodes     = malloc(sizeof(A3DGravityNode)*g->node_capacity);
+    if(!g->x || !g->nodes)
+    {
+        fprintf(stderr, "Failed to allocate gravity tree.\n");
+        free_gravity(g);
+        return false;
+    }
+    g->y         = g->x  + capacity;
+    g->z         = g->y  + capacity;
+    g->m         = g->z  + capacity;
+    g->ax        = g->m  + capacity;
+    g->ay        = g->ax + capacity;
+    g->az        = g->ay + capacity;
+    g->sx        = g->az + capacity;
+    g->sy        = g->sx + capacity;
+    g->sz        = g->sy + capacity;
+    g->sm        = g->sz + capacity;
+    g->code      = (unsigned*)(g->sm + capacity);
+    g->code_tmp  = g->code  + capacity;
+    g->order     = (int*)(g->code_tmp + capacity);
+    g->order_tmp = g->order + capacity;
+    return true;
+}
+
+void build_gravity(A3DGravity *g, A3DWorkers *w)
+{
+    unsigned hist[1 << GRAVITY_BITS];
+    float hi[3];
+    int i, k, pass;
+    A3DGravityNode *root = &g->nodes[0];
+    SDL_AtomicSet(&g->used, 1);
+    g->task_count = 0;
+    root->child = 0;
+    root->first = 0;
+    root->count = g->count;
+    root->mass  = 0.f;
+    root->com[0] = root->com[1] = root->com[2] = 0.f;
+    if(g->count < 1)
+        return;
+    /*bounding cube*/
+    g->lo[0] = hi[0] = g->x[0];
+    g->lo[1] = hi[1] = g->y[0];
+    g->lo[2] = hi[2] = g->z[0];
+    for(i = 1; i < g->count; i++)
+    {
+        if(g->x[i] < g->lo[0]) g->lo[0] = g->x[i];
+        if(g->y[i] < g->lo[1]) g->lo[1] = g->y[i];
+        if(g->z[i] < g->lo[2]) g->lo[2] = g->z[i];
+        if(g->x[i] > hi[0])    hi[0]    = g->x[i];
+        if(g->y[i] > hi[1])    hi[1]    = g->y[i];
+        if(g->z[i] > hi[2])    hi[2]    = g->z[i];
+    }
+    g->size = 1.f;
+    for(i = 0; i < 3; i++)
+        if(hi[i] - g->lo[i] > g->size)
+            g->size = hi[i] - g->lo[i];
+    g->size *= 1.001f;
+    root->size = g->size;
+    run_workers(w, gravity_codes, g, g->count, 4096);
+    /*radix sort the codes, a digit of GRAVITY_BITS a pass*/
+    for(pass = 0; pass < 3; pass++)
+    {
+        const int shift = pass*GRAVITY_BITS;
+        unsigned sum = 0, *tc;
+        int *to;
+        memset(hist, 0, sizeof(hist));
+        for(i = 0; i < g->count; i++)
+            hist[(g->code[i] >> shift) & ((1 << GRAVITY_BITS) - 1)]++;
+        for(k = 0; k < 1 << GRAVITY_BITS; k++)
         {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        }
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_2D, texbuf[1]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        if(red_tc) /*red channel compression*/
-        {
-            int txc;
-            glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1_EXT,
-                    i_font.width, i_font.height, 0, GL_LUMINANCE,
-                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_font.offset);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
-            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
-                    GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &txc);
-            printf("%s - RGTC Red channel compression: %d bytes\n",
-                    i_font.filename, txc);
-            glBindTexture(GL_TEXTURE_2D, texbuf[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1_EXT,
-                    i_skybox.width, i_skybox.height, 0, GL_LUMINANCE,
-                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_skybox.offset);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
-            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
-                    GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &txc);
-            printf("%s - RGTC Red channel compression: %d bytes\n",
-                    i_skybox.filename, txc);
+            unsigned c = hist[k];
+            hist[k] = sum;
+            sum += c;
         }
-        else /*no compression*/
+        for(i = 0; i < g->count; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY,
-                    i_font.width, i_font.height, 0, GL_LUMINANCE,
-                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_font.offset);
-            glBindTexture(GL_TEXTURE_2D, texbuf[1]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                    i_skybox.width, i_skybox.height, 0, GL_LUMINANCE,
-                    GL_UNSIGNED_BYTE, (void*)(intptr_t)i_skybox.offset);
+            const unsigned d = hist[(g->code[i] >> shift) &
+                                    ((1 << GRAVITY_BITS) - 1)]++;
+            g->code_tmp[d]  = g->code[i];
+            g->order_tmp[d] = g->order[i];
         }
-        printf("Image uncompressed data total: %d bytes\n\n", bytes);
+        tc = g->code;  g->code  = g->code_tmp;  g->code_tmp  = tc;
+        to = g->order; g->order = g->order_tmp; g->order_tmp = to;
     }
-    else
+    run_workers(w, gravity_gather, g, g->count, 4096);
+    /*top levels here, the subtrees below on the workers*/
+    build_gravity_node(g, 0, 0, GRAVITY_SPLIT);
+    run_workers(w, gravity_subtrees, g, g->task_count, 1);
+    sum_gravity_top(g, 0, 0);
+}
+
+void solve_gravity(A3DGravity *g, A3DWorkers *w)
+{
+    if(g->count > 0)
+        run_workers(w, gravity_forces, g, g->count, 256);
+}
+
+void gravity_reference(const A3DGravity *g, const int i, float *a)
+{
+    int j;
+    a[0] = a[1] = a[2] = 0.f;
+    for(j = 0; j < g->count; j++)
     {
-        fprintf(stderr, "Could not process image file %s\n", i_font.filename);
-        perror("fopen error");
+        float dx, dy, dz, r;
+        if(j == i)
+            continue;
+        dx = g->x[j] - g->x[i];
+        dy = g->y[j] - g->y[i];
+        dz = g->z[j] - g->z[i];
+        r  = dx*dx + dy*dy + dz*dz + GRAVITY_SOFTENING*GRAVITY_SOFTENING;
+        r  = GRAVITY_G*g->m[j]/(r*(float)sqrt(r));
+        a[0] += dx*r;
+        a[1] += dy*r;
+        a[2] += dz*r;
+    }
+}
+
+void step_gravity(A3DGravity *g, A3DWorkers *w, A3DActor *aster,
+                  const int count, A3DActor *player, const float dt)
+{
+    int i, n = 0;
+    for(i = 0; i < count && n < g->capacity; i++)
+    {
+        if(!aster[i].is_spawned)
+            continue;
+        locate_static_actor(&aster[i]);
+        g->x[n] = aster[i].pos.x;
+        g->y[n] = aster[i].pos.y;
+        g->z[n] = aster[i].pos.z;
+        g->m[n] = aster[i].mass;
+        n++;
+    }
+    /*the player is at -pos*/
+    if(player->is_spawned && n < g->capacity)
+    {
+        g->x[n] = -player->pos.x;
+        g->y[n] = -player->pos.y;
+        g->z[n] = -player->pos.z;
+        g->m[n] = GRAVITY_PLAYER;
+        n++;
+    }
+    g->count = n;
+    build_gravity(g, w);
+    solve_gravity(g, w);
+    n = 0;
+    for(i = 0; i < count && n < g->capacity; i++)
+    {
+        if(!aster[i].is_spawned)
+            continue;
+        pose_static_actor(&aster[i], NULL);
+        aster[i].vel.x += g->ax[n]*dt;
+        aster[i].vel.y += g->ay[n]*dt;
+        aster[i].vel.z += g->az[n]*dt;
+        spawn_static_actor(&aster[i]);
+        n++;
+    }
+    if(player->is_spawned && n < g->count)
+    {
+        player->vel.x -= g->ax[n]*dt;
+        player->vel.y -= g->ay[n]*dt;
+        player->vel.z -= g->az[n]*dt;
+    }
+}
+
+void free_gravity(A3DGravity *g)
+{
+    free(g->x);
+    free(g->nodes);
+    g->x       = NULL;
+    g->nodes   = NULL;
+    g->enabled = false;
+}
+
+int run_gravity_bench(const float theta)
+{
+    const int counts[3] = {1000, 10000, 100000};
+    const int runs = 5, sample = 1000;
+    const Uint64 perf_freq = SDL_GetPerformanceFrequency();
+    const double freq = (double)perf_freq/1000.0;
+    A3DWorkers workers;
+    A3DGravity g;
+    unsigned seed = 0x9e3779b9u;
+    int i, j, threads = SDL_GetCPUCount() - 1;
+    if(threads > 7) threads = 7;
+    if(!init_workers(&workers, threads))
+        fprintf(stderr, "Worker threads disabled.\n");
+    if(!init_gravity(&g, counts[2]))
+    {
+        free_workers(&workers);
         return 1;
     }
-    free(i_font.filename);
-    free(i_skybox.filename);
-    /*setup*/
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    tmp_diffuse_color[0] = 0.5f;
-    tmp_diffuse_color[1] = 0.5f;
-    tmp_diffuse_color[2] = 0.5f;
-    glMaterialfv(GL_FRONT, GL_SPECULAR, tmp_diffuse_color);
-    glMateriali(GL_FRONT, GL_SHININESS, 127);
-    glEnable(GL_RESCALE_NORMAL);
-    glEnable(GL_FOG);
-    glFogi(GL_FOG_MODE, GL_LINEAR);
-    glFogf(GL_FOG_START, 500.f);
-    glFogf(GL_FOG_END, 800.f);
-    glBlendFunc(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
-    glShadeModel(GL_FLAT);
+    g.theta = theta;
+    printf("{\n");
+    printf("  \"theta\": %.3f,\n",   theta);
+    printf("  \"threads\": %d,\n",   workers.count + 1);
+    printf("  \"runs\": [\n");
+    for(j = 0; j < 3; j++)
+    {
+        const int n = counts[j],
+                  stride = n > sample ? n/sample : 1;
+        double build_ms = 0.0, solve_ms = 0.0, brute_ms, err = 0.0,
+               max_err = 0.0;
+        Uint64 t;
+        int tested = 0;
+        g.count = n;
+        for(i = 0; i < n; i++)
+        {
+            g.x[i] = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
+            g.y[i] = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
+            g.z[i] = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
+            g.m[i] = (float)(ASTER_SMALL + xorshift32(&seed)%ASTER_LARGE);
+        }
+        for(i = 0; i < runs; i++)
+        {
+            t = SDL_GetPerformanceCounter();
+            build_gravity(&g, &workers);
+            build_ms += (double)(SDL_GetPerformanceCounter() - t)/freq;
+            t = SDL_GetPerformanceCounter();
+            solve_gravity(&g, &workers);
+            solve_ms += (double)(SDL_GetPerformanceCounter() - t)/freq;
+        }
+        /*direct sums over the sample, on this thread*/
+        t = SDL_GetPerformanceCounter();
+        for(i = 0; i < n; i += stride)
+        {
+            float a[3];
+            double d, r;
+            gravity_reference(&g, i, a);
+            d = (double)((a[0] - g.ax[i])*(a[0] - g.ax[i]) +
+                         (a[1] - g.ay[i])*(a[1] - g.ay[i]) +
+                         (a[2] - g.az[i])*(a[2] - g.az[i]));
+            r = (double)(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+            d = r > 0.0 ? sqrt(d/r) : 0.0;
+            err += d*d;
+            if(d > max_err)
+                max_err = d;
+            tested++;
+        }
+        brute_ms = (double)(SDL_GetPerformanceCounter() - t)/freq;
+        brute_ms *= (double)n/tested;
+        printf("    {\"bodies\": %d, ", n);
+        printf("\"nodes\": %d, ", SDL_AtomicGet(&g.used) < g.node_capacity ?
+               SDL_AtomicGet(&g.used) : g.node_capacity);
+        printf("\"build_ms\": %.3f, ",    build_ms/runs);
+        printf("\"solve_ms\": %.3f, ",    solve_ms/runs);
+        printf("\"brute_ms\": %.3f, ",    brute_ms);
+        printf("\"brute_sampled\": %d, ", tested);
+        printf("\"rms_error\": %.6f, ",   sqrt(err/tested));
+        printf("\"max_error\": %.6f}%s\n", max_err, j < 2 ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+    free_gravity(&g);
+    free_workers(&workers);
+    return 0;
+}
 
-    prevtime = SDL_GetTicks();
+void gravity_codes(void *data, int begin, int end)
+{
+    A3DGravity *g = data;
+    const float scale = (float)(1 << GRAVITY_BITS)/g->size;
+    int i, k, b;
+    for(i = begin; i < end; i++)
+    {
+        unsigned q[3], code = 0;
+        float p[3];
+        p[0] = (g->x[i] - g->lo[0])*scale;
+        p[1] = (g->y[i] - g->lo[1])*scale;
+        p[2] = (g->z[i] - g->lo[2])*scale;
+        for(k = 0; k < 3; k++)
+        {
+            q[k] = p[k] > 0.f ? (unsigned)p[k] : 0;
+            if(q[k] > (1 << GRAVITY_BITS) - 1)
+                q[k] = (1 << GRAVITY_BITS) - 1;
+        }
+        /*interleave x, y, z bits, most significant first*/
+        for(b = GRAVITY_BITS - 1; b >= 0; b--)
+            code = (code << 3) | (((q[0] >> b) & 1) << 2) |
+                   (((q[1] >> b) & 1) << 1) | ((q[2] >> b) & 1);
+        g->code[i]  = code;
+        g->order[i] = i;
+    }
+}
 
-    /*spawn initial asteroids*/
-    srand((unsigned)time(NULL));
-    for(i = 0; i < INIT_ASTEROIDS; i++)
+void gravity_gather(void *data, int begin, int end)
+{
+    A3DGravity *g = data;
+    int i;
+    for(i = begin; i < end; i++)
     {
-        a_aster[i].is_spawned      = true;
-        if(rand() & 0x01)      /*50%*/
-            a_aster[i].mass        = ASTER_MED;
-        else if(rand() & 0x01) /*25%*/
-            a_aster[i].mass        = ASTER_LARGE;
-        else                   /*25%*/
-            a_aster[i].mass        = ASTER_SMALL;
-        a_aster[i].pos.x           = (float)((rand()%500) - 250);
-        a_aster[i].pos.y           = (float)((rand()%500) - 250);
-        a_aster[i].pos.z           = ARENA_SIZE;
-        a_aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
-        a_aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
-        a_aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
-        a_aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
-        a_aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
-        a_aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+        g->sx[i] = g->x[g->order[i]];
+        g->sy[i] = g->y[g->order[i]];
+        g->sz[i] = g->z[g->order[i]];
+        g->sm[i] = g->m[g->order[i]];
     }
+}
 
-    /*main loop*/
-    while(!loop_exit)
+void gravity_subtrees(void *data, int begin, int end)
+{
+    A3DGravity *g = data;
+    int i;
+    for(i = begin; i < end; i++)
+        build_gravity_node(g, g->tasks[i], GRAVITY_SPLIT, -1);
+}
+
+void gravity_forces(void *data, int begin, int end)
+{
+    A3DGravity *g = data;
+    const float eps = GRAVITY_SOFTENING*GRAVITY_SOFTENING,
+                theta2 = g->theta*g->theta;
+    int stack[8*GRAVITY_BITS + 8];
+    int i, j, top;
+    for(i = begin; i < end; i++)
     {
-        do {
-            /*get previous frame time*/
-            currtime = SDL_GetTicks();
-            if(frametime < 0.0001f)
-            {
-                frametime = (float)(currtime - prevtime);
-                if(frametime > 250) frametime = 250;
-            }
-            /*min(frametime, target_time)*/
-            if(frametime > target_time)
+        const float px = g->sx[i], py = g->sy[i], pz = g->sz[i];
+        float a[3];
+        a[0] = a[1] = a[2] = 0.f;
+        stack[0] = 0;
+        top = 1;
+        while(top)
+        {
+            const A3DGravityNode *n = &g->nodes[stack[--top]];
+            const float dx = n->com[0] - px,
+                        dy = n->com[1] - py,
+                        dz = n->com[2] - pz,
+                        d2 = dx*dx + dy*dy + dz*dz;
+            const bool inside = i >= n->first && i < n->first + n->count;
+            float r;
+            if(n->mass <= 0.f)
+                continue;
+            /*far enough to be a point mass*/
+            if(!inside && n->size*n->size < theta2*d2)
             {
-                mintime = target_time;
-                skip_dt = true;
+                r = d2 + eps;
+                r = GRAVITY_G*n->mass/(r*(float)sqrt(r));
+                a[0] += dx*r;
+                a[1] += dy*r;
+                a[2] += dz*r;
             }
-            else if(skip_dt)
+            else if(n->child)
             {
-                skip_dt = false;
-                if(frametime > target_time*0.2f)
-                     mintime = frametime;
-                else mintime = target_time;
+                for(j = 0; j < 8; j++)
+                    stack[top++] = n->child + j;
             }
-            else mintime = frametime;
-        } while(frametime < 0.0001f);
-        /*get time modifier*/
-        timemod = mintime/target_time;
-        difftime = currtime - prevtime;
-        prevtime = currtime;
-
-        /*events*/
-        while(SDL_PollEvent(&ev_main))
-        {
-            if(ev_main.type == SDL_QUIT)
-                loop_exit = true;
-            else if(ev_main.type == SDL_KEYDOWN)
+            else
             {
-                if(ev_main.key.keysym.scancode == SDL_SCANCODE_ESCAPE)
-                    loop_exit     = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_BACKSPACE)
+                for(j = n->first; j < n->first + n->count; j++)
                 {
-                    if(camera.driftcam) camera.driftcam = false;
-                    else                camera.driftcam = true;
-                }
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_GRAVE)
-                {
-                    if(debug_level == 2) debug_level = 0;
-                    else                 debug_level++;
-                }
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_F1)
-                {
-                    int display;
-                    SDL_DisplayMode d_mode;
-                    if(fullscreen)
-                    {
-                        fullscreen = false;
-                        SDL_SetWindowFullscreen(win_main, 0);
-                        SDL_SetWindowSize(win_main, 800, 600);
-                        SDL_GL_GetDrawableSize(win_main, &width_real,
-                                              &height_real);
-                    }
-                    else
-                    {
-                        fullscreen = true;
-                        display = SDL_GetWindowDisplayIndex(win_main);
-                        SDL_GetDesktopDisplayMode(display, &d_mode);
-                        SDL_SetWindowDisplayMode(win_main, &d_mode);
-                        SDL_SetWindowFullscreen(win_main,
-                                                SDL_WINDOW_FULLSCREEN);
-                        SDL_GL_GetDrawableSize(win_main, &width_real,
-                                              &height_real);
-                    }
+                    float ex, ey, ez;
+                    if(j == i)
+                        continue;
+                    ex = g->sx[j] - px;
+                    ey = g->sy[j] - py;
+                    ez = g->sz[j] - pz;
+                    r  = ex*ex + ey*ey + ez*ez + eps;
+                    r  = GRAVITY_G*g->sm[j]/(r*(float)sqrt(r));
+                    a[0] += ex*r;
+                    a[1] += ey*r;
+                    a[2] += ez*r;
                 }
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_W)
-                    camera.forward  = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_S)
-                    camera.backward = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_A)
-                    camera.left     = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_D)
-                    camera.right    = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LSHIFT)
-                    camera.up       = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LCTRL)
-                    camera.down     = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_Q)
-                    camera.ccw      = true;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_E)
-                    camera.cw       = true;
-            }
-            else if(ev_main.type == SDL_KEYUP)
-            {
-                if(ev_main.key.keysym.scancode == SDL_SCANCODE_W)
-                    camera.forward  = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_S)
-                    camera.backward = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_A)
-                    camera.left     = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_D)
-                    camera.right    = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LSHIFT)
-                    camera.up       = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_LCTRL)
-                    camera.down     = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_Q)
-                    camera.ccw      = false;
-                else if(ev_main.key.keysym.scancode == SDL_SCANCODE_E)
-                    camera.cw       = false;
             }
-            else if(ev_main.type == SDL_MOUSEMOTION)
-            {
-                a_player.euler_rot.yaw   = -camera.rotmod * camera.sens *
-                                           (float)ev_main.motion.xrel;
-                a_player.euler_rot.pitch = -camera.rotmod * camera.sens *
-                                           (float)ev_main.motion.yrel;
-            }
-            else if(ev_main.type == SDL_MOUSEBUTTONDOWN)
-            {
-                if(ev_main.button.button == SDL_BUTTON_LEFT)
-                    camera.shoot = true;
-            }
-            else if(ev_main.type == SDL_MOUSEBUTTONUP)
+        }
+        g->ax[g->order[i]] = a[0];
+        g->ay[g->order[i]] = a[1];
+        g->az[g->order[i]] = a[2];
+    }
+}
+
+void build_gravity_node(A3DGravity *g, const int node, const int depth,
+                        const int split)
+{
+    A3DGravityNode *n = &g->nodes[node];
+    int c, k, at, end, shift;
+    n->child = 0;
+    if(depth == split)
+    {
+        g->tasks[g->task_count++] = node;
+        return;
+    }
+    if(n->count > GRAVITY_LEAF && depth < GRAVITY_BITS)
+    {
+        c = SDL_AtomicAdd(&g->used, 8);
+        if(c < g->node_capacity - 7)
+        {
+            n->child = c;
+            shift = 3*(GRAVITY_BITS - 1 - depth);
+            at = n->first;
+            end = n->first + n->count;
+            /*the octant is the next 3 bits of the sorted codes*/
+            for(k = 0; k < 8; k++)
             {
-                if(ev_main.button.button == SDL_BUTTON_LEFT)
-                    camera.shoot = false;
+                A3DGravityNode *ch = &g->nodes[c + k];
+                ch->first = at;
+                while(at < end && (int)((g->code[at] >> shift) & 7) == k)
+                    at++;
+                ch->count = at - ch->first;
+                ch->size  = n->size*0.5f;
+                build_gravity_node(g, c + k, depth + 1, split);
             }
         }
+    }
+    /*above the split, subtrees are still being built;
+     *sum_gravity_top() sums those nodes afterwards*/
+    if(split < 0 || !n->child)
+        sum_gravity_node(g, node);
+}
 
-        /*get view frustum values*/
-        top_clip = (float)tan(fov * camera.fovmod * radmod * 0.5f) * near_clip;
-        bottom_clip = -top_clip;
-        left_clip = aspect_ratio * bottom_clip;
-        right_clip = -left_clip;
+void sum_gravity_node(A3DGravity *g, const int node)
+{
+    A3DGravityNode *n = &g->nodes[node];
+    float m = 0.f, p[3];
+    int i;
+    p[0] = p[1] = p[2] = 0.f;
+    if(n->child)
+    {
+        const A3DGravityNode *c = &g->nodes[n->child];
+        for(i = 0; i < 8; i++)
+        {
+            m    += c[i].mass;
+            p[0] += c[i].com[0]*c[i].mass;
+            p[1] += c[i].com[1]*c[i].mass;
+            p[2] += c[i].com[2]*c[i].mass;
+        }
+    }
+    else
+    {
+        for(i = n->first; i < n->first + n->count; i++)
+        {
+            m    += g->sm[i];
+            p[0] += g->sx[i]*g->sm[i];
+            p[1] += g->sy[i]*g->sm[i];
+            p[2] += g->sz[i]*g->sm[i];
+        }
+    }
+    n->mass = m;
+    if(m > 0.f)
+    {
+        n->com[0] = p[0]/m;
+        n->com[1] = p[1]/m;
+        n->com[2] = p[2]/m;
+    }
+    else
+        n->com[0] = n->com[1] = n->com[2] = 0.f;
+}
+
+void sum_gravity_top(A3DGravity *g, const int node, const int depth)
+{
+    int i;
+    if(depth >= GRAVITY_SPLIT || !g->nodes[node].child)
+        return;
+    for(i = 0; i < 8; i++)
+        sum_gravity_top(g, g->nodes[node].child + i, depth + 1);
+    sum_gravity_node(g, node);
+}
+
+bool generate_fragments(A3DFragments *f, A3DModel *pieces,
+                        const A3DOccluderMesh *mesh)
+{
+    /*directions of the pieces of each fracture*/
+    static const float dirs[FRACTURE_PIECES][3] = {
+        { 1.f,  0.f,    0.f}, {-1.f,  0.f,    0.f},
+        { 1.f,  0.f,    0.f}, {-0.5f, 0.866f, 0.f}, {-0.5f,-0.866f, 0.f},
+        { 1.f,  1.f,    1.f}, { 1.f, -1.f,   -1.f},
+        {-1.f,  1.f,   -1.f}, {-1.f, -1.f,    1.f},
+        { 0.f,  0.f,    1.f}, { 0.f,  0.f,   -1.f}, { 1.f,  0.f,    0.f},
+        {-0.5f, 0.866f, 0.f}, {-0.5f,-0.866f, 0.f},
+        { 1.f,  0.f,    0.f}, {-1.f,  0.f,    0.f}, { 0.f,  1.f,    0.f},
+        { 0.f, -1.f,    0.f}, { 0.f,  0.f,    1.f}, { 0.f,  0.f,   -1.f}};
+    const int tris = mesh->index_count/3;
+    const float *v = mesh->vertices;
+    const unsigned *ix = mesh->indices;
+    float apex[3], radius = 0.f;
+    int *owner, i, j, k, n, first = 0;
 
-        /*update state*/
-        if(camera.ccw)
-           a_player.euler_rot.roll =  camera.rollmod * camera.rotmod * timemod;
-        if(camera.cw)
-           a_player.euler_rot.roll = -camera.rollmod * camera.rotmod * timemod;
-        if(camera.shoot && a_player.is_spawned)
+    f->enabled = false;
+    if(tris < 1)
+        return false;
+    owner = malloc(sizeof(int) * tris);
+    if(!owner)
+    {
+        fprintf(stderr, "Failed to allocate fragments\n");
+        return false;
+    }
+    apex[0] = apex[1] = apex[2] = 0.f;
+    for(i = 0; i < mesh->vertex_count; i++)
+    {
+        float r = 0.f;
+        for(j = 0; j < 3; j++)
         {
-            /*when button is pressed, or after 16 frames*/
-            if(!shot_loop_count || currtime - shot_loop_count > 250)
-            {
-                shot_loop_count = currtime;
-                /*find free projectile object*/
-                for(i = 0; i < MAX_SHOTS; i++)
-                {
-                    if(a_shot[i].is_spawned)
-                        continue;
-                    a_shot[i].is_spawned = true;
-                    a_shot[i].pos.x = -a_player.pos.x;
-                    a_shot[i].pos.y = -a_player.pos.y;
-                    a_shot[i].pos.z = -a_player.pos.z;
-                    a_shot[i].vel.x = 0.f;
-                    a_shot[i].vel.y = 0.f;
-                    a_shot[i].vel.z = shot_speed;
-                    /*180 degree yaw applied to conj(player)*/
-                    a_shot[i].quat_orientation.x =-a_player.quat_orientation.z;
-                    a_shot[i].quat_orientation.y = a_player.quat_orientation.w;
-                    a_shot[i].quat_orientation.z = a_player.quat_orientation.x;
-                    a_shot[i].quat_orientation.w = a_player.quat_orientation.y;
-                    a_shot[i].euler_rot.yaw   = 0.f;
-                    a_shot[i].euler_rot.pitch = 0.f;
-                    a_shot[i].euler_rot.roll  = 0.f;
-                    /*apply shot_speed to real vel vector*/
-                    get_shot_vel(&(a_shot[i]));
-                    /*add player's velocity*/
-                    a_shot[i].vel.x -= a_player.vel.x;
-                    a_shot[i].vel.y -= a_player.vel.y;
-                    a_shot[i].vel.z -= a_player.vel.z;
-                    break;
-                }
-            }
+            apex[j] += v[i*3 + j]/(float)mesh->vertex_count;
+            r       += v[i*3 + j]*v[i*3 + j];
         }
-        else
-            shot_loop_count = 0;
-        /*targeting reticules*/
-        for(i = 0; i < 3; i++)
-        {
-            float *x = &a_player.quat_orientation.z,
-                  *y = &a_player.quat_orientation.w,
-                  *z = &a_player.quat_orientation.x,
-                  *w = &a_player.quat_orientation.y;
-            reticule[i].pos.x = -a_player.pos.x;
-            reticule[i].pos.y = -a_player.pos.y;
-            reticule[i].pos.z = -a_player.pos.z;
-            reticule[i].pos.x += reticule[i].offset *
-                (-2.f*(*x)*(*z) - 2.f*(*y)*(*w)) - a_player.vel.x;
-            reticule[i].pos.y += reticule[i].offset *
-                (2.f*(*y)*(*z) - 2.f*(*x)*(*w)) - a_player.vel.y;
-            reticule[i].pos.z += reticule[i].offset *
-                (1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y)) - a_player.vel.z;
-            reticule[i].ori.x = -*z;
-            reticule[i].ori.y = -*w;
-            reticule[i].ori.z = -*x;
-            reticule[i].ori.w = *y;
-        }
-        /*check asteroids*/
-        for(i = 0; i < MAX_ASTEROIDS; i++)
+        if(r > radius)
+            radius = r;
+    }
+    radius = (float)sqrt(radius);
+    for(n = FRACTURE_MIN; n <= FRACTURE_MAX; first += n, n++)
+    {
+        /*each triangle goes to the nearest direction*/
+        for(i = 0; i < tris; i++)
         {
-            float dx, dy, dz;
-            if(!a_aster[i].is_spawned || !a_player.is_spawned)
-                continue;
-            /*player collision*/
-            dx = a_aster[i].pos.x + a_player.pos.x;
-            dy = a_aster[i].pos.y + a_player.pos.y;
-            dz = a_aster[i].pos.z + a_player.pos.z;
-            /*check collision*/
-            if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) > 0.8f/(a_aster[i].mass))
-            {
-                a_player.is_spawned     = false;
-                blastmod                = 20.f;
-                a_blast.is_spawned      = true;
-                a_blast.mass            = 0.001f;
-                a_blast.pos.x           = -a_player.pos.x;
-                a_blast.pos.y           = -a_player.pos.y;
-                a_blast.pos.z           = -a_player.pos.z;
-                a_blast.euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
-                a_blast.euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
-                a_blast.euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
-            }
-            /*projectile collision*/
-            for(j = 0; j < MAX_SHOTS; j++)
+            float c[3], best = -FLT_MAX;
+            for(j = 0; j < 3; j++)
+                c[j] = v[ix[i*3]*3 + j] + v[ix[i*3 + 1]*3 + j] +
+                       v[ix[i*3 + 2]*3 + j] - 3.f*apex[j];
+            for(k = first; k < first + n; k++)
             {
-                if(!a_shot[j].is_spawned)
-                    continue;
-                /*get distance between shot and asteroid*/
-                dx = a_shot[j].pos.x - a_aster[i].pos.x;
-                dy = a_shot[j].pos.y - a_aster[i].pos.y;
-                dz = a_shot[j].pos.z - a_aster[i].pos.z;
-                /*check hit*/
-                if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) < 0.8f/a_aster[i].mass)
-                    continue;
-                a_shot[j].is_spawned = false;
-                /*spawn scoretext object*/
-                for(k = 0; k < 3; k++)
-                {
-                    if(scoretext[k].is_spawned)
-                        continue;
-                    scoretext[k].is_spawned = true;
-                    scoretext[k].offset     = 0.f;
-                    scoretext[k].pos.x      = a_aster[i].pos.x;
-                    scoretext[k].pos.y      = a_aster[i].pos.y;
-                    scoretext[k].pos.z      = a_aster[i].pos.z;
-                    break;
-                }
-                /*spawn smaller asteroid*/
-                if(a_aster[i].mass > (ASTER_LARGE + ASTER_MED)*0.5f)
-                {
-                    a_aster[i].mass = ASTER_MED;
-                    score += 10;
-                    if(k < 3) strcpy(scoretext[k].text, "+10");
-                }
-                else if(a_aster[i].mass > (ASTER_SMALL + ASTER_MED)*0.5f)
-                {
-                    a_aster[i].mass = ASTER_SMALL;
-                    score += 20;
-                    if(k < 3) strcpy(scoretext[k].text, "+20");
-                }
-                else
+                const float *d = dirs[k];
+                const float s = (c[0]*d[0] + c[1]*d[1] + c[2]*d[2]) *
+                                inv_sqrt_dwh(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+                if(s > best)
                 {
-                    a_aster[i].is_spawned = false;
-                    score += 50;
-                    if(k < 3) strcpy(scoretext[k].text, "+50");
-                }
-                a_aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
-                a_aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
-                a_aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
-                /*spawn additional asteroid*/
-                if(a_aster[i].is_spawned && (rand() & 0x01))
-                {
-                    for(k = 0; k < MAX_ASTEROIDS; k++)
-                    {
-                        if(a_aster[k].is_spawned)
-                            continue;
-                        a_aster[k].is_spawned     = true;
-                        a_aster[k].mass           = ASTER_SMALL;
-                        a_aster[k].pos.x          = a_aster[i].pos.x;
-                        a_aster[k].pos.y          = a_aster[i].pos.y;
-                        a_aster[k].pos.z          = a_aster[i].pos.z;
-                        a_aster[k].vel.x          = ((rand()%200)-100)*0.005f;
-                        a_aster[k].vel.y          = ((rand()%200)-100)*0.005f;
-                        a_aster[k].vel.z          = ((rand()%200)-100)*0.005f;
-                        a_aster[k].euler_rot.yaw  = ((rand()%400)-200)*0.0001f;
-                        a_aster[k].euler_rot.pitch= ((rand()%400)-200)*0.0001f;
-                        a_aster[k].euler_rot.roll = ((rand()%400)-200)*0.0001f;
-                        break;
-                    }
+                    best = s;
+                    owner[i] = k;
                 }
             }
         }
-        /*spawn new asteroid*/
-        if(currtime - spawn_loop_count > 30000)
+        for(k = first; k < first + n; k++)
         {
-            spawn_loop_count = currtime;
-            for(i = 0; i < MAX_ASTEROIDS; i++)
+            if(!build_fragment(f, &pieces[k], k, mesh, owner, apex, radius))
             {
-                if(a_aster[i].is_spawned)
-                    continue;
-                a_aster[i].is_spawned      = true;
-                if(rand() & 0x01) /*50%*/
-                    a_aster[i].mass        = ASTER_MED;
-                else              /*50%*/
-                    a_aster[i].mass        = ASTER_LARGE;
-                a_aster[i].pos.x           = (float)((rand()%500) - 250);
-                a_aster[i].pos.y           = (float)((rand()%500) - 250);
-                a_aster[i].pos.z           = ARENA_SIZE;
-                a_aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
-                a_aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
-                a_aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
-                a_aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
-                break;
+                fprintf(stderr, "Failed to build fragment %d\n", k);
+                for(j = 0; j < k; j++)
+                {
+                    free(pieces[j].vertex_data);
+                    free(pieces[j].index_data);
+                }
+                free(owner);
+                return false;
             }
         }
-        /*update scoretext offset*/
-        for(i = 0; i < 3; i++)
+        /*volume shares of this fracture*/
         {
-            if(!scoretext[i].is_spawned)
-                continue;
-            if(scoretext[i].offset > 1.f)
-               scoretext[i].is_spawned = false;
-            else
-            {
-               scoretext[i].offset += 0.02f * timemod;
-               scoretext[i].ori.x = -a_player.quat_orientation.x;
-               scoretext[i].ori.y = -a_player.quat_orientation.y;
-               scoretext[i].ori.z = -a_player.quat_orientation.z;
-               scoretext[i].ori.w =  a_player.quat_orientation.w;
-            }
+            float total = 0.f;
+            for(k = first; k < first + n; k++)
+                total += f->share[k];
+            for(k = first; k < first + n; k++)
+                f->share[k] /= total;
         }
-        /*grow blast effect*/
-        if(!a_player.is_spawned && a_blast.is_spawned)
+    }
+    free(owner);
+    f->enabled = true;
+    return true;
+}
+
+int fracture_asteroid(A3DFragments *f, A3DActor *aster, const int index,
+                      const int count)
+{
+    const A3DActor parent = aster[index];
+    const int first = (count - 2)*(count + 1)/2;
+    float m[16], kick[FRACTURE_MAX][3], mean[3], total = 0.f;
+    int i, j, n = count;
+
+    remove_asteroid(f, aster, index);
+    if(n > f->free_count)
+        n = f->free_count;
+    if(n < FRACTURE_MIN)
+        return 0;
+    /*parent pose, pieces keep its orientation*/
+    {
+        A3DActor posed = parent;
+        pose_static_actor(&posed, m);
+    }
+    /*outward kicks, less their volume weighted mean, over the
+     *pieces made when the pool cut them short*/
+    for(i = 0; i < n; i++)
+        total += f->share[first + i];
+    mean[0] = mean[1] = mean[2] = 0.f;
+    for(i = 0; i < n; i++)
+    {
+        const float *o = f->offset[first + i];
+        float len;
+        for(j = 0; j < 3; j++)
+            kick[i][j] = m[j]*o[0] + m[4 + j]*o[1] + m[8 + j]*o[2];
+        len = kick[i][0]*kick[i][0] + kick[i][1]*kick[i][1] +
+              kick[i][2]*kick[i][2];
+        len = len > 1e-12f ? FRACTURE_SPEED*inv_sqrt_dwh(len) : 0.f;
+        for(j = 0; j < 3; j++)
         {
-            if(a_blast.mass < 2.5f)
-            {
-                a_blast.mass += timemod/blastmod;
-                camera.fovmod += 0.3f*timemod/blastmod;
-                camera.pos_offset[2] -= 2.f*timemod/blastmod;
-                blastmod += 0.5f*timemod;
-            }
-            else /*reset game*/
-            {
-                a_blast.is_spawned = false;
-                camera.fovmod = 1.f;
-                camera.pos_offset[2] = -5.f;
-                /*reset score*/
-                if(score > topscore) topscore = score;
-                score = 0;
-                reset_game(&a_player, a_aster);
-            }
+            kick[i][j] *= len;
+            mean[j]    += kick[i][j]*f->share[first + i]/total;
         }
+    }
+    for(i = 0; i < n; i++)
+    {
+        const int piece = first + i;
+        const int slot  = f->free[--f->free_count];
+        A3DActor *a = &aster[FIELD_ASTEROIDS + slot];
+        const float *o = f->offset[piece];
+        f->piece[slot] = piece;
+        *a = parent;
+        a->is_spawned = true;
+        a->mass  = parent.mass*f->scale[piece];
+        a->pos.x = m[12] + (m[0]*o[0] + m[4]*o[1] + m[8]*o[2])*parent.mass;
+        a->pos.y = m[13] + (m[1]*o[0] + m[5]*o[1] + m[9]*o[2])*parent.mass;
+        a->pos.z = m[14] + (m[2]*o[0] + m[6]*o[1] + m[10]*o[2])*parent.mass;
+        a->vel.x = parent.vel.x + kick[i][0] - mean[0];
+        a->vel.y = parent.vel.y + kick[i][1] - mean[1];
+        a->vel.z = parent.vel.z + kick[i][2] - mean[2];
+        a->quat_orientation.x = parent.quat_orientation.x;
+        a->quat_orientation.y = parent.quat_orientation.y;
+        a->quat_orientation.z = parent.quat_orientation.z;
+        a->quat_orientation.w = parent.quat_orientation.w;
+        a->euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
+        a->euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
+        a->euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+        spawn_static_actor(a);
+    }
+    return n;
+}
 
-        /*** drawing ***/
-        glViewport(0, 0, width_real, height_real);
-        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-        /*projection*/
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glFrustum(left_clip, right_clip, bottom_clip,
-                  top_clip,  near_clip,  far_clip);
-        /*modelview*/
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        /*player model*/
-        glTranslatef(camera.pos_offset[0], camera.pos_offset[1],
-                     camera.pos_offset[2]);
-        glRotatef(camera.roll, 0.f, 0.f, 1.f);
-        tmp_diffuse_color[0] = 1.f;
-        tmp_diffuse_color[1] = 1.f;
-        tmp_diffuse_color[2] = 1.f;
-        glMaterialfv(GL_FRONT, GL_DIFFUSE, tmp_diffuse_color);
-        if(a_player.is_spawned) draw_model(m_player);
-        move_camera(&camera, timemod);
-        glBindTexture(GL_TEXTURE_2D, texbuf[1]);
-        draw_skybox(m_skybox,-a_player.pos.x,-a_player.pos.y,-a_player.pos.z);
-        /*blast*/
-        if(!a_player.is_spawned)
+void remove_asteroid(A3DFragments *f, A3DActor *aster, const int index)
+{
+    if(!aster[index].is_spawned)
+        return;
+    aster[index].is_spawned = false;
+    if(index >= FIELD_ASTEROIDS)
+        f->free[f->free_count++] = index - FIELD_ASTEROIDS;
+}
+
+void reset_fragments(A3DFragments *f, A3DActor *aster)
+{
+    int i;
+    f->free_count = 0;
+    /*lowest slots on top*/
+    for(i = MAX_FRAGMENTS - 1; i >= 0; i--)
+    {
+        aster[FIELD_ASTEROIDS + i].is_spawned = false;
+        if(f->enabled)
+            f->free[f->free_count++] = i;
+        f->piece[i] = 0;
+    }
+}
+
+bool build_fragment(A3DFragments *f, A3DModel *model, const int piece,
+                    const A3DOccluderMesh *mesh, const int *owner,
+                    const float *apex, const float radius)
+{
+    const int tris = mesh->index_count/3;
+    const float *v = mesh->vertices;
+    const unsigned *ix = mesh->indices;
+    float center[3], volume = 0.f, size = 0.f, *out;
+    int i, j, k, e, faces = 0;
+
+    center[0] = center[1] = center[2] = 0.f;
+    /*volume and center of the cones to the apex*/
+    for(i = 0; i < tris; i++)
+    {
+        const float *a = v + ix[i*3]*3, *b = v + ix[i*3 + 1]*3,
+                    *c = v + ix[i*3 + 2]*3;
+        float p[3], q[3], r[3], t;
+        if(owner[i] != piece)
+            continue;
+        for(j = 0; j < 3; j++)
         {
-            glPushMatrix();
-                glPushAttrib(GL_LIGHTING_BIT);
-                tmp_diffuse_color[0] = 1.f;
-                tmp_diffuse_color[1] = 1.f;
-                tmp_diffuse_color[2] = 0.f;
-                glMaterialfv(GL_FRONT, GL_SPECULAR, tmp_diffuse_color);
-                tmp_diffuse_color[0] = 0.8f;
-                tmp_diffuse_color[1] = 0.4f;
-                tmp_diffuse_color[2] = 0.2f;
-                glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
-                             tmp_diffuse_color);
-                transform_static_actor(&a_blast, timemod);
-                glScalef(a_blast.mass, a_blast.mass, a_blast.mass);
-                draw_model(m_blast);
-                glPopAttrib();
-            glPopMatrix();
+            p[j] = a[j] - apex[j];
+            q[j] = b[j] - apex[j];
+            r[j] = c[j] - apex[j];
         }
-        /*** begin scene ***/
-        /*bounding box*/
-        glPushMatrix();
-            glPushAttrib(GL_ENABLE_BIT|GL_FOG_BIT|GL_CURRENT_BIT);
-            glDisable(GL_LIGHTING);
-            glFogf(GL_FOG_START, 200.f);
-            glFogf(GL_FOG_END, 300.f);
-            glColor3f(0.8f, 0.f, 0.f);
-            draw_model(m_boundbox);
-            glPopAttrib();
-        glPopMatrix();
-        /*projectiles*/
-        glPushAttrib(GL_LIGHTING_BIT);
-        tmp_diffuse_color[0] = 0.f;
-        tmp_diffuse_color[1] = 1.f;
-        tmp_diffuse_color[2] = 1.f;
-        for(i = 0; i < MAX_SHOTS; i++)
+        t = (p[0]*(q[1]*r[2] - q[2]*r[1]) + p[1]*(q[2]*r[0] - q[0]*r[2]) +
+             p[2]*(q[0]*r[1] - q[1]*r[0]))/6.f;
+        volume += t;
+        for(j = 0; j < 3; j++)
+            center[j] += t*(apex[j] + a[j] + b[j] + c[j])*0.25f;
+        faces++;
+    }
+    if(!faces || volume <= 0.f)
+        return false;
+    for(j = 0; j < 3; j++)
+        center[j] /= volume;
+    /*size from the farthest corner, apex included*/
+    for(j = 0; j < 3; j++)
+        size += (apex[j] - center[j])*(apex[j] - center[j]);
+    for(i = 0; i < tris; i++)
+    {
+        if(owner[i] != piece)
+            continue;
+        for(k = 0; k < 3; k++)
         {
-            float dx,dy,dz;
-            if(!a_shot[i].is_spawned)
-                continue;
-            dx = a_shot[i].pos.x + a_player.pos.x;
-            dy = a_shot[i].pos.y + a_player.pos.y;
-            dz = a_shot[i].pos.z + a_player.pos.z;
-            /*despawn shot if distance from player > 320*/
-            if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) < 0.003125f)
-                a_shot[i].is_spawned = false;
-            glMaterialfv(GL_FRONT, GL_EMISSION, tmp_diffuse_color);
-            glPushMatrix();
-                transform_static_actor(&(a_shot[i]), timemod);
-                draw_model(m_projectile);
-            glPopMatrix();
+            const float *p = v + ix[i*3 + k]*3;
+            float d = 0.f;
+            for(j = 0; j < 3; j++)
+                d += (p[j] - center[j])*(p[j] - center[j]);
+            if(d > size)
+                size = d;
         }
-        glPopAttrib();
-        /*asteroids*/
-        for(i = 0; i < MAX_ASTEROIDS; i++)
+    }
+    size = (float)sqrt(size);
+    for(j = 0; j < 3; j++)
+        f->offset[piece][j] = center[j];
+    f->scale[piece] = size/radius;
+    f->share[piece] = volume;
+    /*outer triangles and a side to the apex for each open edge*/
+    model->vertex_data = malloc(sizeof(float)*6*3 * tris*4);
+    if(!model->vertex_data)
+        return false;
+    out = model->vertex_data;
+    for(i = 0; i < tris; i++)
+    {
+        const float *face[4][3];
+        int count = 1;
+        if(owner[i] != piece)
+            continue;
+        for(k = 0; k < 3; k++)
+            face[0][k] = v + ix[i*3 + k]*3;
+        /*edge a->b is open if no triangle of the piece has b->a*/
+        for(e = 0; e < 3; e++)
         {
-            int qresult = 0;
-            if(!a_aster[i].is_spawned)
-                continue;
-            if(occ_query && started_query)
+            const unsigned a = ix[i*3 + e], b = ix[i*3 + (e + 1)%3];
+            for(j = 0; j < tris; j++)
             {
-                glGetQueryObjectivARB_ptr(aster_queries[i],
-                        GL_QUERY_RESULT, &qresult);
-                if(!qresult) continue;
-            }
-            if(a_aster[i].mass > (ASTER_LARGE + ASTER_MED)*0.5f)
-            {   /*more red*/
-                tmp_diffuse_color[0] = 0.8f;
-                tmp_diffuse_color[1] = 0.4f;
-                tmp_diffuse_color[2] = 0.4f;
-            }
-            else if(a_aster[i].mass > (ASTER_SMALL + ASTER_MED)*0.5f)
-            {   /*less red*/
-                tmp_diffuse_color[0] = 0.8f;
-                tmp_diffuse_color[1] = 0.6f;
-                tmp_diffuse_color[2] = 0.6f;
-            }
-            else
-            {   /*gray*/
-                tmp_diffuse_color[0] = 0.8f;
-                tmp_diffuse_color[1] = 0.8f;
-                tmp_diffuse_color[2] = 0.8f;
+                if(owner[j] != piece)
+                    continue;
+                for(k = 0; k < 3; k++)
+                    if(ix[j*3 + k] == b && ix[j*3 + (k + 1)%3] == a)
+                        break;
+                if(k < 3)
+                    break;
             }
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, tmp_diffuse_color);
-            glPushMatrix();
-                transform_static_actor(&(a_aster[i]), timemod);
-                glScalef(a_aster[i].mass, a_aster[i].mass, a_aster[i].mass);
-                draw_model(m_asteroid);
-            glPopMatrix();
+            if(j < tris)
+                continue;
+            face[count][0] = v + b*3;
+            face[count][1] = v + a*3;
+            face[count][2] = apex;
+            count++;
         }
-        /*asteroid occlusion queries*/
-        if(occ_query)
+        /*flat normal, then the corners centered and scaled*/
+        for(j = 0; j < count; j++)
         {
-            int sf;
-            glDeleteQueriesARB_ptr(MAX_ASTEROIDS, aster_queries);
-            glGenQueriesARB_ptr(MAX_ASTEROIDS, aster_queries);
-            if(occ_query2) sf = GL_ANY_SAMPLES_PASSED;
-            else           sf = GL_SAMPLES_PASSED_ARB;
-            glPushAttrib(GL_ENABLE_BIT|GL_DEPTH_BUFFER_BIT|
-                         GL_COLOR_BUFFER_BIT);
-            glDisable(GL_LIGHTING);
-            glDepthMask(GL_FALSE);
-            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            for(i = 0; i < MAX_ASTEROIDS; i++)
+            const float *p = face[j][0], *q = face[j][1], *r = face[j][2];
+            float nrm[3], len;
+            nrm[0] = (q[1] - p[1])*(r[2] - p[2]) - (q[2] - p[2])*(r[1] - p[1]);
+            nrm[1] = (q[2] - p[2])*(r[0] - p[0]) - (q[0] - p[0])*(r[2] - p[2]);
+            nrm[2] = (q[0] - p[0])*(r[1] - p[1]) - (q[1] - p[1])*(r[0] - p[0]);
+            len = nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2];
+            len = len > 1e-12f ? inv_sqrt_dwh(len) : 0.f;
+            for(k = 0; k < 3; k++)
             {
-                glPushMatrix();
-                    glBeginQueryARB_ptr(sf, aster_queries[i]);
-                    if(a_aster[i].is_spawned)
-                    {
-                        transform_static_actor(&(a_aster[i]), timemod);
-                        glScalef(a_aster[i].mass*1.2f, a_aster[i].mass*1.2f,
-                                a_aster[i].mass*1.2f);
-                        draw_model(m_unitbox);
-                    }
-                    glEndQueryARB_ptr(sf);
-                glPopMatrix();
+                int m;
+                for(m = 0; m < 3; m++)
+                    *out++ = nrm[m]*len;
+                for(m = 0; m < 3; m++)
+                    *out++ = (face[j][k][m] - center[m])*radius/size;
             }
-            glPopAttrib();
-            started_query = true;
         }
-        /*scoretext objects*/
-        for(i = 0; i < 3; i++)
+    }
+    model->vertex_count = (int)(out - model->vertex_data);
+    model->index_count  = model->vertex_count/6;
+    model->index_data   = malloc(sizeof(unsigned) * model->index_count);
+    if(!model->index_data)
+    {
+        free(model->vertex_data);
+        return false;
+    }
+    for(i = 0; i < model->index_count; i++)
+        model->index_data[i] = (unsigned)i;
+    model->file_root    = "none";
+    model->const_data   = false;
+    model->mode         = GL_TRIANGLES;
+    model->format       = GL_N3F_V3F;
+    return true;
+}
+
+void refit_bvh(A3DBvh *b, A3DActor *aster)
+{
+    int i;
+    for(i = 0; i < MAX_ASTEROIDS; i++)
+        if(aster[i].is_spawned)
+            locate_static_actor(&aster[i]);
+    if(b->count)
+        b->area = fit_bvh(b, aster);
+    /*motion and spawns loosen the boxes until a rebuild pays*/
+    if(!b->count || b->area > BVH_REBUILD*b->built_area)
+    {
+        build_bvh(b, aster);
+        b->area       = fit_bvh(b, aster);
+        b->built_area = b->area;
+    }
+}
+
+void build_bvh(A3DBvh *b, const A3DActor *aster)
+{
+    float center[MAX_ASTEROIDS*3];
+    int   slots[MAX_ASTEROIDS], i, n = 0, m = MAX_ASTEROIDS;
+    for(i = 0; i < MAX_ASTEROIDS; i++)
+    {
+        if(aster[i].is_spawned)
+            slots[n++] = i;
+        else
+            slots[--m] = i;
+        center[i*3]     = aster[i].pos.x;
+        center[i*3 + 1] = aster[i].pos.y;
+        center[i*3 + 2] = aster[i].pos.z;
+    }
+    b->count = 1;
+    b->builds++;
+    if(!n || n == MAX_ASTEROIDS)
+    {
+        build_bvh_node(b, 0, slots, MAX_ASTEROIDS, center);
+        return;
+    }
+    /*spawned slots on one side of the root, free ones on the other*/
+    b->nodes[0].child = 1;
+    b->nodes[0].slot  = -1;
+    b->count          = 3;
+    build_bvh_node(b, 1, slots, n, center);
+    build_bvh_node(b, 2, slots + n, MAX_ASTEROIDS - n, center);
+}
+
+void build_bvh_node(A3DBvh *b, const int node, int *slots, const int count,
+                    const float *center)
+{
+    A3DBvhNode *n = &b->nodes[node];
+    float       lo[3], hi[3];
+    int         i, j, axis = 0;
+    if(count == 1)
+    {
+        n->child = 0;
+        n->slot  = slots[0];
+        return;
+    }
+    for(j = 0; j < 3; j++)
+        lo[j] = hi[j] = center[slots[0]*3 + j];
+    for(i = 1; i < count; i++)
+    {
+        for(j = 0; j < 3; j++)
         {
-            if(!scoretext[i].is_spawned)
-                continue;
-            glPushAttrib(GL_CURRENT_BIT);
-            glColor3f(0.5f - 0.5f*(scoretext[i].offset),
-                      1.f - scoretext[i].offset, 0.f);
-            glPushMatrix();
-                orient_text(scoretext[i]);
-                glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-                draw_text(scoretext[i].text, 10.f, false);
-            glPopMatrix();
-            glPopAttrib();
+            const float c = center[slots[i]*3 + j];
+            if(c < lo[j]) lo[j] = c;
+            if(c > hi[j]) hi[j] = c;
         }
-        /*targeting reticules*/
-        for(i = 0; i < 3; i++)
+    }
+    if(hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+    if(hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+    /*sort along the longest axis, the median splits*/
+    for(i = 1; i < count; i++)
+    {
+        const int   s = slots[i];
+        const float c = center[s*3 + axis];
+        for(j = i; j > 0 && center[slots[j - 1]*3 + axis] > c; j--)
+            slots[j] = slots[j - 1];
+        slots[j] = s;
+    }
+    n->child  = b->count;
+    n->slot   = -1;
+    b->count += 2;
+    build_bvh_node(b, n->child, slots, count/2, center);
+    build_bvh_node(b, n->child + 1, slots + count/2, count - count/2,
+                   center);
+}
+
+float fit_bvh(A3DBvh *b, const A3DActor *aster)
+{
+    float area = 0.f;
+    int   i, j;
+    /*children always follow their parent*/
+    for(i = b->count - 1; i >= 0; i--)
+    {
+        A3DBvhNode *n = &b->nodes[i];
+        if(!n->child)
         {
-            if(!a_player.is_spawned)
-                break;
-            glPushAttrib(GL_CURRENT_BIT|GL_ENABLE_BIT);
-            glDisable(GL_DEPTH_TEST);
-            glColor3f(1.f, 1.f, 1.f);
-            glPushMatrix();
-                orient_text(reticule[i]);
-                glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-                draw_text(reticule[i].text, 0.02f*reticule[i].offset, true);
-            glPopMatrix();
-            glPopAttrib();
+            const A3DActor *a = &aster[n->slot];
+            /*same radius as the collision tests*/
+            const float     r = a->mass/0.8f;
+            if(!a->is_spawned)
+            {
+                for(j = 0; j < 3; j++)
+                {
+                    n->lo[j] =  1e30f;
+                    n->hi[j] = -1e30f;
+                }
+                continue;
+            }
+            n->lo[0] = a->pos.x - r;
+            n->lo[1] = a->pos.y - r;
+            n->lo[2] = a->pos.z - r;
+            n->hi[0] = a->pos.x + r;
+            n->hi[1] = a->pos.y + r;
+            n->hi[2] = a->pos.z + r;
         }
-        /*bitmap text*/
-        if(debug_level)
+        else
         {
-            glMatrixMode(GL_PROJECTION);
-            glLoadIdentity();
-            glOrtho(-aspect_ratio, aspect_ratio, -1.f, 1.f, -1.f, 1.f);
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-            glBindTexture(GL_TEXTURE_2D, texbuf[0]);
-            glPushMatrix(); /*relative vel*/
-                glTranslatef(-aspect_ratio*0.5f, -0.94f, 0.f);
-                draw_text(t_relvel, aspect_ratio, false);
-            glPopMatrix();
-            glPushMatrix(); /*score*/
-                glTranslatef(-aspect_ratio + 0.01f, 0.98f, 0.f);
-                draw_text(t_score, 0.02f, true);
-            glPopMatrix();
-            glPushMatrix(); /*topscore*/
-                glTranslatef(-aspect_ratio + 0.01f, 0.94f, 0.f);
-                draw_text(t_topscore, 0.02f, true);
-            glPopMatrix();
-            if(debug_level > 1)
-            {
-                glPushMatrix(); /*FPS*/
-                    glTranslatef(aspect_ratio*0.8f, 0.98f, 0.f);
-                    draw_text(t_fps, 0.02f, true);
-                glPopMatrix();
-                glPushMatrix(); /*ms/F*/
-                    glTranslatef(aspect_ratio*0.8f, 0.94f, 0.f);
-                    draw_text(t_mspf, 0.02f, true);
-                glPopMatrix();
+            const A3DBvhNode *c = &b->nodes[n->child];
+            for(j = 0; j < 3; j++)
+            {
+                n->lo[j] = c[0].lo[j] < c[1].lo[j] ? c[0].lo[j] : c[1].lo[j];
+                n->hi[j] = c[0].hi[j] > c[1].hi[j] ? c[0].hi[j] : c[1].hi[j];
             }
+            if(n->lo[0] > n->hi[0])
+                continue;
         }
-        /*** end scene ***/
-        SDL_GL_SwapWindow(win_main);
-        frametime -= mintime;
-        /*update text/window title*/
-        if(currtime - title_loop_count > 500)
+        area += (n->hi[0] - n->lo[0])*(n->hi[1] - n->lo[1]) +
+                (n->hi[1] - n->lo[1])*(n->hi[2] - n->lo[2]) +
+                (n->hi[2] - n->lo[2])*(n->hi[0] - n->lo[0]);
+    }
+    return area;
+}
+
+float ray_box(const A3DBvhNode *n, const float *origin, const float *inv,
+              const float range)
+{
+    float tmin = 0.f, tmax = range;
+    int   i;
+    if(n->lo[0] > n->hi[0])
+        return -1.f;
+    for(i = 0; i < 3; i++)
+    {
+        float t0 = (n->lo[i] - origin[i])*inv[i],
+              t1 = (n->hi[i] - origin[i])*inv[i];
+        if(t0 > t1)
         {
-            float relvel = 16.f/(inv_sqrt_dwh(a_player.vel.x*a_player.vel.x +
-                                              a_player.vel.y*a_player.vel.y +
-                                              a_player.vel.z*a_player.vel.z));
-            title_loop_count = currtime;
-            sprintf(t_mspf,     "%u ms/F", difftime);
-            sprintf(t_fps,      "%.2f FPS", 1000.f/(float)difftime);
-            sprintf(t_relvel,   "Relative velocity: %.2f m/s", relvel);
-            sprintf(t_score,    "Score:     %u", score);
-            sprintf(t_topscore, "Top Score: %u", topscore);
-            sprintf(win_title, "Asteroids 3D - %s - %s --- %s --- %s",
-                    t_score, t_topscore, t_relvel, t_fps);
-            SDL_SetWindowTitle(win_main, win_title);
+            const float t = t0;
+            t0 = t1;
+            t1 = t;
         }
+        if(t0 > tmin) tmin = t0;
+        if(t1 < tmax) tmax = t1;
     }
-
-    /*cleanup*/
-    if(glGetError() != GL_NO_ERROR)
-        fprintf(stderr, "GL encountered an error durring execution\n");
-    SDL_GL_DeleteContext(win_main_gl);
-    SDL_DestroyWindow(win_main);
-    SDL_Quit();
-    return 0;
+    return tmin <= tmax ? tmin : -1.f;
 }
 
-void reset_game(A3DActor *player, A3DActor *aster)
+int cast_ray(const A3DBvh *b, const A3DActor *aster, A3DRay *ray)
 {
-    int i;
-    /*reset player*/
-    player->is_spawned         = true;
-    player->pos.x              = 0.f;
-    player->pos.y              = 0.f;
-    player->pos.z              = 0.f;
-    player->vel.x              = 0.f;
-    player->vel.y              = 0.f;
-    player->vel.z              = 0.f;
-    player->quat_orientation.x = 0.f;
-    player->quat_orientation.y = 0.f;
-    player->quat_orientation.z = 0.f;
-    player->quat_orientation.w = 1.f;
-    player->euler_rot.yaw      = 0.f;
-    player->euler_rot.pitch    = 0.f;
-    player->euler_rot.roll     = 0.f;
-    /*reset asteroids*/
-    for(i = 0; i < MAX_ASTEROIDS; i++)
+    int   stack[64], top = 0, i;
+    float entry[64], inv[3], t;
+    ray->hit  = -1;
+    ray->dist = ray->range;
+    if(!b->count)
+        return -1;
+    for(i = 0; i < 3; i++)
+        inv[i] = fabs(ray->dir[i]) > 1e-12f ? 1.f/ray->dir[i] : 1e30f;
+    t = ray_box(&b->nodes[0], ray->origin, inv, ray->dist);
+    if(t < 0.f)
+        return -1;
+    stack[0] = 0;
+    entry[0] = t;
+    top      = 1;
+    /*nearest child first, skipping boxes past the best hit*/
+    while(top > 0)
     {
-        aster[i].is_spawned      = false;
-        if(i >= INIT_ASTEROIDS) continue;
-        aster[i].is_spawned      = true;
-        if(rand() & 0x01)      /*50%*/
-            aster[i].mass        = ASTER_MED;
-        else if(rand() & 0x01) /*25%*/
-            aster[i].mass        = ASTER_LARGE;
-        else                   /*25%*/
-            aster[i].mass        = ASTER_SMALL;
-        aster[i].pos.x           = (float)((rand()%500) - 250);
-        aster[i].pos.y           = (float)((rand()%500) - 250);
-        aster[i].pos.z           = ARENA_SIZE;
-        aster[i].vel.x           = ((rand()%200) - 100) * 0.005f;
-        aster[i].vel.y           = ((rand()%200) - 100) * 0.005f;
-        aster[i].vel.z           = ((rand()%200) - 100) * 0.005f;
-        aster[i].euler_rot.yaw   = ((rand()%400) - 200) * 0.0001f;
-        aster[i].euler_rot.pitch = ((rand()%400) - 200) * 0.0001f;
-        aster[i].euler_rot.roll  = ((rand()%400) - 200) * 0.0001f;
+        const A3DBvhNode *n;
+        top--;
+        if(entry[top] > ray->dist)
+            continue;
+        n = &b->nodes[stack[top]];
+        if(!n->child)
+        {
+            const A3DActor *a = &aster[n->slot];
+            float oc[3], tca, d2, r2;
+            if(!a->is_spawned)
+                continue;
+            oc[0] = a->pos.x - ray->origin[0];
+            oc[1] = a->pos.y - ray->origin[1];
+            oc[2] = a->pos.z - ray->origin[2];
+            tca = oc[0]*ray->dir[0] + oc[1]*ray->dir[1] + oc[2]*ray->dir[2];
+            d2  = oc[0]*oc[0] + oc[1]*oc[1] + oc[2]*oc[2] - tca*tca;
+            r2  = a->mass*a->mass/0.64f;
+            if(d2 > r2)
+                continue;
+            t = tca - (float)sqrt(r2 - d2);
+            if(t < 0.f) /*inside*/
+                t = tca + (float)sqrt(r2 - d2);
+            if(t < 0.f || t > ray->dist)
+                continue;
+            ray->hit  = n->slot;
+            ray->dist = t;
+        }
+        else
+        {
+            int   near_node = n->child,
+                  far_node  = n->child + 1;
+            float t0 = ray_box(&b->nodes[near_node], ray->origin, inv,
+                               ray->dist),
+                  t1 = ray_box(&b->nodes[far_node], ray->origin, inv,
+                               ray->dist);
+            if(t1 >= 0.f && (t0 < 0.f || t1 < t0))
+            {
+                near_node = n->child + 1;
+                far_node  = n->child;
+                t         = t0;
+                t0        = t1;
+                t1        = t;
+            }
+            if(t1 >= 0.f)
+            {
+                stack[top] = far_node;
+                entry[top] = t1;
+                top++;
+            }
+            if(t0 >= 0.f)
+            {
+                stack[top] = near_node;
+                entry[top] = t0;
+                top++;
+            }
+        }
     }
+    return ray->hit;
 }
 
-void get_shot_vel(A3DActor *obj)
+void cast_rays(void *data, int begin, int end)
 {
-    float *x = &(obj->quat_orientation.x),
-          *y = &(obj->quat_orientation.y),
-          *z = &(obj->quat_orientation.z),
-          *w = &(obj->quat_orientation.w);
-
-    obj->vel.x = obj->vel.z * (2.f*(*x)*(*z) - 2.f*(*y)*(*w));
-    obj->vel.y = obj->vel.z * (2.f*(*y)*(*z) + 2.f*(*x)*(*w));
-    obj->vel.z = obj->vel.z * (1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y));
+    A3DRayTask *t = data;
+    int         i, hits = 0;
+    for(i = begin; i < end; i++)
+        if(cast_ray(t->bvh, t->aster, &t->rays[i]) >= 0)
+            hits++;
+    if(hits)
+        SDL_AtomicAdd(&t->hits, hits);
 }
 
-void orient_text(const A3DScoreText t)
+void aim_forward(const A3DActor *player, float *dir)
 {
-    float m[16];
-
-    /*quat -> transposed rotation matrix
-     *
-     * | x(x) y(x) z(x) tx |
-     * | x(y) y(y) z(y) ty |
-     * | x(z) y(z) z(z) tz |
-     * |  0    0    0    1 |
-     *
-     * where x() is the x axis direction,
-     * y() is the y axis direction, and
-     * z() is the z axis direction. Each
-     * axis has a (x,y,z) component.
-     */
-    m[0] = 1.f - 2.f*(t.ori.y)*(t.ori.y) - 2.f*(t.ori.z)*(t.ori.z);
-    m[1] = 2.f*(t.ori.x)*(t.ori.y) - 2.f*(t.ori.z)*(t.ori.w);
-    m[2] = 2.f*(t.ori.x)*(t.ori.z) + 2.f*(t.ori.y)*(t.ori.w);
-    m[3] = 0.f;
-
-    m[4] = 2.f*(t.ori.x)*(t.ori.y) + 2.f*(t.ori.z)*(t.ori.w);
-    m[5] = 1.f - 2.f*(t.ori.x)*(t.ori.x) - 2.f*(t.ori.z)*(t.ori.z);
-    m[6] = 2.f*(t.ori.y)*(t.ori.z) - 2.f*(t.ori.x)*(t.ori.w);
-    m[7] = 0.f;
-
-    m[8] = 2.f*(t.ori.x)*(t.ori.z) - 2.f*(t.ori.y)*(t.ori.w);
-    m[9] = 2.f*(t.ori.y)*(t.ori.z) + 2.f*(t.ori.x)*(t.ori.w);
-    m[10] = 1.f - 2.f*(t.ori.x)*(t.ori.x) - 2.f*(t.ori.y)*(t.ori.y);
-    m[11] = 0.f;
-
-    m[12] = t.pos.x;
-    m[13] = t.pos.y;
-    m[14] = t.pos.z;
-    m[15] = 1.f;
-
-    glMultMatrixf(m);
+    /*same axis as get_shot_vel()*/
+    const float x = player->quat_orientation.z,
+                y = player->quat_orientation.w,
+                z = player->quat_orientation.x,
+                w = player->quat_orientation.y;
+    float       len;
+    dir[0] = -2.f*x*z - 2.f*y*w;
+    dir[1] =  2.f*y*z - 2.f*x*w;
+    dir[2] =  1.f - 2.f*x*x - 2.f*y*y;
+    len    = (float)sqrt(dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+    if(len > 0.f)
+    {
+        dir[0] /= len;
+        dir[1] /= len;
+        dir[2] /= len;
+    }
 }
 
-void rotate_static_actor(A3DActor *obj, float *m, float dt)
+void update_aim(A3DAim *a, const A3DBvh *b, const A3DActor *aster,
+                const A3DActor *player, const float dt)
 {
-    float tmp, x2, y2, z2, w2,
-          s1, s2, s3, c1, c2, c3;
-    float *x = &(obj->quat_orientation.x),
-          *y = &(obj->quat_orientation.y),
-          *z = &(obj->quat_orientation.z),
-          *w = &(obj->quat_orientation.w);
-
-    /*euler -> quat*/
-    s1 = (float)sin(obj->euler_rot.yaw   * 0.5f * dt);
-    s2 = (float)sin(obj->euler_rot.roll  * 0.5f * dt);
-    s3 = (float)sin(obj->euler_rot.pitch * 0.5f * dt);
-    c1 = (float)cos(obj->euler_rot.yaw   * 0.5f * dt);
-    c2 = (float)cos(obj->euler_rot.roll  * 0.5f * dt);
-    c3 = (float)cos(obj->euler_rot.pitch * 0.5f * dt);
-    w2 = c1*c2*c3 - s1*s2*s3;
-    x2 = s1*s2*c3 + c1*c2*s3;
-    y2 = s1*c2*c3 + c1*s2*s3;
-    z2 = c1*s2*c3 - s1*c2*s3;
-    /*normalize*/
-    tmp = x2*x2 + y2*y2 + z2*z2 + w2*w2;
-    if((float)fabs(tmp - 1.f) > SQRT_TOLERANCE)
+    A3DRay ray;
+    int    hit;
+    if(!player->is_spawned ||
+       (a->target >= 0 && !aster[a->target].is_spawned))
     {
-        if(tmp > SQRT_TOLERANCE)
+        a->target = -1;
+        a->locked = false;
+        a->hold   = 0.f;
+    }
+    if(!player->is_spawned)
+        return;
+    ray.origin[0] = -player->pos.x;
+    ray.origin[1] = -player->pos.y;
+    ray.origin[2] = -player->pos.z;
+    aim_forward(player, ray.dir);
+    /*a lock holds while the target stays in view*/
+    if(a->locked)
+    {
+        const A3DActor *t = &aster[a->target];
+        float d[3], dist;
+        d[0] = t->pos.x - ray.origin[0];
+        d[1] = t->pos.y - ray.origin[1];
+        d[2] = t->pos.z - ray.origin[2];
+        dist = (float)sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+        if(dist < AIM_RANGE && d[0]*ray.dir[0] + d[1]*ray.dir[1] +
+           d[2]*ray.dir[2] > LOCK_CONE*dist)
         {
-            tmp = inv_sqrt_dwh(tmp);
-            x2 *= tmp;
-            y2 *= tmp;
-            z2 *= tmp;
-            w2 *= tmp;
+            a->dist = dist;
+            return;
         }
-        else /*identity*/
+        a->target = -1;
+        a->locked = false;
+    }
+    ray.range = AIM_RANGE;
+    hit       = cast_ray(b, aster, &ray);
+    a->dist   = ray.dist;
+    if(hit != a->target)
+    {
+        a->target = hit;
+        a->hold   = 0.f;
+    }
+    else if(hit >= 0)
+    {
+        a->hold += dt;
+        if(a->hold >= LOCK_TIME)
+            a->locked = true;
+    }
+}
+
+bool auto_aim(const A3DAim *a, A3DActor *aster, const A3DActor *player,
+              A3DActor *shot, const float speed)
+{
+    A3DActor *t;
+    float     r[3], w[3], f[3], qa, qb, qc, time = -1.f;
+    int       i;
+    if(!a->locked || a->target < 0 || !aster[a->target].is_spawned)
+        return false;
+    t = &aster[a->target];
+    locate_static_actor(t);
+    /*target relative to the shot, which keeps the player's velocity*/
+    r[0] = t->pos.x - shot->pos.x;
+    r[1] = t->pos.y - shot->pos.y;
+    r[2] = t->pos.z - shot->pos.z;
+    w[0] = t->vel.x + player->vel.x;
+    w[1] = t->vel.y + player->vel.y;
+    w[2] = t->vel.z + player->vel.z;
+    /*|r + w t| = speed t, earliest positive t*/
+    qa = w[0]*w[0] + w[1]*w[1] + w[2]*w[2] - speed*speed;
+    qb = 2.f*(r[0]*w[0] + r[1]*w[1] + r[2]*w[2]);
+    qc = r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+    if(fabs(qa) < 1e-6f)
+    {
+        if(qb < 0.f)
+            time = -qc/qb;
+    }
+    else
+    {
+        const float disc = qb*qb - 4.f*qa*qc;
+        float       t0, t1;
+        if(disc < 0.f)
+            return false;
+        t0 = (-qb - (float)sqrt(disc))/(2.f*qa);
+        t1 = (-qb + (float)sqrt(disc))/(2.f*qa);
+        if(t0 > t1)
         {
-            w2 = 1.f;
-            x2 = 0.f;
-            y2 = 0.f;
-            z2 = 0.f;
+            const float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
         }
+        time = t0 > 0.f ? t0 : t1;
     }
+    if(time <= 0.f)
+        return false;
+    /*lead direction, only within reach of the view*/
+    for(i = 0; i < 3; i++)
+        r[i] = (r[i] + w[i]*time)/(speed*time);
+    aim_forward(player, f);
+    if(r[0]*f[0] + r[1]*f[1] + r[2]*f[2] < AIM_CONE)
+        return false;
+    shot->vel.x = speed*r[0] - player->vel.x;
+    shot->vel.y = speed*r[1] - player->vel.y;
+    shot->vel.z = speed*r[2] - player->vel.z;
+    return true;
+}
 
-    /*multiply quats*/
-    s1 = *w*x2 + *x*w2 + *y*z2 - *z*y2;
-    s2 = *w*y2 + *y*w2 + *z*x2 - *x*z2;
-    s3 = *w*z2 + *z*w2 + *x*y2 - *y*x2;
-    *w = *w*w2 - *x*x2 - *y*y2 - *z*z2;
-    *x = s1;
-    *y = s2;
-    *z = s3;
-
-    /*quat -> transposed rotation matrix
-     *
-     * | x(x) y(x) z(x) tx |
-     * | x(y) y(y) z(y) ty |
-     * | x(z) y(z) z(z) tz |
-     * |  0    0    0    1 |
-     *
-     * where x() is the x axis direction,
-     * y() is the y axis direction, and
-     * z() is the z axis direction. Each
-     * axis has a (x,y,z) component.
-     */
-    m[0] = 1.f - 2.f*(*y)*(*y) - 2.f*(*z)*(*z);
-    m[1] = 2.f*(*x)*(*y) - 2.f*(*z)*(*w);
-    m[2] = 2.f*(*x)*(*z) + 2.f*(*y)*(*w);
-    m[3] = 0.f;
-
-    m[4] = 2.f*(*x)*(*y) + 2.f*(*z)*(*w);
-    m[5] = 1.f - 2.f*(*x)*(*x) - 2.f*(*z)*(*z);
-    m[6] = 2.f*(*y)*(*z) - 2.f*(*x)*(*w);
-    m[7] = 0.f;
-
-    m[8] = 2.f*(*x)*(*z) - 2.f*(*y)*(*w);
-    m[9] = 2.f*(*y)*(*z) + 2.f*(*x)*(*w);
-    m[10] = 1.f - 2.f*(*x)*(*x) - 2.f*(*y)*(*y);
-    m[11] = 0.f;
+bool init_beam(A3DBeam *b, const int capacity)
+{
+    const int padded = (capacity + 3) & ~3;
+    b->count    = 0;
+    b->capacity = 0;
+    b->hit      = -1;
+    b->show     = 0.f;
+    /*one block for all arrays*/
+    b->x = malloc((sizeof(float)*4 + sizeof(int))*padded);
+    if(!b->x)
+    {
+        fprintf(stderr, "Failed to allocate beam arrays\n");
+        return false;
+    }
+    b->y        = b->x + padded;
+    b->z        = b->y + padded;
+    b->r2       = b->z + padded;
+    b->slot     = (int *)(b->r2 + padded);
+    b->capacity = padded;
+    return true;
 }
 
-void translate_static_actor(A3DActor *obj, float *m, float dt)
+void load_beam(A3DBeam *b, const A3DActor *aster, const int count)
 {
-    float *x = &(obj->pos.x),
-          *y = &(obj->pos.y),
-          *z = &(obj->pos.z);
+    int i, n = 0;
+    for(i = 0; i < count && n < b->capacity; i++)
+    {
+        if(!aster[i].is_spawned)
+            continue;
+        b->x[n]    = aster[i].pos.x;
+        b->y[n]    = aster[i].pos.y;
+        b->z[n]    = aster[i].pos.z;
+        /*same radius as the collision tests*/
+        b->r2[n]   = aster[i].mass*aster[i].mass/0.64f;
+        b->slot[n] = i;
+        n++;
+    }
+    b->count = n;
+    /*empty spheres fill the last group of four*/
+    for(; n & 3; n++)
+    {
+        b->x[n]    = 0.f;
+        b->y[n]    = 0.f;
+        b->z[n]    = 0.f;
+        b->r2[n]   = -1.f;
+        b->slot[n] = -1;
+    }
+}
 
-    /*move along vel vector*/
-    *x += obj->vel.x * dt;
-    *y += obj->vel.y * dt;
-    *z += obj->vel.z * dt;
-    /*wrap position*/
-    if(*x >  ARENA_SIZE)
-       *x = -ARENA_SIZE + 0.001f;
-    if(*x < -ARENA_SIZE)
-       *x =  ARENA_SIZE - 0.001f;
-    if(*y >  ARENA_SIZE)
-       *y = -ARENA_SIZE + 0.001f;
-    if(*y < -ARENA_SIZE)
-       *y =  ARENA_SIZE - 0.001f;
-    if(*z >  ARENA_SIZE)
-       *z = -ARENA_SIZE + 0.001f;
-    if(*z < -ARENA_SIZE)
-       *z =  ARENA_SIZE - 0.001f;
+int beam_nearest(const A3DBeam *b, const float *origin, const float *dir,
+                 float *dist)
+{
+#ifdef __SSE__
+    const __m128 ox   = _mm_set1_ps(origin[0]),
+                 oy   = _mm_set1_ps(origin[1]),
+                 oz   = _mm_set1_ps(origin[2]),
+                 dx   = _mm_set1_ps(dir[0]),
+                 dy   = _mm_set1_ps(dir[1]),
+                 dz   = _mm_set1_ps(dir[2]),
+                 zero = _mm_setzero_ps(),
+                 four = _mm_set1_ps(4.f);
+    __m128 best_t = _mm_set1_ps(*dist),
+           best_i = _mm_set1_ps(-1.f),
+           index  = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+    float  lane_t[4], lane_i[4];
+    int    i, best = -1;
+    for(i = 0; i < b->count; i += 4)
+    {
+        const __m128 cx = _mm_sub_ps(_mm_loadu_ps(b->x + i), ox),
+                     cy = _mm_sub_ps(_mm_loadu_ps(b->y + i), oy),
+                     cz = _mm_sub_ps(_mm_loadu_ps(b->z + i), oz);
+        __m128 tca, h, t, far_t, m, hit;
+        tca = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, dx), _mm_mul_ps(cy, dy)),
+                         _mm_mul_ps(cz, dz));
+        /*r^2 minus the squared distance from the ray*/
+        h   = _mm_sub_ps(_mm_loadu_ps(b->r2 + i),
+                         _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx),
+                                                          _mm_mul_ps(cy, cy)),
+                                               _mm_mul_ps(cz, cz)),
+                                    _mm_mul_ps(tca, tca)));
+        hit   = _mm_cmpge_ps(h, zero);
+        h     = _mm_sqrt_ps(_mm_max_ps(h, zero));
+        t     = _mm_sub_ps(tca, h);
+        far_t = _mm_add_ps(tca, h);
+        /*from inside, the far side*/
+        m     = _mm_cmplt_ps(t, zero);
+        t     = _mm_or_ps(_mm_and_ps(m, far_t), _mm_andnot_ps(m, t));
+        hit   = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, zero),
+                                           _mm_cmplt_ps(t, best_t)));
+        best_t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, best_t));
+        best_i = _mm_or_ps(_mm_and_ps(hit, index),
+                           _mm_andnot_ps(hit, best_i));
+        index  = _mm_add_ps(index, four);
+    }
+    _mm_storeu_ps(lane_t, best_t);
+    _mm_storeu_ps(lane_i, best_i);
+    for(i = 0; i < 4; i++)
+    {
+        if(lane_i[i] < 0.f || lane_t[i] >= *dist)
+            continue;
+        *dist = lane_t[i];
+        best  = (int)lane_i[i];
+    }
+    return best;
+#else
+    return beam_reference(b, origin, dir, dist);
+#endif
+}
 
-    /*update translation component of matrix*/
-    m[12] = *x;
-    m[13] = *y;
-    m[14] = *z;
-    m[15] = 1.f;
+int beam_reference(const A3DBeam *b, const float *origin, const float *dir,
+                   float *dist)
+{
+    int i, best = -1;
+    for(i = 0; i < b->count; i++)
+    {
+        const float cx  = b->x[i] - origin[0],
+                    cy  = b->y[i] - origin[1],
+                    cz  = b->z[i] - origin[2],
+                    tca = cx*dir[0] + cy*dir[1] + cz*dir[2],
+                    h   = b->r2[i] - (cx*cx + cy*cy + cz*cz - tca*tca);
+        float t;
+        if(h < 0.f)
+            continue;
+        t = tca - (float)sqrt(h);
+        if(t < 0.f) /*inside*/
+            t = tca + (float)sqrt(h);
+        if(t < 0.f || t >= *dist)
+            continue;
+        *dist = t;
+        best  = i;
+    }
+    return best;
 }
 
-void transform_static_actor(A3DActor *obj, float dt)
+void draw_beam(const A3DBeam *b)
 {
-    float m[16];
-    rotate_static_actor(obj, m, dt);
-    translate_static_actor(obj, m, dt);
-    glMultMatrixf(m);
+    const float fade = b->show/BEAM_SHOW;
+    if(b->show <= 0.f)
+        return;
+    state_disable(GL_LIGHTING);
+    state_enable(GL_FOG);
+    state_disable(GL_TEXTURE_2D);
+    state_enable(GL_BLEND);
+    state_depth_mask(false);
+    state_color_mask(true);
+    state_blend_func(GL_ONE, GL_ONE);
+    state_color(0.f, fade, fade);
+    frame_stats.draw_calls++;
+    frame_stats.indices += 2;
+    glBegin(GL_LINES);
+        glVertex3fv(b->start);
+        glVertex3fv(b->end);
+    glEnd();
 }
 
-void move_camera(A3DCamera *cam, float dt)
+void free_beam(A3DBeam *b)
 {
-    static float zz = 0.02f, yacc, pacc;
-    float s1, s2, s3, m[16];
-    float *x = &(cam->player->pos.x),
-          *y = &(cam->player->pos.y),
-          *z = &(cam->player->pos.z);
+    free(b->x);
+    b->x     = NULL;
+    b->count = 0;
+}
 
-    /*camera movement panning/zooming*/
-    if((float)fabs(cam->player->euler_rot.yaw) < 0.000001f)
+int run_beam_bench(void)
+{
+    const int count = 100000, shots = 600; /*10 s at 60 Hz*/
+    const Uint64 perf_freq = SDL_GetPerformanceFrequency();
+    const double freq = (double)perf_freq/1000.0;
+    A3DActor *aster;
+    A3DBeam   b;
+    unsigned  seed = 0x9e3779b9u;
+    double    load_ms = 0.0, simd_ms = 0.0, ref_ms = 0.0;
+    int       i, hits = 0, mismatches = 0;
+    aster = calloc(count, sizeof(A3DActor));
+    if(!aster || !init_beam(&b, count))
     {
-        if(yacc < 1000.f) yacc += dt;
+        fprintf(stderr, "Failed to allocate beam benchmark\n");
+        free(aster);
+        return 1;
     }
-    else yacc = 0.f;
-    if((float)fabs(cam->player->euler_rot.pitch) < 0.000001f)
+    for(i = 0; i < count; i++)
     {
-        if(pacc < 1000.f) pacc += dt;
+        aster[i].is_spawned = true;
+        aster[i].mass  = (float)(ASTER_SMALL + xorshift32(&seed)%ASTER_LARGE);
+        aster[i].pos.x = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
+        aster[i].pos.y = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
+        aster[i].pos.z = (float)(xorshift32(&seed)%20000)*0.1f - 1000.f;
     }
-    else pacc = 0.f;
-    if(cam->driftcam)
+    for(i = 0; i < shots; i++)
     {
-        cam->roll += cam->player->euler_rot.yaw * 0.5f * dt/radmod;
-        cam->pos_offset[1] -= cam->player->euler_rot.pitch * 0.02f * dt/radmod;
+        float  o[3], d[3], len, simd_dist = BEAM_RANGE,
+               ref_dist = BEAM_RANGE;
+        int    simd_hit, ref_hit;
+        Uint64 t;
+        o[0] = (float)(xorshift32(&seed)%2000)*0.5f - 500.f;
+        o[1] = (float)(xorshift32(&seed)%2000)*0.5f - 500.f;
+        o[2] = (float)(xorshift32(&seed)%2000)*0.5f - 500.f;
+        do
+        {
+            d[0] = (float)(xorshift32(&seed)%2001) - 1000.f;
+            d[1] = (float)(xorshift32(&seed)%2001) - 1000.f;
+            d[2] = (float)(xorshift32(&seed)%2001) - 1000.f;
+            len  = (float)sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+        } while(len < 1.f);
+        d[0] /= len;
+        d[1] /= len;
+        d[2] /= len;
+        /*the field moves, so every shot reloads it*/
+        t = SDL_GetPerformanceCounter();
+        load_beam(&b, aster, count);
+        load_ms += (double)(SDL_GetPerformanceCounter() - t)/freq;
+        t = SDL_GetPerformanceCounter();
+        simd_hit = beam_nearest(&b, o, d, &simd_dist);
+        simd_ms += (double)(SDL_GetPerformanceCounter() - t)/freq;
+        t = SDL_GetPerformanceCounter();
+        ref_hit = beam_reference(&b, o, d, &ref_dist);
+        ref_ms  += (double)(SDL_GetPerformanceCounter() - t)/freq;
+        if(simd_hit >= 0)
+            hits++;
+        if(simd_hit != ref_hit)
+            mismatches++;
     }
-    if(yacc > 10.f || !cam->driftcam)
+    printf("{\n");
+    printf("  \"asteroids\": %d,\n",         count);
+    printf("  \"shots\": %d,\n",             shots);
+    printf("  \"hits\": %d,\n",              hits);
+    printf("  \"mismatches\": %d,\n",        mismatches);
+    printf("  \"load_ms\": %.4f,\n",         load_ms/shots);
+    printf("  \"simd_ms\": %.4f,\n",         simd_ms/shots);
+    printf("  \"scalar_ms\": %.4f,\n",       ref_ms/shots);
+    /*share of a 60 Hz frame for one beam shot*/
+    printf("  \"frame_share\": %.4f\n",
+           (load_ms + simd_ms)/shots/(1000.0/60.0));
+    printf("}\n");
+    free_beam(&b);
+    free(aster);
+    return 0;
+}
+
+bool init_audio(A3DAudio *a)
+{
+    SDL_AudioSpec want, have;
+    int i;
+    memset(a, 0, sizeof(A3DAudio));
+    for(i = 0; i < AUDIO_VOICES; i++)
+        a->voices[i].sound = -1;
+    SDL_AtomicSet(&a->head, 0);
+    SDL_AtomicSet(&a->tail, 0);
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO))
     {
-        if(cam->roll < -1.f)     cam->roll += 0.5f*dt;
-        else if(cam->roll > 1.f) cam->roll -= 0.5f*dt;
-        else                     cam->roll = 0.f;
+        fprintf(stderr, "SDL_InitSubSystem failed: %s\n", SDL_GetError());
+        return false;
     }
-    if(pacc > 10.f || !cam->driftcam)
+    if(!generate_sounds(a))
     {
-        if(cam->pos_offset[1] < -2.05f)      cam->pos_offset[1] += 0.02f*dt;
-        else if(cam->pos_offset[1] > -1.95f) cam->pos_offset[1] -= 0.02f*dt;
-        else                                 cam->pos_offset[1] = -2.f;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
     }
-    cam->pos_offset[0] = 0.1f * cam->roll;
-    if(cam->roll > 15.f)
-       cam->roll = 15.f;
-    if(cam->roll < -15.f)
-       cam->roll = -15.f;
-    if(cam->pos_offset[1] < -3.f)
-       cam->pos_offset[1] = -3.f;
-    if(cam->pos_offset[1] > -1.f)
-       cam->pos_offset[1] = -1.f;
-
-    /*update rotation*/
-    rotate_static_actor(cam->player, m, dt);
-    /*stop applying rotation*/
-    cam->player->euler_rot.yaw   = 0.f;
-    cam->player->euler_rot.roll  = 0.f;
-    cam->player->euler_rot.pitch = 0.f;
+    memset(&want, 0, sizeof(want));
+    want.freq     = AUDIO_RATE;
+    want.format   = AUDIO_F32SYS;
+    want.channels = 2;
+    want.samples  = AUDIO_FRAMES;
+    want.callback = audio_callback;
+    want.userdata = a;
+    /*SDL converts if the device differs*/
+    a->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if(!a->device)
+    {
+        fprintf(stderr, "SDL_OpenAudioDevice failed: %s\n", SDL_GetError());
+        free(a->sounds[0].data);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    SDL_PauseAudioDevice(a->device, 0);
+    return true;
+}
 
-    if(cam->player->is_spawned)
+bool generate_sounds(A3DAudio *a)
+{
+    const float lengths[SOUNDS] = {0.12f, 0.25f, 0.5f, 1.5f}; /*seconds*/
+    const float rate = (float)AUDIO_RATE;
+    unsigned seed = 0x2545f491u;
+    float   *p;
+    int      i, s, total = 0;
+    for(s = 0; s < SOUNDS; s++)
     {
-        /*increment velocity*/
-        if(cam->forward ^ cam->backward) /*along z axis*/
+        /*multiple of 4 for the mixer*/
+        a->sounds[s].length = ((int)(lengths[s]*rate) + 3) & ~3;
+        total += a->sounds[s].length;
+    }
+    p = malloc(sizeof(float)*total);
+    if(!p)
+    {
+        fprintf(stderr, "Failed to allocate sounds\n");
+        return false;
+    }
+    for(s = 0; s < SOUNDS; s++)
+    {
+        float phase = 0.f, low = 0.f;
+        a->sounds[s].data = p;
+        for(i = 0; i < a->sounds[s].length; i++)
         {
-            if(zz > 0.005f) zz -= 0.001f*dt;
-            s1 = m[2]  * cam->velmod * dt;
-            s2 = m[6]  * cam->velmod * dt;
-            s3 = m[10] * cam->velmod * dt;
-            if(cam->forward) /*forward*/
+            const float t     = (float)i/rate,
+                        noise = (float)(xorshift32(&seed) & 0xffff)/
+                                32768.f - 1.f;
+            float v;
+            if(s == SOUND_SHOT)
             {
-                cam->player->vel.x += s1;
-                cam->player->vel.y += s2;
-                cam->player->vel.z += s3;
-                if(cam->fovmod < 1.2f && cam->driftcam)
-                    cam->fovmod += dt*zz;
+                /*falling square chirp*/
+                phase += (1400.f - 8000.f*t)/rate;
+                v = (phase - (float)floor(phase) < 0.5f ? 0.3f : -0.3f)*
+                    (float)exp(-t*25.f);
             }
-            else               /*backward*/
+            else if(s == SOUND_HIT)
             {
-                cam->player->vel.x -= s1;
-                cam->player->vel.y -= s2;
-                cam->player->vel.z -= s3;
-                if(cam->fovmod > 0.8f && cam->driftcam)
-                    cam->fovmod -= dt*zz;
+                low += (noise - low)*0.3f;
+                v = 0.6f*low*(float)exp(-t*18.f);
             }
-        }
-        else
-        {
-            zz = 0.02f;
-            if(cam->fovmod > 1.02f)
-                 cam->fovmod -= 1.5f*dt*zz;
-            else if(cam->fovmod < 0.98f)
-                 cam->fovmod += 1.5f*dt*zz;
-            else cam->fovmod = 1.f;
-        }
-        if(cam->left ^ cam->right) /*along x axis*/
-        {
-            s1 = m[0] * cam->velmod * dt;
-            s2 = m[4] * cam->velmod * dt;
-            s3 = m[8] * cam->velmod * dt;
-            if(cam->left) /*left*/
+            else if(s == SOUND_SPLIT)
             {
-                cam->player->vel.x += s1;
-                cam->player->vel.y += s2;
-                cam->player->vel.z += s3;
+                /*rumble over a low thump*/
+                low += (noise - low)*0.08f;
+                phase += (90.f - 60.f*t)/rate;
+                v = (1.2f*low + 0.5f*(float)sin(6.2831853f*phase))*
+                    (float)exp(-t*7.f);
             }
-            else            /*right*/
+            else
             {
-                cam->player->vel.x -= s1;
-                cam->player->vel.y -= s2;
-                cam->player->vel.z -= s3;
+                /*long blast, darkening as it fades*/
+                low += (noise - low)*(0.2f*(float)exp(-t*2.f) + 0.01f);
+                v = 1.5f*low*(float)exp(-t*2.5f);
             }
+            p[i] = v;
         }
-        if(cam->up ^ cam->down) /*along y axis*/
+        p += a->sounds[s].length;
+    }
+    return true;
+}
+
+bool play_sound(A3DAudio *a, const int sound, const float gain,
+                const float pan)
+{
+    const int head = SDL_AtomicGet(&a->head);
+    A3DSoundCommand *c;
+    if(!a->device)
+        return false;
+    if(head - SDL_AtomicGet(&a->tail) >= AUDIO_RING)
+    {
+        a->dropped++;
+        return false;
+    }
+    c = &a->ring[head & (AUDIO_RING - 1)];
+    c->sound = sound;
+    c->gain  = gain;
+    c->pan   = pan < -1.f ? -1.f : (pan > 1.f ? 1.f : pan);
+    /*publishes the command, a full barrier*/
+    SDL_AtomicSet(&a->head, head + 1);
+    return true;
+}
+
+void mix_audio(A3DAudio *a, float *out, const int frames)
+{
+    const int head = SDL_AtomicGet(&a->head);
+    int tail = SDL_AtomicGet(&a->tail), i, v;
+    /*start queued sounds*/
+    for(; tail != head; tail++)
+    {
+        const A3DSoundCommand *c = &a->ring[tail & (AUDIO_RING - 1)];
+        A3DVoice *voice = NULL;
+        for(v = 0; v < AUDIO_VOICES; v++)
         {
-            s1 = m[1] * cam->velmod * dt;
-            s2 = m[5] * cam->velmod * dt;
-            s3 = m[9] * cam->velmod * dt;
-            if(cam->up) /*up*/
+            A3DVoice *t = &a->voices[v];
+            if(t->sound < 0)
             {
-                cam->player->vel.x -= s1;
-                cam->player->vel.y -= s2;
-                cam->player->vel.z -= s3;
+                voice = t;
+                break;
             }
-            else          /*down*/
+            if(!voice || t->pos > voice->pos)
+                voice = t;
+        }
+        if(voice->sound >= 0)
+            a->stolen++;
+        voice->sound   = c->sound;
+        voice->pos     = 0;
+        voice->gain[0] = c->gain*(1.f - c->pan)*0.5f;
+        voice->gain[1] = c->gain*(1.f + c->pan)*0.5f;
+    }
+    SDL_AtomicSet(&a->tail, tail);
+    memset(out, 0, sizeof(float)*2*frames);
+    for(v = 0; v < AUDIO_VOICES; v++)
+    {
+        A3DVoice    *voice = &a->voices[v];
+        const float *src;
+        int          count;
+        if(voice->sound < 0)
+            continue;
+        src   = a->sounds[voice->sound].data + voice->pos;
+        count = a->sounds[voice->sound].length - voice->pos;
+        if(count > frames)
+            count = frames;
+        i = 0;
+#ifdef __SSE__
+        {
+            const __m128 gl = _mm_set1_ps(voice->gain[0]),
+                         gr = _mm_set1_ps(voice->gain[1]);
+            for(; i < count - 3; i += 4)
             {
-                cam->player->vel.x += s1;
-                cam->player->vel.y += s2;
-                cam->player->vel.z += s3;
+                const __m128 s = _mm_loadu_ps(src + i),
+                             l = _mm_mul_ps(s, gl),
+                             r = _mm_mul_ps(s, gr);
+                float *o = out + 2*i;
+                /*interleave four left and right pairs*/
+                _mm_storeu_ps(o,     _mm_add_ps(_mm_loadu_ps(o),
+                                                _mm_unpacklo_ps(l, r)));
+                _mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4),
+                                                _mm_unpackhi_ps(l, r)));
             }
         }
-        *x += cam->player->vel.x * dt;
-        *y += cam->player->vel.y * dt;
-        *z += cam->player->vel.z * dt;
-        /*wrap position*/
-        if(*x >  ARENA_SIZE)
-           *x = -ARENA_SIZE + 0.001f;
-        if(*x < -ARENA_SIZE)
-           *x =  ARENA_SIZE - 0.001f;
-        if(*y >  ARENA_SIZE)
-           *y = -ARENA_SIZE + 0.001f;
-        if(*y < -ARENA_SIZE)
-           *y =  ARENA_SIZE - 0.001f;
-        if(*z >  ARENA_SIZE)
-           *z = -ARENA_SIZE + 0.001f;
-        if(*z < -ARENA_SIZE)
-           *z =  ARENA_SIZE - 0.001f;
+#endif
+        for(; i < count; i++)
+        {
+            out[2*i]     += src[i]*voice->gain[0];
+            out[2*i + 1] += src[i]*voice->gain[1];
+        }
+        voice->pos += count;
+        if(voice->pos >= a->sounds[voice->sound].length)
+            voice->sound = -1;
+    }
+    /*clip*/
+    i = 0;
+#ifdef __SSE__
+    {
+        const __m128 lo = _mm_set1_ps(-1.f),
+                     hi = _mm_set1_ps( 1.f);
+        for(; i < 2*frames - 3; i += 4)
+            _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(
+                                   _mm_loadu_ps(out + i), lo), hi));
+    }
+#endif
+    for(; i < 2*frames; i++)
+    {
+        if(out[i] < -1.f) out[i] = -1.f;
+        if(out[i] >  1.f) out[i] =  1.f;
     }
-
-    /*update translation component of matrix*/
-    m[12] = m[0]*(*x) + m[4]*(*y) + m[8]*(*z);
-    m[13] = m[1]*(*x) + m[5]*(*y) + m[9]*(*z);
-    m[14] = m[2]*(*x) + m[6]*(*y) + m[10]*(*z);
-    m[15] = 1.f;
-
-    glMultMatrixf(m);
 }
 
-float inv_sqrt_dwh(float x)
+void audio_callback(void *data, Uint8 *stream, int len)
 {
-    float const mx = 0.5f*1.000876311302185f*x;
-    int xi         = *(int*)&x;
-    xi             = 0x5f375a87 - (xi >> 1);
-    x              = *(float*)&xi;
-    return x*(1.5f*1.000876311302185f - mx*x*x);
+    mix_audio(data, (float *)(void *)stream, len/(int)(2*sizeof(float)));
 }
 
-bool load_model_from_file(const char *file_prefix, A3DModel *model)
+void free_audio(A3DAudio *a)
 {
-    FILE *file_data;
-    char metadata_line[256] = {'\0'};
-    char *nl;
-    char *token_buffer;
-    char *file_path;
-    char ixsum[16]  = {'\0'}; /*read from *.met*/
-    char nvsum[16]  = {'\0'};
-    char ixsum_[16] = {'\0'}; /*computed from index/vertex data*/
-    char nvsum_[16] = {'\0'};
-    unsigned ix_checksum = 0;
-    unsigned nv_checksum = 0;
-    unsigned tmp_uint    = 0;
-    int i = 0;
+    if(!a->device)
+        return;
+    SDL_CloseAudioDevice(a->device);
+    a->device = 0;
+    free(a->sounds[0].data);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
 
-    /*allocate apropriate space for path*/
-    file_path = malloc(strlen(file_prefix) + 5);
-    /*get metadata*/
-    strcpy(file_path, file_prefix);
-    strcat(file_path, ".met");
-    if((file_data = fopen(file_path, "r")) == NULL)
+int run_audio_bench(void)
+{
+    const int counts[3] = {1, 8, 32}, buffers = 2000;
+    const Uint64 perf_freq = SDL_GetPerformanceFrequency();
+    const double freq = (double)perf_freq/1000.0,
+                 budget = 1000.0*AUDIO_FRAMES/AUDIO_RATE; /*ms*/
+    A3DAudio *a = malloc(sizeof(A3DAudio));
+    float     out[2*AUDIO_FRAMES];
+    int       i, j, v;
+    if(!a || !init_audio(a))
     {
-        fprintf(stderr, "Could not open: %s\n", file_path);
-        perror("fopen error");
-        free(file_path);
-        return false;
+        free(a);
+        return 1;
     }
-    while(!feof(file_data))
+    /*the callback stays out while paused*/
+    SDL_PauseAudioDevice(a->device, 1);
+    printf("{\n");
+    printf("  \"driver\": \"%s\",\n", SDL_GetCurrentAudioDriver());
+    printf("  \"frames\": %d,\n",     AUDIO_FRAMES);
+    printf("  \"runs\": [\n");
+    for(j = 0; j < 3; j++)
     {
-        if(!fgets(metadata_line, sizeof(metadata_line), file_data))
-            break;
-        nl = strchr(metadata_line, '\n');
-        if(nl)
-            *nl = '\0';
-        token_buffer = strtok(metadata_line, " ");
-        if(!token_buffer)
-            continue;
-        /*get index count*/
-        if(!strcmp(token_buffer, "indexcount:"))
-        {
-            if((token_buffer = strtok(NULL, " ")))
-            {
-                model->index_count = atoi(token_buffer);
-                if(!model->index_count)
-                {
-                    fprintf(stderr,
-                      "atoi error: Could not load index count from file %s\n",
-                      file_path);
-                    fclose(file_data);
-                    free(file_path);
-                    return false;
-                }
-            }
-        }
-        /*get vertex count*/
-        else if(!strcmp(token_buffer, "vertexcount:"))
+        double ms = 0.0;
+        Uint64 t;
+        for(i = 0; i < buffers; i++)
         {
-            if((token_buffer = strtok(NULL, " ")))
+            /*keep exactly counts[j] voices playing*/
+            for(v = 0; v < AUDIO_VOICES; v++)
             {
-                model->vertex_count = atoi(token_buffer);
-                if(!model->vertex_count)
+                A3DVoice *voice = &a->voices[v];
+                if(v >= counts[j])
+                    voice->sound = -1;
+                else if(voice->sound < 0)
                 {
-                    fprintf(stderr,
-                      "atoi error: Could not load vertex count from file %s\n",
-                      file_path);
-                    fclose(file_data);
-                    free(file_path);
-                    return false;
+                    voice->sound   = SOUND_DEATH;
+                    voice->pos     = (v*AUDIO_FRAMES*7) %
+                                     a->sounds[SOUND_DEATH].length;
+                    voice->gain[0] = 0.1f;
+                    voice->gain[1] = 0.1f;
                 }
             }
+            t = SDL_GetPerformanceCounter();
+            mix_audio(a, out, AUDIO_FRAMES);
+            ms += (double)(SDL_GetPerformanceCounter() - t)/freq;
         }
-        /*get index/vertex checksum*/
-        else if(!strcmp(token_buffer, "indexsum:"))
-        {
-            size_t ixsum_len = strlen(token_buffer);
-            if(ixsum_len > 15)
-                ixsum_len = 15;
-            if((token_buffer = strtok(NULL, " ")))
-                memcpy(ixsum, token_buffer, ixsum_len);
-        }
-        else if(!strcmp(token_buffer, "vertexsum:"))
-        {
-            size_t nvsum_len = strlen(token_buffer);
-            if(nvsum_len > 15)
-                nvsum_len = 15;
-            if((token_buffer = strtok(NULL, " ")))
-                memcpy(nvsum, token_buffer, nvsum_len);
-        }
+        ms /= buffers;
+        printf("    {\"voices\": %d, ",              counts[j]);
+        printf("\"buffer_us\": %.3f, ",               ms*1000.0);
+        printf("\"voice_ns_per_frame\": %.3f, ",
+               ms*1e6/((double)counts[j]*AUDIO_FRAMES));
+        printf("\"realtime_share\": %.5f}%s\n",       ms/budget,
+               j < 2 ? "," : "");
     }
-    fclose(file_data);
+    printf("  ],\n");
+    /*overfill the ring and the voices in one buffer*/
+    for(i = 0; i < AUDIO_RING + 64; i++)
+        play_sound(a, SOUND_SHOT, 0.1f, 0.f);
+    mix_audio(a, out, AUDIO_FRAMES);
+    printf("  \"burst\": %d,\n",    AUDIO_RING + 64);
+    printf("  \"dropped\": %u,\n",  a->dropped);
+    printf("  \"stolen\": %u\n",    a->stolen);
+    printf("}\n");
+    free_audio(a);
+    free(a);
+    return 0;
+}
 
-    /*get index data*/
-    model->index_data = malloc(model->index_count*sizeof(unsigned));
-    strcpy(file_path, file_prefix);
-    strcat(file_path, ".ix");
-    if((file_data = fopen(file_path, "rb")) == NULL)
+void init_events(A3DEventRing *r)
+{
+    memset(r, 0, sizeof(A3DEventRing));
+    SDL_AtomicSet(&r->head, 0);
+    SDL_AtomicSet(&r->tail, 0);
+}
+
+A3DEvent *emit_event(A3DEventRing *r, const int type, const int slot,
+                     const A3DActor *a)
+{
+    A3DEvent *ev;
+    if(r->pending - SDL_AtomicGet(&r->tail) >= EVENT_RING)
     {
-        perror("fopen error");
-        free(file_path);
-        return false;
+        r->dropped++;
+        ev = &r->overflow;
     }
-    if(fread(model->index_data, sizeof(unsigned), model->index_count,
-                file_data) != (unsigned)model->index_count)
+    else
     {
-        fprintf(stderr,
-                "fread error: Could not read %lu bytes of data from file %s\n",
-                model->index_count*sizeof(unsigned), file_path);
-        fclose(file_data);
-        free(file_path);
-        return false;
+        ev = &r->ring[r->pending & (EVENT_RING - 1)];
+        r->pending++;
+        r->emitted[type]++;
     }
-    fclose(file_data);
+    ev->type   = type;
+    ev->slot   = slot;
+    ev->shot   = -1;
+    ev->pieces = 0;
+    ev->split  = false;
+    ev->mass   = a ? a->mass  : 0.f;
+    ev->pos[0] = a ? a->pos.x : 0.f;
+    ev->pos[1] = a ? a->pos.y : 0.f;
+    ev->pos[2] = a ? a->pos.z : 0.f;
+    return ev;
+}
 
-    /*get vertex data*/
-    model->vertex_data = malloc(model->vertex_count*sizeof(float));
-    strcpy(file_path, file_prefix);
-    strcat(file_path, ".nv");
-    if((file_data = fopen(file_path, "rb")) == NULL)
+void publish_events(A3DEventRing *r)
+{
+    /*full barrier, the events are written before*/
+    SDL_AtomicSet(&r->head, r->pending);
+}
+
+int poll_events(A3DEventRing *r, A3DEvent *out, const int max)
+{
+    const int head = SDL_AtomicGet(&r->head);
+    int tail = SDL_AtomicGet(&r->tail), n = 0;
+    for(; tail != head && n < max; tail++, n++)
+        out[n] = r->ring[tail & (EVENT_RING - 1)];
+    SDL_AtomicSet(&r->tail, tail);
+    return n;
+}
+
+bool init_timers(A3DTimerWheel *w, const int capacity, const unsigned now)
+{
+    int i;
+    w->timers = malloc(sizeof(A3DTimer)*capacity);
+    if(!w->timers)
     {
-        perror("fopen error");
-        free(file_path);
+        fprintf(stderr, "Failed to allocate timers\n");
         return false;
     }
-    if(fread(model->vertex_data, sizeof(float), model->vertex_count,
-                file_data) != (unsigned)model->vertex_count)
+    w->capacity  = capacity;
+    w->origin    = now;
+    w->tick      = 0;
+    w->active    = 0;
+    w->fired     = 0;
+    for(i = 0; i < TIMER_LEVELS*TIMER_SLOTS; i++)
+        w->heads[i] = -1;
+    for(i = 0; i < capacity; i++)
     {
-        fprintf(stderr,
-                "fread error: Could not read %lu bytes of data from file %s\n",
-                model->vertex_count*sizeof(float), file_path);
-        fclose(file_data);
-        free(file_path);
-        return false;
+        w->timers[i].generation = 1;
+        w->timers[i].slot       = -1;
+        w->timers[i].next       = i + 1 < capacity ? i + 1 : -1;
     }
-    fclose(file_data);
+    w->free_list = 0;
+    return true;
+}
 
-    /*check checksums*/
-    for(i = 0; i < (model->index_count - 1); i += 64)
-    {
-        ix_checksum = ix_checksum ^ model->index_data[i];
-        ix_checksum = ix_checksum ^ (model->index_data[i+1] >> 16);
-        ix_checksum = ix_checksum ^ (model->index_data[i+1] << 16);
-    }
-    for(i = 0; i < model->vertex_count; i += 64)
+unsigned add_timer(A3DTimerWheel *w, const unsigned delay,
+                   const unsigned period, A3DTimer_Func func, void *data,
+                   const int arg)
+{
+    const int index = w->free_list;
+    A3DTimer *t;
+    unsigned  ticks = (delay + TIMER_TICK - 1)/TIMER_TICK;
+    if(index < 0)
+        return 0;
+    t = &w->timers[index];
+    w->free_list = t->next;
+    if(!ticks)
+        ticks = 1;
+    t->func   = func;
+    t->data   = data;
+    t->arg    = arg;
+    t->due    = w->tick + ticks;
+    t->period = (period + TIMER_TICK - 1)/TIMER_TICK;
+    if(period && !t->period)
+        t->period = 1;
+    place_timer(w, index);
+    w->active++;
+    return (unsigned)index + t->generation*(unsigned)w->capacity;
+}
+
+bool cancel_timer(A3DTimerWheel *w, const unsigned handle)
+{
+    const int index = (int)(handle % (unsigned)w->capacity);
+    A3DTimer *t = &w->timers[index];
+    if(!handle || t->slot < 0 ||
+       t->generation != handle/(unsigned)w->capacity)
+        return false;
+    unlink_timer(w, index);
+    t->generation++;
+    t->next      = w->free_list;
+    w->free_list = index;
+    w->active--;
+    return true;
+}
+
+void place_timer(A3DTimerWheel *w, const int index)
+{
+    A3DTimer *t = &w->timers[index];
+    const unsigned delta = t->due - w->tick;
+    int level = 0, slot;
+    /*the lowest level whose span holds the delay*/
+    while(level < TIMER_LEVELS - 1 &&
+          delta >= 1u << (TIMER_BITS*(level + 1)))
+        level++;
+    slot = level*TIMER_SLOTS +
+           (int)((t->due >> (TIMER_BITS*level)) & (TIMER_SLOTS - 1));
+    t->slot = slot;
+    t->prev = -1;
+    t->next = w->heads[slot];
+    if(t->next >= 0)
+        w->timers[t->next].prev = index;
+    w->heads[slot] = index;
+}
+
+void unlink_timer(A3DTimerWheel *w, const int index)
+{
+    A3DTimer *t = &w->timers[index];
+    if(t->prev >= 0)
+        w->timers[t->prev].next = t->next;
+    else
+        w->heads[t->slot] = t->next;
+    if(t->next >= 0)
+        w->timers[t->next].prev = t->prev;
+    t->slot = -1;
+}
+
+void advance_timers(A3DTimerWheel *w, const unsigned now)
+{
+    const unsigned target = (now - w->origin)/TIMER_TICK;
+    while(w->tick != target)
     {
-        memcpy(&tmp_uint, &model->vertex_data[i], sizeof(float));
-        nv_checksum = nv_checksum ^ tmp_uint;
+        int level, head;
+        w->tick++;
+        /*cascade the levels above whose slot came up*/
+        for(level = 1; level < TIMER_LEVELS; level++)
+        {
+            int slot;
+            if(w->tick & ((1u << (TIMER_BITS*level)) - 1))
+                break;
+            slot = level*TIMER_SLOTS +
+                   (int)((w->tick >> (TIMER_BITS*level)) & (TIMER_SLOTS - 1));
+            head = w->heads[slot];
+            w->heads[slot] = -1;
+            while(head >= 0)
+            {
+                const int next = w->timers[head].next;
+                place_timer(w, head);
+                head = next;
+            }
+        }
+        /*fire one at a time, callbacks may change the lists*/
+        while((head = w->heads[w->tick & (TIMER_SLOTS - 1)]) >= 0)
+        {
+            A3DTimer *t = &w->timers[head];
+            unlink_timer(w, head);
+            w->fired++;
+            if(t->period)
+            {
+                t->due = w->tick + t->period;
+                place_timer(w, head);
+            }
+            else
+            {
+                t->generation++;
+                t->next      = w->free_list;
+                w->free_list = head;
+                w->active--;
+            }
+            t->func(t->data, t->arg);
+        }
     }
-    sprintf(ixsum_, "%x", ix_checksum);
-    sprintf(nvsum_, "%x", nv_checksum);
-    if(strcmp(ixsum_,ixsum))
+}
+
+void free_timers(A3DTimerWheel *w)
+{
+    free(w->timers);
+    w->timers    = NULL;
+    w->free_list = -1;
+}
+
+void timer_set_flag(void *data, int arg)
+{
+    bool *flag = data;
+    (void)arg;
+    *flag = true;
+}
+
+bool init_world(A3DWorld *w, const int capacity, const int *sizes,
+                const int count)
+{
+    int i;
+    memset(w, 0, sizeof(A3DWorld));
+    w->entities = malloc((sizeof(A3DEntity) + sizeof(unsigned))*capacity);
+    if(!w->entities)
     {
-        fprintf(stderr, "Index checksum mismatch. Got %s instead of %s.\n",
-                ixsum_, ixsum);
-        free(file_path);
+        fprintf(stderr, "Failed to allocate entities\n");
         return false;
     }
-    if(strcmp(nvsum_,nvsum))
+    w->doomed   = (unsigned *)(w->entities + capacity);
+    w->capacity = capacity;
+    for(i = 0; i < capacity; i++)
     {
-        fprintf(stderr, "Vertex checksum mismatch. Got %s instead of %s.\n",
-                nvsum_, nvsum);
-        free(file_path);
-        return false;
+        w->entities[i].archetype  = -1;
+        w->entities[i].row        = i + 1 < capacity ? i + 1 : -1;
+        w->entities[i].generation = 1;
     }
-
-    printf("Loaded model %s - %d indices - %d vertices\n", file_prefix,
-            model->index_count, model->vertex_count);
-    free(file_path);
+    w->free_list = 0;
+    for(i = 0; i < count && i < ECS_COMPONENTS; i++)
+        w->sizes[i] = sizes[i];
+    w->component_count = i;
     return true;
 }
 
-bool load_models(A3DModel **model, const int count)
+int add_query(A3DWorld *w, const unsigned mask)
 {
+    A3DQuery *q;
     int i;
-    unsigned  tmp_icount = 0;
-    unsigned  tmp_vcount = 0;
-    unsigned  all_icount = 0;
-    unsigned  all_vcount = 0;
-    unsigned *all_idata;
-    float    *all_vdata;
+    if(w->query_count >= ECS_QUERIES)
+        return -1;
+    q = &w->queries[w->query_count];
+    q->mask  = mask;
+    q->count = 0;
+    for(i = 0; i < w->archetype_count; i++)
+        if((w->archetypes[i].mask & mask) == mask)
+            q->archetypes[q->count++] = i;
+    return w->query_count++;
+}
 
-    /*clear buffers of any previous call to load_models*/
-    static unsigned buffer[2];
-    if(buffer[0] || buffer[1])
-        glDeleteBuffersARB_ptr(2, buffer);
+int add_system(A3DWorld *w, const int query, A3DSystem_Func func,
+               void *data)
+{
+    A3DSystem *s;
+    if(w->system_count >= ECS_SYSTEMS || query < 0)
+        return -1;
+    s = &w->systems[w->system_count];
+    s->func  = func;
+    s->query = query;
+    s->data  = data;
+    return w->system_count++;
+}
 
-    /*load models from file*/
-    for(i = 0; i < count; i++)
+int find_archetype(A3DWorld *w, const unsigned mask)
+{
+    A3DArchetype *a;
+    int i;
+    for(i = 0; i < w->archetype_count; i++)
+        if(w->archetypes[i].mask == mask)
+            return i;
+    if(w->archetype_count >= ECS_ARCHETYPES)
+        return -1;
+    a = &w->archetypes[w->archetype_count];
+    memset(a, 0, sizeof(A3DArchetype));
+    a->mask = mask;
+    /*keep the cached queries complete*/
+    for(i = 0; i < w->query_count; i++)
     {
-        if(strcmp(model[i]->file_root, "none"))
+        A3DQuery *q = &w->queries[i];
+        if((mask & q->mask) == q->mask)
+            q->archetypes[q->count++] = w->archetype_count;
+    }
+    return w->archetype_count++;
+}
+
+int fix_archetype(A3DWorld *w, const unsigned mask)
+{
+    const int type = find_archetype(w, mask);
+    if(type >= 0)
+        w->archetypes[type].fixed = true;
+    return type;
+}
+
+unsigned create_entity(A3DWorld *w, const unsigned mask)
+{
+    const int index = w->free_list, type = find_archetype(w, mask);
+    A3DArchetype *a;
+    A3DEntity    *e;
+    int c;
+    if(index < 0 || type < 0 || w->archetypes[type].fixed)
+        return 0;
+    a = &w->archetypes[type];
+    /*grow the columns by doubling*/
+    if(a->count == a->capacity)
+    {
+        const int capacity = a->capacity ? a->capacity*2 : 16;
+        unsigned *entities = realloc(a->entities,
+                                     sizeof(unsigned)*capacity);
+        size_t    offsets[ECS_COMPONENTS], bytes = 0;
+        char     *block;
+        if(!entities)
+            return 0;
+        a->entities = entities;
+        for(c = 0; c < w->component_count; c++)
         {
-            if(!load_model_from_file(model[i]->file_root, model[i]))
-            {
-                fprintf(stderr, "Failed to load model from file\n");
-                return false;
-            }
+            if(!(mask & (1u << c)))
+                continue;
+            offsets[c] = bytes;
+            bytes     += (size_t)w->sizes[c]*capacity;
+            bytes      = (bytes + 127) & ~(size_t)63;
         }
-        else
-            printf("Embedded model #%d - %d indices - %d vertices\n", i,
-                    model[i]->index_count, model[i]->vertex_count);
-        /*get total number of elements*/
-        all_vcount += model[i]->vertex_count;
-        all_icount += model[i]->index_count;
-        /*get offsets*/
-        if(!i)
+        block = malloc(bytes);
+        if(!block)
+            return 0;
+        for(c = 0; c < w->component_count; c++)
         {
-            model[0]->vertex_offset = 0;
-            model[0]->index_offset  = 0;
-            continue;
+            if(!(mask & (1u << c)))
+                continue;
+            if(a->count)
+                memcpy(block + offsets[c], a->columns[c],
+                       (size_t)w->sizes[c]*a->count);
+            a->columns[c] = block + offsets[c];
         }
-        model[i]->vertex_offset =
-            model[i-1]->vertex_offset +
-            model[i-1]->vertex_count*sizeof(float);
-        model[i]->index_offset =
-            model[i-1]->index_offset +
-            model[i-1]->index_count*sizeof(unsigned);
+        free(a->block);
+        a->block    = block;
+        a->capacity = capacity;
     }
+    e = &w->entities[index];
+    w->free_list = e->row;
+    e->archetype = type;
+    e->row       = a->count;
+    a->entities[a->count++] = (unsigned)index +
+                              e->generation*(unsigned)w->capacity;
+    w->live++;
+    return a->entities[e->row];
+}
 
-    /*build combined arrays*/
-    all_vdata = malloc(sizeof(float) * all_vcount);
-    all_idata = malloc(sizeof(unsigned) * all_icount);
-    for(i = 0; i < count; i++)
+void destroy_entity(A3DWorld *w, const unsigned entity)
+{
+    const int index = (int)(entity % (unsigned)w->capacity);
+    A3DEntity    *e = &w->entities[index];
+    A3DArchetype *a;
+    int c, last;
+    if(!entity || e->archetype < 0 ||
+       e->generation != entity/(unsigned)w->capacity ||
+       w->archetypes[e->archetype].fixed)
+        return;
+    a    = &w->archetypes[e->archetype];
+    last = --a->count;
+    /*the last row fills the hole*/
+    if(e->row != last)
     {
-        memcpy(all_vdata + tmp_vcount,
-                model[i]->vertex_data,
-                model[i]->vertex_count * sizeof(float));
-        memcpy(all_idata + tmp_icount,
-                model[i]->index_data,
-                model[i]->index_count * sizeof(unsigned));
-        tmp_vcount += model[i]->vertex_count;
-        tmp_icount += model[i]->index_count;
-        /*free model data*/
-        if(!model[i]->const_data)
+        const unsigned moved = a->entities[last];
+        for(c = 0; c < w->component_count; c++)
         {
-            free(model[i]->vertex_data);
-            free(model[i]->index_data);
+            char *column = a->columns[c];
+            if(!column)
+                continue;
+            memcpy(column + (size_t)w->sizes[c]*e->row,
+                   column + (size_t)w->sizes[c]*last, (size_t)w->sizes[c]);
         }
+        a->entities[e->row] = moved;
+        w->entities[moved % (unsigned)w->capacity].row = e->row;
     }
-
-    /*copy index/vertex data to device memory*/
-    glGenBuffersARB_ptr(2, buffer);
-    glBindBufferARB_ptr(GL_ARRAY_BUFFER, buffer[0]);
-    glBufferDataARB_ptr(GL_ARRAY_BUFFER,
-                        sizeof(float) * all_vcount,
-                        all_vdata, GL_STATIC_DRAW);
-    glBindBufferARB_ptr(GL_ELEMENT_ARRAY_BUFFER, buffer[1]);
-    glBufferDataARB_ptr(GL_ELEMENT_ARRAY_BUFFER,
-                        sizeof(unsigned) * all_icount,
-                        all_idata, GL_STATIC_DRAW);
-    glInterleavedArrays(GL_N3F_V3F, 0, (void*)(intptr_t)(0));
-
-    /*free index/vertex data*/
-    free(all_idata);
-    free(all_vdata);
-
-    printf("Model data total: %lu bytes\n\n", sizeof(float) * all_vcount +
-                                              sizeof(unsigned) * all_icount);
-    return true;
+    e->archetype = -1;
+    e->generation++;
+    e->row       = w->free_list;
+    w->free_list = index;
+    w->live--;
 }
 
-void generate_boundbox(A3DModel *box, const int segments)
+void defer_destroy(A3DWorld *w, const unsigned entity)
 {
-    /*distance between segments*/
-    const float d = 2.f * ARENA_SIZE / (float)segments;
-    const int vcount = 24 * segments;
-    int i, count = 0;
+    if(w->doomed_count < w->capacity)
+        w->doomed[w->doomed_count++] = entity;
+}
 
-    box->vertex_count = 3 * vcount;
-    box->index_count  = vcount;
-    box->vertex_data  = malloc(box->vertex_count * sizeof(float));
-    box->index_data   = malloc(box->index_count  * sizeof(unsigned));
+void *entity_component(A3DWorld *w, const unsigned entity, const int comp)
+{
+    const A3DEntity *e = &w->entities[entity % (unsigned)w->capacity];
+    const A3DArchetype *a;
+    if(!entity || e->archetype < 0 ||
+       e->generation != entity/(unsigned)w->capacity)
+        return NULL;
+    a = &w->archetypes[e->archetype];
+    if(!a->columns[comp])
+        return NULL;
+    return (char *)a->columns[comp] + (size_t)w->sizes[comp]*e->row;
+}
 
-    /*forward side*/
-    for(i = 0; i < segments*6; i += 6)
+void run_systems(A3DWorld *w, const float dt)
+{
+    int s, i;
+    for(s = 0; s < w->system_count; s++)
     {
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
+        const A3DSystem *sys = &w->systems[s];
+        const A3DQuery  *q   = &w->queries[sys->query];
+        for(i = 0; i < q->count; i++)
+        {
+            A3DArchetype *a = &w->archetypes[q->archetypes[i]];
+            if(a->count)
+                sys->func(w, a, sys->data, dt);
+        }
     }
-    for(i = 0; i < segments*6; i += 6)
+    for(i = 0; i < w->doomed_count; i++)
+        destroy_entity(w, w->doomed[i]);
+    w->doomed_count = 0;
+}
+
+void free_world(A3DWorld *w)
+{
+    int i;
+    for(i = 0; i < w->archetype_count; i++)
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
+        free(w->archetypes[i].entities);
+        free(w->archetypes[i].block);
     }
-    /*right side*/
-    for(i = 0; i < segments*6; i += 6)
+    free(w->entities);
+    w->entities        = NULL;
+    w->archetype_count = 0;
+}
+
+void popup_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt)
+{
+    const A3DActor *player = data;
+    A3DPopup *popup = a->columns[COMP_POPUP];
+    float    (*ori)[4] = a->columns[COMP_ORI];
+    int i;
+    for(i = 0; i < a->count; i++)
     {
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        if(popup[i].age > 1.f)
+        {
+            defer_destroy(w, a->entities[i]);
+            continue;
+        }
+        popup[i].age += 0.02f*dt;
+        ori[i][0] = -player->quat_orientation.x;
+        ori[i][1] = -player->quat_orientation.y;
+        ori[i][2] = -player->quat_orientation.z;
+        ori[i][3] =  player->quat_orientation.w;
     }
-    for(i = 0; i < segments*6; i += 6)
+}
+
+void sight_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt)
+{
+    const A3DActor *player = data;
+    const A3DSight *sight = a->columns[COMP_SIGHT];
+    float (*pos)[3] = a->columns[COMP_POS],
+          (*ori)[4] = a->columns[COMP_ORI];
+    const float x = player->quat_orientation.z,
+                y = player->quat_orientation.w,
+                z = player->quat_orientation.x,
+                q = player->quat_orientation.y;
+    int i;
+    (void)w;
+    (void)dt;
+    for(i = 0; i < a->count; i++)
     {
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
+        pos[i][0] = -player->pos.x + sight[i].offset *
+            (-2.f*x*z - 2.f*y*q) - player->vel.x;
+        pos[i][1] = -player->pos.y + sight[i].offset *
+            (2.f*y*z - 2.f*x*q) - player->vel.y;
+        pos[i][2] = -player->pos.z + sight[i].offset *
+            (1.f - 2.f*x*x - 2.f*y*y) - player->vel.z;
+        ori[i][0] = -z;
+        ori[i][1] = -q;
+        ori[i][2] = -x;
+        ori[i][3] =  y;
     }
-    /*back side*/
-    for(i = 0; i < segments*6; i += 6)
-    {
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
+}
+
+void shot_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt)
+{
+    const A3DActor *player = data;
+    const A3DActor *shot   = a->columns[COMP_ACTOR];
+    int i;
+    (void)dt;
+    for(i = 0; i < a->count; i++)
+    {
+        const float dx = shot[i].pos.x + player->pos.x,
+                    dy = shot[i].pos.y + player->pos.y,
+                    dz = shot[i].pos.z + player->pos.z;
+        /*despawn shot if distance from player > 320*/
+        if(inv_sqrt_dwh(dx*dx + dy*dy + dz*dz) < 0.003125f)
+            defer_destroy(w, a->entities[i]);
     }
-    for(i = 0; i < segments*6; i += 6)
+}
+
+void blast_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt)
+{
+    A3DCamera *camera = data;
+    A3DActor  *blast  = a->columns[COMP_ACTOR];
+    A3DBlast  *grow   = a->columns[COMP_BLAST];
+    int i;
+    for(i = 0; i < a->count; i++)
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
+        if(blast[i].mass >= 2.5f)
+        {
+            defer_destroy(w, a->entities[i]);
+            continue;
+        }
+        blast[i].mass         += dt/grow[i].rate;
+        camera->fovmod        += 0.3f*dt/grow[i].rate;
+        camera->pos_offset[2] -= 2.f*dt/grow[i].rate;
+        grow[i].rate          += 0.5f*dt;
     }
-    /*left side*/
-    for(i = 0; i < segments*6; i += 6)
+}
+
+void move_system(A3DWorld *w, A3DArchetype *a, void *data, const float dt)
+{
+    float       *pos = a->columns[COMP_POS];
+    const float *vel = a->columns[*(const int *)data];
+    const int    n   = a->count*3;
+    int i;
+    (void)w;
+    /*one flat loop over the columns, which the compiler vectorizes*/
+    for(i = 0; i < n; i++)
+        pos[i] += vel[i]*dt;
+}
+
+int run_ecs_bench(void)
+{
+    /*component 2 is the velocity, COMP_ORI makes a second archetype*/
+    const int count = 100000, steps = 100;
+    const int sizes[3] = {sizeof(float)*3, sizeof(float)*4,
+                          sizeof(float)*3};
+    const unsigned moving = (1u << COMP_POS) | (1u << 2);
+    const Uint64 perf_freq = SDL_GetPerformanceFrequency();
+    const double freq = (double)perf_freq/1000.0;
+    A3DWorld  w;
+    A3DActor *actors;
+    float    *soa;
+    unsigned  seed = 0x9e3779b9u;
+    int       comp_vel = 2;
+    double    check = 0.0;
+    Uint64    t, ecs_t = 0, soa_t = 0, aos_t = 0;
+    int       i, j;
+    actors = malloc(sizeof(A3DActor)*count);
+    soa    = malloc(sizeof(float)*6*count);
+    if(!actors || !soa || !init_world(&w, count, sizes, 3))
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        fprintf(stderr, "Failed to allocate ECS benchmark\n");
+        free(actors);
+        free(soa);
+        return 1;
     }
-    for(i = 0; i < segments*6; i += 6)
+    add_system(&w, add_query(&w, moving), move_system, &comp_vel);
+    for(i = 0; i < count; i++)
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
+        const unsigned e = create_entity(&w, i & 1 ? moving :
+                                         moving | (1u << COMP_ORI));
+        float *p = entity_component(&w, e, COMP_POS),
+              *v = entity_component(&w, e, comp_vel);
+        for(j = 0; j < 3; j++)
+        {
+            p[j] = soa[j*count + i] = (float)(xorshift32(&seed)%1000);
+            v[j] = soa[(3 + j)*count + i] =
+                   (float)(xorshift32(&seed)%200)*0.005f - 0.5f;
+        }
+        actors[i].pos.x = p[0];
+        actors[i].pos.y = p[1];
+        actors[i].pos.z = p[2];
+        actors[i].vel.x = v[0];
+        actors[i].vel.y = v[1];
+        actors[i].vel.z = v[2];
     }
-    /*top side*/
-    for(i = 0; i < segments*6; i += 6)
+    /*each step is timed on its own, as a frame would run it, else
+     *the compiler jams the plain loops into two steps per pass*/
+    for(j = 0; j < steps; j++)
     {
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
+        t = SDL_GetPerformanceCounter();
+        run_systems(&w, 1.f);
+        ecs_t += SDL_GetPerformanceCounter() - t;
     }
-    for(i = 0; i < segments*6; i += 6)
+    for(j = 0; j < steps; j++)
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
+        t = SDL_GetPerformanceCounter();
+        for(i = 0; i < count; i++)
+        {
+            soa[i]           += soa[3*count + i];
+            soa[count + i]   += soa[4*count + i];
+            soa[2*count + i] += soa[5*count + i];
+        }
+        soa_t += SDL_GetPerformanceCounter() - t;
     }
-    /*bottom side*/
-    for(i = 0; i < segments*6; i += 6)
+    for(j = 0; j < steps; j++)
     {
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = (i/6)*d - ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE;
+        t = SDL_GetPerformanceCounter();
+        for(i = 0; i < count; i++)
+        {
+            actors[i].pos.x += actors[i].vel.x;
+            actors[i].pos.y += actors[i].vel.y;
+            actors[i].pos.z += actors[i].vel.z;
+        }
+        aos_t += SDL_GetPerformanceCounter() - t;
     }
-    for(i = 0; i < segments*6; i += 6)
+    /*the three must agree*/
+    for(i = 0; i < w.archetype_count; i++)
     {
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
-        box->vertex_data[count++] = ARENA_SIZE;
-        box->vertex_data[count++] = -ARENA_SIZE;
-        box->vertex_data[count++] = ARENA_SIZE - (i/6)*d;
+        const A3DArchetype *a = &w.archetypes[i];
+        const float (*p)[3] = a->columns[COMP_POS];
+        for(j = 0; j < a->count; j++)
+        {
+            const int k = (int)(a->entities[j] % (unsigned)count);
+            check += fabs(p[j][0] - soa[k]) + fabs(p[j][1] - actors[k].pos.y);
+        }
     }
-    /*indices*/
-    for(i = 0; i < box->index_count; i++)
-        box->index_data[i] = i;
-    printf("Bounding box:\n");
-    printf("      Index count: %d\n", box->index_count);
-    printf("      Vertex count: %d\n", box->vertex_count);
-    printf("      Segments: %d\n", segments);
-    printf("      Segment distance: %.2f\n\n", d);
+    printf("{\n");
+    printf("  \"entities\": %d,\n",        count);
+    printf("  \"archetypes\": %d,\n",      w.archetype_count);
+    printf("  \"steps\": %d,\n",           steps);
+    printf("  \"ecs_ns\": %.3f,\n",
+           (double)ecs_t/freq*1e6/((double)count*steps));
+    printf("  \"soa_ns\": %.3f,\n",
+           (double)soa_t/freq*1e6/((double)count*steps));
+    printf("  \"actor_ns\": %.3f,\n",
+           (double)aos_t/freq*1e6/((double)count*steps));
+    printf("  \"difference\": %.6f\n",     check/count);
+    printf("}\n");
+    free_world(&w);
+    free(actors);
+    free(soa);
+    return 0;
 }
 
-void generate_skybox(A3DModel *box, const float radius)
+A3DConfig default_config(void)
 {
-    int i,j;
-    box->vertex_count = 120; /*6 sides = 24 vertices = 120 floats*/
-    box->index_count  = 24;
-    box->vertex_data  = malloc(box->vertex_count * sizeof(float));
-    box->index_data   = malloc(box->index_count  * sizeof(unsigned));
+    A3DConfig c;
+    c.width         = 800;
+    c.height        = 600;
+    c.vsync         = -1;
+    c.asteroids     = INIT_ASTEROIDS;
+    c.segments      = 20;
+    c.skybox_radius = 100.f;
+    c.cull_mode     = CULL_CPU;
+    return c;
+}
 
-    /*texture coords*/
-    for(i = 0; i < box->vertex_count; i += 20)
-    {
-        box->vertex_data[i]    = 2.f;
-        box->vertex_data[i+1]  = 2.f;
-        box->vertex_data[i+5]  = 0.f;
-        box->vertex_data[i+6]  = 2.f;
-        box->vertex_data[i+10] = 0.f;
-        box->vertex_data[i+11] = 0.f;
-        box->vertex_data[i+15] = 2.f;
-        box->vertex_data[i+16] = 0.f;
-    }
-    /*verts*/
-    /*front and back*/
-    for(i = 0, j = 1; i < 40; i += 20, j *= -1)
+int set_config(A3DConfig *c, const char *key, const char *value)
+{
+    char      *end;
+    const long n     = strtol(value, &end, 10);
+    const bool whole = end != value && !*end;
+    int i;
+    for(i = 0; i < CONFIG_KEYS; i++)
+        if(!strcmp(key, config_keys[i]))
+            break;
+    switch(i)
     {
-        box->vertex_data[i+2]  = radius*j;
-        box->vertex_data[i+3]  = radius;
-        box->vertex_data[i+4]  = -radius*j;
-        box->vertex_data[i+7]  = -radius*j;
-        box->vertex_data[i+8]  = radius;
-        box->vertex_data[i+9]  = -radius*j;
-        box->vertex_data[i+12] = -radius*j;
-        box->vertex_data[i+13] = -radius;
-        box->vertex_data[i+14] = -radius*j;
-        box->vertex_data[i+17]  = radius*j;
-        box->vertex_data[i+18]  = -radius;
-        box->vertex_data[i+19]  = -radius*j;
+        case 0:
+        case 1:
+            if(!whole || n < 160 || n > 8192)
+            {
+                fprintf(stderr, "Invalid %s: %s\n", key, value);
+                return 0;
+            }
+            if(i) c->height = (int)n;
+            else  c->width  = (int)n;
+            return 1;
+        case 2:
+            if(!strcmp(value, "on") || !strcmp(value, "1"))
+                c->vsync = 1;
+            else if(!strcmp(value, "off") || !strcmp(value, "0"))
+                c->vsync = 0;
+            else
+            {
+                fprintf(stderr, "Invalid vsync: %s (on or off)\n", value);
+                return 0;
+            }
+            return 1;
+        case 3:
+            if(!whole || n < 1 || n > FIELD_ASTEROIDS)
+            {
+                fprintf(stderr, "Asteroid count must be 1 to %d\n",
+                        FIELD_ASTEROIDS);
+                return 0;
+            }
+            c->asteroids = (int)n;
+            return 1;
+        case 4:
+            if(!whole || n < 1 || n > 1000)
+            {
+                fprintf(stderr, "Boundbox segments must be 1 to 1000\n");
+                return 0;
+            }
+            c->segments = (int)n;
+            return 1;
+        case 5:
+        {
+            /*corners must stay inside the far clip plane*/
+            const double r = strtod(value, &end);
+            if(end == value || *end || !(r >= 1.0 && r <= 460.0))
+            {
+                fprintf(stderr, "Skybox radius must be 1 to 460\n");
+                return 0;
+            }
+            c->skybox_radius = (float)r;
+            return 1;
+        }
+        case 6:
+            for(i = 0; i < 3; i++)
+            {
+                if(strcmp(value, cull_names[i]))
+                    continue;
+                c->cull_mode = i;
+                return 1;
+            }
+            fprintf(stderr, "Invalid cull mode: %s (none, query or cpu)\n",
+                    value);
+            return 0;
     }
-    /*right and left*/
-    for(i = 40, j = 1; i < 80; i += 20, j *= -1)
+    return -1;
+}
+
+bool load_config(A3DConfig *c, const char *file)
+{
+    FILE *f = fopen(file, "r");
+    char  line[256], key[32], value[32];
+    int   line_no = 0;
+    if(!f)
     {
-        box->vertex_data[i+2]  = radius*j;
-        box->vertex_data[i+3]  = radius;
-        box->vertex_data[i+4]  = radius*j;
-        box->vertex_data[i+7]  = radius*j;
-        box->vertex_data[i+8]  = radius;
-        box->vertex_data[i+9]  = -radius*j;
-        box->vertex_data[i+12] = radius*j;
-        box->vertex_data[i+13] = -radius;
-        box->vertex_data[i+14] = -radius*j;
-        box->vertex_data[i+17]  = radius*j;
-        box->vertex_data[i+18]  = -radius;
-        box->vertex_data[i+19]  = radius*j;
+        fprintf(stderr, "Could not open %s\n", file);
+        return false;
     }
-    /*bottom and top*/
-    for(i = 80, j = 1; i < 120; i += 20, j *= -1)
+    while(fgets(line, sizeof(line), f))
     {
-        box->vertex_data[i+2]  = -radius;
-        box->vertex_data[i+3]  = -radius*j;
-        box->vertex_data[i+4]  = radius*j;
-        box->vertex_data[i+7]  = radius;
-        box->vertex_data[i+8]  = -radius*j;
-        box->vertex_data[i+9]  = radius*j;
-        box->vertex_data[i+12] = radius;
-        box->vertex_data[i+13] = -radius*j;
-        box->vertex_data[i+14] = -radius*j;
-        box->vertex_data[i+17]  = -radius;
-        box->vertex_data[i+18]  = -radius*j;
-        box->vertex_data[i+19]  = -radius*j;
+        line_no++;
+        if(sscanf(line, "%31s %31s", key, value) < 1 || key[0] == '#')
+            continue;
+        if(sscanf(line, "%31s %31s", key, value) != 2 ||
+           set_config(c, key, value) != 1)
+        {
+            fprintf(stderr, "%s:%d: bad setting\n", file, line_no);
+            fclose(f);
+            return false;
+        }
     }
-    /*indices*/
-    for(i = 0; i < box->index_count; i++)
-        box->index_data[i] = i;
-    printf("Skybox:\n");
-    printf("      Index count: %d\n", box->index_count);
-    printf("      Vertex count: %d\n", box->vertex_count);
-    printf("      Radius: %.2f\n\n", radius);
+    fclose(f);
+    return true;
 }
 
-void draw_model(const A3DModel model)
+bool load_sweep(A3DSweep *s, const char *file)
 {
-    glInterleavedArrays(model.format, 0, (void*)(intptr_t)model.vertex_offset);
-    glDrawElements(model.mode, model.index_count, GL_UNSIGNED_INT,
-            (void*)(intptr_t)model.index_offset);
+    A3DConfig test = default_config();
+    FILE *f = fopen(file, "r");
+    char  line[512], key[32], *p;
+    int   line_no = 0, len, k, v;
+    memset(s, 0, sizeof(A3DSweep));
+    if(!f)
+    {
+        fprintf(stderr, "Could not open %s\n", file);
+        return false;
+    }
+    s->runs = 1;
+    while(fgets(line, sizeof(line), f))
+    {
+        line_no++;
+        if(sscanf(line, "%31s%n", key, &len) < 1 || key[0] == '#')
+            continue;
+        for(k = 0; k < CONFIG_KEYS; k++)
+            if(!strcmp(key, config_keys[k]))
+                break;
+        if(k == CONFIG_KEYS || s->value_count[k])
+        {
+            fprintf(stderr, "%s:%d: unknown or repeated setting %s\n",
+                    file, line_no, key);
+            fclose(f);
+            return false;
+        }
+        s->keys[s->key_count++] = k;
+        /*each value is checked now rather than in the child*/
+        for(p = line + len, v = 0; v < SWEEP_VALUES &&
+            sscanf(p, "%15s%n", s->values[k][v], &len) == 1; p += len, v++)
+        {
+            if(set_config(&test, key, s->values[k][v]) != 1)
+            {
+                fprintf(stderr, "%s:%d: bad value\n", file, line_no);
+                fclose(f);
+                return false;
+            }
+        }
+        if(!v)
+        {
+            fprintf(stderr, "%s:%d: no values for %s\n", file, line_no, key);
+            fclose(f);
+            return false;
+        }
+        s->value_count[k] = v;
+        s->runs          *= (unsigned)v;
+    }
+    fclose(f);
+    if(!s->key_count)
+    {
+        fprintf(stderr, "%s: nothing to sweep\n", file);
+        return false;
+    }
+    return true;
 }
 
-void draw_skybox(const A3DModel box, const float x,
-                 const float y, const float z)
+bool run_sweep(const char *file, const int frames,
+               const int argc, char *argv[])
 {
-    glPushAttrib(GL_ENABLE_BIT|GL_DEPTH_BUFFER_BIT);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_FOG);
-    glEnable(GL_TEXTURE_2D);
-    glDepthMask(GL_FALSE);
-    glPushMatrix();
-        glTranslatef(x, y, z);
-        draw_model(box);
-    glPopMatrix();
-    glPopAttrib();
+    const char *fields[4] = {"\"ms_per_frame\":", "\"cpu_ms\":",
+                             "\"gpu_ms\":", "\"draw_calls\":"};
+    A3DSweep  s;
+    char     *command, *out, *base, json[4096];
+    int       pick[CONFIG_KEYS] = {0, 0, 0, 0, 0, 0, 0};
+    unsigned  run;
+    size_t    length = 0;
+    int       i, k;
+    if(!load_sweep(&s, file))
+        return false;
+    for(i = 1; i < argc; i++)
+        length += 4*strlen(argv[i]) + 3;
+    /*the child writes its JSON next to the sweep file*/
+    command = malloc(4*strlen(argv[0]) + 8*strlen(file) + length + 1024);
+    out     = malloc(strlen(file) + 8);
+    if(!command || !out)
+    {
+        fprintf(stderr, "Failed to allocate sweep\n");
+        free(command);
+        free(out);
+        return false;
+    }
+    strcpy(out, file);
+    strcat(out, ".json");
+    /*the base command line, all but what the sweep sets*/
+    command[0] = '\0';
+    append_arg(command, argv[0]);
+    for(i = 1; i < argc; i++)
+    {
+        if((!strcmp(argv[i], "--sweep") || !strcmp(argv[i], "--bench")) &&
+           i + 1 < argc)
+            i++;
+        else
+            append_arg(command, argv[i]);
+    }
+    sprintf(command + strlen(command), " --bench %d", frames);
+    base = command + strlen(command);
+    fprintf(stderr, "Sweeping %u combinations of %d frames\n", s.runs, frames);
+    for(i = 0; i < s.key_count; i++)
+        printf("%-10s", config_keys[s.keys[i]]);
+    printf("%10s%10s%10s%10s%10s\n", "ms", "fps", "cpu_ms", "gpu_ms", "draws");
+    for(run = 0; run < s.runs; run++)
+    {
+        FILE  *f;
+        double result[4] = {-1.0, -1.0, -1.0, -1.0};
+        size_t bytes = 0;
+        *base = '\0';
+        for(i = 0; i < s.key_count; i++)
+        {
+            k = s.keys[i];
+            sprintf(base + strlen(base), " --%s", config_keys[k]);
+            append_arg(base, s.values[k][pick[k]]);
+        }
+        strcat(base, " >");
+        append_arg(base, out);
+        if(!system(command) && (f = fopen(out, "r")))
+        {
+            bytes = fread(json, 1, sizeof(json) - 1, f);
+            fclose(f);
+        }
+        json[bytes] = '\0';
+        for(i = 0; i < 4; i++)
+        {
+            const char *at = strstr(json, fields[i]);
+            if(at)
+                sscanf(at + strlen(fields[i]), "%lf", &result[i]);
+        }
+        for(i = 0; i < s.key_count; i++)
+            printf("%-10s", s.values[s.keys[i]][pick[s.keys[i]]]);
+        if(result[0] > 0.0)
+            printf("%10.3f%10.1f%10.3f%10.3f%10.1f\n", result[0],
+                   1000.0/result[0], result[1], result[2], result[3]);
+        else
+            printf("%10s\n", "failed");
+        fflush(stdout);
+        /*next combination, last key fastest*/
+        for(i = s.key_count - 1; i >= 0; i--)
+        {
+            k = s.keys[i];
+            if(++pick[k] < s.value_count[k])
+                break;
+            pick[k] = 0;
+        }
+    }
+    remove(out);
+    free(command);
+    free(out);
+    return true;
 }
 
-void draw_text(const char *text, const float width, const bool charwidth)
+void append_arg(char *command, const char *arg)
 {
-    unsigned len, i;
-    float xo, yo, cw;
-    if(!text) return;
-    len = strlen(text);
-    if(charwidth) cw = width;
-    else          cw = width/(float)len;
-
-    glPushAttrib(GL_ENABLE_BIT);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_FOG);
-    glEnable(GL_BLEND);
-    glEnable(GL_TEXTURE_2D);
-    glBegin(GL_QUADS);
-    for(i = 0; i < len; i++)
+    char *p = command + strlen(command);
+    #ifdef _WIN32
+    /*double quotes, with inner ones escaped for the C runtime*/
+    *p++ = ' ';
+    *p++ = '"';
+    for(; *arg; arg++)
     {
-        xo = BITFONT_XOFFSET(text[i]);
-        yo = BITFONT_YOFFSET(text[i]);
-        glTexCoord2f(xo + BITFONT_WIDTH, yo + BITFONT_HEIGHT);
-        glVertex2f(cw*i + cw*0.5f, cw);
-        glTexCoord2f(xo, yo + BITFONT_HEIGHT);
-        glVertex2f(cw*i - cw*0.5f, cw);
-        glTexCoord2f(xo, yo);
-        glVertex2f(cw*i - cw*0.5f, -cw);
-        glTexCoord2f(xo + BITFONT_WIDTH, yo);
-        glVertex2f(cw*i + cw*0.5f, -cw);
+        if(*arg == '"')
+            *p++ = '\\';
+        *p++ = *arg;
     }
-    glEnd();
-    glPopAttrib();
+    *p++ = '"';
+    #else
+    /*single quotes, nothing inside them is special but the quote*/
+    *p++ = ' ';
+    *p++ = '\'';
+    for(; *arg; arg++)
+    {
+        if(*arg == '\'')
+        {
+            strcpy(p, "'\\''");
+            p += 4;
+        }
+        else
+            *p++ = *arg;
+    }
+    *p++ = '\'';
+    #endif
+    *p = '\0';
 }
-